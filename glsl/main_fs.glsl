@@ -3,9 +3,15 @@
 out vec4 FragColor;
 
 // Types
+// TEXTURE_ARRAYS: maps are layers of texture array pools
 struct Material {
+#ifdef TEXTURE_ARRAYS
+    sampler2DArray diffuse;
+    sampler2DArray specular;
+#else
     sampler2D diffuse;
     sampler2D specular;
+#endif
     float shininess;
 };
 
@@ -49,6 +55,9 @@ struct SpotLight {
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+#ifdef TEXTURE_ARRAYS
+flat in ivec2 Layers;  // diffuse, specular
+#endif
 
 uniform vec3 viewPos;
 uniform PointLight pointLights[NR_POINT_LIGHTS];
@@ -60,6 +69,8 @@ uniform Material material;
 vec3 calc_dir_light(DirLight light, vec3 normal, vec3 viewDir);
 vec3 calc_point_light(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 diffuse_color();
+vec3 specular_color();
 
 void main() {
     vec3 norm = normalize(Normal);
@@ -84,9 +95,9 @@ vec3 calc_dir_light(DirLight light, vec3 normal, vec3 viewDir) {
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
     // Results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuse_color();
+    vec3 diffuse = light.diffuse * diff * diffuse_color();
+    vec3 specular = light.specular * spec * specular_color();
 
     return (ambient + diffuse + specular);
 }
@@ -107,9 +118,9 @@ vec3 calc_point_light(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
                     distance + light.quadratic * (distance * distance));
 
     // Results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuse_color();
+    vec3 diffuse = light.diffuse * diff * diffuse_color();
+    vec3 specular = light.specular * spec * specular_color();
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -139,9 +150,9 @@ vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
     // Results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
+    vec3 ambient = light.ambient * diffuse_color();
+    vec3 diffuse = light.diffuse * diff * diffuse_color();
+    vec3 specular = light.specular * spec * specular_color();
 
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
@@ -149,3 +160,19 @@ vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
 
     return (ambient + diffuse + specular);
 }
+
+vec3 diffuse_color() {
+#ifdef TEXTURE_ARRAYS
+    return texture(material.diffuse, vec3(TexCoords, Layers.x)).rgb;
+#else
+    return texture(material.diffuse, TexCoords).rgb;
+#endif
+}
+
+vec3 specular_color() {
+#ifdef TEXTURE_ARRAYS
+    return texture(material.specular, vec3(TexCoords, Layers.y)).rgb;
+#else
+    return texture(material.specular, TexCoords).rgb;
+#endif
+}
@@ -4,6 +4,10 @@
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
+#ifdef TEXTURE_ARRAYS
+// Constant per draw, see MESH_LAYERS_ATTRIB
+layout(location = 7) in ivec2 aLayers;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
@@ -12,11 +16,17 @@ uniform mat4 projection;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+#ifdef TEXTURE_ARRAYS
+flat out ivec2 Layers;
+#endif
 
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
     TexCoords = aTexCoords;
+#ifdef TEXTURE_ARRAYS
+    Layers = aLayers;
+#endif
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
@@ -0,0 +1,7 @@
+#version 330 core
+out vec4 FragColor;
+
+// Only the depth test matters, colour writes are masked off
+void main() {
+  FragColor = vec4(1.0);
+}
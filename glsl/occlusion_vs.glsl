@@ -0,0 +1,11 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+
+// World space box, the unit cube is stretched over it
+uniform vec3 boxMin;
+uniform vec3 boxSize;
+uniform mat4 viewProjection;
+
+void main() {
+  gl_Position = viewProjection * vec4(boxMin + aPos * boxSize, 1.0);
+}
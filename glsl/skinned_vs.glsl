@@ -0,0 +1,51 @@
+#version 330 core
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+layout(location = 5) in ivec4 aBoneIDs;
+layout(location = 6) in vec4 aWeights;
+#ifdef TEXTURE_ARRAYS
+// Constant per draw, see MESH_LAYERS_ATTRIB
+layout(location = 7) in ivec2 aLayers;
+#endif
+
+// Must match MAX_BONES in animation.h
+const int MAX_BONES = 128;
+
+layout(std140) uniform Bones {
+    mat4 bones[MAX_BONES];
+};
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+#ifdef TEXTURE_ARRAYS
+flat out ivec2 Layers;
+#endif
+
+void main() {
+    // Vertices without influences (rigid meshes) keep their bind pose
+    mat4 skin = mat4(1.0);
+    if (dot(aWeights, vec4(1.0)) > 0.0) {
+        skin = aWeights.x * bones[aBoneIDs.x] +
+               aWeights.y * bones[aBoneIDs.y] +
+               aWeights.z * bones[aBoneIDs.z] +
+               aWeights.w * bones[aBoneIDs.w];
+    }
+
+    mat4 skinnedModel = model * skin;
+    FragPos = vec3(skinnedModel * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(skinnedModel))) * aNormal;
+    TexCoords = aTexCoords;
+#ifdef TEXTURE_ARRAYS
+    Layers = aLayers;
+#endif
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+#extension GL_ARB_separate_shader_objects : enable
+out vec4 FragColor;
+
+in vec3 TexCoords;
+
+uniform samplerCube skybox;
+
+void main() {
+    FragColor = texture(skybox, TexCoords);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 aPos;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 TexCoords;
+
+void main() {
+    TexCoords = aPos;
+
+    // z = w lands every fragment on the far plane, depth 1.0
+    vec4 pos = projection * view * vec4(aPos, 1.0);
+    gl_Position = pos.xyww;
+}
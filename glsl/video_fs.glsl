@@ -0,0 +1,32 @@
+#version 330 core
+#extension GL_ARB_separate_shader_objects : enable
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// 4:2:0 planes, chroma at half resolution
+uniform sampler2D planeY;
+uniform sampler2D planeU;
+uniform sampler2D planeV;
+uniform bool fullRange;
+
+void main() {
+    float y = texture(planeY, TexCoords).r;
+    float u = texture(planeU, TexCoords).r - 0.5;
+    float v = texture(planeV, TexCoords).r - 0.5;
+
+    // Studio range: luma 16-235, chroma 16-240
+    if (!fullRange) {
+        y = (y - 16.0 / 255.0) * (255.0 / 219.0);
+        u *= 255.0 / 224.0;
+        v *= 255.0 / 224.0;
+    }
+
+    // BT.709
+    vec3 rgb = vec3(y + 1.5748 * v,
+                    y - 0.1873 * u - 0.4681 * v,
+                    y + 1.8556 * u);
+
+    // Gamma-encoded like sRGB, the framebuffer encodes it again on write
+    FragColor = vec4(pow(clamp(rgb, 0.0, 1.0), vec3(2.2)), 1.0);
+}
@@ -4,36 +4,87 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb/stb_image.h"
-
 #define GLFW_DLL
 #include <GLFW/glfw3.h>
 #define GL_LOG_FILE "gl.log"
 
 #include "cglm/struct/affine-pre.h"
 #include "cglm/struct/affine.h"
+#include "cglm/struct/box.h"
 #include "cglm/struct/cam.h"
 #include "cglm/struct/mat4.h"
+#include "cglm/struct/quat.h"
+#include "cglm/struct/vec3.h"
 #include "cglm/types-struct.h"
 
+#include "animation.h"
+#include "bench.h"
+#include "bvh.h"
 #include "camera.h"
+#include "cull.h"
+#include "glstate.h"
+#include "job.h"
+#include "model.h"
+#include "occlusion.h"
+#include "pacing.h"
+#include "raster.h"
+#include "render.h"
+#include "replay.h"
+#include "scene.h"
 #include "shader.h"
+#include "skybox.h"
+#include "stats.h"
+#include "texpool.h"
+#include "texture.h"
+#include "video.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void process_input(GLFWwindow* window);
-GLuint generate_texture(const char* filename);
+void set_light_uniforms(Shader* shader, const vec3s* pointLightPositions);
+void bind_cube_textures(const void* material, Shader* shader);
+void enqueue_cubes(void* data, uint32_t begin, uint32_t end);
+
+// Textures every cube draws with, pool slots when --texture-arrays
+typedef struct {
+  TextureHandle diffuse;
+  TextureHandle specular;
+  TexturePoolSlot diffuseSlot;
+  TexturePoolSlot specularSlot;
+  bool pooled;
+} CubeMaterial;
+
+// Visible cubes and lamps per enqueue_cubes job
+#define CUBE_ENQUEUE_OBJECTS 256
+
+// The visible set enqueue_cubes turns into packets, one buffer per slice.
+// The first 10 scene objects are the textured cubes, the rest lamps.
+typedef struct {
+  RenderQueue* queue;
+  RenderBuffer* buffers;
+  const uint32_t* visible;
+  const int32_t* nodes;
+  const mat4s* world;
+  Shader* cubeShader;
+  Shader* lightShader;
+  GLuint cubeVAO;
+  GLuint lightVAO;
+  const CubeMaterial* material;
+} CubeBatch;
 
 const GLuint SCR_WIDTH = 800;
 const GLuint SCR_HEIGHT = 600;
+// Current framebuffer height in pixels, tracks resizes and HiDPI scaling
+int framebufferHeight = SCR_HEIGHT;
 
 // Camera
 Camera camera;
 float lastX = (float)SCR_WIDTH / 2;
 float lastY = (float)SCR_HEIGHT / 2;
 bool firstMouse = true;
+// Camera path being recorded or played back, --record / --replay
+Replay replay;
 
 // Timing
 float deltaTime = 0.0f;
@@ -42,11 +93,64 @@ float lastFrame = 0.0f;
 // Light
 vec3s lightPos = {{1.2f, 1.0f, 2.0f}};
 
-int main(void) {
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return bench_run(argc - 2, argv + 2);
+  }
+
+  // [--stats] [--texture-arrays] [--texture-budget MiB] [--sky-first]
+  // [--occlusion] [--record path | --replay path] [--frames-in-flight N]
+  // [--fps N] [model]
+  bool showStats = false;
+  bool skyFirst = false;
+  bool occlusionCulling = false;
+  bool textureArrays = false;
+  size_t textureBudget = 0;
+  const char* modelPath = NULL;
+  uint32_t framesInFlight = 0;
+  double targetFps = 0.0;
+  const char* recordPath = NULL;
+  const char* replayPath = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      showStats = true;
+    } else if (strcmp(argv[i], "--texture-arrays") == 0) {
+      textureArrays = true;
+    } else if (strcmp(argv[i], "--sky-first") == 0) {
+      skyFirst = true;
+    } else if (strcmp(argv[i], "--occlusion") == 0) {
+      occlusionCulling = true;
+    } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+      framesInFlight = (uint32_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      targetFps = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+      textureBudget = (size_t)(atof(argv[++i]) * 1024.0 * 1024.0);
+    } else {
+      modelPath = argv[i];
+    }
+  }
+
+  if (replayPath != NULL && !replay_load(&replay, replayPath)) {
+    fprintf(stderr, "ERROR: Can't read camera path %s\n", replayPath);
+    return EXIT_FAILURE;
+  }
+  if (recordPath != NULL && replayPath == NULL &&
+      !replay_record(&replay, recordPath)) {
+    fprintf(stderr, "ERROR: Can't create camera path %s\n", recordPath);
+    return EXIT_FAILURE;
+  }
+  bool replaying = replay.frames != NULL;
+
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
   GLFWwindow* window =
       glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Learn OpenGL", NULL, NULL);
@@ -59,6 +163,7 @@ int main(void) {
 
   glfwMakeContextCurrent(window);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+  glfwGetFramebufferSize(window, NULL, &framebufferHeight);
 
   glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
   glfwSetCursorPosCallback(window, mouse_callback);
@@ -66,13 +171,27 @@ int main(void) {
 
   glewExperimental = GL_TRUE;
   glewInit();
+  // Every bind and state change goes through the cache from here on
+  glstate_reset();
 
   // Enables \ Disables
-  glEnable(GL_DEPTH_TEST);
+  glstate_set_enabled(GL_DEPTH_TEST, true);
+  // Lighting happens in linear space: sRGB textures are decoded on sampling
+  // and the result encoded again on write
+  glstate_set_enabled(GL_FRAMEBUFFER_SRGB, true);
+
+  // Image files decode on the workers while the rest of startup proceeds
+  JobPool* pool = job_pool_create(0);
+  double loadStart = glfwGetTime();
+  texture_manager_init(pool);
+  texture_set_budget(textureBudget);
+  texpool_init();
 
   // Shader
-  Shader cubeShader =
-      shader_create("./glsl/main_vs.glsl", "./glsl/main_fs.glsl");
+  const char* materialDefines =
+      textureArrays ? "#define TEXTURE_ARRAYS" : NULL;
+  Shader cubeShader = shader_create_with_defines(
+      "./glsl/main_vs.glsl", "./glsl/main_fs.glsl", materialDefines);
   Shader lightShader =
       shader_create("./glsl/light_vs.glsl", "./glsl/light_fs.glsl");
 
@@ -127,15 +246,82 @@ int main(void) {
       (vec3s){{0.7f, 0.2f, 2.0f}}, (vec3s){{2.3f, -3.3f, -4.0f}},
       (vec3s){{-4.0f, 2.0f, -12.0f}}, (vec3s){{0.0f, 0.0f, -3.0f}}};
 
+  // Scene
+  Scene scene = scene_create(16);
+
+  int32_t cubeNodes[10];
+  for (unsigned int i = 0; i < 10; i++) {
+    float angle = 20.0f * i;
+    cubeNodes[i] = scene_add_node(
+        &scene, SCENE_NO_PARENT, cubePositions[i],
+        glms_quatv(glm_rad(angle), (vec3s){{1.0f, 0.3f, 0.5f}}),
+        glms_vec3_one());
+  }
+
+  int32_t lampNodes[4];
+  for (unsigned int i = 0; i < 4; i++) {
+    lampNodes[i] =
+        scene_add_node(&scene, SCENE_NO_PARENT, pointLightPositions[i],
+                       glms_quat_identity(), glms_vec3_fill(0.2f));
+  }
+
+  // Optional model passed on the command line
+  bool hasModel = modelPath != NULL;
+  Model loadedModel = {0};
+  if (hasModel) {
+    ModelLoadFlags flags = MODEL_LOAD_BATCH_STATIC;
+    if (textureArrays) flags |= MODEL_LOAD_TEXTURE_ARRAYS;
+    loadedModel = model_create_with_flags(modelPath, flags);
+  }
+
+  // Skinned models play their first clip on the GPU skinning path
+  bool hasSkin = hasModel && loadedModel.skeleton.numBones > 0;
+
+  // One query per static mesh of the model, --occlusion. The cubes are culled
+  // on the CPU instead, see the raster below.
+  bool hasOcclusion = hasModel && !hasSkin && occlusionCulling;
+  Occlusion occlusion = {0};
+  if (hasOcclusion) occlusion = occlusion_create(loadedModel.numMeshes);
+  Shader skinnedShader = {0};
+  Animator animator = {0};
+  CompressedClip compressedClip = {0};
+  GLuint paletteUBO = 0;
+  if (hasSkin) {
+    skinnedShader = shader_create_with_defines(
+        "./glsl/skinned_vs.glsl", "./glsl/main_fs.glsl", materialDefines);
+    shader_set_block_binding(&skinnedShader, "Bones", BONES_UBO_BINDING);
+    shader_use(&skinnedShader);
+    shader_set_int(&skinnedShader, "material.diffuse", 0);
+    shader_set_int(&skinnedShader, "material.specular", 1);
+
+    scene_update(&loadedModel.scene);
+    if (loadedModel.numClips > 0) {
+      const AnimationClip* clip = &loadedModel.clips[0];
+      compressedClip = clip_compress(
+          clip, (ClipTolerance){.positionError = 0.0005f,
+                                .rotationError = 0.001f,
+                                .scaleError = 0.0005f});
+      printf("clip %s: %zu -> %zu bytes\n", clip->name,
+             clip_uncompressed_memory_size(clip),
+             clip_memory_size(&compressedClip));
+      animator = animator_create_compressed(
+          &loadedModel.scene, &loadedModel.skeleton, &compressedClip);
+    } else {
+      animator = animator_create(&loadedModel.scene, &loadedModel.skeleton,
+                                 NULL);
+    }
+    paletteUBO = animation_create_palette_buffer();
+  }
+
   // Vertex Buffer
   GLuint VBO, VAO;
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glstate_bind_buffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindVertexArray(VAO);
+  glstate_bind_vertex_array(VAO);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, false, 8 * sizeof(float), NULL);
   glEnableVertexAttribArray(0);
@@ -150,137 +336,316 @@ int main(void) {
 
   GLuint lightVAO;
   glGenVertexArrays(1, &lightVAO);
-  glBindVertexArray(lightVAO);
+  glstate_bind_vertex_array(lightVAO);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glstate_bind_buffer(GL_ARRAY_BUFFER, VBO);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, false, 8 * sizeof(float), NULL);
   glEnableVertexAttribArray(0);
 
   camera = create_camerav((vec3s){{0.0f, 0.0f, 3.0f}});
+  camera_set_perspective(&camera, (float)SCR_WIDTH / (float)SCR_HEIGHT, ZNEAR,
+                         ZFAR);
+
+  // Sky, drawn last unless --sky-first asks for the fill-rate comparison
+  const char* skyFaces[SKYBOX_FACES] = {
+      "./textures/posx.jpg", "./textures/negx.jpg", "./textures/posy.jpg",
+      "./textures/negy.jpg", "./textures/posz.jpg", "./textures/negz.jpg",
+  };
+  Skybox skybox;
+  bool hasSky = skybox_create(&skybox, skyFaces, pool);
+  if (hasSky) {
+    printf("skybox %dx%d, drawn %s\n", skybox.size, skybox.size,
+           skyFirst ? "first" : "last");
+  }
 
-  GLuint diffuseMap = generate_texture("./textures/container2.png");
-  GLuint specularMap = generate_texture("./textures/container2_specular.png");
+  // Decodes on its own thread while the textures load. Replays leave it out:
+  // which frame is up depends on how far the decoder got.
+  Video* video = replaying ? NULL : video_open("./textures/Jol-G.mp4");
+
+  TextureHandle diffuseMap =
+      texture_load("./textures/container2.png", TEXTURE_SRGB);
+  TextureHandle specularMap =
+      texture_load("./textures/container2_specular.png", 0);
+  texture_finish();
+
+  // The cubes share the model's pools when their textures fit them
+  TexturePoolSlot diffuseSlot = {0};
+  TexturePoolSlot specularSlot = {0};
+  if (textureArrays) {
+    diffuseSlot = texpool_add(diffuseMap);
+    specularSlot = texpool_add(specularMap);
+    texture_release(diffuseMap);
+    texture_release(specularMap);
+    diffuseMap = specularMap = TEXTURE_FALLBACK;
+  }
+
+  printf("textures resident after %.1f ms on %u workers\n",
+         (glfwGetTime() - loadStart) * 1000.0, pool->numThreads);
+  texture_print_stats(stdout);
+  if (textureArrays) texpool_print_stats(stdout);
+
+  stats_init(showStats ? 2.0 : 0.0);
+  stats_add_report(texture_print_frame_stats);
+  if (hasSky) stats_add_report(skybox_print_frame_stats);
+  if (video != NULL) stats_add_report(video_print_frame_stats);
+  stats_add_report(cull_print_frame_stats);
+  stats_add_report(render_queue_print_frame_stats);
+  stats_add_report(glstate_print_frame_stats);
+  if (hasOcclusion) stats_add_report(occlusion_print_frame_stats);
+  if (occlusionCulling) stats_add_report(raster_print_frame_stats);
 
   shader_use(&cubeShader);
   shader_set_int(&cubeShader, "material.diffuse", 0);
   shader_set_int(&cubeShader, "material.specular", 1);
 
+  // Cubes, lamps and the model are drawn sorted by state and depth, except
+  // for a model drawn with occlusion queries
+  RenderQueue renderQueue = render_queue_create();
+  CubeMaterial cubeMaterial = {
+      .diffuse = diffuseMap,
+      .specular = specularMap,
+      .diffuseSlot = diffuseSlot,
+      .specularSlot = specularSlot,
+      .pooled = textureArrays,
+  };
+
+  // Cubes then lamps in one tree, both unit cubes placed by their nodes
+  vec3s cubeBox[2] = {{{-0.5f, -0.5f, -0.5f}}, {{0.5f, 0.5f, 0.5f}}};
+  int32_t sceneNodes[14];
+  int32_t sceneLeaves[14];
+  uint32_t visible[14];
+  Bvh sceneBvh = bvh_create(32, 0.1f);
+
+  // With --occlusion the cubes also hide what is behind them, drawn on the
+  // CPU as closed boxes
+  const float cubeCorners[] = {
+      -0.5f, -0.5f, -0.5f, 0.5f,  -0.5f, -0.5f, 0.5f,  0.5f,  -0.5f, -0.5f,
+      0.5f,  -0.5f, -0.5f, -0.5f, 0.5f,  0.5f,  -0.5f, 0.5f,  0.5f,  0.5f,
+      0.5f,  -0.5f, 0.5f,  0.5f,
+  };
+  const uint32_t cubeTriangles[] = {
+      0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+      3, 7, 6, 3, 6, 2, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+  };
+  Raster raster = {0};
+  if (occlusionCulling) raster = raster_create();
+  CullFrustum frustum;
+  uint32_t frustumVersion = camera.Version - 1;
+  scene_update(&scene);
+  for (unsigned int i = 0; i < 14; i++) {
+    sceneNodes[i] = i < 10 ? cubeNodes[i] : lampNodes[i - 10];
+    vec3s box[2];
+    glms_aabb_transform(cubeBox, scene.world[sceneNodes[i]], box);
+    sceneLeaves[i] = bvh_insert(&sceneBvh, box, i);
+  }
+
+  // Replays time the frames drawn, unthrottled by vsync
+  double replayMs = 0.0;
+  double replayWorstMs = 0.0;
+  double sceneTime = 0.0;
+  if (replaying) glfwSwapInterval(0);
+
+  Pacing pacing = pacing_create(framesInFlight, targetFps);
+  stats_add_report(pacing_print_frame_stats);
+
   // Main Loop
   while (!glfwWindowShouldClose(window)) {
+    pacing_begin_frame(&pacing);
     float currentFrame = glfwGetTime();
-    deltaTime = currentFrame - lastFrame;
+    float frameTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
+    // Replays advance the same time every frame, however long it took
+    deltaTime = replaying ? REPLAY_STEP : frameTime;
+    sceneTime += deltaTime;
+
+    // Work the camera doesn't change comes first, input is sampled as late
+    // as possible before the matrices are taken
+    scene_update(&scene);
+    texture_pump();
+    if (textureArrays) texpool_update();
+    if (video != NULL) video_update(video, sceneTime);
+
+    // Leaves only move when their nodes did
+    if (scene.numUpdated > 0) {
+      for (unsigned int i = 0; i < 14; i++) {
+        vec3s box[2];
+        glms_aabb_transform(cubeBox, scene.world[sceneNodes[i]], box);
+        bvh_update(&sceneBvh, sceneLeaves[i], box);
+      }
+    }
 
+    glfwPollEvents();
     process_input(window);
+    if (replaying) {
+      if (replay.frame > 1) {
+        replayMs += frameTime * 1000.0;
+        if (frameTime * 1000.0 > replayWorstMs) {
+          replayWorstMs = frameTime * 1000.0;
+        }
+      }
+      if (!replay_play(&replay, &camera)) break;
+    } else if (replay.file != NULL) {
+      camera_update(&camera);
+      replay_write(&replay, &camera);
+    }
+    pacing_mark_input(&pacing);
 
     glClearColor(0x1e / 255.0, 0x29 / 255.0, 0x3b / 255.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    shader_use(&cubeShader);
-    shader_set_vec3(&cubeShader, "viewPos", camera.Position);
-    shader_set_float(&cubeShader, "material.shininess", 32.0f);
-
-    // Light
-
-    // directional light
-    shader_set_vec3f(&cubeShader, "dirLight.direction", -0.2f, -1.0f, -0.3f);
-    shader_set_vec3f(&cubeShader, "dirLight.ambient", 0.05f, 0.05f, 0.05f);
-    shader_set_vec3f(&cubeShader, "dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-    shader_set_vec3f(&cubeShader, "dirLight.specular", 0.5f, 0.5f, 0.5f);
-    // point light 1
-    shader_set_vec3(&cubeShader, "pointLights[0].position",
-                    pointLightPositions[0]);
-    shader_set_vec3f(&cubeShader, "pointLights[0].ambient", 0.05f, 0.05f,
-                     0.05f);
-    shader_set_vec3f(&cubeShader, "pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-    shader_set_vec3f(&cubeShader, "pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-    shader_set_float(&cubeShader, "pointLights[0].constant", 1.0f);
-    shader_set_float(&cubeShader, "pointLights[0].linear", 0.09f);
-    shader_set_float(&cubeShader, "pointLights[0].quadratic", 0.032f);
-    // point light 2
-    shader_set_vec3(&cubeShader, "pointLights[1].position",
-                    pointLightPositions[1]);
-    shader_set_vec3f(&cubeShader, "pointLights[1].ambient", 0.05f, 0.05f,
-                     0.05f);
-    shader_set_vec3f(&cubeShader, "pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-    shader_set_vec3f(&cubeShader, "pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-    shader_set_float(&cubeShader, "pointLights[1].constant", 1.0f);
-    shader_set_float(&cubeShader, "pointLights[1].linear", 0.09f);
-    shader_set_float(&cubeShader, "pointLights[1].quadratic", 0.032f);
-    // point light 3
-    shader_set_vec3(&cubeShader, "pointLights[2].position",
-                    pointLightPositions[2]);
-    shader_set_vec3f(&cubeShader, "pointLights[2].ambient", 0.05f, 0.05f,
-                     0.05f);
-    shader_set_vec3f(&cubeShader, "pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-    shader_set_vec3f(&cubeShader, "pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-    shader_set_float(&cubeShader, "pointLights[2].constant", 1.0f);
-    shader_set_float(&cubeShader, "pointLights[2].linear", 0.09f);
-    shader_set_float(&cubeShader, "pointLights[2].quadratic", 0.032f);
-    // point light 4
-    shader_set_vec3(&cubeShader, "pointLights[3].position",
-                    pointLightPositions[3]);
-    shader_set_vec3f(&cubeShader, "pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-    shader_set_vec3f(&cubeShader, "pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-    shader_set_vec3f(&cubeShader, "pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-    shader_set_float(&cubeShader, "pointLights[3].constant", 1.0f);
-    shader_set_float(&cubeShader, "pointLights[3].linear", 0.09f);
-    shader_set_float(&cubeShader, "pointLights[3].quadratic", 0.032f);
-
-    // View/Projection
-    mat4s projection =
-        glms_perspective(glm_rad(camera.Zoom),
-                         (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.f);
+    // View/Projection, rebuilt by the camera only after it changed
+    mat4s projection = camera_get_projection_matrix(&camera);
     mat4s view = camera_get_view_matrix(&camera);
+    if (camera.Version != frustumVersion) {
+      frustum = cull_frustum_create(camera.ViewProjection);
+      frustumVersion = camera.Version;
+    }
+
+    uint32_t numVisible =
+        bvh_query_frustum(&sceneBvh, &frustum, visible, 14);
+    if (occlusionCulling) {
+      raster_begin(&raster, camera.ViewProjection);
+      for (uint32_t v = 0; v < numVisible; v++) {
+        if (visible[v] >= 10) continue;
+        RasterOccluder occluder = {
+            .positions = cubeCorners,
+            .stride = 3 * sizeof(float),
+            .numVertices = 8,
+            .indices = cubeTriangles,
+            .numTriangles = 12,
+            .world = scene.world[sceneNodes[visible[v]]],
+        };
+        raster_add_occluder(&raster, &occluder);
+      }
+      raster_render(&raster, pool);
+
+      uint32_t kept = 0;
+      for (uint32_t v = 0; v < numVisible; v++) {
+        if (raster_test_aabb(&raster, cubeBox,
+                             scene.world[sceneNodes[visible[v]]])) {
+          visible[kept++] = visible[v];
+        }
+      }
+      numVisible = kept;
+    }
+
+    if (hasSky && skyFirst) skybox_draw(&skybox, view, projection);
+
+    shader_use(&cubeShader);
+    set_light_uniforms(&cubeShader, pointLightPositions);
+    texture_stream_view(camera.Position.raw, glm_rad(camera.Zoom),
+                        (float)framebufferHeight);
     shader_set_mat4(&cubeShader, "projection", projection);
     shader_set_mat4(&cubeShader, "view", view);
 
-    mat4s model = glms_mat4_identity();
-    shader_set_mat4(&cubeShader, "model", model);
+    shader_use(&lightShader);
+    shader_set_mat4(&lightShader, "projection", projection);
+    shader_set_mat4(&lightShader, "view", view);
 
-    // Bind diffuse texture map
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
+    render_queue_begin(&renderQueue, camera.Position, camera.Front,
+                       camera.Far);
+    CubeBatch cubeBatch = {
+        .queue = &renderQueue,
+        .buffers = render_queue_buffers(
+            &renderQueue,
+            (numVisible + CUBE_ENQUEUE_OBJECTS - 1) / CUBE_ENQUEUE_OBJECTS),
+        .visible = visible,
+        .nodes = sceneNodes,
+        .world = scene.world,
+        .cubeShader = &cubeShader,
+        .lightShader = &lightShader,
+        .cubeVAO = VAO,
+        .lightVAO = lightVAO,
+        .material = &cubeMaterial,
+    };
+    job_pool_parallel_for(pool, numVisible, CUBE_ENQUEUE_OBJECTS,
+                          enqueue_cubes, &cubeBatch);
+    render_queue_merge(&renderQueue);
+    // Streaming isn't thread safe, the cubes report their textures here.
+    // Each face maps the whole texture onto one unit square.
+    for (uint32_t v = 0; v < numVisible; v++) {
+      if (visible[v] >= 10) continue;
+      texture_use(diffuseMap, cubePositions[visible[v]].raw, 1.0f);
+      texture_use(specularMap, cubePositions[visible[v]].raw, 1.0f);
+    }
 
-    // Bind specular texture map
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMap);
+    if (hasSkin) {
+      animator_update(&animator, deltaTime);
+      animation_upload_palette(paletteUBO, &animator);
+
+      shader_use(&skinnedShader);
+      set_light_uniforms(&skinnedShader, pointLightPositions);
+      shader_set_mat4(&skinnedShader, "projection", projection);
+      shader_set_mat4(&skinnedShader, "view", view);
+      model_enqueue(&loadedModel, &renderQueue, &skinnedShader,
+                    glms_mat4_identity(), &frustum, pool);
+    } else if (hasModel && !hasOcclusion) {
+      model_enqueue(&loadedModel, &renderQueue, &cubeShader,
+                    glms_mat4_identity(), &frustum, pool);
+    }
+    render_queue_flush(&renderQueue, pool);
 
-    glBindVertexArray(VAO);
-    for (unsigned int i = 0; i < 10; i++) {
-      mat4s model = glms_mat4_identity();
-      model = glms_translate(model, cubePositions[i]);
-      float angle = 20.0f * i;
-      model = glms_rotate(model, glm_rad(angle), (vec3s){{1.0f, 0.3f, 0.5f}});
-      shader_set_mat4(&cubeShader, "model", model);
+    if (hasOcclusion) {
+      shader_use(&cubeShader);
+      occlusion_begin_frame(&occlusion, camera.ViewProjection, camera.Position);
+      model_draw_occluded(&loadedModel, &cubeShader, glms_mat4_identity(),
+                          &frustum, &occlusion);
+    }
 
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+    // Screen behind the cubes
+    if (video != NULL) {
+      mat4s screen = glms_translate_make((vec3s){{0.0f, 2.0f, -25.0f}});
+      video_draw(video, glms_scale_uni(screen, 16.0f), view, projection);
     }
 
-    // Lamp
-    shader_use(&lightShader);
-    shader_set_mat4(&lightShader, "projection", projection);
-    shader_set_mat4(&lightShader, "view", view);
+    // Every opaque pixel is in the depth buffer by now
+    if (hasSky && !skyFirst) skybox_draw(&skybox, view, projection);
 
-    glBindVertexArray(lightVAO);
-    for (unsigned int i = 0; i < 4; i++) {
-      model = glms_mat4_identity();
-      model = glms_translate(model, pointLightPositions[i]);
-      model = glms_scale_uni(model, 0.2f);
-      shader_set_mat4(&lightShader, "model", model);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
-    }
+    texture_stream_update();
+    // Replays wait for the levels asked for, so every run draws the same ones
+    if (replaying) texture_finish();
 
     glfwSwapBuffers(window);
-    glfwPollEvents();
+    pacing_end_frame(&pacing);
+    stats_frame(frameTime);
   }
-
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteVertexArrays(1, &lightVAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteProgram(cubeShader.ID);
-  glDeleteProgram(lightShader.ID);
+  pacing_destroy(&pacing);
+  render_queue_destroy(&renderQueue);
+
+  // The first frame pays for driver warm-up and is left out
+  if (replaying && replay.frame > 1) {
+    printf("replay: %u frames, %.2f ms/frame, worst %.2f ms\n",
+           replay.frame - 1, replayMs / (replay.frame - 1), replayWorstMs);
+    printf("replay: video off, texture streaming finished every frame\n");
+  } else if (replay.file != NULL) {
+    printf("recorded %u frames to %s\n", replay.numFrames, recordPath);
+  }
+  replay_close(&replay);
+
+  glstate_delete_vertex_arrays(1, &VAO);
+  glstate_delete_vertex_arrays(1, &lightVAO);
+  glstate_delete_buffers(1, &VBO);
+  glstate_delete_program(cubeShader.ID);
+  glstate_delete_program(lightShader.ID);
+  scene_destroy(&scene);
+  bvh_destroy(&sceneBvh);
+  if (occlusionCulling) raster_destroy(&raster);
+  if (hasSky) skybox_destroy(&skybox);
+  video_close(video);
+  if (hasSkin) {
+    animator_destroy(&animator);
+    clip_destroy(&compressedClip);
+    glstate_delete_buffers(1, &paletteUBO);
+    glstate_delete_program(skinnedShader.ID);
+  }
+  if (hasOcclusion) occlusion_destroy(&occlusion);
+  if (hasModel) model_destroy(&loadedModel);
+  texture_release(diffuseMap);
+  texture_release(specularMap);
+  texpool_destroy();
+  texture_manager_destroy();
+  job_pool_destroy(pool);
 
   glfwTerminate();
 
@@ -289,7 +654,13 @@ int main(void) {
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
   (void)window;
-  glViewport(0, 0, width, height);
+  glstate_viewport(0, 0, width, height);
+  // Minimized windows report 0, keep streaming for the last real size
+  if (height > 0) {
+    framebufferHeight = height;
+    camera_set_perspective(&camera, (float)width / (float)height, camera.Near,
+                           camera.Far);
+  }
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
@@ -322,6 +693,8 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 void process_input(GLFWwindow* window) {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, true);
+  // The camera path moves the camera
+  if (replay.frames != NULL) return;
 
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     camera_process_keyboard(&camera, FORWARD, deltaTime);
@@ -333,39 +706,88 @@ void process_input(GLFWwindow* window) {
     camera_process_keyboard(&camera, RIGHT, deltaTime);
 }
 
-GLuint generate_texture(const char* path) {
-  GLuint texture;
-  glGenTextures(1, &texture);
-
-  stbi_set_flip_vertically_on_load(true);
-  // load and generate the texture
-  int width, height, nrChannels;
-  GLubyte* data = stbi_load(path, &width, &height, &nrChannels, 0);
-  if (!data) {
-    fprintf(stderr, "ERROR: Failed to load texture at path: %s\n", path);
-    stbi_image_free(data);
-    return 0;
+// Cube textures, from their pools with --texture-arrays
+void bind_cube_textures(const void* material, Shader* shader) {
+  (void)shader;
+  const CubeMaterial* cube = material;
+  if (cube->pooled) {
+    texpool_bind(cube->diffuseSlot, MESH_DIFFUSE_UNIT);
+    texpool_bind(cube->specularSlot, MESH_SPECULAR_UNIT);
+    glVertexAttribI2i(MESH_LAYERS_ATTRIB, cube->diffuseSlot.layer,
+                      cube->specularSlot.layer);
+  } else {
+    texture_bind(cube->diffuse, 0);
+    texture_bind(cube->specular, 1);
   }
+}
 
-  GLenum format;
-  if (nrChannels == 1) format = GL_RED;
-  if (nrChannels == 3) format = GL_RGB;
-  if (nrChannels == 4) format = GL_RGBA;
-
-  // set the texture wrapping/filtering options (on the currently bound texture
-  // object)
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-               GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                  GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  stbi_image_free(data);
+// Packets of visible objects [begin, end), into the slice's own buffer
+void enqueue_cubes(void* data, uint32_t begin, uint32_t end) {
+  const CubeBatch* batch = data;
+  RenderBuffer* buffer = &batch->buffers[begin / CUBE_ENQUEUE_OBJECTS];
+
+  for (uint32_t v = begin; v < end; v++) {
+    uint32_t i = batch->visible[v];
+    mat4s world = batch->world[batch->nodes[i]];
+    RenderPacket packet = {
+        .shader = batch->lightShader,
+        .VAO = batch->lightVAO,
+        .model = world,
+        .mode = GL_TRIANGLES,
+        .count = 36,
+    };
+    if (i < 10) {
+      packet.shader = batch->cubeShader;
+      packet.VAO = batch->cubeVAO;
+      packet.bind = bind_cube_textures;
+      packet.material = batch->material;
+    }
+    render_buffer_submit(batch->queue, buffer, RENDER_PASS_OPAQUE, &packet,
+                         glms_vec3(world.col[3]));
+  }
+}
 
-  return texture;
+// Material shininess and the directional + point lights shared by the lit
+// shaders
+void set_light_uniforms(Shader* shader, const vec3s* pointLightPositions) {
+  shader_set_vec3(shader, "viewPos", camera.Position);
+  shader_set_float(shader, "material.shininess", 32.0f);
+
+  // directional light
+  shader_set_vec3f(shader, "dirLight.direction", -0.2f, -1.0f, -0.3f);
+  shader_set_vec3f(shader, "dirLight.ambient", 0.05f, 0.05f, 0.05f);
+  shader_set_vec3f(shader, "dirLight.diffuse", 0.4f, 0.4f, 0.4f);
+  shader_set_vec3f(shader, "dirLight.specular", 0.5f, 0.5f, 0.5f);
+  // point light 1
+  shader_set_vec3(shader, "pointLights[0].position", pointLightPositions[0]);
+  shader_set_vec3f(shader, "pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
+  shader_set_vec3f(shader, "pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
+  shader_set_vec3f(shader, "pointLights[0].specular", 1.0f, 1.0f, 1.0f);
+  shader_set_float(shader, "pointLights[0].constant", 1.0f);
+  shader_set_float(shader, "pointLights[0].linear", 0.09f);
+  shader_set_float(shader, "pointLights[0].quadratic", 0.032f);
+  // point light 2
+  shader_set_vec3(shader, "pointLights[1].position", pointLightPositions[1]);
+  shader_set_vec3f(shader, "pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
+  shader_set_vec3f(shader, "pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
+  shader_set_vec3f(shader, "pointLights[1].specular", 1.0f, 1.0f, 1.0f);
+  shader_set_float(shader, "pointLights[1].constant", 1.0f);
+  shader_set_float(shader, "pointLights[1].linear", 0.09f);
+  shader_set_float(shader, "pointLights[1].quadratic", 0.032f);
+  // point light 3
+  shader_set_vec3(shader, "pointLights[2].position", pointLightPositions[2]);
+  shader_set_vec3f(shader, "pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
+  shader_set_vec3f(shader, "pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
+  shader_set_vec3f(shader, "pointLights[2].specular", 1.0f, 1.0f, 1.0f);
+  shader_set_float(shader, "pointLights[2].constant", 1.0f);
+  shader_set_float(shader, "pointLights[2].linear", 0.09f);
+  shader_set_float(shader, "pointLights[2].quadratic", 0.032f);
+  // point light 4
+  shader_set_vec3(shader, "pointLights[3].position", pointLightPositions[3]);
+  shader_set_vec3f(shader, "pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
+  shader_set_vec3f(shader, "pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
+  shader_set_vec3f(shader, "pointLights[3].specular", 1.0f, 1.0f, 1.0f);
+  shader_set_float(shader, "pointLights[3].constant", 1.0f);
+  shader_set_float(shader, "pointLights[3].linear", 0.09f);
+  shader_set_float(shader, "pointLights[3].quadratic", 0.032f);
 }
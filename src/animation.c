@@ -0,0 +1,282 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "animation.h"
+
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/quat.h"
+#include "cglm/struct/vec3.h"
+#include "glstate.h"
+#include "mesh.h"
+
+typedef struct {
+  Animator* animators;
+  float deltaTime;
+} AnimatorBatch;
+
+// Privates
+static uint32_t animation_find_key(const void* keys, size_t stride,
+                                   uint32_t count, float time);
+static float animation_key_factor(float from, float to, float time);
+static void animator_update_range(void* data, uint32_t begin, uint32_t end);
+
+// Samples the three tracks of a channel at `time` (seconds). Every track is
+// searched independently, times outside the keys clamp to the ends.
+void animation_sample_channel(const AnimationChannel* channel, float time,
+                              vec3s* position, versors* rotation,
+                              vec3s* scale) {
+  if (channel->numPositions == 1) {
+    *position = channel->positions[0].value;
+  } else if (channel->numPositions > 1) {
+    uint32_t i = animation_find_key(channel->positions, sizeof(VectorKey),
+                                    channel->numPositions, time);
+    const VectorKey* a = &channel->positions[i];
+    const VectorKey* b = &channel->positions[i + 1];
+    *position = glms_vec3_lerp(a->value, b->value,
+                               animation_key_factor(a->time, b->time, time));
+  }
+
+  if (channel->numRotations == 1) {
+    *rotation = channel->rotations[0].value;
+  } else if (channel->numRotations > 1) {
+    uint32_t i = animation_find_key(channel->rotations, sizeof(QuatKey),
+                                    channel->numRotations, time);
+    const QuatKey* a = &channel->rotations[i];
+    const QuatKey* b = &channel->rotations[i + 1];
+    *rotation = glms_quat_slerp(a->value, b->value,
+                                animation_key_factor(a->time, b->time, time));
+  }
+
+  if (channel->numScales == 1) {
+    *scale = channel->scales[0].value;
+  } else if (channel->numScales > 1) {
+    uint32_t i = animation_find_key(channel->scales, sizeof(VectorKey),
+                                    channel->numScales, time);
+    const VectorKey* a = &channel->scales[i];
+    const VectorKey* b = &channel->scales[i + 1];
+    *scale = glms_vec3_lerp(a->value, b->value,
+                            animation_key_factor(a->time, b->time, time));
+  }
+}
+
+// Creates the playback state of one character. The scene must have been
+// updated at least once, its local matrices provide the rest pose.
+Animator animator_create(const Scene* scene, const Skeleton* skeleton,
+                         const AnimationClip* clip) {
+  Animator animator = {
+      .scene = scene,
+      .skeleton = skeleton,
+      .clip = clip,
+      .nodeChannels = malloc(scene->count * sizeof(int32_t)),
+      .global = aligned_alloc(32, scene->count * sizeof(mat4s)),
+      .palette = aligned_alloc(32, MAX_BONES * sizeof(mat4s)),
+  };
+
+  for (uint32_t i = 0; i < scene->count; i++) {
+    animator.nodeChannels[i] = -1;
+  }
+  for (uint32_t c = 0; clip != NULL && c < clip->numChannels; c++) {
+    int32_t node = clip->channels[c].node;
+    if (node >= 0 && (uint32_t)node < scene->count) {
+      animator.nodeChannels[node] = (int32_t)c;
+    }
+  }
+
+  for (uint32_t b = 0; b < MAX_BONES; b++) {
+    animator.palette[b] = glms_mat4_identity();
+  }
+
+  return animator;
+}
+
+// Same as animator_create but plays a compressed clip through a cursor.
+// Channels start from the rest TRS of their node, so tracks the compressor
+// left empty keep it.
+Animator animator_create_compressed(const Scene* scene,
+                                    const Skeleton* skeleton,
+                                    const CompressedClip* clip) {
+  Animator animator = animator_create(scene, skeleton, NULL);
+  animator.compressed = clip;
+  animator.cursor = clip_cursor_create(clip);
+  animator.positions = malloc(clip->numChannels * sizeof(vec3s));
+  animator.rotations = aligned_alloc(16, clip->numChannels * sizeof(versors));
+  animator.scales = malloc(clip->numChannels * sizeof(vec3s));
+
+  for (uint32_t c = 0; c < clip->numChannels; c++) {
+    int32_t node = clip->nodes[c];
+    if (node >= 0 && (uint32_t)node < scene->count) {
+      animator.nodeChannels[node] = (int32_t)c;
+      animator.positions[c] = scene->position[node];
+      animator.rotations[c] = scene->rotation[node];
+      animator.scales[c] = scene->scale[node];
+    } else {
+      animator.positions[c] = glms_vec3_zero();
+      animator.rotations[c] = glms_quat_identity();
+      animator.scales[c] = glms_vec3_one();
+    }
+  }
+
+  return animator;
+}
+
+void animator_destroy(Animator* animator) {
+  if (animator->compressed != NULL) clip_cursor_destroy(&animator->cursor);
+  free(animator->positions);
+  free(animator->rotations);
+  free(animator->scales);
+  free(animator->nodeChannels);
+  free(animator->global);
+  free(animator->palette);
+
+  *animator = (Animator){0};
+}
+
+// Advances the clip (looping) and rebuilds the bone palette
+void animator_update(Animator* animator, float deltaTime) {
+  const Scene* scene = animator->scene;
+  const Skeleton* skeleton = animator->skeleton;
+  const AnimationClip* clip = animator->clip;
+  const CompressedClip* compressed = animator->compressed;
+
+  float duration = compressed != NULL ? compressed->duration
+                   : clip != NULL     ? clip->duration
+                                      : 0.0f;
+  if (duration > 0.0f) {
+    animator->time = fmodf(animator->time + deltaTime, duration);
+    if (animator->time < 0.0f) animator->time += duration;
+  }
+
+  // The cursor decodes every channel at once, in stream order
+  if (compressed != NULL) {
+    clip_cursor_sample(&animator->cursor, animator->time, animator->positions,
+                       animator->rotations, animator->scales);
+  }
+
+  // Parents precede children, so one pass resolves the whole hierarchy
+  for (uint32_t i = 0; i < scene->count; i++) {
+    mat4s local;
+    int32_t channel = animator->nodeChannels[i];
+    if (channel >= 0 && compressed != NULL) {
+      local = scene_trs_matrix(animator->positions[channel],
+                               animator->rotations[channel],
+                               animator->scales[channel]);
+    } else if (channel >= 0) {
+      vec3s position = scene->position[i];
+      versors rotation = scene->rotation[i];
+      vec3s scale = scene->scale[i];
+      animation_sample_channel(&clip->channels[channel], animator->time,
+                               &position, &rotation, &scale);
+      local = scene_trs_matrix(position, rotation, scale);
+    } else {
+      local = scene->local[i];
+    }
+
+    int32_t parent = scene->parent[i];
+    if (parent == SCENE_NO_PARENT) {
+      animator->global[i] = local;
+    } else {
+      glm_mat4_mul(animator->global[parent].raw, local.raw,
+                   animator->global[i].raw);
+    }
+  }
+
+  uint32_t numBones =
+      skeleton->numBones < MAX_BONES ? skeleton->numBones : MAX_BONES;
+  for (uint32_t b = 0; b < numBones; b++) {
+    glm_mat4_mul(animator->global[skeleton->nodes[b]].raw,
+                 skeleton->offsets[b].raw, animator->palette[b].raw);
+  }
+}
+
+void animator_update_many(JobPool* pool, Animator* animators, uint32_t count,
+                          float deltaTime) {
+  AnimatorBatch batch = {.animators = animators, .deltaTime = deltaTime};
+  job_pool_parallel_for(pool, count, 8, animator_update_range, &batch);
+}
+
+// Uniform buffer holding the palette, bound to BONES_UBO_BINDING
+bool animation_add_influence(int* boneIDs, float* weights, uint32_t bone,
+                             float weight) {
+  if (bone >= MAX_BONES) return false;
+
+  // Take a free slot, or evict the weakest influence if this one is larger
+  int slot = 0;
+  for (int i = 1; i < MAX_BONE_INFLUENCE; i++) {
+    if (weights[i] < weights[slot]) slot = i;
+  }
+  if (weight > weights[slot]) {
+    boneIDs[slot] = (int)bone;
+    weights[slot] = weight;
+  }
+
+  return true;
+}
+
+void animation_normalize_influences(float* weights) {
+  float total = 0.0f;
+  for (int i = 0; i < MAX_BONE_INFLUENCE; i++) total += weights[i];
+  for (int i = 0; total > 0.0f && i < MAX_BONE_INFLUENCE; i++) {
+    weights[i] /= total;
+  }
+}
+
+GLuint animation_create_palette_buffer(void) {
+  GLuint ubo;
+  glGenBuffers(1, &ubo);
+  glstate_bind_buffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferData(GL_UNIFORM_BUFFER, MAX_BONES * sizeof(mat4s), NULL,
+               GL_DYNAMIC_DRAW);
+  glstate_bind_buffer_base(GL_UNIFORM_BUFFER, BONES_UBO_BINDING, ubo);
+  glstate_bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+  return ubo;
+}
+
+void animation_upload_palette(GLuint ubo, const Animator* animator) {
+  uint32_t numBones = animator->skeleton->numBones < MAX_BONES
+                          ? animator->skeleton->numBones
+                          : MAX_BONES;
+
+  glstate_bind_buffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, numBones * sizeof(mat4s),
+                  animator->palette);
+  glstate_bind_buffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// ------------------------------------------------------------------------
+
+// Index i of the key pair [i, i + 1] surrounding `time`, count must be >= 2
+static uint32_t animation_find_key(const void* keys, size_t stride,
+                                   uint32_t count, float time) {
+  const unsigned char* base = keys;
+  uint32_t low = 0;
+  uint32_t high = count - 1;
+
+  while (high - low > 1) {
+    uint32_t mid = (low + high) / 2;
+    float midTime = *(const float*)(base + mid * stride);
+    if (midTime <= time) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+static float animation_key_factor(float from, float to, float time) {
+  if (to <= from) return 0.0f;
+
+  float t = (time - from) / (to - from);
+  return t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+}
+
+static void animator_update_range(void* data, uint32_t begin, uint32_t end) {
+  AnimatorBatch* batch = data;
+  for (uint32_t i = begin; i < end; i++) {
+    animator_update(&batch->animators[i], batch->deltaTime);
+  }
+}
@@ -0,0 +1,103 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "cglm/types-struct.h"
+#include "clip.h"
+#include "job.h"
+#include "scene.h"
+
+// Must match the array size of the Bones block in skinned_vs.glsl
+#define MAX_BONES 128
+#define BONES_UBO_BINDING 0
+
+typedef struct {
+  float time;
+  vec3s value;
+} VectorKey;
+
+typedef struct {
+  float time;
+  versors value;
+} QuatKey;
+
+// Keyframes of a single scene node, times in seconds
+typedef struct {
+  int32_t node;
+
+  VectorKey* positions;
+  QuatKey* rotations;
+  VectorKey* scales;
+
+  uint32_t numPositions;
+  uint32_t numRotations;
+  uint32_t numScales;
+} AnimationChannel;
+
+typedef struct AnimationClip {
+  char* name;
+  AnimationChannel* channels;
+  uint32_t numChannels;
+  float duration;
+} AnimationClip;
+
+// Bones are scene nodes that deform vertices: offsets[i] takes a vertex from
+// mesh space into the bind-pose space of bone i.
+typedef struct {
+  char** names;
+  int32_t* nodes;
+  mat4s* offsets;
+  uint32_t numBones;
+} Skeleton;
+
+// Playback state of one character. The scene supplies the hierarchy and the
+// rest pose of every node a channel does not drive.
+typedef struct {
+  const Scene* scene;
+  const Skeleton* skeleton;
+  const AnimationClip* clip;
+  const CompressedClip* compressed;  // replaces `clip` when set
+  ClipCursor cursor;
+  float time;
+
+  int32_t* nodeChannels;  // channel driving each node, or -1
+  mat4s* global;          // per node, relative to the model root
+  mat4s* palette;         // per bone, uploaded for skinning
+
+  // Per channel TRS sampled from a compressed clip
+  vec3s* positions;
+  versors* rotations;
+  vec3s* scales;
+} Animator;
+
+void animation_sample_channel(const AnimationChannel* channel, float time,
+                              vec3s* position, versors* rotation,
+                              vec3s* scale);
+
+Animator animator_create(const Scene* scene, const Skeleton* skeleton,
+                         const AnimationClip* clip);
+Animator animator_create_compressed(const Scene* scene,
+                                    const Skeleton* skeleton,
+                                    const CompressedClip* clip);
+void animator_destroy(Animator* animator);
+void animator_update(Animator* animator, float deltaTime);
+// Advances and evaluates many characters in parallel on the pool
+void animator_update_many(JobPool* pool, Animator* animators, uint32_t count,
+                          float deltaTime);
+
+// Puts a bone's influence into a vertex's MAX_BONE_INFLUENCE slots, evicting
+// the weakest one if it is stronger. Bones from MAX_BONES on have no palette
+// entry, their influence is dropped and false returned.
+bool animation_add_influence(int* boneIDs, float* weights, uint32_t bone,
+                             float weight);
+// Scales a vertex's weights to sum to one, all zero stays all zero
+void animation_normalize_influences(float* weights);
+
+GLuint animation_create_palette_buffer(void);
+void animation_upload_palette(GLuint ubo, const Animator* animator);
+
+#endif  // ANIMATION_H
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Privates
+static ArenaBlock* arena_add_block(Arena* arena, size_t minSize);
+
+// Creates an empty arena. The first block is allocated lazily with at least
+// `blockSize` bytes, so callers that know their total up front can size it to
+// fit everything in a single system allocation.
+Arena arena_create(size_t blockSize) {
+  return (Arena){
+      .blockSize = blockSize > 0 ? blockSize : 64 * 1024,
+  };
+}
+
+void arena_destroy(Arena* arena) {
+  ArenaBlock* block = arena->head;
+  while (block != NULL) {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+
+  *arena = (Arena){0};
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t align) {
+  if (size == 0) return NULL;
+  if (align == 0) align = 1;
+
+  ArenaBlock* block = arena->head;
+  uintptr_t offset = 0;
+
+  if (block != NULL) {
+    uintptr_t base = (uintptr_t)block->data;
+    offset = ((base + block->used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+  }
+
+  if (block == NULL || offset + size > block->size) {
+    block = arena_add_block(arena, size + align);
+    if (block == NULL) return NULL;
+
+    uintptr_t base = (uintptr_t)block->data;
+    offset = ((base + align - 1) & ~(uintptr_t)(align - 1)) - base;
+  }
+
+  block->used = offset + size;
+
+  arena->numAllocs++;
+  arena->bytesAllocated += size;
+
+  return block->data + offset;
+}
+
+void* arena_calloc(Arena* arena, size_t count, size_t size, size_t align) {
+  void* data = arena_alloc(arena, count * size, align);
+  if (data != NULL) memset(data, 0, count * size);
+
+  return data;
+}
+
+char* arena_strdup(Arena* arena, const char* str) {
+  size_t length = strlen(str) + 1;
+  char* copy = arena_alloc(arena, length, 1);
+  if (copy != NULL) memcpy(copy, str, length);
+
+  return copy;
+}
+
+void arena_print_stats(const Arena* arena, const char* name, FILE* stream) {
+  fprintf(stream,
+          "%s: %zu allocations (%zu bytes) served from %zu system "
+          "allocations (%zu bytes reserved, grew %zu times)\n",
+          name, arena->numAllocs, arena->bytesAllocated, arena->numBlocks,
+          arena->bytesReserved, arena->numGrowths);
+}
+
+// ------------------------------------------------------------------------
+
+static ArenaBlock* arena_add_block(Arena* arena, size_t minSize) {
+  size_t size = arena->blockSize > minSize ? arena->blockSize : minSize;
+
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+  if (block == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate %zu byte arena block\n", size);
+    return NULL;
+  }
+
+  if (arena->head != NULL) arena->numGrowths++;
+  block->next = arena->head;
+  block->size = size;
+  block->used = 0;
+  arena->head = block;
+
+  arena->numBlocks++;
+  arena->bytesReserved += size;
+
+  return block;
+}
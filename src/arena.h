@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct ArenaBlock {
+  struct ArenaBlock* next;
+  size_t size;
+  size_t used;
+  unsigned char data[];
+} ArenaBlock;
+
+// Region allocator: allocations are bumped out of large blocks and released
+// all at once by arena_destroy. Blocks are chained, never reallocated, so
+// pointers stay valid for the arena's whole lifetime.
+typedef struct {
+  ArenaBlock* head;
+  size_t blockSize;
+
+  // Instrumentation
+  size_t numAllocs;       // requests served
+  size_t bytesAllocated;  // bytes handed out, padding excluded
+  size_t numBlocks;       // system allocations made
+  size_t numGrowths;      // blocks added because the ones before were full
+  size_t bytesReserved;   // bytes obtained from the system
+} Arena;
+
+Arena arena_create(size_t blockSize);
+void arena_destroy(Arena* arena);
+
+void* arena_alloc(Arena* arena, size_t size, size_t align);
+void* arena_calloc(Arena* arena, size_t count, size_t size, size_t align);
+char* arena_strdup(Arena* arena, const char* str);
+
+#define arena_new(arena, type, count) \
+  ((type*)arena_alloc((arena), sizeof(type) * (count), _Alignof(type)))
+
+void arena_print_stats(const Arena* arena, const char* name, FILE* stream);
+
+#endif  // ARENA_H
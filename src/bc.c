@@ -0,0 +1,381 @@
+#include <math.h>
+#include <string.h>
+
+#include "bc.h"
+
+typedef struct {
+  BCFormat format;
+  const uint8_t* pixels;
+  int32_t width;
+  int32_t height;
+  int32_t channels;
+  uint8_t* out;
+} BCJob;
+
+// BC7 interpolation weights for 4-bit indices
+static const int BC7_WEIGHTS[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                    34, 38, 43, 47, 51, 55, 60, 64};
+
+// Privates
+static void bc_encode_rows(void* data, uint32_t begin, uint32_t end);
+static void bc_fetch_block(const BCJob* job, int32_t bx, int32_t by,
+                           uint8_t block[16][4]);
+static void bc_find_extremes(const uint8_t block[16][4], int numChannels,
+                             int* minIndex, int* maxIndex);
+static void bc_encode_color(const uint8_t block[16][4], uint8_t out[8]);
+static void bc_encode_channel(const uint8_t block[16][4], int channel,
+                              uint8_t out[8]);
+static void bc7_encode_mode6(const uint8_t block[16][4], uint8_t out[16]);
+static uint16_t bc_pack_565(const uint8_t color[4]);
+static void bc_unpack_565(uint16_t packed, int color[3]);
+static void bc_put_bits(uint8_t* out, uint32_t* pos, uint32_t value,
+                        uint32_t count);
+
+size_t bc_block_bytes(BCFormat format) {
+  return format == BC1 || format == BC4 ? 8 : 16;
+}
+
+size_t bc_level_size(BCFormat format, int32_t width, int32_t height) {
+  size_t blocksX = (width + 3) / 4;
+  size_t blocksY = (height + 3) / 4;
+
+  return blocksX * blocksY * bc_block_bytes(format);
+}
+
+GLenum bc_gl_format(BCFormat format, bool srgb) {
+  switch (format) {
+    case BC1:
+      return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+                  : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BC3:
+      return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+                  : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BC4:
+      return GL_COMPRESSED_RED_RGTC1;
+    case BC5:
+      return GL_COMPRESSED_RG_RGTC2;
+    case BC7:
+      return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+                  : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default:
+      return 0;
+  }
+}
+
+const char* bc_name(BCFormat format) {
+  static const char* NAMES[NUM_BC_FORMATS] = {"raw", "BC1", "BC3",
+                                              "BC4", "BC5", "BC7"};
+
+  return format < NUM_BC_FORMATS ? NAMES[format] : "?";
+}
+
+void bc_encode(BCFormat format, const uint8_t* pixels, int32_t width,
+               int32_t height, int32_t channels, uint8_t* out, JobPool* pool) {
+  BCJob job = {
+      .format = format,
+      .pixels = pixels,
+      .width = width,
+      .height = height,
+      .channels = channels,
+      .out = out,
+  };
+
+  uint32_t blockRows = (height + 3) / 4;
+  job_pool_parallel_for(pool, blockRows, 4, bc_encode_rows, &job);
+}
+
+// ------------------------------------------------------------------------
+
+static void bc_encode_rows(void* data, uint32_t begin, uint32_t end) {
+  const BCJob* job = data;
+  int32_t blocksX = (job->width + 3) / 4;
+  size_t blockBytes = bc_block_bytes(job->format);
+
+  for (uint32_t by = begin; by < end; by++) {
+    uint8_t* out = job->out + (size_t)by * blocksX * blockBytes;
+
+    for (int32_t bx = 0; bx < blocksX; bx++, out += blockBytes) {
+      uint8_t block[16][4];
+      bc_fetch_block(job, bx, (int32_t)by, block);
+
+      switch (job->format) {
+        case BC1:
+          bc_encode_color(block, out);
+          break;
+        case BC3:
+          bc_encode_channel(block, 3, out);
+          bc_encode_color(block, out + 8);
+          break;
+        case BC4:
+          bc_encode_channel(block, 0, out);
+          break;
+        case BC5:
+          bc_encode_channel(block, 0, out);
+          bc_encode_channel(block, 1, out + 8);
+          break;
+        case BC7:
+          bc7_encode_mode6(block, out);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+// Expands the 4x4 block at (bx, by) to RGBA, repeating the last row and
+// column of images that aren't a multiple of four
+static void bc_fetch_block(const BCJob* job, int32_t bx, int32_t by,
+                           uint8_t block[16][4]) {
+  for (int y = 0; y < 4; y++) {
+    int32_t py = by * 4 + y;
+    if (py >= job->height) py = job->height - 1;
+
+    for (int x = 0; x < 4; x++) {
+      int32_t px = bx * 4 + x;
+      if (px >= job->width) px = job->width - 1;
+
+      const uint8_t* src =
+          job->pixels + ((size_t)py * job->width + px) * job->channels;
+      uint8_t* texel = block[y * 4 + x];
+      texel[0] = src[0];
+      texel[1] = job->channels == 1 ? src[0] : src[1];
+      texel[2] = job->channels == 1 ? src[0] : job->channels == 2 ? 0 : src[2];
+      texel[3] = job->channels == 4 ? src[3] : 255;
+    }
+  }
+}
+
+// Texels at both ends of the block's principal axis, found by a few steps of
+// power iteration on the covariance of the first `numChannels` channels
+static void bc_find_extremes(const uint8_t block[16][4], int numChannels,
+                             int* minIndex, int* maxIndex) {
+  float mean[4] = {0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < numChannels; c++) mean[c] += block[i][c] / 16.0f;
+  }
+
+  float covariance[4][4] = {{0}};
+  for (int i = 0; i < 16; i++) {
+    for (int a = 0; a < numChannels; a++) {
+      for (int b = 0; b < numChannels; b++) {
+        covariance[a][b] +=
+            (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+      }
+    }
+  }
+
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (int step = 0; step < 8; step++) {
+    float next[4] = {0};
+    float length = 0.0f;
+    for (int a = 0; a < numChannels; a++) {
+      for (int b = 0; b < numChannels; b++) {
+        next[a] += covariance[a][b] * axis[b];
+      }
+      if (next[a] * next[a] > length) length = next[a] * next[a];
+    }
+    if (length == 0.0f) break;  // flat block, any axis will do
+
+    for (int a = 0; a < numChannels; a++) axis[a] = next[a] / sqrtf(length);
+  }
+
+  float minDot = INFINITY, maxDot = -INFINITY;
+  *minIndex = *maxIndex = 0;
+  for (int i = 0; i < 16; i++) {
+    float dot = 0.0f;
+    for (int c = 0; c < numChannels; c++) dot += block[i][c] * axis[c];
+    if (dot < minDot) minDot = dot, *minIndex = i;
+    if (dot > maxDot) maxDot = dot, *maxIndex = i;
+  }
+}
+
+// BC1 colour block, always in four colour mode so it is valid inside BC3
+static void bc_encode_color(const uint8_t block[16][4], uint8_t out[8]) {
+  int minIndex, maxIndex;
+  bc_find_extremes(block, 3, &minIndex, &maxIndex);
+
+  uint16_t c0 = bc_pack_565(block[maxIndex]);
+  uint16_t c1 = bc_pack_565(block[minIndex]);
+  if (c0 < c1) {
+    uint16_t swap = c0;
+    c0 = c1;
+    c1 = swap;
+  }
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    int palette[4][3];
+    bc_unpack_565(c0, palette[0]);
+    bc_unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      int bestError = 1 << 30;
+      for (int p = 0; p < 4; p++) {
+        int error = 0;
+        for (int c = 0; c < 3; c++) {
+          int d = block[i][c] - palette[p][c];
+          error += d * d;
+        }
+        if (error < bestError) bestError = error, best = p;
+      }
+      indices |= (uint32_t)best << (2 * i);
+    }
+  }
+
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  memcpy(out + 4, &indices, 4);
+}
+
+// BC4 block of one channel, eight value mode spanning the block's range
+static void bc_encode_channel(const uint8_t block[16][4], int channel,
+                              uint8_t out[8]) {
+  int lo = 255, hi = 0;
+  for (int i = 0; i < 16; i++) {
+    if (block[i][channel] < lo) lo = block[i][channel];
+    if (block[i][channel] > hi) hi = block[i][channel];
+  }
+
+  out[0] = (uint8_t)hi;
+  out[1] = (uint8_t)lo;
+
+  uint64_t indices = 0;
+  if (hi > lo) {
+    // Index 0 and 1 are the endpoints, 2..7 step from hi towards lo
+    int palette[8] = {hi, lo};
+    for (int p = 1; p < 7; p++) {
+      palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+    }
+
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      int bestError = 256;
+      for (int p = 0; p < 8; p++) {
+        int error = block[i][channel] - palette[p];
+        if (error < 0) error = -error;
+        if (error < bestError) bestError = error, best = p;
+      }
+      indices |= (uint64_t)best << (3 * i);
+    }
+  }
+
+  for (int b = 0; b < 6; b++) {
+    out[2 + b] = (uint8_t)(indices >> (8 * b));
+  }
+}
+
+// BC7 mode 6: RGBA endpoints of 7 bits plus a shared p-bit each, 4-bit
+// indices. Every p-bit combination is tried and the lowest error kept.
+static void bc7_encode_mode6(const uint8_t block[16][4], uint8_t out[16]) {
+  int minIndex, maxIndex;
+  bc_find_extremes(block, 4, &minIndex, &maxIndex);
+
+  int bestError = 1 << 30;
+  int bestEndpoints[2][4] = {{0}};
+  int bestPBits[2] = {0, 0};
+  uint8_t bestIndices[16] = {0};
+
+  for (int pbits = 0; pbits < 4; pbits++) {
+    int p[2] = {pbits & 1, pbits >> 1};
+    int endpoints[2][4];
+    int colors[2][4];
+    for (int c = 0; c < 4; c++) {
+      const uint8_t* source[2] = {block[minIndex], block[maxIndex]};
+      for (int e = 0; e < 2; e++) {
+        int q = (source[e][c] - p[e] + 1) / 2;
+        endpoints[e][c] = q < 0 ? 0 : (q > 127 ? 127 : q);
+        colors[e][c] = (endpoints[e][c] << 1) | p[e];
+      }
+    }
+
+    int palette[16][4];
+    for (int w = 0; w < 16; w++) {
+      for (int c = 0; c < 4; c++) {
+        palette[w][c] = ((64 - BC7_WEIGHTS[w]) * colors[0][c] +
+                         BC7_WEIGHTS[w] * colors[1][c] + 32) >>
+                        6;
+      }
+    }
+
+    int error = 0;
+    uint8_t indices[16];
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      int bestTexel = 1 << 30;
+      for (int w = 0; w < 16; w++) {
+        int e = 0;
+        for (int c = 0; c < 4; c++) {
+          int d = block[i][c] - palette[w][c];
+          e += d * d;
+        }
+        if (e < bestTexel) bestTexel = e, best = w;
+      }
+      indices[i] = (uint8_t)best;
+      error += bestTexel;
+    }
+
+    if (error < bestError) {
+      bestError = error;
+      memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+      memcpy(bestIndices, indices, sizeof(indices));
+      bestPBits[0] = p[0];
+      bestPBits[1] = p[1];
+    }
+  }
+
+  // The first index is stored with 3 bits, its top bit must be zero
+  if (bestIndices[0] >= 8) {
+    for (int c = 0; c < 4; c++) {
+      int swap = bestEndpoints[0][c];
+      bestEndpoints[0][c] = bestEndpoints[1][c];
+      bestEndpoints[1][c] = swap;
+    }
+    int swap = bestPBits[0];
+    bestPBits[0] = bestPBits[1];
+    bestPBits[1] = swap;
+    for (int i = 0; i < 16; i++) bestIndices[i] = 15 - bestIndices[i];
+  }
+
+  memset(out, 0, 16);
+  uint32_t pos = 0;
+  bc_put_bits(out, &pos, 1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    bc_put_bits(out, &pos, bestEndpoints[0][c], 7);
+    bc_put_bits(out, &pos, bestEndpoints[1][c], 7);
+  }
+  bc_put_bits(out, &pos, bestPBits[0], 1);
+  bc_put_bits(out, &pos, bestPBits[1], 1);
+  bc_put_bits(out, &pos, bestIndices[0], 3);
+  for (int i = 1; i < 16; i++) bc_put_bits(out, &pos, bestIndices[i], 4);
+}
+
+static uint16_t bc_pack_565(const uint8_t color[4]) {
+  return (uint16_t)(((color[0] * 31 + 127) / 255) << 11 |
+                    ((color[1] * 63 + 127) / 255) << 5 |
+                    ((color[2] * 31 + 127) / 255));
+}
+
+static void bc_unpack_565(uint16_t packed, int color[3]) {
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+// Appends `count` bits of `value`, least significant first
+static void bc_put_bits(uint8_t* out, uint32_t* pos, uint32_t value,
+                        uint32_t count) {
+  for (uint32_t i = 0; i < count; i++, (*pos)++) {
+    if (value >> i & 1) out[*pos / 8] |= (uint8_t)(1 << (*pos % 8));
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef BC_H
+#define BC_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "job.h"
+
+// Block-compressed formats, 4x4 texels per block
+typedef enum {
+  BC_NONE,  // raw 8-bit channels
+  BC1,      // RGB, 8 bytes per block
+  BC3,      // RGBA, BC1 colour plus a BC4 alpha block
+  BC4,      // one channel, 8 bytes per block
+  BC5,      // two channels, two BC4 blocks
+  BC7,      // RGBA, mode 6 only: one subset, 4-bit indices
+  NUM_BC_FORMATS,
+} BCFormat;
+
+size_t bc_block_bytes(BCFormat format);
+// Bytes of one mip level, partial blocks included
+size_t bc_level_size(BCFormat format, int32_t width, int32_t height);
+GLenum bc_gl_format(BCFormat format, bool srgb);
+const char* bc_name(BCFormat format);
+
+// Encodes one level of 8-bit `pixels` with `channels` channels. Block rows
+// are spread over the pool, NULL encodes on the calling thread. Missing
+// channels read as grey (one channel) or zero, alpha as opaque.
+void bc_encode(BCFormat format, const uint8_t* pixels, int32_t width,
+               int32_t height, int32_t channels, uint8_t* out, JobPool* pool);
+
+#endif  // BC_H
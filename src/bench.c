@@ -0,0 +1,1003 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#include "animation.h"
+#include "bvh.h"
+#include "cglm/struct/affine.h"
+#include "cglm/struct/cam.h"
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/quat.h"
+#include "cglm/struct/vec3.h"
+#include "cglm/struct/vec4.h"
+#include "clip.h"
+#include "cull.h"
+#include "job.h"
+#include "mesh.h"
+#include "mip.h"
+#include "raster.h"
+#include "render.h"
+#include "scene.h"
+#include "texture.h"
+
+typedef struct {
+  const char* name;
+  void (*func)(JobPool* pool);
+} Benchmark;
+
+// Privates
+static double bench_now(void);
+static float bench_random(void);
+static void bench_make_character(Arena* arena, Scene* scene,
+                                 Skeleton* skeleton, AnimationClip* clip,
+                                 uint32_t numBones, uint32_t numKeys);
+static void bench_animation(JobPool* pool);
+static bool bench_check_influences(void);
+static void bench_bvh(JobPool* pool);
+static void bench_clip(JobPool* pool);
+static void bench_cull(JobPool* pool);
+static void bench_decode(JobPool* pool);
+static void bench_decode_range(void* data, uint32_t begin, uint32_t end);
+static void bench_mips(JobPool* pool);
+static float bench_coverage(const uint8_t* pixels, int32_t size);
+static void bench_queue(JobPool* pool);
+static void bench_queue_range(void* data, uint32_t begin, uint32_t end);
+static int bench_compare_keys(const void* a, const void* b);
+static void bench_count_changes(const RenderQueue* queue, uint64_t changes[3]);
+static void bench_raster(JobPool* pool);
+
+static const Benchmark BENCHMARKS[] = {
+    {"animation", bench_animation},
+    {"bvh", bench_bvh},
+    {"clip", bench_clip},
+    {"cull", bench_cull},
+    {"decode", bench_decode},
+    {"mips", bench_mips},
+    {"queue", bench_queue},
+    {"raster", bench_raster},
+};
+#define NUM_BENCHMARKS (sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]))
+
+int bench_run(int argc, char** argv) {
+  JobPool* pool = job_pool_create(0);
+  printf("bench: %u worker threads + caller\n", pool->numThreads);
+
+  bool found = argc == 0;
+  for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+    bool selected = argc == 0;
+    for (int i = 0; i < argc; i++) {
+      if (strcmp(argv[i], BENCHMARKS[b].name) == 0) selected = true;
+    }
+    if (!selected) continue;
+
+    found = true;
+    printf("== %s\n", BENCHMARKS[b].name);
+    BENCHMARKS[b].func(pool);
+  }
+
+  job_pool_destroy(pool);
+
+  if (!found) {
+    fprintf(stderr, "ERROR: Unknown benchmark, available:");
+    for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+      fprintf(stderr, " %s", BENCHMARKS[b].name);
+    }
+    fprintf(stderr, "\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// ------------------------------------------------------------------------
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static float bench_random(void) {
+  return (float)rand() / (float)RAND_MAX;
+}
+
+// A chain of bones, each hanging off the previous one and swinging around a
+// random axis. Positions and scales are keyed but constant, like most
+// exported rigs.
+static void bench_make_character(Arena* arena, Scene* scene,
+                                 Skeleton* skeleton, AnimationClip* clip,
+                                 uint32_t numBones, uint32_t numKeys) {
+  *skeleton = (Skeleton){
+      .nodes = arena_new(arena, int32_t, numBones),
+      .offsets = arena_new(arena, mat4s, numBones),
+      .numBones = numBones,
+  };
+  *clip = (AnimationClip){
+      .channels = arena_new(arena, AnimationChannel, numBones),
+      .numChannels = numBones,
+      .duration = 2.0f,
+  };
+
+  for (uint32_t b = 0; b < numBones; b++) {
+    skeleton->nodes[b] =
+        scene_add_node(scene, (int32_t)b - 1, (vec3s){{0.0f, 0.1f, 0.0f}},
+                       glms_quat_identity(), glms_vec3_one());
+    skeleton->offsets[b] = glms_mat4_identity();
+
+    AnimationChannel* channel = &clip->channels[b];
+    *channel = (AnimationChannel){
+        .node = (int32_t)b,
+        .positions = arena_new(arena, VectorKey, numKeys),
+        .rotations = arena_new(arena, QuatKey, numKeys),
+        .scales = arena_new(arena, VectorKey, numKeys),
+        .numPositions = numKeys,
+        .numRotations = numKeys,
+        .numScales = numKeys,
+    };
+
+    vec3s axis = glms_vec3_normalize(
+        (vec3s){{bench_random(), 1.0f, bench_random()}});
+    float phase = bench_random() * 2.0f * GLM_PIf;
+    for (uint32_t k = 0; k < numKeys; k++) {
+      float time = clip->duration * k / (numKeys - 1);
+      float angle = 0.6f * sinf(phase + time * GLM_PIf);
+      channel->positions[k] = (VectorKey){time, {{0.0f, 0.1f, 0.0f}}};
+      channel->rotations[k] = (QuatKey){time, glms_quatv(angle, axis)};
+      channel->scales[k] = (VectorKey){time, glms_vec3_one()};
+    }
+  }
+  scene_update(scene);
+}
+
+// Characters per millisecond for a 64 bone humanoid-sized skeleton with every
+// bone animated by 60 keys per track
+static void bench_animation(JobPool* pool) {
+  enum { NUM_BONES = 64, NUM_KEYS = 60, NUM_CHARACTERS = 2048, FRAMES = 20 };
+
+  Arena arena = arena_create(0);
+  Scene scene = scene_create(NUM_BONES);
+  Skeleton skeleton;
+  AnimationClip clip;
+  bench_make_character(&arena, &scene, &skeleton, &clip, NUM_BONES, NUM_KEYS);
+
+  Animator* animators = malloc(NUM_CHARACTERS * sizeof(Animator));
+  for (int i = 0; i < NUM_CHARACTERS; i++) {
+    animators[i] = animator_create(&scene, &skeleton, &clip);
+    animators[i].time = clip.duration * bench_random();
+  }
+
+  double start = bench_now();
+  for (int f = 0; f < FRAMES; f++) {
+    for (int i = 0; i < NUM_CHARACTERS; i++) {
+      animator_update(&animators[i], 1.0f / 60.0f);
+    }
+  }
+  double serial = bench_now() - start;
+
+  start = bench_now();
+  for (int f = 0; f < FRAMES; f++) {
+    animator_update_many(pool, animators, NUM_CHARACTERS, 1.0f / 60.0f);
+  }
+  double parallel = bench_now() - start;
+
+  if (!bench_check_influences()) {
+    fprintf(stderr, "ERROR: bones past MAX_BONES reached the vertices\n");
+  }
+
+  double evaluated = (double)NUM_CHARACTERS * FRAMES;
+  printf("  %d bones, %d keys/track\n", NUM_BONES, NUM_KEYS);
+  printf("  single thread: %8.1f characters/ms\n", evaluated / serial);
+  printf("  worker pool:   %8.1f characters/ms (%.2fx)\n",
+         evaluated / parallel, serial / parallel);
+
+  for (int i = 0; i < NUM_CHARACTERS; i++) {
+    animator_destroy(&animators[i]);
+  }
+  free(animators);
+  scene_destroy(&scene);
+  arena_destroy(&arena);
+}
+
+// Vertices of a rig with more bones than the palette holds: influences of
+// bones past it are dropped, what is left still sums to one
+static bool bench_check_influences(void) {
+  int ids[MAX_BONE_INFLUENCE] = {0};
+  float weights[MAX_BONE_INFLUENCE] = {0};
+  bool ok = animation_add_influence(ids, weights, 3, 0.2f);
+  ok = animation_add_influence(ids, weights, MAX_BONES - 1, 0.2f) && ok;
+  ok = !animation_add_influence(ids, weights, MAX_BONES, 0.5f) && ok;
+  ok = !animation_add_influence(ids, weights, MAX_BONES + 7, 0.1f) && ok;
+  animation_normalize_influences(weights);
+
+  float total = 0.0f;
+  for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+    if (ids[i] < 0 || ids[i] >= MAX_BONES) ok = false;
+    total += weights[i];
+  }
+  if (fabsf(total - 1.0f) > 1e-5f) ok = false;
+
+  // Only bones past the palette, the vertex keeps its bind pose
+  int lostIds[MAX_BONE_INFLUENCE] = {0};
+  float lost[MAX_BONE_INFLUENCE] = {0};
+  animation_add_influence(lostIds, lost, MAX_BONES + 1, 1.0f);
+  animation_normalize_influences(lost);
+  for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+    if (lostIds[i] != 0 || lost[i] != 0.0f) ok = false;
+  }
+
+  return ok;
+}
+
+// Build, refit and query costs of a tree over boxes scattered like
+// bench_cull's, against testing every box
+static void bench_bvh(JobPool* pool) {
+  (void)pool;
+  enum { NUM_OBJECTS = 100000, FRAMES = 20, MOVED = NUM_OBJECTS / 10 };
+  enum { QUERIES = 10000 };
+
+  vec3s(*aabbs)[2] = malloc(NUM_OBJECTS * sizeof(*aabbs));
+  for (int i = 0; i < NUM_OBJECTS; i++) {
+    vec3s center = {{(bench_random() - 0.5f) * 1000.0f,
+                     (bench_random() - 0.5f) * 200.0f,
+                     (bench_random() - 0.5f) * 1000.0f}};
+    vec3s extent = glms_vec3_scale(
+        (vec3s){{bench_random(), bench_random(), bench_random()}}, 2.0f);
+    aabbs[i][0] = glms_vec3_sub(center, extent);
+    aabbs[i][1] = glms_vec3_add(center, extent);
+  }
+  int32_t* leaves = malloc(NUM_OBJECTS * sizeof(int32_t));
+  uint32_t* objects = malloc(NUM_OBJECTS * sizeof(uint32_t));
+
+  Bvh bvh = bvh_create(0, 0.1f);
+  double start = bench_now();
+  bvh_build(&bvh, (const vec3s(*)[2])aabbs, NUM_OBJECTS, leaves);
+  double buildTime = bench_now() - start;
+  float buildCost = bvh_cost(&bvh);
+  int32_t buildHeight = bvh_height(&bvh);
+
+  // A tenth of the objects wander every frame
+  start = bench_now();
+  for (int f = 0; f < FRAMES; f++) {
+    for (int m = 0; m < MOVED; m++) {
+      int i = rand() % NUM_OBJECTS;
+      vec3s step = glms_vec3_scale(
+          (vec3s){{bench_random() - 0.5f, bench_random() - 0.5f,
+                   bench_random() - 0.5f}},
+          2.0f);
+      aabbs[i][0] = glms_vec3_add(aabbs[i][0], step);
+      aabbs[i][1] = glms_vec3_add(aabbs[i][1], step);
+      bvh_update(&bvh, leaves[i], aabbs[i]);
+    }
+  }
+  double refitTime = (bench_now() - start) / FRAMES;
+  float refitCost = bvh_cost(&bvh);
+  int32_t refitHeight = bvh_height(&bvh);
+
+  // Frustum queries against the flat SIMD pass over the same boxes
+  CullBounds bounds = cull_bounds_create(NUM_OBJECTS);
+  for (int i = 0; i < NUM_OBJECTS; i++) {
+    cull_bounds_add_aabb(&bounds, aabbs[i], glms_mat4_identity());
+  }
+  mat4s projection = glms_perspective(glm_rad(45.0f), 16.0f / 9.0f, 0.1f,
+                                      200.0f);
+  double treeTime = 0.0;
+  double flatTime = 0.0;
+  uint64_t treeVisible = 0;
+  uint64_t flatVisible = 0;
+  for (int f = 0; f < FRAMES; f++) {
+    float yaw = 2.0f * GLM_PIf * f / FRAMES;
+    mat4s view = glms_lookat(glms_vec3_zero(),
+                             (vec3s){{sinf(yaw), -0.1f, -cosf(yaw)}},
+                             (vec3s){{0.0f, 1.0f, 0.0f}});
+    CullFrustum frustum = cull_frustum_create(glms_mat4_mul(projection, view));
+
+    start = bench_now();
+    treeVisible += bvh_query_frustum(&bvh, &frustum, objects, NUM_OBJECTS);
+    treeTime += bench_now() - start;
+
+    start = bench_now();
+    flatVisible += cull_run(&frustum, &bounds, CULL_AABB, objects);
+    flatTime += bench_now() - start;
+  }
+  cull_bounds_destroy(&bounds);
+
+  uint32_t hits = 0;
+  start = bench_now();
+  for (int q = 0; q < QUERIES; q++) {
+    vec3s origin = {{(bench_random() - 0.5f) * 1000.0f, 0.0f,
+                     (bench_random() - 0.5f) * 1000.0f}};
+    vec3s direction = {{bench_random() - 0.5f, bench_random() - 0.5f,
+                        bench_random() - 0.5f}};
+    BvhHit hit;
+    hits += bvh_query_ray(&bvh, origin, direction, 1000.0f, &hit);
+  }
+  double rayTime = bench_now() - start;
+
+  uint64_t found = 0;
+  start = bench_now();
+  for (int q = 0; q < QUERIES; q++) {
+    vec3s center = {{(bench_random() - 0.5f) * 1000.0f,
+                     (bench_random() - 0.5f) * 200.0f,
+                     (bench_random() - 0.5f) * 1000.0f}};
+    found += bvh_query_sphere(&bvh, center, 10.0f, objects, NUM_OBJECTS);
+  }
+  double sphereTime = bench_now() - start;
+
+  start = bench_now();
+  bvh_build(&bvh, (const vec3s(*)[2])aabbs, NUM_OBJECTS, leaves);
+  double rebuildTime = bench_now() - start;
+
+  printf("  %d objects\n", NUM_OBJECTS);
+  printf("  build:         %8.2f ms, height %d, cost %.1f\n", buildTime,
+         buildHeight, buildCost);
+  printf("  %d moved:   %8.2f ms/frame, height %d, cost %.1f, %u refits, "
+         "%u rotations\n",
+         MOVED, refitTime, refitHeight, refitCost, bvh.numRefits,
+         bvh.numRotations);
+  printf("  frustum:       %8.3f ms/frame tree, %.3f flat, %.0f visible\n",
+         treeTime / FRAMES, flatTime / FRAMES, (double)treeVisible / FRAMES);
+  printf("  ray:           %8.2f us/query, %u of %d hit\n",
+         rayTime / QUERIES * 1e3, hits, QUERIES);
+  printf("  sphere r=10:   %8.2f us/query, %.1f found\n",
+         sphereTime / QUERIES * 1e3, (double)found / QUERIES);
+  printf("  rebuild:       %8.2f ms\n", rebuildTime);
+  if (treeVisible < flatVisible) {
+    fprintf(stderr, "ERROR: Tree found fewer boxes than the flat pass\n");
+  }
+
+  bvh_destroy(&bvh);
+  free(objects);
+  free(leaves);
+  free(aabbs);
+}
+
+// Memory footprint and sampling cost of a compressed clip against the raw
+// keys, plus the worst error the compression introduced
+static void bench_clip(JobPool* pool) {
+  (void)pool;
+  enum { NUM_BONES = 64, NUM_KEYS = 60, LOOPS = 200, STEPS = 120 };
+
+  Arena arena = arena_create(0);
+  Scene scene = scene_create(NUM_BONES);
+  Skeleton skeleton;
+  AnimationClip clip;
+  bench_make_character(&arena, &scene, &skeleton, &clip, NUM_BONES, NUM_KEYS);
+
+  ClipTolerance tolerance = {
+      .positionError = 0.0005f,
+      .rotationError = 0.001f,
+      .scaleError = 0.0005f,
+  };
+  double start = bench_now();
+  CompressedClip compressed = clip_compress(&clip, tolerance);
+  double compressTime = bench_now() - start;
+
+  vec3s* positions = malloc(NUM_BONES * sizeof(vec3s));
+  versors* rotations = aligned_alloc(16, NUM_BONES * sizeof(versors));
+  vec3s* scales = malloc(NUM_BONES * sizeof(vec3s));
+  float step = clip.duration / STEPS;
+
+  // Binary search per track, every frame
+  start = bench_now();
+  for (int l = 0; l < LOOPS; l++) {
+    for (int s = 0; s <= STEPS; s++) {
+      for (uint32_t c = 0; c < clip.numChannels; c++) {
+        animation_sample_channel(&clip.channels[c], s * step, &positions[c],
+                                 &rotations[c], &scales[c]);
+      }
+    }
+  }
+  double searchTime = bench_now() - start;
+
+  // Cursor walking the stream, restarting once per loop
+  ClipCursor cursor = clip_cursor_create(&compressed);
+  start = bench_now();
+  for (int l = 0; l < LOOPS; l++) {
+    for (int s = 0; s <= STEPS; s++) {
+      clip_cursor_sample(&cursor, s * step, positions, rotations, scales);
+    }
+  }
+  double cursorTime = bench_now() - start;
+
+  float maxPosition = 0.0f;
+  float maxRotation = 0.0f;
+  clip_cursor_reset(&cursor);
+  for (int s = 0; s <= STEPS; s++) {
+    clip_cursor_sample(&cursor, s * step, positions, rotations, scales);
+    for (uint32_t c = 0; c < clip.numChannels; c++) {
+      vec3s position;
+      versors rotation;
+      vec3s scale;
+      animation_sample_channel(&clip.channels[c], s * step, &position,
+                               &rotation, &scale);
+
+      float dp = glms_vec3_distance(position, positions[c]);
+      float dr = clip_rotation_error(rotation, rotations[c]);
+      if (dp > maxPosition) maxPosition = dp;
+      if (dr > maxRotation) maxRotation = dr;
+    }
+  }
+
+  if (maxRotation > tolerance.rotationError + CLIP_ROTATION_QUANTIZATION) {
+    fprintf(stderr, "ERROR: compressed rotations drift past the tolerance\n");
+  }
+
+  size_t rawSize = clip_uncompressed_memory_size(&clip);
+  size_t packedSize = clip_memory_size(&compressed);
+  uint32_t rawKeys = NUM_BONES * NUM_KEYS * 3;
+  double samples = (double)LOOPS * (STEPS + 1) * NUM_BONES;
+
+  printf("  %d bones, %d keys/track\n", NUM_BONES, NUM_KEYS);
+  printf("  keys:          %8u -> %u\n", rawKeys, compressed.numKeys);
+  printf("  memory:        %8zu -> %zu bytes (%.1fx)\n", rawSize, packedSize,
+         (double)rawSize / packedSize);
+  printf("  compress:      %8.2f ms\n", compressTime);
+  printf("  binary search: %8.1f channels/us\n", samples / searchTime / 1e3);
+  printf("  cursor:        %8.1f channels/us (%.2fx)\n",
+         samples / cursorTime / 1e3, searchTime / cursorTime);
+  printf("  max error:     %8.5f units, %.5f rad\n", maxPosition, maxRotation);
+
+  clip_cursor_destroy(&cursor);
+  free(positions);
+  free(rotations);
+  free(scales);
+  clip_destroy(&compressed);
+  scene_destroy(&scene);
+  arena_destroy(&arena);
+}
+
+// Frustum tests of a million boxes and spheres scattered around a camera,
+// with every kernel the CPU runs and across the worker pool
+static void bench_cull(JobPool* pool) {
+  enum { NUM_OBJECTS = 1000000, FRAMES = 20 };
+  static const char* const KERNELS[] = {"scalar", "sse", "avx"};
+  static const struct {
+    const char* name;
+    CullShape shape;
+  } SHAPES[] = {{"aabb", CULL_AABB}, {"sphere", CULL_SPHERE}};
+
+  CullBounds bounds = cull_bounds_create(NUM_OBJECTS);
+  for (int i = 0; i < NUM_OBJECTS; i++) {
+    vec3s center = {{(bench_random() - 0.5f) * 1000.0f,
+                     (bench_random() - 0.5f) * 200.0f,
+                     (bench_random() - 0.5f) * 1000.0f}};
+    vec3s extent = glms_vec3_scale(
+        (vec3s){{bench_random(), bench_random(), bench_random()}}, 2.0f);
+    vec3s aabb[2] = {glms_vec3_sub(center, extent),
+                     glms_vec3_add(center, extent)};
+    cull_bounds_add_aabb(&bounds, aabb, glms_mat4_identity());
+  }
+  uint32_t* visible = malloc(NUM_OBJECTS * sizeof(uint32_t));
+
+  // The camera turns a little every frame so the planes never repeat
+  CullFrustum frustums[FRAMES];
+  mat4s projection = glms_perspective(glm_rad(45.0f), 16.0f / 9.0f, 0.1f,
+                                      500.0f);
+  for (int f = 0; f < FRAMES; f++) {
+    float yaw = 2.0f * GLM_PIf * f / FRAMES;
+    mat4s view = glms_lookat(glms_vec3_zero(),
+                             (vec3s){{sinf(yaw), -0.1f, -cosf(yaw)}},
+                             (vec3s){{0.0f, 1.0f, 0.0f}});
+    frustums[f] = cull_frustum_create(glms_mat4_mul(projection, view));
+  }
+
+  const char* detected = cull_kernel_name();
+  printf("  %d objects\n", NUM_OBJECTS);
+  for (size_t s = 0; s < sizeof(SHAPES) / sizeof(SHAPES[0]); s++) {
+    double scalar = 0.0;
+    uint64_t expected = 0;
+    for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+      if (!cull_use_kernel(KERNELS[k])) continue;
+
+      uint64_t total = 0;
+      double start = bench_now();
+      for (int f = 0; f < FRAMES; f++) {
+        total += cull_run(&frustums[f], &bounds, SHAPES[s].shape, visible);
+      }
+      double serial = (bench_now() - start) / FRAMES;
+
+      uint64_t parallelTotal = 0;
+      start = bench_now();
+      for (int f = 0; f < FRAMES; f++) {
+        parallelTotal += cull_run_parallel(pool, &frustums[f], &bounds,
+                                           SHAPES[s].shape, visible);
+      }
+      double parallel = (bench_now() - start) / FRAMES;
+
+      if (k == 0) {
+        scalar = serial;
+        expected = total;
+      }
+      if (total != expected || parallelTotal != expected) {
+        fprintf(stderr, "ERROR: %s kernel disagrees on visible %ss\n",
+                KERNELS[k], SHAPES[s].name);
+      }
+
+      printf("  %-6s %-6s %6.2f ms/frame (%.2fx), pool %6.2f ms/frame "
+             "(%.2fx), %.1f%% visible\n",
+             SHAPES[s].name, KERNELS[k], serial, scalar / serial, parallel,
+             scalar / parallel, 100.0 * total / ((double)FRAMES * NUM_OBJECTS));
+    }
+  }
+  cull_use_kernel(detected);
+
+  free(visible);
+  cull_bounds_destroy(&bounds);
+}
+
+typedef struct {
+  const char* const* paths;
+  TextureImage* images;
+} DecodeBatch;
+
+// Image decode throughput of the bundled textures, one file per job
+static void bench_decode(JobPool* pool) {
+  enum { ROUNDS = 3 };
+  static const char* const PATHS[] = {
+      "./textures/posx.jpg",          "./textures/negx.jpg",
+      "./textures/posy.jpg",          "./textures/negy.jpg",
+      "./textures/posz.jpg",          "./textures/negz.jpg",
+      "./textures/container2.png",    "./textures/container2_specular.png",
+      "./textures/container.jpg",     "./textures/awesomeface.png",
+      "./textures/matrix.jpg",
+  };
+  enum { NUM_IMAGES = sizeof(PATHS) / sizeof(PATHS[0]) };
+
+  TextureImage images[NUM_IMAGES];
+  DecodeBatch batch = {.paths = PATHS, .images = images};
+
+  // The last parallel round keeps its images for the totals below
+  double serial = 0.0;
+  double parallel = 0.0;
+  for (int r = 0; r < ROUNDS; r++) {
+    double start = bench_now();
+    bench_decode_range(&batch, 0, NUM_IMAGES);
+    serial += bench_now() - start;
+    for (int i = 0; i < NUM_IMAGES; i++) texture_image_free(&images[i]);
+
+    start = bench_now();
+    job_pool_parallel_for(pool, NUM_IMAGES, 1, bench_decode_range, &batch);
+    parallel += bench_now() - start;
+    if (r + 1 == ROUNDS) break;
+    for (int i = 0; i < NUM_IMAGES; i++) texture_image_free(&images[i]);
+  }
+  serial /= ROUNDS;
+  parallel /= ROUNDS;
+
+  size_t fileBytes = 0;
+  size_t pixelBytes = 0;
+  int decoded = 0;
+  for (int i = 0; i < NUM_IMAGES; i++) {
+    if (images[i].pixels == NULL) {
+      fprintf(stderr, "ERROR: Failed to decode %s\n", PATHS[i]);
+      continue;
+    }
+    fileBytes += images[i].fileBytes;
+    pixelBytes +=
+        (size_t)images[i].width * images[i].height * images[i].channels;
+    decoded++;
+    texture_image_free(&images[i]);
+  }
+
+  double mib = fileBytes / (1024.0 * 1024.0);
+  printf("  %d images, %.1f MiB encoded, %.1f MiB decoded\n", decoded, mib,
+         pixelBytes / (1024.0 * 1024.0));
+  printf("  single thread: %8.1f MiB/s %8.1f images/s\n", mib / serial * 1e3,
+         decoded / serial * 1e3);
+  printf("  worker pool:   %8.1f MiB/s %8.1f images/s (%.2fx)\n",
+         mib / parallel * 1e3, decoded / parallel * 1e3, serial / parallel);
+}
+
+static void bench_decode_range(void* data, uint32_t begin, uint32_t end) {
+  DecodeBatch* batch = data;
+  for (uint32_t i = begin; i < end; i++) {
+    texture_decode_file(batch->paths[i], &batch->images[i]);
+  }
+}
+
+// Mip chain of a 2048x2048 RGBA image with every kernel the CPU runs, for
+// each kind of filtering
+static void bench_mips(JobPool* pool) {
+  (void)pool;
+  enum { SIZE = 2048, ROUNDS = 3 };
+  static const char* const KERNELS[] = {"scalar", "sse2", "avx2"};
+  static const struct {
+    const char* name;
+    uint32_t flags;
+  } MODES[] = {
+      {"linear", 0},
+      {"sRGB", MIP_SRGB},
+      {"normal map", MIP_NORMAL_MAP},
+      {"alpha tested", MIP_SRGB | MIP_ALPHA_COVERAGE},
+  };
+
+  uint8_t* pixels = malloc((size_t)SIZE * SIZE * 4);
+  for (size_t i = 0; i < (size_t)SIZE * SIZE * 4; i++) {
+    pixels[i] = (uint8_t)(bench_random() * 255.0f);
+  }
+
+  const char* detected = mip_kernel_name();
+  double texels = SIZE * SIZE * 4.0 / 3.0;
+  for (size_t m = 0; m < sizeof(MODES) / sizeof(MODES[0]); m++) {
+    double scalar = 0.0;
+    for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+      if (!mip_use_kernel(KERNELS[k])) continue;
+
+      double elapsed = 0.0;
+      for (int r = 0; r < ROUNDS; r++) {
+        double start = bench_now();
+        free(mip_build_chain(pixels, SIZE, SIZE, 4, MODES[m].flags));
+        elapsed += bench_now() - start;
+      }
+      elapsed /= ROUNDS;
+      if (k == 0) scalar = elapsed;
+
+      printf("  %-12s %-6s %8.2f ms %8.1f Mtexels/s (%.2fx)\n",
+             MODES[m].name, KERNELS[k], elapsed, texels / elapsed / 1e3,
+             scalar / elapsed);
+    }
+  }
+  mip_use_kernel(detected);
+
+  // Cut-out alpha, scattered opaque texels over a transparent background
+  enum { CHECKED_LEVEL = 4 };
+  for (size_t i = 0; i < (size_t)SIZE * SIZE; i++) {
+    pixels[i * 4 + 3] = bench_random() < 0.3f ? 255 : 0;
+  }
+  uint8_t* kept = mip_build_chain(pixels, SIZE, SIZE, 4,
+                                  MIP_SRGB | MIP_ALPHA_COVERAGE);
+  uint8_t* plain = mip_build_chain(pixels, SIZE, SIZE, 4, MIP_SRGB);
+  size_t offset = mip_chain_size(SIZE, SIZE, 4) -
+                  mip_chain_size(SIZE >> CHECKED_LEVEL, SIZE >> CHECKED_LEVEL,
+                                 4);
+  int32_t size = SIZE >> CHECKED_LEVEL;
+  float base = bench_coverage(pixels, SIZE);
+  float keptCoverage = bench_coverage(kept + offset, size);
+  float plainCoverage = bench_coverage(plain + offset, size);
+  if (fabsf(keptCoverage - base) > 0.02f) {
+    fprintf(stderr, "ERROR: alpha tested mips lost their coverage\n");
+  }
+  printf("  alpha coverage %.1f%% at level 0, level %d %.1f%% kept, %.1f%% "
+         "plain\n",
+         base * 100.0f, CHECKED_LEVEL, keptCoverage * 100.0f,
+         plainCoverage * 100.0f);
+
+  free(kept);
+  free(plain);
+  free(pixels);
+}
+
+// Share of texels of a size x size RGBA level that pass a 0.5 alpha test
+static float bench_coverage(const uint8_t* pixels, int32_t size) {
+  size_t texels = (size_t)size * size;
+  size_t passed = 0;
+  for (size_t i = 0; i < texels; i++) passed += pixels[i * 4 + 3] >= 128;
+
+  return (float)passed / texels;
+}
+
+// Occluder triangles drawn per millisecond and bounds culled in a grid of
+// rooms, walls with a doorway between each pair, furniture boxes on the
+// floors and the camera turning in a room near the middle
+static void bench_raster(JobPool* pool) {
+  enum { ROOMS = 20, OBJECTS_PER_ROOM = 48, FRAMES = 32 };
+  static const char* const KERNELS[] = {"scalar", "sse", "avx"};
+  static const float ROOM_SIZE = 8.0f, WALL = 0.2f, HEIGHT = 3.0f;
+  static const float DOOR = 1.5f;
+  // Unit cube, counter-clockwise from outside
+  static const float CUBE_POSITIONS[] = {
+      0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+      0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+  };
+  static const uint32_t CUBE_INDICES[] = {
+      0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+      3, 7, 6, 3, 6, 2, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+  };
+
+  vec3s unitBox[2] = {{{0.0f, 0.0f, 0.0f}}, {{1.0f, 1.0f, 1.0f}}};
+
+  // Two wall pieces either side of each doorway, along x then along z
+  uint32_t numWalls = 0;
+  mat4s* walls = malloc(4 * (ROOMS + 1) * ROOMS * sizeof(mat4s));
+  for (int line = 0; line <= ROOMS; line++) {
+    for (int room = 0; room < ROOMS; room++) {
+      float across = line * ROOM_SIZE - WALL * 0.5f;
+      float along = room * ROOM_SIZE;
+      float piece = (ROOM_SIZE - DOOR) * 0.5f;
+      for (int side = 0; side < 2; side++) {
+        float start = along + side * (piece + DOOR);
+        walls[numWalls++] = glms_mat4_mul(
+            glms_translate_make((vec3s){{start, 0.0f, across}}),
+            glms_scale_make((vec3s){{piece, HEIGHT, WALL}}));
+        walls[numWalls++] = glms_mat4_mul(
+            glms_translate_make((vec3s){{across, 0.0f, start}}),
+            glms_scale_make((vec3s){{WALL, HEIGHT, piece}}));
+      }
+    }
+  }
+
+  CullBounds bounds = cull_bounds_create(ROOMS * ROOMS * OBJECTS_PER_ROOM);
+  for (int room = 0; room < ROOMS * ROOMS; room++) {
+    float x = (room % ROOMS) * ROOM_SIZE;
+    float z = (room / ROOMS) * ROOM_SIZE;
+    for (int i = 0; i < OBJECTS_PER_ROOM; i++) {
+      vec3s size = {{0.2f + 0.6f * bench_random(), 0.2f + bench_random(),
+                     0.2f + 0.6f * bench_random()}};
+      vec3s min = {{x + 0.5f + (ROOM_SIZE - 2.0f) * bench_random(), 0.0f,
+                    z + 0.5f + (ROOM_SIZE - 2.0f) * bench_random()}};
+      vec3s aabb[2] = {min, glms_vec3_add(min, size)};
+      cull_bounds_add_aabb(&bounds, aabb, glms_mat4_identity());
+    }
+  }
+  uint32_t* visible = malloc(bounds.count * sizeof(uint32_t));
+
+  mat4s projection = glms_perspective(
+      glm_rad(60.0f), (float)RASTER_WIDTH / RASTER_HEIGHT, 0.1f, 200.0f);
+  mat4s viewProjections[FRAMES];
+  float middle = (ROOMS / 2 + 0.5f) * ROOM_SIZE;
+  for (int f = 0; f < FRAMES; f++) {
+    float yaw = 2.0f * GLM_PIf * f / FRAMES;
+    vec3s eye = {{middle + 1.0f, 1.6f, middle - 1.0f}};
+    mat4s view = glms_look(eye, (vec3s){{sinf(yaw), -0.05f, -cosf(yaw)}},
+                           (vec3s){{0.0f, 1.0f, 0.0f}});
+    viewProjections[f] = glms_mat4_mul(projection, view);
+  }
+
+  Raster raster = raster_create();
+  const char* detected = raster_kernel_name();
+  printf("  %ux%u, %u occluders with %u triangles, %u objects\n",
+         RASTER_WIDTH, RASTER_HEIGHT, numWalls, numWalls * 12, bounds.count);
+  double scalar = 0.0;
+  uint64_t expected = 0;
+  for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+    if (!raster_use_kernel(KERNELS[k])) continue;
+
+    double serial = 0.0, parallel = 0.0, testing = 0.0;
+    uint64_t inFrustum = 0, unoccluded = 0;
+    RasterStats before = raster_get_stats();
+    for (int f = 0; f < FRAMES; f++) {
+      // Walls outside the frustum are left out, as a renderer would
+      CullFrustum frustum = cull_frustum_create(viewProjections[f]);
+      raster_begin(&raster, viewProjections[f]);
+      for (uint32_t w = 0; w < numWalls; w++) {
+        if (!cull_test_aabb(&frustum, unitBox, walls[w])) continue;
+        RasterOccluder occluder = {
+            .positions = CUBE_POSITIONS,
+            .stride = 3 * sizeof(float),
+            .numVertices = 8,
+            .indices = CUBE_INDICES,
+            .numTriangles = 12,
+            .world = walls[w],
+        };
+        raster_add_occluder(&raster, &occluder);
+      }
+
+      double start = bench_now();
+      raster_render(&raster, NULL);
+      serial += bench_now() - start;
+      start = bench_now();
+      raster_render(&raster, pool);
+      parallel += bench_now() - start;
+
+      uint32_t count = cull_run(&frustum, &bounds, CULL_AABB, visible);
+      start = bench_now();
+      inFrustum += count;
+      unoccluded += raster_test_bounds(&raster, &bounds, visible, count);
+      testing += bench_now() - start;
+    }
+    RasterStats after = raster_get_stats();
+    // Each frame rendered twice
+    double submitted = (after.triangles - before.triangles) * 0.5;
+    double drawn = (after.rasterized - before.rasterized) * 0.5;
+
+    if (k == 0) {
+      scalar = serial;
+      expected = unoccluded;
+    }
+    if (unoccluded != expected) {
+      fprintf(stderr, "ERROR: %s kernel disagrees on visible objects\n",
+              KERNELS[k]);
+    }
+
+    printf("  %-6s %6.3f ms/frame (%.2fx), pool %6.3f ms/frame (%.2fx), "
+           "%.0f triangles/frame, %.0f drawn/ms\n",
+           KERNELS[k], serial / FRAMES, scalar / serial, parallel / FRAMES,
+           scalar / parallel, submitted / FRAMES, drawn / serial);
+    printf("         tests %6.3f ms/frame, %.1f%% of objects in the "
+           "frustum, %.1f%% of those occluded\n",
+           testing / FRAMES,
+           100.0 * inFrustum / ((double)FRAMES * bounds.count),
+           inFrustum > 0 ? 100.0 * (inFrustum - unoccluded) / inFrustum
+                         : 0.0);
+  }
+  raster_use_kernel(detected);
+
+  raster_destroy(&raster);
+  free(visible);
+  cull_bounds_destroy(&bounds);
+  free(walls);
+}
+
+typedef struct {
+  RenderQueue* queue;
+  RenderBuffer* buffers;
+  const RenderPacket* packets;
+  const vec3s* centers;
+} QueueBatch;
+
+// Packets per bench_queue_range job
+#define BENCH_QUEUE_PACKETS 1024
+
+// A frame of draws in scene order: objects spread over a few programs,
+// many materials and VAOs, scattered in depth. Submitted on one thread and
+// built into per-job buffers on the pool, radix sorted against qsort on the
+// same keys, then recorded into command lists on one thread and on the
+// pool. Runs without a GL context, so the lists are never replayed.
+static void bench_queue(JobPool* pool) {
+  enum { NUM_PACKETS = 20000, PROGRAMS = 4, MATERIALS = 200, VAOS = 64 };
+  enum { FRAMES = 50 };
+
+  Shader shaders[PROGRAMS];
+  for (int p = 0; p < PROGRAMS; p++) shaders[p] = (Shader){.ID = p + 1};
+
+  RenderQueue queue = render_queue_create();
+  RenderQueue built = render_queue_create();
+  RenderPacket* packets = malloc(NUM_PACKETS * sizeof(RenderPacket));
+  vec3s* centers = malloc(NUM_PACKETS * sizeof(vec3s));
+  uint64_t* keys = malloc(NUM_PACKETS * sizeof(uint64_t));
+  double submit = 0.0, build = 0.0;
+  double radix = 0.0, sorted = 0.0;
+  double serial = 0.0, parallel = 0.0;
+  size_t bytes = 0;
+  uint64_t commands = 0;
+  uint64_t before[3] = {0}, after[3] = {0};
+  bool merged = true, ordered = true, recorded = true;
+  for (int f = 0; f < FRAMES; f++) {
+    srand(f + 1);
+    for (int i = 0; i < NUM_PACKETS; i++) {
+      packets[i] = (RenderPacket){
+          .shader = &shaders[rand() % PROGRAMS],
+          .VAO = 1 + rand() % VAOS,
+          .materialId = rand() % MATERIALS,
+          .mode = GL_TRIANGLES,
+          .count = 36,
+      };
+      centers[i] = (vec3s){{(bench_random() - 0.5f) * 200.0f, 0.0f,
+                            -bench_random() * 500.0f}};
+    }
+
+    double start = bench_now();
+    render_queue_begin(&queue, glms_vec3_zero(),
+                       (vec3s){{0.0f, 0.0f, -1.0f}}, 500.0f);
+    for (int i = 0; i < NUM_PACKETS; i++) {
+      render_queue_submit(&queue, i % 8 == 0 ? RENDER_PASS_BLENDED
+                                             : RENDER_PASS_OPAQUE,
+                          &packets[i], centers[i]);
+    }
+    submit += bench_now() - start;
+
+    start = bench_now();
+    render_queue_begin(&built, glms_vec3_zero(),
+                       (vec3s){{0.0f, 0.0f, -1.0f}}, 500.0f);
+    QueueBatch batch = {
+        .queue = &built,
+        .buffers = render_queue_buffers(
+            &built,
+            (NUM_PACKETS + BENCH_QUEUE_PACKETS - 1) / BENCH_QUEUE_PACKETS),
+        .packets = packets,
+        .centers = centers,
+    };
+    job_pool_parallel_for(pool, NUM_PACKETS, BENCH_QUEUE_PACKETS,
+                          bench_queue_range, &batch);
+    render_queue_merge(&built);
+    build += bench_now() - start;
+
+    for (int i = 0; i < NUM_PACKETS; i++) {
+      keys[i] = queue.items[i].key;
+      if (built.items[i].key != keys[i] || built.items[i].packet != (uint32_t)i) {
+        merged = false;
+      }
+    }
+    bench_count_changes(&queue, before);
+
+    start = bench_now();
+    render_queue_sort(&queue);
+    radix += bench_now() - start;
+    bench_count_changes(&queue, after);
+
+    start = bench_now();
+    qsort(keys, NUM_PACKETS, sizeof(uint64_t), bench_compare_keys);
+    sorted += bench_now() - start;
+
+    for (int i = 0; i < NUM_PACKETS; i++) {
+      if (queue.items[i].key != keys[i]) ordered = false;
+    }
+
+    start = bench_now();
+    render_queue_record(&queue, NULL);
+    serial += bench_now() - start;
+    size_t serialBytes = 0;
+    for (uint32_t l = 0; l < queue.numLists; l++) {
+      serialBytes += queue.lists[l].size;
+    }
+
+    start = bench_now();
+    render_queue_record(&queue, pool);
+    parallel += bench_now() - start;
+    size_t parallelBytes = 0;
+    for (uint32_t l = 0; l < queue.numLists; l++) {
+      parallelBytes += queue.lists[l].size;
+      commands += queue.lists[l].numCommands;
+    }
+    if (parallelBytes != serialBytes) recorded = false;
+    bytes += parallelBytes;
+  }
+  if (!merged) {
+    fprintf(stderr, "ERROR: pool built other packets than one thread\n");
+  }
+  if (!ordered) fprintf(stderr, "ERROR: radix sort disagrees with qsort\n");
+  if (!recorded) {
+    fprintf(stderr, "ERROR: pool recorded other commands than one thread\n");
+  }
+
+  printf("  %d packets: submit %6.3f ms/frame, pool build %6.3f ms/frame "
+         "(%.2fx)\n",
+         NUM_PACKETS, submit / FRAMES, build / FRAMES, submit / build);
+  printf("  %d packets: radix %6.3f ms/frame, qsort %6.3f ms/frame (%.2fx)\n",
+         NUM_PACKETS, radix / FRAMES, sorted / FRAMES, sorted / radix);
+  printf("  state changes/frame submitted -> sorted: %.0f -> %.0f programs, "
+         "%.0f -> %.0f materials, %.0f -> %.0f VAOs\n",
+         (double)before[0] / FRAMES, (double)after[0] / FRAMES,
+         (double)before[1] / FRAMES, (double)after[1] / FRAMES,
+         (double)before[2] / FRAMES, (double)after[2] / FRAMES);
+  printf("  record %6.3f ms/frame, pool %6.3f ms/frame (%.2fx), %.0f "
+         "commands in %.0f KiB\n",
+         serial / FRAMES, parallel / FRAMES, serial / parallel,
+         (double)commands / FRAMES, bytes / 1024.0 / FRAMES);
+
+  free(keys);
+  free(centers);
+  free(packets);
+  render_queue_destroy(&built);
+  render_queue_destroy(&queue);
+}
+
+// Keys packets [begin, end) into the slice's buffer
+static void bench_queue_range(void* data, uint32_t begin, uint32_t end) {
+  QueueBatch* batch = data;
+  RenderBuffer* buffer = &batch->buffers[begin / BENCH_QUEUE_PACKETS];
+  for (uint32_t i = begin; i < end; i++) {
+    render_buffer_submit(batch->queue, buffer,
+                         i % 8 == 0 ? RENDER_PASS_BLENDED : RENDER_PASS_OPAQUE,
+                         &batch->packets[i], batch->centers[i]);
+  }
+}
+
+static int bench_compare_keys(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+// Programs, materials and VAOs differing from the draw before, in item order
+static void bench_count_changes(const RenderQueue* queue,
+                                uint64_t changes[3]) {
+  const RenderPacket* last = NULL;
+  for (uint32_t i = 0; i < queue->numPackets; i++) {
+    const RenderPacket* packet = &queue->packets[queue->items[i].packet];
+    bool program = last == NULL || packet->shader != last->shader;
+    changes[0] += program;
+    changes[1] += program || packet->materialId != last->materialId;
+    changes[2] += last == NULL || packet->VAO != last->VAO;
+    last = packet;
+  }
+}
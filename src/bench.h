@@ -0,0 +1,8 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Headless CPU benchmarks, run with `a --bench [name...]`. Without names every
+// benchmark runs. Returns a process exit code.
+int bench_run(int argc, char** argv);
+
+#endif  // BENCH_H
@@ -0,0 +1,640 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bvh.h"
+
+#include "cglm/struct/vec3.h"
+
+// Query stacks live on the C stack up to this depth
+#define BVH_STACK 64
+// Centroid bins the build sweeps along the longest axis
+#define BVH_BINS 16
+
+typedef struct {
+  vec3s aabb[2];
+  vec3s centroid;
+  uint32_t object;
+  uint32_t index;  // into the build's aabbs and leaves
+} BvhBuildItem;
+
+// Privates
+static int32_t bvh_alloc_node(Bvh* bvh);
+static void bvh_free_node(Bvh* bvh, int32_t index);
+static void bvh_reserve(Bvh* bvh, uint32_t capacity);
+static int32_t bvh_build_range(Bvh* bvh, BvhBuildItem* items, uint32_t count,
+                               int32_t parent, int32_t* leaves);
+static void bvh_insert_leaf(Bvh* bvh, int32_t leaf);
+static void bvh_remove_leaf(Bvh* bvh, int32_t leaf);
+static void bvh_refit(Bvh* bvh, int32_t index);
+static void bvh_rotate(Bvh* bvh, int32_t index);
+static uint64_t* bvh_stack(const Bvh* bvh, uint64_t* local);
+static void bvh_merge(const vec3s a[2], const vec3s b[2], vec3s out[2]);
+static float bvh_area(const vec3s aabb[2]);
+static bool bvh_contains(const vec3s outer[2], const vec3s inner[2]);
+static bool bvh_overlaps(const vec3s a[2], const vec3s b[2]);
+static float bvh_ray_box(const vec3s aabb[2], vec3s origin, vec3s inverse,
+                         float maxDistance);
+
+static inline bool bvh_is_leaf(const BvhNode* node) {
+  return node->left == BVH_NULL_NODE;
+}
+
+Bvh bvh_create(uint32_t capacity, float margin) {
+  Bvh bvh = {
+      .root = BVH_NULL_NODE,
+      .freeList = BVH_NULL_NODE,
+      .margin = margin,
+  };
+  bvh_reserve(&bvh, capacity > 0 ? capacity : 16);
+
+  return bvh;
+}
+
+void bvh_destroy(Bvh* bvh) {
+  free(bvh->nodes);
+  *bvh = (Bvh){0};
+}
+
+// Top-down, one object per leaf. Each split is the bin boundary with the
+// lowest count-weighted surface area on either side.
+void bvh_build(Bvh* bvh, const vec3s (*aabbs)[2], uint32_t count,
+               int32_t* leaves) {
+  // Every node goes back on the free list, in index order
+  bvh_reserve(bvh, 2 * count);
+  for (uint32_t i = 0; i < bvh->capacity; i++) {
+    bvh->nodes[i].parent = i + 1 < bvh->capacity ? (int32_t)i + 1
+                                                  : BVH_NULL_NODE;
+    bvh->nodes[i].height = -1;
+  }
+  bvh->freeList = 0;
+  bvh->root = BVH_NULL_NODE;
+  bvh->numLeaves = count;
+  if (count == 0) return;
+
+  vec3s margin = glms_vec3_broadcast(bvh->margin);
+  BvhBuildItem* items = malloc(count * sizeof(BvhBuildItem));
+  for (uint32_t i = 0; i < count; i++) {
+    items[i] = (BvhBuildItem){
+        .aabb = {glms_vec3_sub(aabbs[i][0], margin),
+                 glms_vec3_add(aabbs[i][1], margin)},
+        .centroid =
+            glms_vec3_scale(glms_vec3_add(aabbs[i][0], aabbs[i][1]), 0.5f),
+        .object = i,
+        .index = i,
+    };
+  }
+
+  bvh->root = bvh_build_range(bvh, items, count, BVH_NULL_NODE, leaves);
+  free(items);
+}
+
+int32_t bvh_insert(Bvh* bvh, const vec3s aabb[2], uint32_t object) {
+  int32_t leaf = bvh_alloc_node(bvh);
+  vec3s margin = glms_vec3_broadcast(bvh->margin);
+  bvh->nodes[leaf] = (BvhNode){
+      .aabb = {glms_vec3_sub(aabb[0], margin), glms_vec3_add(aabb[1], margin)},
+      .parent = BVH_NULL_NODE,
+      .left = BVH_NULL_NODE,
+      .right = BVH_NULL_NODE,
+      .height = 0,
+      .object = object,
+  };
+  bvh_insert_leaf(bvh, leaf);
+  bvh->numLeaves++;
+
+  return leaf;
+}
+
+void bvh_remove(Bvh* bvh, int32_t leaf) {
+  bvh_remove_leaf(bvh, leaf);
+  bvh_free_node(bvh, leaf);
+  bvh->numLeaves--;
+}
+
+// Short moves refit in place. An object that left its old box entirely
+// belongs to another part of the tree and is inserted again instead.
+bool bvh_update(Bvh* bvh, int32_t leaf, const vec3s aabb[2]) {
+  BvhNode* node = &bvh->nodes[leaf];
+  if (bvh_contains(node->aabb, aabb)) return false;
+
+  bool overlaps = bvh_overlaps(node->aabb, aabb);
+  vec3s margin = glms_vec3_broadcast(bvh->margin);
+  node->aabb[0] = glms_vec3_sub(aabb[0], margin);
+  node->aabb[1] = glms_vec3_add(aabb[1], margin);
+  bvh->numRefits++;
+
+  if (overlaps) {
+    bvh_refit(bvh, node->parent);
+  } else {
+    bvh_remove_leaf(bvh, leaf);
+    bvh_insert_leaf(bvh, leaf);
+  }
+
+  return true;
+}
+
+// Stack entries pair a node with the planes its parent still crossed
+uint32_t bvh_query_frustum(const Bvh* bvh, const CullFrustum* frustum,
+                           uint32_t* objects, uint32_t max) {
+  if (bvh->root == BVH_NULL_NODE) return 0;
+
+  uint64_t local[BVH_STACK];
+  uint64_t* stack = bvh_stack(bvh, local);
+  uint32_t top = 0;
+  stack[top++] =
+      (uint64_t)((1u << CULL_PLANES) - 1) << 32 | (uint32_t)bvh->root;
+
+  uint32_t count = 0;
+  while (top > 0 && count < max) {
+    uint64_t item = stack[--top];
+    const BvhNode* node = &bvh->nodes[(int32_t)(uint32_t)item];
+    uint32_t mask = (uint32_t)(item >> 32);
+
+    // A subtree inside every plane is walked down to its leaves without
+    // touching the node boxes
+    bool outside = false;
+    if (mask != 0) {
+      vec3s center = glms_vec3_scale(
+          glms_vec3_add(node->aabb[0], node->aabb[1]), 0.5f);
+      vec3s extent = glms_vec3_scale(
+          glms_vec3_sub(node->aabb[1], node->aabb[0]), 0.5f);
+      for (int p = 0; p < CULL_PLANES && mask != 0; p++) {
+        if (!(mask & 1u << p)) continue;
+
+        vec4s plane = frustum->planes[p];
+        float distance = plane.x * center.x + plane.y * center.y +
+                         plane.z * center.z + plane.w;
+        float reach = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y +
+                      fabsf(plane.z) * extent.z;
+        if (distance + reach < 0.0f) {
+          outside = true;
+          break;
+        }
+        if (distance - reach >= 0.0f) mask &= ~(1u << p);
+      }
+    }
+    if (outside) continue;
+
+    if (bvh_is_leaf(node)) {
+      objects[count++] = node->object;
+    } else {
+      stack[top++] = (uint64_t)mask << 32 | (uint32_t)node->left;
+      stack[top++] = (uint64_t)mask << 32 | (uint32_t)node->right;
+    }
+  }
+
+  if (stack != local) free(stack);
+  return count;
+}
+
+uint32_t bvh_query_sphere(const Bvh* bvh, vec3s center, float radius,
+                          uint32_t* objects, uint32_t max) {
+  if (bvh->root == BVH_NULL_NODE) return 0;
+
+  uint64_t local[BVH_STACK];
+  uint64_t* stack = bvh_stack(bvh, local);
+  uint32_t top = 0;
+  stack[top++] = (uint32_t)bvh->root;
+
+  uint32_t count = 0;
+  while (top > 0 && count < max) {
+    const BvhNode* node = &bvh->nodes[(int32_t)stack[--top]];
+
+    // Squared distance from the centre to the closest point of the box
+    vec3s closest;
+    for (int a = 0; a < 3; a++) {
+      float c = center.raw[a];
+      closest.raw[a] = c < node->aabb[0].raw[a]   ? node->aabb[0].raw[a]
+                       : c > node->aabb[1].raw[a] ? node->aabb[1].raw[a]
+                                                  : c;
+    }
+    if (glms_vec3_distance2(center, closest) > radius * radius) continue;
+
+    if (bvh_is_leaf(node)) {
+      objects[count++] = node->object;
+    } else {
+      stack[top++] = (uint32_t)node->left;
+      stack[top++] = (uint32_t)node->right;
+    }
+  }
+
+  if (stack != local) free(stack);
+  return count;
+}
+
+// Stack entries carry the distance at which the ray enters the node, so
+// nodes behind the best hit so far are dropped when popped
+bool bvh_query_ray(const Bvh* bvh, vec3s origin, vec3s direction,
+                   float maxDistance, BvhHit* hit) {
+  if (bvh->root == BVH_NULL_NODE) return false;
+
+  vec3s inverse = glms_vec3_div(glms_vec3_one(), direction);
+  float best = maxDistance;
+  bool found = false;
+
+  const BvhNode* root = &bvh->nodes[bvh->root];
+  float entry = bvh_ray_box(root->aabb, origin, inverse, best);
+  if (entry == INFINITY) return false;
+
+  uint64_t local[BVH_STACK];
+  uint64_t* stack = bvh_stack(bvh, local);
+  uint32_t top = 0;
+  uint32_t bits;
+  memcpy(&bits, &entry, sizeof(bits));
+  stack[top++] = (uint64_t)bits << 32 | (uint32_t)bvh->root;
+
+  while (top > 0) {
+    uint64_t item = stack[--top];
+    bits = (uint32_t)(item >> 32);
+    memcpy(&entry, &bits, sizeof(entry));
+    if (entry > best) continue;
+
+    const BvhNode* node = &bvh->nodes[(int32_t)(uint32_t)item];
+    if (bvh_is_leaf(node)) {
+      best = entry;
+      hit->object = node->object;
+      hit->distance = entry;
+      found = true;
+      continue;
+    }
+
+    // The nearer child goes on top
+    int32_t children[2] = {node->left, node->right};
+    float entries[2] = {
+        bvh_ray_box(bvh->nodes[node->left].aabb, origin, inverse, best),
+        bvh_ray_box(bvh->nodes[node->right].aabb, origin, inverse, best),
+    };
+    int first = entries[0] > entries[1] ? 0 : 1;
+    for (int i = 0; i < 2; i++) {
+      int c = i == 0 ? first : 1 - first;
+      if (entries[c] == INFINITY) continue;
+      memcpy(&bits, &entries[c], sizeof(bits));
+      stack[top++] = (uint64_t)bits << 32 | (uint32_t)children[c];
+    }
+  }
+
+  if (stack != local) free(stack);
+  return found;
+}
+
+int32_t bvh_height(const Bvh* bvh) {
+  return bvh->root == BVH_NULL_NODE ? 0 : bvh->nodes[bvh->root].height;
+}
+
+float bvh_cost(const Bvh* bvh) {
+  if (bvh->root == BVH_NULL_NODE) return 0.0f;
+
+  float sum = 0.0f;
+  for (uint32_t i = 0; i < bvh->capacity; i++) {
+    if (bvh->nodes[i].height > 0) sum += bvh_area(bvh->nodes[i].aabb);
+  }
+  float rootArea = bvh_area(bvh->nodes[bvh->root].aabb);
+
+  return rootArea > 0.0f ? sum / rootArea : 0.0f;
+}
+
+void bvh_print_stats(const Bvh* bvh, const char* name, FILE* stream) {
+  fprintf(stream,
+          "bvh %s: %u leaves, height %d, cost %.1f, %u refits, %u "
+          "rotations\n",
+          name, bvh->numLeaves, bvh_height(bvh), bvh_cost(bvh),
+          bvh->numRefits, bvh->numRotations);
+}
+
+// ------------------------------------------------------------------------
+
+static int32_t bvh_alloc_node(Bvh* bvh) {
+  if (bvh->freeList == BVH_NULL_NODE) bvh_reserve(bvh, bvh->capacity * 2);
+
+  int32_t index = bvh->freeList;
+  bvh->freeList = bvh->nodes[index].parent;
+
+  return index;
+}
+
+static void bvh_free_node(Bvh* bvh, int32_t index) {
+  bvh->nodes[index].parent = bvh->freeList;
+  bvh->nodes[index].height = -1;
+  bvh->freeList = index;
+}
+
+// New nodes are chained in front of the free list
+static void bvh_reserve(Bvh* bvh, uint32_t capacity) {
+  if (capacity <= bvh->capacity) return;
+
+  bvh->nodes = realloc(bvh->nodes, capacity * sizeof(BvhNode));
+  for (uint32_t i = bvh->capacity; i < capacity; i++) {
+    bvh->nodes[i].parent =
+        i + 1 < capacity ? (int32_t)i + 1 : bvh->freeList;
+    bvh->nodes[i].height = -1;
+  }
+  bvh->freeList = (int32_t)bvh->capacity;
+  bvh->capacity = capacity;
+}
+
+static int32_t bvh_build_range(Bvh* bvh, BvhBuildItem* items, uint32_t count,
+                               int32_t parent, int32_t* leaves) {
+  int32_t index = bvh_alloc_node(bvh);
+  BvhNode* node = &bvh->nodes[index];
+  node->parent = parent;
+
+  if (count == 1) {
+    node->aabb[0] = items[0].aabb[0];
+    node->aabb[1] = items[0].aabb[1];
+    node->left = node->right = BVH_NULL_NODE;
+    node->height = 0;
+    node->object = items[0].object;
+    if (leaves != NULL) leaves[items[0].index] = index;
+    return index;
+  }
+
+  vec3s bounds[2] = {items[0].centroid, items[0].centroid};
+  for (uint32_t i = 1; i < count; i++) {
+    bounds[0] = glms_vec3_minv(bounds[0], items[i].centroid);
+    bounds[1] = glms_vec3_maxv(bounds[1], items[i].centroid);
+  }
+  vec3s size = glms_vec3_sub(bounds[1], bounds[0]);
+  int axis = size.x > size.y ? (size.x > size.z ? 0 : 2)
+                             : (size.y > size.z ? 1 : 2);
+  float extent = size.raw[axis];
+
+  // Coincident centroids leave nothing to choose from, halve the range
+  uint32_t split = count / 2;
+  if (extent > 0.0f) {
+    uint32_t binCounts[BVH_BINS] = {0};
+    vec3s binBoxes[BVH_BINS][2];
+    for (int b = 0; b < BVH_BINS; b++) {
+      binBoxes[b][0] = glms_vec3_broadcast(INFINITY);
+      binBoxes[b][1] = glms_vec3_broadcast(-INFINITY);
+    }
+
+    float scale = BVH_BINS / extent;
+    uint8_t* bins = malloc(count);
+    for (uint32_t i = 0; i < count; i++) {
+      int b = (int)((items[i].centroid.raw[axis] - bounds[0].raw[axis]) *
+                    scale);
+      bins[i] = (uint8_t)(b < BVH_BINS ? b : BVH_BINS - 1);
+      binCounts[bins[i]]++;
+      bvh_merge(binBoxes[bins[i]], items[i].aabb, binBoxes[bins[i]]);
+    }
+
+    // Surface areas of everything left of each boundary, then the sweep
+    // from the right picks the cheapest boundary
+    float leftCost[BVH_BINS];
+    vec3s box[2] = {glms_vec3_broadcast(INFINITY),
+                    glms_vec3_broadcast(-INFINITY)};
+    uint32_t below = 0;
+    for (int b = 0; b < BVH_BINS - 1; b++) {
+      bvh_merge(box, binBoxes[b], box);
+      below += binCounts[b];
+      leftCost[b] = below > 0 ? below * bvh_area(box) : 0.0f;
+    }
+
+    float bestCost = INFINITY;
+    int bestBin = -1;
+    box[0] = glms_vec3_broadcast(INFINITY);
+    box[1] = glms_vec3_broadcast(-INFINITY);
+    uint32_t above = 0;
+    for (int b = BVH_BINS - 1; b > 0; b--) {
+      bvh_merge(box, binBoxes[b], box);
+      above += binCounts[b];
+      if (above == 0 || above == count) continue;
+
+      float cost = leftCost[b - 1] + above * bvh_area(box);
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestBin = b;
+      }
+    }
+
+    if (bestBin > 0) {
+      uint32_t left = 0;
+      for (uint32_t i = 0; i < count; i++) {
+        if (bins[i] >= bestBin) continue;
+
+        BvhBuildItem swap = items[i];
+        items[i] = items[left];
+        items[left] = swap;
+        uint8_t bin = bins[i];
+        bins[i] = bins[left];
+        bins[left] = bin;
+        left++;
+      }
+      split = left;
+    }
+    free(bins);
+  }
+
+  int32_t left = bvh_build_range(bvh, items, split, index, leaves);
+  int32_t right =
+      bvh_build_range(bvh, items + split, count - split, index, leaves);
+
+  node = &bvh->nodes[index];
+  node->left = left;
+  node->right = right;
+  bvh_merge(bvh->nodes[left].aabb, bvh->nodes[right].aabb, node->aabb);
+  node->height = 1 + (bvh->nodes[left].height > bvh->nodes[right].height
+                          ? bvh->nodes[left].height
+                          : bvh->nodes[right].height);
+
+  return index;
+}
+
+// Walks down towards the cheapest sibling: each step compares pairing with
+// the current node against the growth each child would see, counting the
+// area every ancestor gains on the way
+static void bvh_insert_leaf(Bvh* bvh, int32_t leaf) {
+  if (bvh->root == BVH_NULL_NODE) {
+    bvh->root = leaf;
+    bvh->nodes[leaf].parent = BVH_NULL_NODE;
+    return;
+  }
+
+  vec3s box[2] = {bvh->nodes[leaf].aabb[0], bvh->nodes[leaf].aabb[1]};
+  int32_t sibling = bvh->root;
+  while (!bvh_is_leaf(&bvh->nodes[sibling])) {
+    const BvhNode* node = &bvh->nodes[sibling];
+    vec3s merged[2];
+    bvh_merge(node->aabb, box, merged);
+    float area = bvh_area(node->aabb);
+    float cost = 2.0f * bvh_area(merged);
+    float inherited = 2.0f * (bvh_area(merged) - area);
+
+    float childCosts[2];
+    int32_t children[2] = {node->left, node->right};
+    for (int c = 0; c < 2; c++) {
+      const BvhNode* child = &bvh->nodes[children[c]];
+      bvh_merge(child->aabb, box, merged);
+      childCosts[c] = bvh_area(merged) + inherited;
+      if (!bvh_is_leaf(child)) childCosts[c] -= bvh_area(child->aabb);
+    }
+
+    if (cost < childCosts[0] && cost < childCosts[1]) break;
+    sibling = childCosts[0] < childCosts[1] ? children[0] : children[1];
+  }
+
+  // Allocation may move the nodes, no pointers across it
+  int32_t parent = bvh_alloc_node(bvh);
+  int32_t grandparent = bvh->nodes[sibling].parent;
+  BvhNode* node = &bvh->nodes[parent];
+  node->parent = grandparent;
+  node->left = sibling;
+  node->right = leaf;
+  node->height = bvh->nodes[sibling].height + 1;
+  bvh_merge(bvh->nodes[sibling].aabb, box, node->aabb);
+  bvh->nodes[sibling].parent = parent;
+  bvh->nodes[leaf].parent = parent;
+
+  if (grandparent == BVH_NULL_NODE) {
+    bvh->root = parent;
+  } else if (bvh->nodes[grandparent].left == sibling) {
+    bvh->nodes[grandparent].left = parent;
+  } else {
+    bvh->nodes[grandparent].right = parent;
+  }
+
+  bvh_refit(bvh, grandparent);
+}
+
+// The leaf's sibling takes its parent's place
+static void bvh_remove_leaf(Bvh* bvh, int32_t leaf) {
+  if (leaf == bvh->root) {
+    bvh->root = BVH_NULL_NODE;
+    return;
+  }
+
+  int32_t parent = bvh->nodes[leaf].parent;
+  int32_t grandparent = bvh->nodes[parent].parent;
+  int32_t sibling = bvh->nodes[parent].left == leaf
+                        ? bvh->nodes[parent].right
+                        : bvh->nodes[parent].left;
+
+  bvh->nodes[sibling].parent = grandparent;
+  bvh_free_node(bvh, parent);
+  if (grandparent == BVH_NULL_NODE) {
+    bvh->root = sibling;
+    return;
+  }
+
+  if (bvh->nodes[grandparent].left == parent) {
+    bvh->nodes[grandparent].left = sibling;
+  } else {
+    bvh->nodes[grandparent].right = sibling;
+  }
+  bvh_refit(bvh, grandparent);
+}
+
+// Boxes and heights from `index` up to the root, rotating on the way
+static void bvh_refit(Bvh* bvh, int32_t index) {
+  while (index != BVH_NULL_NODE) {
+    bvh_rotate(bvh, index);
+
+    BvhNode* node = &bvh->nodes[index];
+    const BvhNode* left = &bvh->nodes[node->left];
+    const BvhNode* right = &bvh->nodes[node->right];
+    bvh_merge(left->aabb, right->aabb, node->aabb);
+    node->height =
+        1 + (left->height > right->height ? left->height : right->height);
+
+    index = node->parent;
+  }
+}
+
+// Swaps a child with a grandchild under the other child when that shrinks
+// the other child's box the most. The node keeps the same leaves, so only
+// the other child's box changes.
+static void bvh_rotate(Bvh* bvh, int32_t index) {
+  BvhNode* nodes = bvh->nodes;
+  int32_t children[2] = {nodes[index].left, nodes[index].right};
+
+  float best = 0.0f;
+  int32_t child = BVH_NULL_NODE;
+  int32_t grandchild = BVH_NULL_NODE;
+  for (int side = 0; side < 2; side++) {
+    const BvhNode* other = &nodes[children[1 - side]];
+    if (bvh_is_leaf(other)) continue;
+
+    float area = bvh_area(other->aabb);
+    int32_t grandchildren[2] = {other->left, other->right};
+    for (int g = 0; g < 2; g++) {
+      // The other child would hold this child and the grandchild staying
+      vec3s merged[2];
+      bvh_merge(nodes[children[side]].aabb,
+                nodes[grandchildren[1 - g]].aabb, merged);
+      float delta = bvh_area(merged) - area;
+      if (delta < best) {
+        best = delta;
+        child = children[side];
+        grandchild = grandchildren[g];
+      }
+    }
+  }
+  if (child == BVH_NULL_NODE) return;
+
+  int32_t other = nodes[grandchild].parent;
+  if (nodes[index].left == child) {
+    nodes[index].left = grandchild;
+  } else {
+    nodes[index].right = grandchild;
+  }
+  if (nodes[other].left == grandchild) {
+    nodes[other].left = child;
+  } else {
+    nodes[other].right = child;
+  }
+  nodes[grandchild].parent = index;
+  nodes[child].parent = other;
+
+  const BvhNode* left = &nodes[nodes[other].left];
+  const BvhNode* right = &nodes[nodes[other].right];
+  bvh_merge(left->aabb, right->aabb, nodes[other].aabb);
+  nodes[other].height =
+      1 + (left->height > right->height ? left->height : right->height);
+  bvh->numRotations++;
+}
+
+// Depth-first traversal holds at most one entry per level plus one
+static uint64_t* bvh_stack(const Bvh* bvh, uint64_t* local) {
+  size_t size = (size_t)bvh_height(bvh) + 2;
+  if (size <= BVH_STACK) return local;
+
+  return malloc(size * sizeof(uint64_t));
+}
+
+static void bvh_merge(const vec3s a[2], const vec3s b[2], vec3s out[2]) {
+  out[0] = glms_vec3_minv(a[0], b[0]);
+  out[1] = glms_vec3_maxv(a[1], b[1]);
+}
+
+static float bvh_area(const vec3s aabb[2]) {
+  vec3s d = glms_vec3_sub(aabb[1], aabb[0]);
+
+  return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool bvh_contains(const vec3s outer[2], const vec3s inner[2]) {
+  return outer[0].x <= inner[0].x && outer[0].y <= inner[0].y &&
+         outer[0].z <= inner[0].z && inner[1].x <= outer[1].x &&
+         inner[1].y <= outer[1].y && inner[1].z <= outer[1].z;
+}
+
+static bool bvh_overlaps(const vec3s a[2], const vec3s b[2]) {
+  return a[0].x <= b[1].x && b[0].x <= a[1].x && a[0].y <= b[1].y &&
+         b[0].y <= a[1].y && a[0].z <= b[1].z && b[0].z <= a[1].z;
+}
+
+// Slab test, the distance the ray enters the box at or INFINITY on a miss
+static float bvh_ray_box(const vec3s aabb[2], vec3s origin, vec3s inverse,
+                         float maxDistance) {
+  float near = 0.0f;
+  float far = maxDistance;
+  for (int a = 0; a < 3; a++) {
+    float t0 = (aabb[0].raw[a] - origin.raw[a]) * inverse.raw[a];
+    float t1 = (aabb[1].raw[a] - origin.raw[a]) * inverse.raw[a];
+    near = fmaxf(near, fminf(t0, t1));
+    far = fminf(far, fmaxf(t0, t1));
+  }
+
+  return near <= far ? near : INFINITY;
+}
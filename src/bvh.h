@@ -0,0 +1,79 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+#include "cull.h"
+
+#define BVH_NULL_NODE (-1)
+
+// Node of a binary tree of boxes. Leaves hold one object each and keep
+// their index for as long as the object stays in the tree.
+typedef struct {
+  vec3s aabb[2];
+  int32_t parent;
+  int32_t left;   // BVH_NULL_NODE in leaves
+  int32_t right;
+  int32_t height;  // 0 in leaves
+  uint32_t object;
+} BvhNode;
+
+// Dynamic bounding volume hierarchy over object bounds. Leaves store their
+// box grown by `margin`, so objects moving a little leave the tree alone.
+// Past that a move refits the leaf's ancestors and rotates the ones whose
+// children can trade places for a smaller surface area, which keeps the
+// tree close to what a fresh build would give without rebuilding it.
+typedef struct {
+  BvhNode* nodes;
+  uint32_t capacity;
+  int32_t root;
+  int32_t freeList;  // unused nodes chained through `parent`
+  uint32_t numLeaves;
+  float margin;
+
+  // Instrumentation
+  uint32_t numRefits;     // leaves whose box outgrew the margin
+  uint32_t numRotations;  // ancestors rotated by refits and inserts
+} Bvh;
+
+typedef struct {
+  uint32_t object;
+  float distance;  // along the ray to the object's box
+} BvhHit;
+
+Bvh bvh_create(uint32_t capacity, float margin);
+void bvh_destroy(Bvh* bvh);
+
+// Replaces the whole tree with a surface area heuristic build over `count`
+// boxes. Object i gets aabbs[i] and its leaf index in leaves[i].
+void bvh_build(Bvh* bvh, const vec3s (*aabbs)[2], uint32_t count,
+               int32_t* leaves);
+int32_t bvh_insert(Bvh* bvh, const vec3s aabb[2], uint32_t object);
+void bvh_remove(Bvh* bvh, int32_t leaf);
+// Moves a leaf to new bounds. False when they still fit the grown box and
+// the tree is unchanged, O(log n) otherwise.
+bool bvh_update(Bvh* bvh, int32_t leaf, const vec3s aabb[2]);
+
+// Objects whose boxes touch the frustum, unordered. Subtrees inside a plane
+// skip its test, subtrees inside every plane are still walked to their
+// leaves but with no box tests at all. Writes at most `max` and returns how
+// many were written.
+uint32_t bvh_query_frustum(const Bvh* bvh, const CullFrustum* frustum,
+                           uint32_t* objects, uint32_t max);
+// Objects whose boxes touch the sphere, unordered
+uint32_t bvh_query_sphere(const Bvh* bvh, vec3s center, float radius,
+                          uint32_t* objects, uint32_t max);
+// Nearest box along the ray within `maxDistance`, closer subtrees first.
+// `direction` needs no normalizing, distances are in its units.
+bool bvh_query_ray(const Bvh* bvh, vec3s origin, vec3s direction,
+                   float maxDistance, BvhHit* hit);
+
+int32_t bvh_height(const Bvh* bvh);
+// Sum of the inner nodes' surface areas over the root's, lower is better
+float bvh_cost(const Bvh* bvh);
+void bvh_print_stats(const Bvh* bvh, const char* name, FILE* stream);
+
+#endif  // BVH_H
@@ -1,15 +1,19 @@
 #include "camera.h"
 
 #include "cglm/struct/cam.h"
+#include "cglm/struct/mat4.h"
 
 const float YAW = -90.0f;
 const float PITCH = 0.0f;
 const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 80.0f;
+const float ZNEAR = 0.1f;
+const float ZFAR = 100.0f;
 
 // Privates.
 static void update_camera_vectors(Camera *camera);
+static void apply_camera_rotation(Camera *camera);
 
 // Creates a camera with specified initial parameters and returns it.
 Camera create_camera(vec3s position, vec3s up, float yaw, float pitch) {
@@ -22,6 +26,10 @@ Camera create_camera(vec3s position, vec3s up, float yaw, float pitch) {
         .MovementSpeed = SPEED,
         .MouseSensitivity = SENSITIVITY,
         .Zoom = ZOOM,
+        .Aspect = 1.0f,
+        .Near = ZNEAR,
+        .Far = ZFAR,
+        .Dirty = CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION,
     };
 
     update_camera_vectors(&camera);
@@ -46,6 +54,10 @@ Camera create_camera_scalar(float posX, float posY, float posZ, float upX,
         .MovementSpeed = SPEED,
         .MouseSensitivity = SENSITIVITY,
         .Zoom = ZOOM,
+        .Aspect = 1.0f,
+        .Near = ZNEAR,
+        .Far = ZFAR,
+        .Dirty = CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION,
     };
 
     update_camera_vectors(&camera);
@@ -53,12 +65,88 @@ Camera create_camera_scalar(float posX, float posY, float posZ, float upX,
     return camera;
 }
 
-// Calculates and returns the view matrix for the given camera.
-// returns the view matrix calculated using Euler Angles and the LookAt Matrix
+// Sets the projection's aspect ratio and clip planes.
+void camera_set_perspective(Camera *camera, float aspect, float near,
+                            float far) {
+    if (aspect == camera->Aspect && near == camera->Near &&
+        far == camera->Far) {
+        return;
+    }
+
+    camera->Aspect = aspect;
+    camera->Near = near;
+    camera->Far = far;
+    camera->Dirty |= CAMERA_DIRTY_PROJECTION;
+}
+
+// Moves and turns the camera to a saved pose, as replays do.
+void camera_set_pose(Camera *camera, vec3s position, float yaw, float pitch,
+                     float zoom) {
+    camera->PendingYaw = 0.0f;
+    camera->PendingPitch = 0.0f;
+    camera->Dirty &= ~CAMERA_DIRTY_ROTATION;
+
+    // Frames where the camera held still leave the matrices alone
+    if (!glms_vec3_eqv(position, camera->Position) || yaw != camera->Yaw ||
+        pitch != camera->Pitch) {
+        camera->Position = position;
+        camera->Yaw = yaw;
+        camera->Pitch = pitch;
+        update_camera_vectors(camera);
+        camera->Dirty |= CAMERA_DIRTY_VIEW;
+    }
+
+    if (zoom != camera->Zoom) {
+        camera->Zoom = zoom;
+        camera->Dirty |= CAMERA_DIRTY_PROJECTION;
+    }
+}
+
+// Rebuilds only the matrices input made stale since the last call.
+bool camera_update(Camera *camera) {
+    apply_camera_rotation(camera);
+    if (!(camera->Dirty & (CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION))) {
+        return false;
+    }
+
+    if (camera->Dirty & CAMERA_DIRTY_VIEW) {
+        camera->View = glms_lookat(
+            camera->Position, glms_vec3_add(camera->Position, camera->Front),
+            camera->Up);
+    }
+    if (camera->Dirty & CAMERA_DIRTY_PROJECTION) {
+        camera->Projection =
+            glms_perspective(glm_rad(camera->Zoom), camera->Aspect,
+                             camera->Near, camera->Far);
+    }
+    camera->ViewProjection = glms_mat4_mul(camera->Projection, camera->View);
+    camera->InverseViewProjection = glms_mat4_inv(camera->ViewProjection);
+
+    camera->Dirty = 0;
+    camera->Version++;
+
+    return true;
+}
+
+// Returns the view matrix calculated using Euler Angles and the LookAt Matrix
 mat4s camera_get_view_matrix(Camera *camera) {
-    return glms_lookat(camera->Position,
-                       glms_vec3_add(camera->Position, camera->Front),
-                       camera->Up);
+    camera_update(camera);
+    return camera->View;
+}
+
+mat4s camera_get_projection_matrix(Camera *camera) {
+    camera_update(camera);
+    return camera->Projection;
+}
+
+mat4s camera_get_view_projection_matrix(Camera *camera) {
+    camera_update(camera);
+    return camera->ViewProjection;
+}
+
+mat4s camera_get_inverse_view_projection_matrix(Camera *camera) {
+    camera_update(camera);
+    return camera->InverseViewProjection;
 }
 
 // processes input received from any keyboard-like input system. Accepts input
@@ -66,6 +154,10 @@ mat4s camera_get_view_matrix(Camera *camera) {
 // systems)
 void camera_process_keyboard(Camera *camera, CameraMovement direction,
                              float deltaTime) {
+    // Moves along where the mouse turned the camera to this frame
+    apply_camera_rotation(camera);
+    camera->Dirty |= CAMERA_DIRTY_VIEW;
+
     float velocity = camera->MovementSpeed * deltaTime;
     if (direction == FORWARD) {
         camera->Position = glms_vec3_muladds(camera->Front, velocity, camera->Position);
@@ -81,18 +173,10 @@ void camera_process_keyboard(Camera *camera, CameraMovement direction,
 // Processes mouse movement to update the camera's orientation.
 void camera_process_mouse_movement(Camera *camera, float xoffset,
                                    float yoffset, bool constraintPitch) {
-    xoffset *= camera->MouseSensitivity;
-    yoffset *= camera->MouseSensitivity;
-
-    camera->Yaw += xoffset;
-    camera->Pitch += yoffset;
-
-    if (constraintPitch) {
-        if (camera->Pitch > 89.0f) camera->Pitch = 89.f;
-        if (camera->Pitch < -89.0f) camera->Pitch = -89.f;
-    }
-
-    update_camera_vectors(camera);
+    camera->PendingYaw += xoffset * camera->MouseSensitivity;
+    camera->PendingPitch += yoffset * camera->MouseSensitivity;
+    camera->ConstrainPitch = constraintPitch;
+    camera->Dirty |= CAMERA_DIRTY_ROTATION;
 }
 
 // Processes mouse scroll to update the camera's zoom level.
@@ -100,10 +184,31 @@ void camera_process_mouse_scroll(Camera *camera, float yoffset) {
     camera->Zoom -= (float)yoffset;
     if (camera->Zoom < 1.0f) camera->Zoom = 1.0f;
     if (camera->Zoom > 80.0f) camera->Zoom = 80.0f;
+    camera->Dirty |= CAMERA_DIRTY_PROJECTION;
 }
 
 // ------------------------------------------------------------------------
 
+// Folds the mouse movement gathered since the last call into the Euler
+// angles and rebuilds the basis once for all of it.
+static void apply_camera_rotation(Camera *camera) {
+    if (!(camera->Dirty & CAMERA_DIRTY_ROTATION)) return;
+
+    camera->Yaw += camera->PendingYaw;
+    camera->Pitch += camera->PendingPitch;
+    camera->PendingYaw = 0.0f;
+    camera->PendingPitch = 0.0f;
+
+    if (camera->ConstrainPitch) {
+        if (camera->Pitch > 89.0f) camera->Pitch = 89.f;
+        if (camera->Pitch < -89.0f) camera->Pitch = -89.f;
+    }
+
+    update_camera_vectors(camera);
+    camera->Dirty &= ~CAMERA_DIRTY_ROTATION;
+    camera->Dirty |= CAMERA_DIRTY_VIEW;
+}
+
 // Updates the camera's internal vectors based on its orientation.
 // Calculates the front vector from the Camera's (updated) Euler Angles
 static void update_camera_vectors(Camera *camera) {
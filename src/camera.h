@@ -3,16 +3,26 @@
 
 #include <GL/glew.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "cglm/types-struct.h"
 
 typedef enum { FORWARD, BACKWARD, LEFT, RIGHT } CameraMovement;
 
+// What camera_update has to rebuild
+typedef enum {
+  CAMERA_DIRTY_ROTATION = 1 << 0,    // mouse deltas waiting, basis stale
+  CAMERA_DIRTY_VIEW = 1 << 1,        // moved or turned
+  CAMERA_DIRTY_PROJECTION = 1 << 2,  // zoom, aspect or clip planes changed
+} CameraDirtyFlags;
+
 extern const float YAW;
 extern const float PITCH;
 extern const float SPEED;
 extern const float SENSITIVITY;
 extern const float ZOOM;
+extern const float ZNEAR;
+extern const float ZFAR;
 
 typedef struct {
   vec3s Position;
@@ -27,15 +37,46 @@ typedef struct {
   float MovementSpeed;
   float MouseSensitivity;
   float Zoom;
+  // Projection
+  float Aspect;
+  float Near;
+  float Far;
+
+  // Mouse movement since the last update, applied all at once
+  float PendingYaw;
+  float PendingPitch;
+  bool ConstrainPitch;
+  uint32_t Dirty;  // CameraDirtyFlags
+
+  // Cached by camera_update
+  mat4s View;
+  mat4s Projection;
+  mat4s ViewProjection;
+  mat4s InverseViewProjection;
+  // Bumped whenever the matrices change, compare against a saved value to
+  // skip work while the camera holds still
+  uint32_t Version;
 } Camera;
 
 Camera create_camera(vec3s position, vec3s up, float yaw, float pitch);
 Camera create_camerav(vec3s position);
 Camera create_camera_scalar(float posX, float posY, float posZ, float upX,
                             float upY, float upZ, float yaw, float pitch);
+void camera_set_perspective(Camera *camera, float aspect, float near,
+                            float far);
+// Places the camera outright, dropping mouse movement not applied yet
+void camera_set_pose(Camera *camera, vec3s position, float yaw, float pitch,
+                     float zoom);
+// Applies pending input and rebuilds what it made stale. Returns true when
+// the matrices changed. The getters below call it.
+bool camera_update(Camera *camera);
 mat4s camera_get_view_matrix(Camera *camera);
+mat4s camera_get_projection_matrix(Camera *camera);
+mat4s camera_get_view_projection_matrix(Camera *camera);
+mat4s camera_get_inverse_view_projection_matrix(Camera *camera);
 void camera_process_keyboard(Camera *camera, CameraMovement direction,
                              float deltaTime);
+// Accumulates cursor movement, the basis is rebuilt once by camera_update
 void camera_process_mouse_movement(Camera *camera, float xoffset, float yoffset,
                                    bool constraintPitch);
 void camera_process_mouse_scroll(Camera *camera, float yoffset);
@@ -0,0 +1,379 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clip.h"
+
+#include "animation.h"
+#include "cglm/struct/quat.h"
+#include "cglm/struct/vec3.h"
+#include "cglm/struct/vec4.h"
+
+#define CLIP_TIME_STEPS 65535.0f
+#define CLIP_VALUE_STEPS 65535.0f
+#define CLIP_ROTATION_STEPS 32767.0f
+
+// Key waiting to be sorted into the stream
+typedef struct {
+  uint16_t needTime;  // quantized time at which playback first reads the key
+  uint32_t order;     // creation order, keeps the sort stable
+  ClipKey key;
+} ClipPendingKey;
+
+// Privates
+static uint32_t clip_reduce_track(const float* times, const vec4s* values,
+                                  uint32_t count, ClipTrackType type,
+                                  float tolerance, uint32_t* kept);
+static float clip_error(vec4s a, vec4s b, ClipTrackType type);
+static vec4s clip_interpolate(vec4s a, vec4s b, float t, ClipTrackType type);
+static void clip_encode(const ClipTrack* track, vec4s value,
+                        uint16_t out[3]);
+static vec4s clip_decode(const ClipTrack* track, const uint16_t value[3]);
+static int clip_compare_pending(const void* a, const void* b);
+
+// Reduces every track to the keys needed to stay within `tolerance` under
+// linear interpolation, quantizes them and lays them out time-major
+CompressedClip clip_compress(const AnimationClip* source,
+                             ClipTolerance tolerance) {
+  CompressedClip clip = {
+      .numChannels = source->numChannels,
+      .numTracks = source->numChannels * 3,
+      .duration = source->duration > 0.0f ? source->duration : 1.0f,
+  };
+  clip.tracks = calloc(clip.numTracks, sizeof(ClipTrack));
+  clip.nodes = malloc(clip.numChannels * sizeof(int32_t));
+
+  uint32_t maxKeys = 0;
+  uint32_t totalKeys = 0;
+  for (uint32_t c = 0; c < source->numChannels; c++) {
+    const AnimationChannel* channel = &source->channels[c];
+    uint32_t counts[3] = {channel->numPositions, channel->numRotations,
+                          channel->numScales};
+    for (int t = 0; t < 3; t++) {
+      if (counts[t] > maxKeys) maxKeys = counts[t];
+      totalKeys += counts[t];
+    }
+  }
+
+  float* times = malloc(maxKeys * sizeof(float));
+  vec4s* values = aligned_alloc(16, (maxKeys + 1) * sizeof(vec4s));
+  uint32_t* kept = malloc(maxKeys * sizeof(uint32_t));
+  ClipPendingKey* pending = malloc(totalKeys * sizeof(ClipPendingKey));
+  uint32_t numPending = 0;
+
+  float timeScale = CLIP_TIME_STEPS / clip.duration;
+  float tolerances[3] = {tolerance.positionError, tolerance.rotationError,
+                         tolerance.scaleError};
+
+  for (uint32_t c = 0; c < source->numChannels; c++) {
+    const AnimationChannel* channel = &source->channels[c];
+    clip.nodes[c] = channel->node;
+
+    for (uint32_t type = 0; type < 3; type++) {
+      uint32_t count = 0;
+      if (type == CLIP_TRACK_POSITION) {
+        count = channel->numPositions;
+        for (uint32_t k = 0; k < count; k++) {
+          times[k] = channel->positions[k].time;
+          values[k] = glms_vec4(channel->positions[k].value, 0.0f);
+        }
+      } else if (type == CLIP_TRACK_ROTATION) {
+        count = channel->numRotations;
+        for (uint32_t k = 0; k < count; k++) {
+          times[k] = channel->rotations[k].time;
+          values[k] = glms_vec4_normalize(
+              glms_vec4_make(channel->rotations[k].value.raw));
+        }
+      } else {
+        count = channel->numScales;
+        for (uint32_t k = 0; k < count; k++) {
+          times[k] = channel->scales[k].time;
+          values[k] = glms_vec4(channel->scales[k].value, 0.0f);
+        }
+      }
+
+      uint32_t trackIndex = c * 3 + type;
+      ClipTrack* track = &clip.tracks[trackIndex];
+      track->channel = (uint16_t)c;
+      track->type = (uint16_t)type;
+      track->numKeys = clip_reduce_track(times, values, count, type,
+                                         tolerances[type], kept);
+
+      // Quantization range of the keys that survived
+      if (type != CLIP_TRACK_ROTATION && track->numKeys > 0) {
+        vec3s lo = glms_vec3(values[kept[0]]);
+        vec3s hi = lo;
+        for (uint32_t k = 1; k < track->numKeys; k++) {
+          lo = glms_vec3_minv(lo, glms_vec3(values[kept[k]]));
+          hi = glms_vec3_maxv(hi, glms_vec3(values[kept[k]]));
+        }
+        track->min = lo;
+        track->extent = glms_vec3_sub(hi, lo);
+      }
+
+      for (uint32_t k = 0; k < track->numKeys; k++) {
+        ClipPendingKey* p = &pending[numPending];
+        float need = k < 2 ? 0.0f : times[kept[k - 1]];
+        p->needTime = (uint16_t)lroundf(need * timeScale);
+        p->order = numPending;
+        p->key.track = (uint16_t)trackIndex;
+        p->key.time = (uint16_t)lroundf(times[kept[k]] * timeScale);
+        clip_encode(track, values[kept[k]], p->key.value);
+        numPending++;
+      }
+    }
+  }
+
+  qsort(pending, numPending, sizeof(ClipPendingKey), clip_compare_pending);
+
+  clip.numKeys = numPending;
+  clip.keys = malloc(numPending * sizeof(ClipKey));
+  for (uint32_t i = 0; i < numPending; i++) {
+    clip.keys[i] = pending[i].key;
+  }
+
+  free(times);
+  free(values);
+  free(kept);
+  free(pending);
+
+  return clip;
+}
+
+// The chord between unit quaternions keeps full float precision for small
+// angles, unlike acos of their dot product which moves in steps of ~7e-4 rad
+// near 1
+float clip_rotation_error(versors a, versors b) {
+  vec4s va = glms_vec4_normalize(glms_vec4_make(a.raw));
+  vec4s vb = glms_vec4_normalize(glms_vec4_make(b.raw));
+  if (glms_vec4_dot(va, vb) < 0.0f) vb = glms_vec4_negate(vb);
+
+  float half = 0.5f * glms_vec4_distance(va, vb);
+  return 4.0f * asinf(half > 1.0f ? 1.0f : half);
+}
+
+void clip_destroy(CompressedClip* clip) {
+  free(clip->tracks);
+  free(clip->keys);
+  free(clip->nodes);
+
+  *clip = (CompressedClip){0};
+}
+
+ClipCursor clip_cursor_create(const CompressedClip* clip) {
+  size_t size = clip->numTracks * sizeof(ClipCursorTrack);
+  ClipCursor cursor = {
+      .clip = clip,
+      .tracks = aligned_alloc(16, (size + 15) & ~(size_t)15),
+  };
+  clip_cursor_reset(&cursor);
+
+  return cursor;
+}
+
+void clip_cursor_destroy(ClipCursor* cursor) {
+  free(cursor->tracks);
+
+  *cursor = (ClipCursor){0};
+}
+
+void clip_cursor_reset(ClipCursor* cursor) {
+  for (uint32_t i = 0; i < cursor->clip->numTracks; i++) {
+    cursor->tracks[i].loaded = 0;
+  }
+  cursor->next = 0;
+  cursor->time = 0.0f;
+}
+
+void clip_cursor_sample(ClipCursor* cursor, float time, vec3s* positions,
+                        versors* rotations, vec3s* scales) {
+  const CompressedClip* clip = cursor->clip;
+  if (time < cursor->time) clip_cursor_reset(cursor);
+  cursor->time = time;
+
+  // Read every key whose predecessor has been reached. The stream is sorted
+  // by that moment, so the first key that is not due yet ends the scan.
+  float keyTime = clip->duration / CLIP_TIME_STEPS;
+  while (cursor->next < clip->numKeys) {
+    const ClipKey* key = &clip->keys[cursor->next];
+    ClipCursorTrack* track = &cursor->tracks[key->track];
+    if (track->loaded >= 2 && track->time[1] > time) break;
+
+    if (track->loaded < 2) {
+      track->loaded++;
+    } else {
+      track->time[0] = track->time[1];
+      track->value[0] = track->value[1];
+    }
+    track->time[track->loaded - 1] = key->time * keyTime;
+    track->value[track->loaded - 1] =
+        clip_decode(&clip->tracks[key->track], key->value);
+    cursor->next++;
+  }
+
+  for (uint32_t i = 0; i < clip->numTracks; i++) {
+    const ClipCursorTrack* track = &cursor->tracks[i];
+    if (track->loaded == 0) continue;
+
+    vec4s value = track->value[0];
+    if (track->loaded == 2 && track->time[1] > track->time[0]) {
+      float t = (time - track->time[0]) / (track->time[1] - track->time[0]);
+      t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+      value = clip_interpolate(track->value[0], track->value[1], t,
+                               clip->tracks[i].type);
+    }
+
+    uint16_t channel = clip->tracks[i].channel;
+    switch (clip->tracks[i].type) {
+      case CLIP_TRACK_POSITION:
+        positions[channel] = glms_vec3(value);
+        break;
+      case CLIP_TRACK_ROTATION:
+        rotations[channel] = glms_quat_init(value.x, value.y, value.z, value.w);
+        break;
+      case CLIP_TRACK_SCALE:
+        scales[channel] = glms_vec3(value);
+        break;
+    }
+  }
+}
+
+size_t clip_memory_size(const CompressedClip* clip) {
+  return sizeof(CompressedClip) + clip->numTracks * sizeof(ClipTrack) +
+         clip->numKeys * sizeof(ClipKey) + clip->numChannels * sizeof(int32_t);
+}
+
+size_t clip_uncompressed_memory_size(const AnimationClip* clip) {
+  size_t size =
+      sizeof(AnimationClip) + clip->numChannels * sizeof(AnimationChannel);
+  for (uint32_t c = 0; c < clip->numChannels; c++) {
+    const AnimationChannel* channel = &clip->channels[c];
+    size += (channel->numPositions + channel->numScales) * sizeof(VectorKey) +
+            channel->numRotations * sizeof(QuatKey);
+  }
+
+  return size;
+}
+
+// ------------------------------------------------------------------------
+
+// Greedy reduction: a segment is extended while every key it skips can be
+// rebuilt by interpolating its ends. Writes the kept key indices to `kept`.
+static uint32_t clip_reduce_track(const float* times, const vec4s* values,
+                                  uint32_t count, ClipTrackType type,
+                                  float tolerance, uint32_t* kept) {
+  if (count == 0) return 0;
+
+  // Constant tracks collapse to a single key
+  bool constant = true;
+  for (uint32_t k = 1; k < count && constant; k++) {
+    constant = clip_error(values[0], values[k], type) <= tolerance;
+  }
+  if (constant || count == 1) {
+    kept[0] = 0;
+    return 1;
+  }
+
+  uint32_t numKept = 0;
+  uint32_t anchor = 0;
+  kept[numKept++] = 0;
+
+  for (uint32_t end = 2; end < count; end++) {
+    float span = times[end] - times[anchor];
+    for (uint32_t k = anchor + 1; k < end; k++) {
+      float t = span > 0.0f ? (times[k] - times[anchor]) / span : 0.0f;
+      vec4s rebuilt = clip_interpolate(values[anchor], values[end], t, type);
+      if (clip_error(rebuilt, values[k], type) > tolerance) {
+        anchor = end - 1;
+        kept[numKept++] = anchor;
+        break;
+      }
+    }
+  }
+  kept[numKept++] = count - 1;
+
+  return numKept;
+}
+
+static float clip_error(vec4s a, vec4s b, ClipTrackType type) {
+  if (type == CLIP_TRACK_ROTATION) {
+    return clip_rotation_error(glms_quat_init(a.x, a.y, a.z, a.w),
+                               glms_quat_init(b.x, b.y, b.z, b.w));
+  }
+
+  return glms_vec3_distance(glms_vec3(a), glms_vec3(b));
+}
+
+// Rotations use a shortest-path nlerp, close enough at keyframe spacing and
+// much cheaper than slerp
+static vec4s clip_interpolate(vec4s a, vec4s b, float t, ClipTrackType type) {
+  if (type != CLIP_TRACK_ROTATION) return glms_vec4_lerp(a, b, t);
+
+  if (glms_vec4_dot(a, b) < 0.0f) b = glms_vec4_negate(b);
+  return glms_vec4_normalize(glms_vec4_lerp(a, b, t));
+}
+
+static void clip_encode(const ClipTrack* track, vec4s value, uint16_t out[3]) {
+  if (track->type != CLIP_TRACK_ROTATION) {
+    for (int i = 0; i < 3; i++) {
+      float extent = track->extent.raw[i];
+      float f = extent > 0.0f ? (value.raw[i] - track->min.raw[i]) / extent
+                              : 0.0f;
+      out[i] = (uint16_t)lroundf(f * CLIP_VALUE_STEPS);
+    }
+    return;
+  }
+
+  // Drop the largest component, made positive so it can be rebuilt from the
+  // unit length. The other three are then within +-1/sqrt(2).
+  int largest = 0;
+  for (int i = 1; i < 4; i++) {
+    if (fabsf(value.raw[i]) > fabsf(value.raw[largest])) largest = i;
+  }
+  if (value.raw[largest] < 0.0f) value = glms_vec4_negate(value);
+
+  int slot = 0;
+  for (int i = 0; i < 4; i++) {
+    if (i == largest) continue;
+    float f = value.raw[i] * (float)GLM_SQRT2 * 0.5f + 0.5f;
+    f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+    out[slot++] = (uint16_t)lroundf(f * CLIP_ROTATION_STEPS);
+  }
+  out[0] |= (uint16_t)((largest & 1) << 15);
+  out[1] |= (uint16_t)((largest >> 1) << 15);
+}
+
+static vec4s clip_decode(const ClipTrack* track, const uint16_t value[3]) {
+  vec4s result = {0};
+
+  if (track->type != CLIP_TRACK_ROTATION) {
+    for (int i = 0; i < 3; i++) {
+      result.raw[i] = track->min.raw[i] +
+                      track->extent.raw[i] * (value[i] / CLIP_VALUE_STEPS);
+    }
+    return result;
+  }
+
+  int largest = (value[0] >> 15) | ((value[1] >> 15) << 1);
+  float sum = 0.0f;
+  int slot = 0;
+  for (int i = 0; i < 4; i++) {
+    if (i == largest) continue;
+    float f = (value[slot++] & 0x7fff) / CLIP_ROTATION_STEPS;
+    result.raw[i] = (f - 0.5f) * 2.0f / (float)GLM_SQRT2;
+    sum += result.raw[i] * result.raw[i];
+  }
+  result.raw[largest] = sqrtf(sum < 1.0f ? 1.0f - sum : 0.0f);
+
+  return result;
+}
+
+static int clip_compare_pending(const void* a, const void* b) {
+  const ClipPendingKey* x = a;
+  const ClipPendingKey* y = b;
+  if (x->needTime != y->needTime) return x->needTime < y->needTime ? -1 : 1;
+
+  return (x->order > y->order) - (x->order < y->order);
+}
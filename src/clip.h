@@ -0,0 +1,91 @@
+#ifndef CLIP_H
+#define CLIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cglm/types-struct.h"
+
+struct AnimationClip;
+
+typedef enum {
+  CLIP_TRACK_POSITION,
+  CLIP_TRACK_ROTATION,
+  CLIP_TRACK_SCALE,
+} ClipTrackType;
+
+// One quantized key. Positions and scales are 16-bit fractions of the track
+// range, rotations use smallest-three: the three smallest components at 15
+// bits each, with the index of the dropped one in the two spare top bits.
+typedef struct {
+  uint16_t track;
+  uint16_t time;  // fraction of the clip duration
+  uint16_t value[3];
+} ClipKey;
+
+typedef struct {
+  uint16_t channel;
+  uint16_t type;  // ClipTrackType
+  uint32_t numKeys;
+  vec3s min;
+  vec3s extent;
+} ClipTrack;
+
+// Compressed clip. Keys of all tracks are interleaved in the order playback
+// needs them: a track's key k+1 follows the moment its key k is reached, so a
+// cursor moving forward in time only ever reads the stream sequentially.
+typedef struct {
+  ClipTrack* tracks;  // 3 per channel: position, rotation, scale
+  ClipKey* keys;
+  int32_t* nodes;  // scene node of every channel
+  uint32_t numChannels;
+  uint32_t numTracks;
+  uint32_t numKeys;
+  float duration;
+} CompressedClip;
+
+// Worst rotation error the 15-bit smallest-three encoding adds on top of the
+// tolerance, in radians: half a step on each stored component plus what it
+// does to the rebuilt one
+#define CLIP_ROTATION_QUANTIZATION 1.5e-4f
+
+typedef struct {
+  float positionError;  // world units
+  float rotationError;  // radians
+  float scaleError;
+} ClipTolerance;
+
+// Decoded neighbouring keys of one track
+typedef struct {
+  float time[2];
+  vec4s value[2];
+  uint32_t loaded;
+} ClipCursorTrack;
+
+// Playback position in a compressed clip. Sampling forward in time is O(1)
+// amortized per track, going backwards restarts from the first key.
+typedef struct {
+  const CompressedClip* clip;
+  ClipCursorTrack* tracks;
+  uint32_t next;  // next key to read from the stream
+  float time;
+} ClipCursor;
+
+CompressedClip clip_compress(const struct AnimationClip* clip,
+                             ClipTolerance tolerance);
+// Angle between two rotations in radians, accurate down to small angles
+float clip_rotation_error(versors a, versors b);
+void clip_destroy(CompressedClip* clip);
+
+ClipCursor clip_cursor_create(const CompressedClip* clip);
+void clip_cursor_destroy(ClipCursor* cursor);
+void clip_cursor_reset(ClipCursor* cursor);
+// Writes the TRS of every channel at `time`. Tracks without keys are skipped
+// so the outputs keep whatever rest values the caller put there.
+void clip_cursor_sample(ClipCursor* cursor, float time, vec3s* positions,
+                        versors* rotations, vec3s* scales);
+
+size_t clip_memory_size(const CompressedClip* clip);
+size_t clip_uncompressed_memory_size(const struct AnimationClip* clip);
+
+#endif  // CLIP_H
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmdlist.h"
+#include "glstate.h"
+
+// Every command starts on this boundary, the largest member alignment
+#define CMDLIST_ALIGN 8
+
+typedef enum {
+  CMD_USE_PROGRAM,
+  CMD_BIND_VERTEX_ARRAY,
+  CMD_CALL,
+  CMD_SET_MAT4,
+  CMD_DRAW_ARRAYS,
+  CMD_DRAW_ELEMENTS,
+} CommandType;
+
+typedef struct {
+  uint32_t type;
+  GLuint name;
+} CmdBind;
+
+typedef struct {
+  uint32_t type;
+  CommandFunc func;
+  const void* data;
+  Shader* shader;
+} CmdCall;
+
+typedef struct {
+  uint32_t type;
+  GLint location;
+  float value[16];
+} CmdSetMat4;
+
+typedef struct {
+  uint32_t type;
+  GLenum mode;
+  GLint first;
+  GLsizei count;
+} CmdDraw;
+
+// Privates
+static void* cmdlist_push(CommandList* list, CommandType type, size_t size);
+static size_t cmdlist_size(size_t size);
+
+CommandList cmdlist_create(size_t capacity) {
+  return (CommandList){
+      .data = capacity > 0 ? malloc(capacity) : NULL,
+      .capacity = capacity,
+  };
+}
+
+void cmdlist_destroy(CommandList* list) {
+  free(list->data);
+  *list = (CommandList){0};
+}
+
+void cmdlist_reset(CommandList* list) {
+  list->size = 0;
+  list->numCommands = 0;
+}
+
+void cmdlist_use_program(CommandList* list, GLuint program) {
+  CmdBind* cmd = cmdlist_push(list, CMD_USE_PROGRAM, sizeof(CmdBind));
+  cmd->name = program;
+}
+
+void cmdlist_bind_vertex_array(CommandList* list, GLuint vertexArray) {
+  CmdBind* cmd = cmdlist_push(list, CMD_BIND_VERTEX_ARRAY, sizeof(CmdBind));
+  cmd->name = vertexArray;
+}
+
+void cmdlist_call(CommandList* list, CommandFunc func, const void* data,
+                  Shader* shader) {
+  CmdCall* cmd = cmdlist_push(list, CMD_CALL, sizeof(CmdCall));
+  cmd->func = func;
+  cmd->data = data;
+  cmd->shader = shader;
+}
+
+void cmdlist_set_mat4(CommandList* list, GLint location, mat4s value) {
+  CmdSetMat4* cmd = cmdlist_push(list, CMD_SET_MAT4, sizeof(CmdSetMat4));
+  cmd->location = location;
+  memcpy(cmd->value, value.raw, sizeof(cmd->value));
+}
+
+void cmdlist_draw_arrays(CommandList* list, GLenum mode, GLint first,
+                         GLsizei count) {
+  CmdDraw* cmd = cmdlist_push(list, CMD_DRAW_ARRAYS, sizeof(CmdDraw));
+  cmd->mode = mode;
+  cmd->first = first;
+  cmd->count = count;
+}
+
+void cmdlist_draw_elements(CommandList* list, GLenum mode, GLint first,
+                           GLsizei count) {
+  CmdDraw* cmd = cmdlist_push(list, CMD_DRAW_ELEMENTS, sizeof(CmdDraw));
+  cmd->mode = mode;
+  cmd->first = first;
+  cmd->count = count;
+}
+
+void cmdlist_execute(const CommandList* list) {
+  const uint8_t* at = list->data;
+  for (uint32_t i = 0; i < list->numCommands; i++) {
+    switch (*(const uint32_t*)at) {
+      case CMD_USE_PROGRAM: {
+        glstate_use_program(((const CmdBind*)at)->name);
+        at += cmdlist_size(sizeof(CmdBind));
+        break;
+      }
+      case CMD_BIND_VERTEX_ARRAY: {
+        glstate_bind_vertex_array(((const CmdBind*)at)->name);
+        at += cmdlist_size(sizeof(CmdBind));
+        break;
+      }
+      case CMD_CALL: {
+        const CmdCall* cmd = (const CmdCall*)at;
+        cmd->func(cmd->data, cmd->shader);
+        at += cmdlist_size(sizeof(CmdCall));
+        break;
+      }
+      case CMD_SET_MAT4: {
+        const CmdSetMat4* cmd = (const CmdSetMat4*)at;
+        glUniformMatrix4fv(cmd->location, 1, GL_FALSE, cmd->value);
+        at += cmdlist_size(sizeof(CmdSetMat4));
+        break;
+      }
+      case CMD_DRAW_ARRAYS: {
+        const CmdDraw* cmd = (const CmdDraw*)at;
+        glDrawArrays(cmd->mode, cmd->first, cmd->count);
+        at += cmdlist_size(sizeof(CmdDraw));
+        break;
+      }
+      case CMD_DRAW_ELEMENTS: {
+        const CmdDraw* cmd = (const CmdDraw*)at;
+        glDrawElements(cmd->mode, cmd->count, GL_UNSIGNED_INT,
+                       (const void*)(cmd->first * sizeof(GLuint)));
+        at += cmdlist_size(sizeof(CmdDraw));
+        break;
+      }
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+
+// Room for one command, the buffer doubles when full
+static void* cmdlist_push(CommandList* list, CommandType type, size_t size) {
+  size = cmdlist_size(size);
+  if (list->size + size > list->capacity) {
+    size_t capacity = list->capacity > 0 ? list->capacity * 2 : 4096;
+    while (capacity < list->size + size) capacity *= 2;
+    list->data = realloc(list->data, capacity);
+    list->capacity = capacity;
+  }
+
+  void* cmd = list->data + list->size;
+  *(uint32_t*)cmd = type;
+  list->size += size;
+  list->numCommands++;
+
+  return cmd;
+}
+
+static size_t cmdlist_size(size_t size) {
+  return (size + CMDLIST_ALIGN - 1) & ~(size_t)(CMDLIST_ALIGN - 1);
+}
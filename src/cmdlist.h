@@ -0,0 +1,46 @@
+#ifndef CMDLIST_H
+#define CMDLIST_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cglm/types-struct.h"
+#include "shader.h"
+
+// Draw and uniform commands written into a linear buffer by any thread and
+// replayed in order on the GL thread. Recording makes no GL calls, so
+// uniform locations are looked up beforehand. Lists keep their memory
+// across cmdlist_reset, a list recorded every frame stops allocating once
+// it has grown to fit. One thread at a time per list.
+
+// Runs on the GL thread during replay, `data` and `shader` as recorded
+typedef void (*CommandFunc)(const void* data, Shader* shader);
+
+typedef struct {
+  uint8_t* data;
+  size_t size;
+  size_t capacity;
+  uint32_t numCommands;
+} CommandList;
+
+CommandList cmdlist_create(size_t capacity);
+void cmdlist_destroy(CommandList* list);
+// Drops the commands, keeps the memory
+void cmdlist_reset(CommandList* list);
+
+void cmdlist_use_program(CommandList* list, GLuint program);
+void cmdlist_bind_vertex_array(CommandList* list, GLuint vertexArray);
+void cmdlist_call(CommandList* list, CommandFunc func, const void* data,
+                  Shader* shader);
+void cmdlist_set_mat4(CommandList* list, GLint location, mat4s value);
+void cmdlist_draw_arrays(CommandList* list, GLenum mode, GLint first,
+                         GLsizei count);
+// GL_UNSIGNED_INT indices of the bound VAO, from index `first`
+void cmdlist_draw_elements(CommandList* list, GLenum mode, GLint first,
+                           GLsizei count);
+
+// GL thread. Binds through glstate.
+void cmdlist_execute(const CommandList* list);
+
+#endif  // CMDLIST_H
@@ -0,0 +1,445 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CULL_X86
+#endif
+
+#include "cull.h"
+
+#include "cglm/struct/frustum.h"
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/vec3.h"
+
+// Tests bounds [begin, end) and writes the visible indices from visible[0]
+typedef uint32_t (*CullFunc)(const CullFrustum* frustum,
+                             const CullBounds* bounds, CullShape shape,
+                             uint32_t begin, uint32_t end, uint32_t* visible);
+
+typedef struct {
+  pthread_once_t once;
+  CullFunc func;
+  const char* kernel;
+} CullKernels;
+
+typedef struct {
+  const CullFrustum* frustum;
+  const CullBounds* bounds;
+  CullShape shape;
+  CullFunc func;
+  uint32_t* visible;
+  uint32_t* counts;  // visible per chunk, left at the chunk's start
+} CullBatch;
+
+static CullKernels kernels = {.once = PTHREAD_ONCE_INIT};
+static CullStats stats;
+static CullStats reported;  // stats at the last frame report
+
+// Privates
+static void cull_init(void);
+static void cull_grow(CullBounds* bounds, uint32_t capacity);
+static void cull_range(void* data, uint32_t begin, uint32_t end);
+static uint32_t cull_scalar(const CullFrustum* frustum,
+                            const CullBounds* bounds, CullShape shape,
+                            uint32_t begin, uint32_t end, uint32_t* visible);
+#ifdef CULL_X86
+static uint32_t cull_sse(const CullFrustum* frustum, const CullBounds* bounds,
+                         CullShape shape, uint32_t begin, uint32_t end,
+                         uint32_t* visible);
+static uint32_t cull_avx(const CullFrustum* frustum, const CullBounds* bounds,
+                         CullShape shape, uint32_t begin, uint32_t end,
+                         uint32_t* visible);
+#endif
+
+CullFrustum cull_frustum_create(mat4s viewProjection) {
+  CullFrustum frustum;
+  glms_frustum_planes(viewProjection, frustum.planes);
+
+  return frustum;
+}
+
+CullBounds cull_bounds_create(uint32_t capacity) {
+  CullBounds bounds = {0};
+  cull_grow(&bounds, capacity > 0 ? capacity : 64);
+
+  return bounds;
+}
+
+void cull_bounds_destroy(CullBounds* bounds) {
+  free(bounds->centerX);
+  *bounds = (CullBounds){0};
+}
+
+void cull_bounds_clear(CullBounds* bounds) {
+  bounds->count = 0;
+}
+
+uint32_t cull_bounds_add_aabb(CullBounds* bounds, const vec3s aabb[2],
+                              mat4s world) {
+  if (bounds->count == bounds->capacity) {
+    cull_grow(bounds, bounds->capacity * 2);
+  }
+  uint32_t index = bounds->count++;
+  cull_bounds_set_aabb(bounds, index, aabb, world);
+
+  return index;
+}
+
+uint32_t cull_bounds_add_sphere(CullBounds* bounds, vec3s center,
+                                float radius) {
+  if (bounds->count == bounds->capacity) {
+    cull_grow(bounds, bounds->capacity * 2);
+  }
+  uint32_t index = bounds->count++;
+  bounds->centerX[index] = center.x;
+  bounds->centerY[index] = center.y;
+  bounds->centerZ[index] = center.z;
+  bounds->extentX[index] = radius;
+  bounds->extentY[index] = radius;
+  bounds->extentZ[index] = radius;
+  bounds->radius[index] = radius;
+
+  return index;
+}
+
+// The transformed box's extent along each world axis is the sum of the
+// absolute matrix columns weighted by the local extents
+void cull_bounds_set_aabb(CullBounds* bounds, uint32_t index,
+                          const vec3s aabb[2], mat4s world) {
+  vec3s center =
+      glms_vec3_scale(glms_vec3_add(aabb[0], aabb[1]), 0.5f);
+  vec3s extent =
+      glms_vec3_scale(glms_vec3_sub(aabb[1], aabb[0]), 0.5f);
+  center = glms_mat4_mulv3(world, center, 1.0f);
+
+  vec3s worldExtent = glms_vec3_zero();
+  for (int c = 0; c < 3; c++) {
+    vec3s column = glms_vec3_abs(glms_vec3(world.col[c]));
+    worldExtent =
+        glms_vec3_add(worldExtent, glms_vec3_scale(column, extent.raw[c]));
+  }
+
+  bounds->centerX[index] = center.x;
+  bounds->centerY[index] = center.y;
+  bounds->centerZ[index] = center.z;
+  bounds->extentX[index] = worldExtent.x;
+  bounds->extentY[index] = worldExtent.y;
+  bounds->extentZ[index] = worldExtent.z;
+  bounds->radius[index] = glms_vec3_norm(worldExtent);
+}
+
+uint32_t cull_run(const CullFrustum* frustum, const CullBounds* bounds,
+                  CullShape shape, uint32_t* visible) {
+  pthread_once(&kernels.once, cull_init);
+
+  uint32_t count =
+      kernels.func(frustum, bounds, shape, 0, bounds->count, visible);
+  stats.tested += bounds->count;
+  stats.visible += count;
+
+  return count;
+}
+
+uint32_t cull_run_parallel(JobPool* pool, const CullFrustum* frustum,
+                           const CullBounds* bounds, CullShape shape,
+                           uint32_t* visible) {
+  pthread_once(&kernels.once, cull_init);
+
+  uint32_t numChunks = (bounds->count + CULL_CHUNK - 1) / CULL_CHUNK;
+  if (numChunks <= 1) return cull_run(frustum, bounds, shape, visible);
+
+  CullBatch batch = {
+      .frustum = frustum,
+      .bounds = bounds,
+      .shape = shape,
+      .func = kernels.func,
+      .visible = visible,
+      .counts = malloc(numChunks * sizeof(uint32_t)),
+  };
+  job_pool_parallel_for(pool, numChunks, 1, cull_range, &batch);
+
+  // Chunks wrote from their own start, close the gaps between them
+  uint32_t count = batch.counts[0];
+  for (uint32_t c = 1; c < numChunks; c++) {
+    memmove(visible + count, visible + c * CULL_CHUNK,
+            batch.counts[c] * sizeof(uint32_t));
+    count += batch.counts[c];
+  }
+  free(batch.counts);
+
+  stats.tested += bounds->count;
+  stats.visible += count;
+
+  return count;
+}
+
+bool cull_test_aabb(const CullFrustum* frustum, const vec3s aabb[2],
+                    mat4s world) {
+  return cull_test_aabb_into(frustum, aabb, world, &stats);
+}
+
+bool cull_test_aabb_into(const CullFrustum* frustum, const vec3s aabb[2],
+                         mat4s world, CullStats* counts) {
+  float values[7];
+  CullBounds one = {
+      .centerX = &values[0],
+      .centerY = &values[1],
+      .centerZ = &values[2],
+      .extentX = &values[3],
+      .extentY = &values[4],
+      .extentZ = &values[5],
+      .radius = &values[6],
+      .count = 1,
+      .capacity = 1,
+  };
+  cull_bounds_set_aabb(&one, 0, aabb, world);
+
+  uint32_t index;
+  bool visible = cull_scalar(frustum, &one, CULL_AABB, 0, 1, &index) > 0;
+  counts->tested++;
+  counts->visible += visible;
+
+  return visible;
+}
+
+const char* cull_kernel_name(void) {
+  pthread_once(&kernels.once, cull_init);
+
+  return kernels.kernel;
+}
+
+bool cull_use_kernel(const char* name) {
+  pthread_once(&kernels.once, cull_init);
+
+  if (strcmp(name, "scalar") == 0) {
+    kernels.func = cull_scalar;
+    kernels.kernel = "scalar";
+    return true;
+  }
+#ifdef CULL_X86
+  if (strcmp(name, "sse") == 0 && __builtin_cpu_supports("sse")) {
+    kernels.func = cull_sse;
+    kernels.kernel = "sse";
+    return true;
+  }
+  if (strcmp(name, "avx") == 0 && __builtin_cpu_supports("avx")) {
+    kernels.func = cull_avx;
+    kernels.kernel = "avx";
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+CullStats cull_get_stats(void) {
+  return stats;
+}
+
+void cull_add_stats(CullStats counts) {
+  stats.tested += counts.tested;
+  stats.visible += counts.visible;
+}
+
+void cull_print_frame_stats(FILE* stream) {
+  uint64_t tested = stats.tested - reported.tested;
+  uint64_t visible = stats.visible - reported.visible;
+  fprintf(stream, "cull: %lu of %lu visible (%.1f%%), %s\n",
+          (unsigned long)visible, (unsigned long)tested,
+          tested > 0 ? 100.0 * visible / tested : 0.0, cull_kernel_name());
+  reported = stats;
+}
+
+// ------------------------------------------------------------------------
+
+static void cull_init(void) {
+  kernels.func = cull_scalar;
+  kernels.kernel = "scalar";
+#ifdef CULL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) {
+    kernels.func = cull_avx;
+    kernels.kernel = "avx";
+  } else if (__builtin_cpu_supports("sse")) {
+    kernels.func = cull_sse;
+    kernels.kernel = "sse";
+  }
+#endif
+}
+
+// Every array lives in one block, each padded to a whole AVX register
+static void cull_grow(CullBounds* bounds, uint32_t capacity) {
+  capacity = (capacity + 7) & ~7u;
+  float* block = aligned_alloc(32, 7 * (size_t)capacity * sizeof(float));
+  float** arrays[7] = {
+      &bounds->centerX, &bounds->centerY, &bounds->centerZ, &bounds->extentX,
+      &bounds->extentY, &bounds->extentZ, &bounds->radius,
+  };
+
+  float* old = bounds->centerX;
+  for (int a = 0; a < 7; a++) {
+    float* array = block + a * (size_t)capacity;
+    if (bounds->count > 0) {
+      memcpy(array, *arrays[a], bounds->count * sizeof(float));
+    }
+    *arrays[a] = array;
+  }
+  free(old);
+  bounds->capacity = capacity;
+}
+
+static void cull_range(void* data, uint32_t begin, uint32_t end) {
+  CullBatch* batch = data;
+  for (uint32_t c = begin; c < end; c++) {
+    uint32_t first = c * CULL_CHUNK;
+    uint32_t last = first + CULL_CHUNK;
+    if (last > batch->bounds->count) last = batch->bounds->count;
+    batch->counts[c] = batch->func(batch->frustum, batch->bounds, batch->shape,
+                                   first, last, batch->visible + first);
+  }
+}
+
+// An object is outside once it lies entirely behind one plane: its centre's
+// distance is below minus the sphere's radius, or minus the box's extent
+// projected on the plane normal
+static uint32_t cull_scalar(const CullFrustum* frustum,
+                            const CullBounds* bounds, CullShape shape,
+                            uint32_t begin, uint32_t end, uint32_t* visible) {
+  uint32_t count = 0;
+  for (uint32_t i = begin; i < end; i++) {
+    bool inside = true;
+    for (int p = 0; p < CULL_PLANES && inside; p++) {
+      vec4s plane = frustum->planes[p];
+      float distance = plane.x * bounds->centerX[i] +
+                       plane.y * bounds->centerY[i] +
+                       plane.z * bounds->centerZ[i] + plane.w;
+      float reach = shape == CULL_SPHERE
+                        ? bounds->radius[i]
+                        : fabsf(plane.x) * bounds->extentX[i] +
+                              fabsf(plane.y) * bounds->extentY[i] +
+                              fabsf(plane.z) * bounds->extentZ[i];
+      inside = distance + reach >= 0.0f;
+    }
+
+    // Written either way, only kept when visible
+    visible[count] = i;
+    count += inside;
+  }
+
+  return count;
+}
+
+#ifdef CULL_X86
+// Four objects per step against all six planes, no early out. Visible lanes
+// come out of the mask lowest first to keep the indices sorted.
+static uint32_t cull_sse(const CullFrustum* frustum, const CullBounds* bounds,
+                         CullShape shape, uint32_t begin, uint32_t end,
+                         uint32_t* visible) {
+  __m128 nx[CULL_PLANES], ny[CULL_PLANES], nz[CULL_PLANES], nw[CULL_PLANES];
+  __m128 ax[CULL_PLANES], ay[CULL_PLANES], az[CULL_PLANES];
+  for (int p = 0; p < CULL_PLANES; p++) {
+    vec4s plane = frustum->planes[p];
+    nx[p] = _mm_set1_ps(plane.x);
+    ny[p] = _mm_set1_ps(plane.y);
+    nz[p] = _mm_set1_ps(plane.z);
+    nw[p] = _mm_set1_ps(plane.w);
+    ax[p] = _mm_set1_ps(fabsf(plane.x));
+    ay[p] = _mm_set1_ps(fabsf(plane.y));
+    az[p] = _mm_set1_ps(fabsf(plane.z));
+  }
+  const __m128 zero = _mm_setzero_ps();
+
+  uint32_t count = 0;
+  uint32_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m128 cx = _mm_loadu_ps(bounds->centerX + i);
+    __m128 cy = _mm_loadu_ps(bounds->centerY + i);
+    __m128 cz = _mm_loadu_ps(bounds->centerZ + i);
+    __m128 ex = _mm_loadu_ps(bounds->extentX + i);
+    __m128 ey = _mm_loadu_ps(bounds->extentY + i);
+    __m128 ez = _mm_loadu_ps(bounds->extentZ + i);
+    __m128 radius = _mm_loadu_ps(bounds->radius + i);
+
+    __m128 outside = zero;
+    for (int p = 0; p < CULL_PLANES; p++) {
+      __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+          _mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p]));
+      __m128 reach =
+          shape == CULL_SPHERE
+              ? radius
+              : _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex),
+                                      _mm_mul_ps(ay[p], ey)),
+                           _mm_mul_ps(az[p], ez));
+      outside = _mm_or_ps(outside,
+                          _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+    }
+
+    uint32_t mask = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+    while (mask != 0) {
+      visible[count++] = i + (uint32_t)__builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+
+  return count + cull_scalar(frustum, bounds, shape, i, end, visible + count);
+}
+
+// Same as the SSE kernel eight objects at a time
+__attribute__((target("avx"))) static uint32_t cull_avx(
+    const CullFrustum* frustum, const CullBounds* bounds, CullShape shape,
+    uint32_t begin, uint32_t end, uint32_t* visible) {
+  __m256 nx[CULL_PLANES], ny[CULL_PLANES], nz[CULL_PLANES], nw[CULL_PLANES];
+  __m256 ax[CULL_PLANES], ay[CULL_PLANES], az[CULL_PLANES];
+  for (int p = 0; p < CULL_PLANES; p++) {
+    vec4s plane = frustum->planes[p];
+    nx[p] = _mm256_set1_ps(plane.x);
+    ny[p] = _mm256_set1_ps(plane.y);
+    nz[p] = _mm256_set1_ps(plane.z);
+    nw[p] = _mm256_set1_ps(plane.w);
+    ax[p] = _mm256_set1_ps(fabsf(plane.x));
+    ay[p] = _mm256_set1_ps(fabsf(plane.y));
+    az[p] = _mm256_set1_ps(fabsf(plane.z));
+  }
+  const __m256 zero = _mm256_setzero_ps();
+
+  uint32_t count = 0;
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 cx = _mm256_loadu_ps(bounds->centerX + i);
+    __m256 cy = _mm256_loadu_ps(bounds->centerY + i);
+    __m256 cz = _mm256_loadu_ps(bounds->centerZ + i);
+    __m256 ex = _mm256_loadu_ps(bounds->extentX + i);
+    __m256 ey = _mm256_loadu_ps(bounds->extentY + i);
+    __m256 ez = _mm256_loadu_ps(bounds->extentZ + i);
+    __m256 radius = _mm256_loadu_ps(bounds->radius + i);
+
+    __m256 outside = zero;
+    for (int p = 0; p < CULL_PLANES; p++) {
+      __m256 distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+          _mm256_add_ps(_mm256_mul_ps(nz[p], cz), nw[p]));
+      __m256 reach =
+          shape == CULL_SPHERE
+              ? radius
+              : _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex),
+                                            _mm256_mul_ps(ay[p], ey)),
+                              _mm256_mul_ps(az[p], ez));
+      outside = _mm256_or_ps(
+          outside,
+          _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+    }
+
+    uint32_t mask = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFF;
+    while (mask != 0) {
+      visible[count++] = i + (uint32_t)__builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+
+  return count + cull_scalar(frustum, bounds, shape, i, end, visible + count);
+}
+#endif
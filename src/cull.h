@@ -0,0 +1,86 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+#include "job.h"
+
+#define CULL_PLANES 6
+// Objects per parallel job, a multiple of every kernel's width
+#define CULL_CHUNK 4096
+
+// World space frustum, planes face inwards and are normalized
+typedef struct {
+  vec4s planes[CULL_PLANES];  // left, right, bottom, top, near, far
+} CullFrustum;
+
+// Bounding volumes as parallel arrays so the kernels load four or eight of
+// a kind at once. Every object has both a box and a sphere around the same
+// centre, whichever cull_run is asked to test.
+typedef struct {
+  float* centerX;
+  float* centerY;
+  float* centerZ;
+  float* extentX;  // box half sizes
+  float* extentY;
+  float* extentZ;
+  float* radius;
+
+  uint32_t count;
+  uint32_t capacity;
+} CullBounds;
+
+typedef enum {
+  CULL_AABB,
+  CULL_SPHERE,
+} CullShape;
+
+typedef struct {
+  uint64_t tested;
+  uint64_t visible;
+} CullStats;
+
+CullFrustum cull_frustum_create(mat4s viewProjection);
+
+CullBounds cull_bounds_create(uint32_t capacity);
+void cull_bounds_destroy(CullBounds* bounds);
+void cull_bounds_clear(CullBounds* bounds);
+// Adds the world space box around `aabb` placed by `world`, returns its index
+uint32_t cull_bounds_add_aabb(CullBounds* bounds, const vec3s aabb[2],
+                              mat4s world);
+uint32_t cull_bounds_add_sphere(CullBounds* bounds, vec3s center,
+                                float radius);
+void cull_bounds_set_aabb(CullBounds* bounds, uint32_t index,
+                          const vec3s aabb[2], mat4s world);
+
+// Writes the indices of the bounds touching the frustum to `visible`, in
+// ascending order, and returns how many. `visible` holds bounds->count.
+uint32_t cull_run(const CullFrustum* frustum, const CullBounds* bounds,
+                  CullShape shape, uint32_t* visible);
+// Same split in CULL_CHUNK jobs over the pool, then compacted
+uint32_t cull_run_parallel(JobPool* pool, const CullFrustum* frustum,
+                           const CullBounds* bounds, CullShape shape,
+                           uint32_t* visible);
+// One box placed by `world`, for callers without bounds arrays
+bool cull_test_aabb(const CullFrustum* frustum, const vec3s aabb[2],
+                    mat4s world);
+// cull_test_aabb counted into `counts` instead, safe to call from jobs that
+// each keep their own. The caller hands them over with cull_add_stats.
+bool cull_test_aabb_into(const CullFrustum* frustum, const vec3s aabb[2],
+                         mat4s world, CullStats* counts);
+
+// Kernels picked for this CPU: "avx", "sse" or "scalar"
+const char* cull_kernel_name(void);
+// Switches kernels by name, for benchmarks. False if the CPU lacks them.
+bool cull_use_kernel(const char* name);
+
+// Counted on the calling thread
+CullStats cull_get_stats(void);
+void cull_add_stats(CullStats counts);
+// Objects tested and visible since the last report, a stats report
+void cull_print_frame_stats(FILE* stream);
+
+#endif  // CULL_H
@@ -0,0 +1,299 @@
+#include "glstate.h"
+
+// Cached value of state GL may hold anything for
+#define GLSTATE_UNKNOWN UINT32_MAX
+
+// Targets and capabilities tracked, others always reach GL
+static const GLenum BUFFER_TARGETS[] = {
+    GL_ARRAY_BUFFER,       GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+    GL_PIXEL_PACK_BUFFER,  GL_PIXEL_UNPACK_BUFFER,  GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER,
+};
+static const GLenum TEXTURE_TARGETS[] = {
+    GL_TEXTURE_2D,
+    GL_TEXTURE_2D_ARRAY,
+    GL_TEXTURE_CUBE_MAP,
+    GL_TEXTURE_3D,
+};
+static const GLenum CAPABILITIES[] = {
+    GL_DEPTH_TEST,   GL_BLEND,         GL_CULL_FACE,
+    GL_SCISSOR_TEST, GL_FRAMEBUFFER_SRGB, GL_TEXTURE_CUBE_MAP_SEAMLESS,
+};
+#define NUM_BUFFER_TARGETS (sizeof(BUFFER_TARGETS) / sizeof(GLenum))
+#define NUM_TEXTURE_TARGETS (sizeof(TEXTURE_TARGETS) / sizeof(GLenum))
+#define NUM_CAPABILITIES (sizeof(CAPABILITIES) / sizeof(GLenum))
+#define ELEMENT_ARRAY_INDEX 1
+
+static struct {
+  GLuint program;
+  GLuint vertexArray;
+  GLuint buffers[NUM_BUFFER_TARGETS];
+  GLuint activeUnit;
+  GLuint textures[GLSTATE_MAX_UNITS][NUM_TEXTURE_TARGETS];
+  GLuint samplers[GLSTATE_MAX_UNITS];
+
+  // Flags hold 0, 1 or GLSTATE_UNKNOWN
+  GLuint enabled[NUM_CAPABILITIES];
+  GLenum depthFunc;
+  GLuint depthMask;
+  GLuint colorMask;
+  GLenum blendSrc;
+  GLenum blendDst;
+  GLenum cullFace;
+  GLint viewport[4];  // width -1 until set
+} state;
+
+static GLStateStats stats;
+static GLStateStats reported;  // stats at the last frame report
+
+// Privates
+static bool glstate_filter(GLStateKind kind, bool unchanged);
+static int glstate_find(const GLenum* values, uint32_t count, GLenum value);
+static void glstate_active_unit(GLuint unit);
+
+void glstate_reset(void) {
+  state.program = GLSTATE_UNKNOWN;
+  state.vertexArray = GLSTATE_UNKNOWN;
+  for (uint32_t b = 0; b < NUM_BUFFER_TARGETS; b++) {
+    state.buffers[b] = GLSTATE_UNKNOWN;
+  }
+  state.activeUnit = GLSTATE_UNKNOWN;
+  for (uint32_t u = 0; u < GLSTATE_MAX_UNITS; u++) {
+    for (uint32_t t = 0; t < NUM_TEXTURE_TARGETS; t++) {
+      state.textures[u][t] = GLSTATE_UNKNOWN;
+    }
+    state.samplers[u] = GLSTATE_UNKNOWN;
+  }
+
+  for (uint32_t c = 0; c < NUM_CAPABILITIES; c++) {
+    state.enabled[c] = GLSTATE_UNKNOWN;
+  }
+  state.depthFunc = GLSTATE_UNKNOWN;
+  state.depthMask = GLSTATE_UNKNOWN;
+  state.colorMask = GLSTATE_UNKNOWN;
+  state.blendSrc = GLSTATE_UNKNOWN;
+  state.blendDst = GLSTATE_UNKNOWN;
+  state.cullFace = GLSTATE_UNKNOWN;
+  state.viewport[2] = -1;
+}
+
+void glstate_use_program(GLuint program) {
+  if (glstate_filter(GLSTATE_PROGRAM, state.program == program)) return;
+  glUseProgram(program);
+  state.program = program;
+}
+
+void glstate_bind_vertex_array(GLuint vertexArray) {
+  if (glstate_filter(GLSTATE_VERTEX_ARRAY,
+                     state.vertexArray == vertexArray)) {
+    return;
+  }
+  glBindVertexArray(vertexArray);
+  state.vertexArray = vertexArray;
+  state.buffers[ELEMENT_ARRAY_INDEX] = GLSTATE_UNKNOWN;
+}
+
+void glstate_bind_buffer(GLenum target, GLuint buffer) {
+  int b = glstate_find(BUFFER_TARGETS, NUM_BUFFER_TARGETS, target);
+  if (glstate_filter(GLSTATE_BUFFER, b >= 0 && state.buffers[b] == buffer)) {
+    return;
+  }
+  glBindBuffer(target, buffer);
+  if (b >= 0) state.buffers[b] = buffer;
+}
+
+void glstate_bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+  glstate_filter(GLSTATE_BUFFER, false);
+  glBindBufferBase(target, index, buffer);
+  int b = glstate_find(BUFFER_TARGETS, NUM_BUFFER_TARGETS, target);
+  if (b >= 0) state.buffers[b] = buffer;
+}
+
+void glstate_bind_texture(GLuint unit, GLenum target, GLuint texture) {
+  int t = glstate_find(TEXTURE_TARGETS, NUM_TEXTURE_TARGETS, target);
+  GLuint* bound =
+      unit < GLSTATE_MAX_UNITS && t >= 0 ? &state.textures[unit][t] : NULL;
+  if (glstate_filter(GLSTATE_TEXTURE, bound != NULL && *bound == texture)) {
+    return;
+  }
+  glstate_active_unit(unit);
+  glBindTexture(target, texture);
+  if (bound != NULL) *bound = texture;
+}
+
+void glstate_bind_sampler(GLuint unit, GLuint sampler) {
+  GLuint* bound = unit < GLSTATE_MAX_UNITS ? &state.samplers[unit] : NULL;
+  if (glstate_filter(GLSTATE_SAMPLER, bound != NULL && *bound == sampler)) {
+    return;
+  }
+  glBindSampler(unit, sampler);
+  if (bound != NULL) *bound = sampler;
+}
+
+void glstate_set_enabled(GLenum capability, bool enabled) {
+  int c = glstate_find(CAPABILITIES, NUM_CAPABILITIES, capability);
+  if (glstate_filter(GLSTATE_FIXED, c >= 0 && state.enabled[c] == enabled)) {
+    return;
+  }
+  if (enabled) {
+    glEnable(capability);
+  } else {
+    glDisable(capability);
+  }
+  if (c >= 0) state.enabled[c] = enabled;
+}
+
+void glstate_depth_func(GLenum func) {
+  if (glstate_filter(GLSTATE_FIXED, state.depthFunc == func)) return;
+  glDepthFunc(func);
+  state.depthFunc = func;
+}
+
+void glstate_depth_mask(bool write) {
+  if (glstate_filter(GLSTATE_FIXED, state.depthMask == write)) return;
+  glDepthMask(write ? GL_TRUE : GL_FALSE);
+  state.depthMask = write;
+}
+
+void glstate_color_mask(bool write) {
+  if (glstate_filter(GLSTATE_FIXED, state.colorMask == write)) return;
+  GLboolean mask = write ? GL_TRUE : GL_FALSE;
+  glColorMask(mask, mask, mask, mask);
+  state.colorMask = write;
+}
+
+void glstate_blend_func(GLenum src, GLenum dst) {
+  if (glstate_filter(GLSTATE_FIXED,
+                     state.blendSrc == src && state.blendDst == dst)) {
+    return;
+  }
+  glBlendFunc(src, dst);
+  state.blendSrc = src;
+  state.blendDst = dst;
+}
+
+void glstate_cull_face(GLenum face) {
+  if (glstate_filter(GLSTATE_FIXED, state.cullFace == face)) return;
+  glCullFace(face);
+  state.cullFace = face;
+}
+
+void glstate_viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  if (glstate_filter(GLSTATE_FIXED,
+                     state.viewport[0] == x && state.viewport[1] == y &&
+                         state.viewport[2] == width &&
+                         state.viewport[3] == height)) {
+    return;
+  }
+  glViewport(x, y, width, height);
+  state.viewport[0] = x;
+  state.viewport[1] = y;
+  state.viewport[2] = width;
+  state.viewport[3] = height;
+}
+
+// A program in use stays current until another is used, the cache can't
+// tell whether that happened
+void glstate_delete_program(GLuint program) {
+  glDeleteProgram(program);
+  if (state.program == program) state.program = GLSTATE_UNKNOWN;
+}
+
+void glstate_delete_vertex_arrays(GLsizei count, const GLuint* vertexArrays) {
+  glDeleteVertexArrays(count, vertexArrays);
+  for (GLsizei i = 0; i < count; i++) {
+    if (vertexArrays[i] != 0 && state.vertexArray == vertexArrays[i]) {
+      state.vertexArray = 0;
+      state.buffers[ELEMENT_ARRAY_INDEX] = GLSTATE_UNKNOWN;
+    }
+  }
+}
+
+void glstate_delete_buffers(GLsizei count, const GLuint* buffers) {
+  glDeleteBuffers(count, buffers);
+  for (GLsizei i = 0; i < count; i++) {
+    if (buffers[i] == 0) continue;
+    for (uint32_t b = 0; b < NUM_BUFFER_TARGETS; b++) {
+      if (state.buffers[b] == buffers[i]) state.buffers[b] = 0;
+    }
+  }
+}
+
+void glstate_delete_textures(GLsizei count, const GLuint* textures) {
+  glDeleteTextures(count, textures);
+  for (GLsizei i = 0; i < count; i++) {
+    if (textures[i] == 0) continue;
+    for (uint32_t u = 0; u < GLSTATE_MAX_UNITS; u++) {
+      for (uint32_t t = 0; t < NUM_TEXTURE_TARGETS; t++) {
+        if (state.textures[u][t] == textures[i]) state.textures[u][t] = 0;
+      }
+    }
+  }
+}
+
+void glstate_delete_samplers(GLsizei count, const GLuint* samplers) {
+  glDeleteSamplers(count, samplers);
+  for (GLsizei i = 0; i < count; i++) {
+    if (samplers[i] == 0) continue;
+    for (uint32_t u = 0; u < GLSTATE_MAX_UNITS; u++) {
+      if (state.samplers[u] == samplers[i]) state.samplers[u] = 0;
+    }
+  }
+}
+
+GLStateStats glstate_get_stats(void) { return stats; }
+
+void glstate_print_frame_stats(FILE* stream) {
+  static const char* const NAMES[GLSTATE_KINDS] = {
+      "programs", "VAOs", "buffers", "textures", "samplers", "fixed",
+  };
+
+  uint64_t issued = 0;
+  uint64_t filtered = 0;
+  for (int k = 0; k < GLSTATE_KINDS; k++) {
+    issued += stats.issued[k] - reported.issued[k];
+    filtered += stats.filtered[k] - reported.filtered[k];
+  }
+  fprintf(stream,
+          "gl state: %lu calls issued, %lu filtered (%.1f%%), "
+          "issued/filtered:",
+          (unsigned long)issued, (unsigned long)filtered,
+          issued + filtered > 0 ? 100.0 * filtered / (issued + filtered)
+                                : 0.0);
+  for (int k = 0; k < GLSTATE_KINDS; k++) {
+    fprintf(stream, " %s %lu/%lu", NAMES[k],
+            (unsigned long)(stats.issued[k] - reported.issued[k]),
+            (unsigned long)(stats.filtered[k] - reported.filtered[k]));
+  }
+  fprintf(stream, "\n");
+  reported = stats;
+}
+
+// ------------------------------------------------------------------------
+
+// Counts the call, true when it can be dropped
+static bool glstate_filter(GLStateKind kind, bool unchanged) {
+  if (unchanged) {
+    stats.filtered[kind]++;
+  } else {
+    stats.issued[kind]++;
+  }
+
+  return unchanged;
+}
+
+static int glstate_find(const GLenum* values, uint32_t count, GLenum value) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (values[i] == value) return (int)i;
+  }
+
+  return -1;
+}
+
+// Counted with the texture binds that needed it
+static void glstate_active_unit(GLuint unit) {
+  if (state.activeUnit == unit) return;
+  stats.issued[GLSTATE_TEXTURE]++;
+  glActiveTexture(GL_TEXTURE0 + unit);
+  state.activeUnit = unit;
+}
@@ -0,0 +1,72 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Last value given to each piece of GL state the engine changes, so a call
+// setting it again never reaches the driver. Objects are bound and deleted
+// through here too, deleting drops them from the cache the way GL unbinds
+// them. Code that touches the same state directly calls glstate_reset
+// afterwards. GL thread only.
+
+// Texture units tracked, units past it are bound every time. GL 3.3 has at
+// least 48, shaders sample from the first 16.
+#define GLSTATE_MAX_UNITS 32
+// Unit textures are bound to while they are created or updated, past the
+// ones shaders sample from so uploads never disturb a draw's textures
+#define GLSTATE_UPLOAD_UNIT (GLSTATE_MAX_UNITS - 1)
+
+typedef enum {
+  GLSTATE_PROGRAM,
+  GLSTATE_VERTEX_ARRAY,
+  GLSTATE_BUFFER,
+  GLSTATE_TEXTURE,  // active unit changes included
+  GLSTATE_SAMPLER,
+  GLSTATE_FIXED,    // capabilities, depth, blend, cull, masks and viewport
+  GLSTATE_KINDS,
+} GLStateKind;
+
+typedef struct {
+  uint64_t issued[GLSTATE_KINDS];    // calls that reached GL
+  uint64_t filtered[GLSTATE_KINDS];  // calls dropped, GL had the value
+} GLStateStats;
+
+// Forgets every value, the next call of each kind reaches GL. Call once the
+// context is current.
+void glstate_reset(void);
+
+void glstate_use_program(GLuint program);
+void glstate_bind_vertex_array(GLuint vertexArray);
+// The element array binding belongs to the vertex array, binding another
+// forgets it
+void glstate_bind_buffer(GLenum target, GLuint buffer);
+// Always reaches GL, the indexed binding isn't tracked. Also binds the
+// buffer to `target`, as GL does.
+void glstate_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+void glstate_bind_texture(GLuint unit, GLenum target, GLuint texture);
+void glstate_bind_sampler(GLuint unit, GLuint sampler);
+
+// GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE and the like
+void glstate_set_enabled(GLenum capability, bool enabled);
+void glstate_depth_func(GLenum func);
+void glstate_depth_mask(bool write);
+// All four channels at once
+void glstate_color_mask(bool write);
+void glstate_blend_func(GLenum src, GLenum dst);
+void glstate_cull_face(GLenum face);
+void glstate_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+void glstate_delete_program(GLuint program);
+void glstate_delete_vertex_arrays(GLsizei count, const GLuint* vertexArrays);
+void glstate_delete_buffers(GLsizei count, const GLuint* buffers);
+void glstate_delete_textures(GLsizei count, const GLuint* textures);
+void glstate_delete_samplers(GLsizei count, const GLuint* samplers);
+
+GLStateStats glstate_get_stats(void);
+// Calls issued and filtered since the last report, a stats report
+void glstate_print_frame_stats(FILE* stream);
+
+#endif  // GLSTATE_H
@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "job.h"
+
+typedef struct {
+  JobRangeFunc func;
+  void* data;
+  uint32_t count;
+  uint32_t grain;
+
+  atomic_uint next;    // first item of the next unclaimed chunk
+  atomic_uint exited;  // helper jobs that are done touching the batch
+} JobBatch;
+
+// Privates
+static void* job_worker(void* arg);
+static void job_batch_run(JobBatch* batch);
+static void job_batch_help(void* data);
+static uint32_t job_pool_cancel(JobPool* pool, JobFunc func, void* data);
+
+JobPool* job_pool_create(uint32_t numThreads) {
+  if (numThreads == 0) {
+    uint32_t cores = job_num_cores();
+    numThreads = cores > 1 ? cores - 1 : 1;
+  }
+
+  JobPool* pool = calloc(1, sizeof(JobPool));
+  if (pool == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate job pool\n");
+    return NULL;
+  }
+
+  pool->capacity = 256;
+  pool->queue = malloc(pool->capacity * sizeof(Job));
+  pool->threads = malloc(numThreads * sizeof(pthread_t));
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+
+  for (uint32_t i = 0; i < numThreads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, job_worker, pool) != 0) {
+      fprintf(stderr, "ERROR: Failed to start job worker %u\n", i);
+      break;
+    }
+    pool->numThreads++;
+  }
+
+  return pool;
+}
+
+void job_pool_destroy(JobPool* pool) {
+  if (pool == NULL) return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (uint32_t i = 0; i < pool->numThreads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->threads);
+  free(pool->queue);
+  free(pool);
+}
+
+void job_pool_submit(JobPool* pool, JobFunc func, void* data) {
+  pthread_mutex_lock(&pool->mutex);
+
+  if (pool->count == pool->capacity) {
+    // Unroll the ring into a larger buffer
+    Job* queue = malloc(pool->capacity * 2 * sizeof(Job));
+    for (uint32_t i = 0; i < pool->count; i++) {
+      queue[i] = pool->queue[(pool->head + i) % pool->capacity];
+    }
+    free(pool->queue);
+    pool->queue = queue;
+    pool->head = 0;
+    pool->capacity *= 2;
+  }
+
+  pool->queue[(pool->head + pool->count) % pool->capacity] =
+      (Job){.func = func, .data = data};
+  pool->count++;
+
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void job_pool_parallel_for(JobPool* pool, uint32_t count, uint32_t grain,
+                           JobRangeFunc func, void* data) {
+  if (count == 0) return;
+  if (grain == 0) grain = 1;
+
+  uint32_t numChunks = (count + grain - 1) / grain;
+  if (pool == NULL || numChunks == 1) {
+    func(data, 0, count);
+    return;
+  }
+
+  JobBatch batch = {
+      .func = func,
+      .data = data,
+      .count = count,
+      .grain = grain,
+  };
+  atomic_init(&batch.next, 0);
+  atomic_init(&batch.exited, 0);
+
+  uint32_t numHelpers = numChunks - 1;
+  if (numHelpers > pool->numThreads) numHelpers = pool->numThreads;
+  for (uint32_t i = 0; i < numHelpers; i++) {
+    job_pool_submit(pool, job_batch_help, &batch);
+  }
+
+  job_batch_run(&batch);
+
+  // Every chunk is claimed now. The batch lives on this stack frame, so wait
+  // until no helper references it. Helpers still queued would find nothing
+  // left to do and are dropped, rather than running whatever else is queued
+  // ahead of them on this thread. Helpers already running are finishing
+  // their last chunk.
+  uint32_t cancelled = job_pool_cancel(pool, job_batch_help, &batch);
+  while (atomic_load(&batch.exited) + cancelled < numHelpers) sched_yield();
+}
+
+uint32_t job_num_cores(void) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? (uint32_t)cores : 1;
+}
+
+void job_queue_push(JobQueue* queue, JobNode* node) {
+  JobNode* head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  do {
+    node->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &queue->head, &head, node, memory_order_release, memory_order_relaxed));
+}
+
+JobNode* job_queue_take_all(JobQueue* queue) {
+  JobNode* node =
+      atomic_exchange_explicit(&queue->head, NULL, memory_order_acquire);
+
+  // The stack is newest first, reverse it
+  JobNode* oldest = NULL;
+  while (node != NULL) {
+    JobNode* next = node->next;
+    node->next = oldest;
+    oldest = node;
+    node = next;
+  }
+
+  return oldest;
+}
+
+// ------------------------------------------------------------------------
+
+static void* job_worker(void* arg) {
+  JobPool* pool = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->count == 0 && !pool->quit) {
+      pthread_cond_wait(&pool->wake, &pool->mutex);
+    }
+    if (pool->count == 0 && pool->quit) {
+      pthread_mutex_unlock(&pool->mutex);
+      return NULL;
+    }
+
+    Job job = pool->queue[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->count--;
+    pthread_mutex_unlock(&pool->mutex);
+
+    job.func(job.data);
+  }
+}
+
+// Removes the queued jobs matching `func` and `data`, keeping the order of
+// the others
+static uint32_t job_pool_cancel(JobPool* pool, JobFunc func, void* data) {
+  pthread_mutex_lock(&pool->mutex);
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < pool->count; i++) {
+    Job job = pool->queue[(pool->head + i) % pool->capacity];
+    if (job.func == func && job.data == data) continue;
+    pool->queue[(pool->head + kept++) % pool->capacity] = job;
+  }
+  uint32_t cancelled = pool->count - kept;
+  pool->count = kept;
+  pthread_mutex_unlock(&pool->mutex);
+
+  return cancelled;
+}
+
+static void job_batch_run(JobBatch* batch) {
+  for (;;) {
+    uint32_t begin = atomic_fetch_add(&batch->next, batch->grain);
+    if (begin >= batch->count) return;
+
+    uint32_t end = begin + batch->grain;
+    if (end > batch->count) end = batch->count;
+    batch->func(batch->data, begin, end);
+  }
+}
+
+static void job_batch_help(void* data) {
+  JobBatch* batch = data;
+  job_batch_run(batch);
+  atomic_fetch_add(&batch->exited, 1);
+}
@@ -0,0 +1,61 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*JobFunc)(void* data);
+// Processes items [begin, end) of a parallel_for
+typedef void (*JobRangeFunc)(void* data, uint32_t begin, uint32_t end);
+
+typedef struct {
+  JobFunc func;
+  void* data;
+} Job;
+
+// Fixed set of worker threads fed from a single FIFO queue
+typedef struct {
+  pthread_t* threads;
+  uint32_t numThreads;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  Job* queue;
+  uint32_t head;
+  uint32_t count;
+  uint32_t capacity;
+  bool quit;
+} JobPool;
+
+// Intrusive link, embedded as the first member of a completion
+typedef struct JobNode {
+  struct JobNode* next;
+} JobNode;
+
+// Lock-free multi-producer, single-consumer queue for handing results back
+// to one thread. Producers push with a CAS, the consumer takes everything at
+// once, so there is no ABA problem.
+typedef struct {
+  _Atomic(JobNode*) head;
+} JobQueue;
+
+// numThreads == 0 uses one worker per core minus the calling thread
+JobPool* job_pool_create(uint32_t numThreads);
+void job_pool_destroy(JobPool* pool);
+
+void job_pool_submit(JobPool* pool, JobFunc func, void* data);
+// Splits [0, count) into chunks of `grain` items, runs them on the workers and
+// the calling thread, and returns once all of them are done. The calling
+// thread only works on this batch, other queued jobs stay on the workers.
+void job_pool_parallel_for(JobPool* pool, uint32_t count, uint32_t grain,
+                           JobRangeFunc func, void* data);
+
+uint32_t job_num_cores(void);
+
+void job_queue_push(JobQueue* queue, JobNode* node);
+// Detaches every node pushed so far, returned oldest first
+JobNode* job_queue_take_all(JobQueue* queue);
+
+#endif  // JOB_H
@@ -1,12 +1,17 @@
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cglm/struct/box.h"
+#include "cglm/struct/vec2.h"
+#include "cglm/struct/vec3.h"
+#include "glstate.h"
 #include "mesh.h"
 
 Mesh* mesh_create(Vertex* vertices, GLuint* indices, Texture* textures,
                   GLuint numVertices, GLuint numIndices, GLuint numTextures) {
-  Mesh* mesh = (Mesh*)malloc(sizeof(Mesh));
+  Mesh* mesh = (Mesh*)calloc(1, sizeof(Mesh));
   if (mesh == NULL) {
     // Handle allocation failure
     fprintf(stderr, "Error: failed to allocate mesh\n");
@@ -20,6 +25,13 @@ Mesh* mesh_create(Vertex* vertices, GLuint* indices, Texture* textures,
   mesh->numIndices = numIndices;
   mesh->numTextures = numTextures;
 
+  glms_aabb_invalidate(mesh->aabb);
+  for (GLuint i = 0; i < numVertices; i++) {
+    mesh->aabb[0] = glms_vec3_minv(mesh->aabb[0], vertices[i].Position);
+    mesh->aabb[1] = glms_vec3_maxv(mesh->aabb[1], vertices[i].Position);
+  }
+  mesh->uvDensity = mesh_uv_density(mesh);
+
   mesh_setup(mesh);
 
   return mesh;
@@ -27,6 +39,7 @@ Mesh* mesh_create(Vertex* vertices, GLuint* indices, Texture* textures,
 
 void mesh_destroy(Mesh* mesh) {
   if (mesh != NULL) {
+    mesh_unload(mesh);
     free(mesh->vertices);
     free(mesh->indices);
     free(mesh->textures);
@@ -34,20 +47,28 @@ void mesh_destroy(Mesh* mesh) {
   }
 }
 
+// Releases the GPU buffers, the CPU arrays stay with their owner
+void mesh_unload(Mesh* mesh) {
+  glstate_delete_vertex_arrays(1, &mesh->VAO);
+  glstate_delete_buffers(1, &mesh->VBO);
+  glstate_delete_buffers(1, &mesh->EBO);
+  mesh->VAO = mesh->VBO = mesh->EBO = 0;
+}
+
 // Configuración de los buffers y arrays para el renderizado del mesh
 void mesh_setup(Mesh* mesh) {
   glGenVertexArrays(1, &mesh->VAO);
   glGenBuffers(1, &mesh->VBO);
   glGenBuffers(1, &mesh->EBO);
 
-  glBindVertexArray(mesh->VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+  glstate_bind_vertex_array(mesh->VAO);
+  glstate_bind_buffer(GL_ARRAY_BUFFER, mesh->VBO);
 
   glBufferData(GL_ARRAY_BUFFER, mesh->numVertices * sizeof(Vertex),
                &mesh->vertices[0], GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->numVertices * sizeof(GLuint),
+  glstate_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->numIndices * sizeof(GLuint),
                &mesh->indices[0], GL_STATIC_DRAW);
 
   glEnableVertexAttribArray(0);
@@ -71,18 +92,38 @@ void mesh_setup(Mesh* mesh) {
                         (void*)offsetof(Vertex, Bitangent));
 
   glEnableVertexAttribArray(5);
-  glVertexAttribPointer(5, 3, GL_FLOAT, false, sizeof(Vertex),
-                        (void*)offsetof(Vertex, m_BoneIDs));
+  glVertexAttribIPointer(5, MAX_BONE_INFLUENCE, GL_INT, sizeof(Vertex),
+                         (void*)offsetof(Vertex, m_BoneIDs));
 
   glEnableVertexAttribArray(6);
-  glVertexAttribPointer(6, 4, GL_FLOAT, false, sizeof(Vertex),
+  glVertexAttribPointer(6, MAX_BONE_INFLUENCE, GL_FLOAT, false, sizeof(Vertex),
                         (void*)offsetof(Vertex, m_Weights));
 
-  glBindVertexArray(0);
+  glstate_bind_vertex_array(0);
 }
 
 // Renderizado del mesh con el shader especificado
 void mesh_draw(Mesh* mesh, Shader* shader) {
+  mesh_bind_textures(mesh, shader);
+  mesh_draw_range(mesh, 0, mesh->numIndices);
+}
+
+void mesh_draw_range(const Mesh* mesh, GLuint firstIndex, GLuint numIndices) {
+  glstate_bind_vertex_array(mesh->VAO);
+  glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT,
+                 (const void*)(firstIndex * sizeof(GLuint)));
+}
+
+void mesh_bind_textures(const Mesh* mesh, Shader* shader) {
+  // Meshes sharing pools draw without touching the texture bindings
+  if (mesh->pooled) {
+    texpool_bind(mesh->diffuseSlot, MESH_DIFFUSE_UNIT);
+    texpool_bind(mesh->specularSlot, MESH_SPECULAR_UNIT);
+    glVertexAttribI2i(MESH_LAYERS_ATTRIB, mesh->diffuseSlot.layer,
+                      mesh->specularSlot.layer);
+    return;
+  }
+
   const char* diffuseTexture = "texture_diffuse";
   const char* specularTexture = "texture_specular";
   const char* normalTexture = "texture_normal";
@@ -94,8 +135,6 @@ void mesh_draw(Mesh* mesh, Shader* shader) {
   GLuint heightNr = 1;
 
   for (GLuint i = 0; i < mesh->numTextures; i++) {
-    glActiveTexture(GL_TEXTURE0 + i);
-
     char number[4];  // espacio para los números de texturas
     char* name = mesh->textures[i].type;
     if (strcmp(diffuseTexture, name) == 0) {
@@ -115,14 +154,47 @@ void mesh_draw(Mesh* mesh, Shader* shader) {
     // TODO: Possible Error
     snprintf(uniformName, sizeof(uniformName), "material.%s%s", name, number);
     shader_set_int(shader, uniformName, i);
-    glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
+    texture_bind(mesh->textures[i].handle, i);
   }
+}
 
-  // Draw the mesh
-  glBindVertexArray(mesh->VAO);
-  glDrawElements(GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_INT, 0);
-  glBindVertexArray(0);
+// Meshes without a diffuse or specular texture pool the fallback in its
+// place, like texture_bind would have bound it. The texture handles stay
+// with the mesh, their owner may release them once pooled.
+void mesh_pool_textures(Mesh* mesh) {
+  TextureHandle diffuse = TEXTURE_FALLBACK;
+  TextureHandle specular = TEXTURE_FALLBACK;
+  for (GLuint i = mesh->numTextures; i-- > 0;) {
+    if (strcmp(mesh->textures[i].type, "texture_diffuse") == 0) {
+      diffuse = mesh->textures[i].handle;
+    } else if (strcmp(mesh->textures[i].type, "texture_specular") == 0) {
+      specular = mesh->textures[i].handle;
+    }
+  }
+
+  mesh->diffuseSlot = texpool_add(diffuse);
+  mesh->specularSlot = texpool_add(specular);
+  mesh->pooled = true;
+}
+
+// Square root of the ratio of UV area to surface area over every triangle,
+// 0 for meshes without texture coordinates
+float mesh_uv_density(const Mesh* mesh) {
+  float area = 0.0f;
+  float uvArea = 0.0f;
+  for (GLuint i = 0; i + 2 < mesh->numIndices; i += 3) {
+    const Vertex* a = &mesh->vertices[mesh->indices[i]];
+    const Vertex* b = &mesh->vertices[mesh->indices[i + 1]];
+    const Vertex* c = &mesh->vertices[mesh->indices[i + 2]];
+
+    vec3s edge0 = glms_vec3_sub(b->Position, a->Position);
+    vec3s edge1 = glms_vec3_sub(c->Position, a->Position);
+    area += glms_vec3_norm(glms_vec3_cross(edge0, edge1));
+
+    vec2s uv0 = glms_vec2_sub(b->TexCoords, a->TexCoords);
+    vec2s uv1 = glms_vec2_sub(c->TexCoords, a->TexCoords);
+    uvArea += fabsf(glms_vec2_cross(uv0, uv1));
+  }
 
-  // Back to default
-  glActiveTexture(GL_TEXTURE0);
+  return area > 0.0f ? sqrtf(uvArea / area) : 0.0f;
 }
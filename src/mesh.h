@@ -8,9 +8,25 @@
 
 #include "cglm/types-struct.h"
 #include "shader.h"
+#include "texpool.h"
+#include "texture.h"
 
 #define MAX_BONE_INFLUENCE 4
 
+// Pooled meshes read their layers from this attribute, a constant set per
+// draw rather than an array, and sample their pools from fixed units
+#define MESH_LAYERS_ATTRIB 7
+#define MESH_DIFFUSE_UNIT 0
+#define MESH_SPECULAR_UNIT 1
+
+// Attributes a mesh actually provides, the Vertex layout itself is fixed
+typedef enum {
+  VERTEX_NORMALS = 1 << 0,
+  VERTEX_TEXCOORDS = 1 << 1,
+  VERTEX_TANGENTS = 1 << 2,
+  VERTEX_BONES = 1 << 3,
+} VertexFormat;
+
 typedef struct {
   vec3s Position;
   vec3s Normal;
@@ -25,28 +41,62 @@ typedef struct {
 } Vertex;
 
 typedef struct {
-  GLuint id;
+  TextureHandle handle;
   char* type;
   char* path;
 } Texture;
 
+// Index range of a mesh that was merged into a static batch, culled on its
+// own bounds
+typedef struct {
+  GLuint firstIndex;
+  GLuint numIndices;
+  vec3s aabb[2];
+} Submesh;
+
 typedef struct {
   Vertex* vertices;
   GLuint* indices;
   Texture* textures;
+  Submesh* submeshes;
   
   GLuint numVertices;
   GLuint numIndices;
   GLuint numTextures;
+  GLuint numSubmeshes;
+  GLuint format;  // VertexFormat flags
+
+  // Bounds of the vertices, in the space they are stored in
+  vec3s aabb[2];
+  // UV units per unit of that space, what texture streaming sizes mips by
+  float uvDensity;
+
+  // Diffuse and specular layers, used instead of textures when pooled
+  TexturePoolSlot diffuseSlot;
+  TexturePoolSlot specularSlot;
+  bool pooled;
 
   // Render Data
   GLuint VAO, VBO, EBO;
 } Mesh;
 
+// A heap mesh over malloc'd arrays it takes ownership of, freed by
+// mesh_destroy. Bounds come from the vertices, the format is left empty, set
+// it when they carry bones.
 Mesh* mesh_create(Vertex* vertices, GLuint* indices, Texture* textures,
                   GLuint numVertices, GLuint numIndices, GLuint numTextures);
 void mesh_destroy(Mesh* mesh);
+void mesh_unload(Mesh* mesh);
 void mesh_draw(Mesh* mesh, Shader* shader);
+// Draws `numIndices` indices from `firstIndex` with whatever textures are
+// bound
+void mesh_draw_range(const Mesh* mesh, GLuint firstIndex, GLuint numIndices);
+// What mesh_draw binds before drawing: the textures, or the pools and layers
+// of a pooled mesh
+void mesh_bind_textures(const Mesh* mesh, Shader* shader);
+// Moves the first diffuse and specular textures into texture pools
+void mesh_pool_textures(Mesh* mesh);
 void mesh_setup(Mesh* mesh);
+float mesh_uv_density(const Mesh* mesh);
 
 #endif // MESH_H
@@ -0,0 +1,357 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIP_X86
+#endif
+
+#include "mip.h"
+
+// Linear values keep 14 bits, so four of them still add up in 16
+#define MIP_ONE 16383
+// Alpha at or above this passes the alpha test
+#define MIP_ALPHA_CUTOFF 128
+
+// Averages 2x2 blocks of RGBA texels from two rows of `width` texels into
+// one row, starting at output texel `begin`
+typedef void (*MipRowFunc)(const uint16_t* row0, const uint16_t* row1,
+                           int32_t width, int32_t begin, uint16_t* out);
+
+typedef struct {
+  pthread_once_t once;
+  MipRowFunc row;
+  const char* kernel;
+  // Conversions between 8-bit and 14-bit linear values, for sRGB and for
+  // channels that are linear already
+  uint16_t srgbToLinear[256];
+  uint8_t linearToSrgb[MIP_ONE + 1];
+  uint16_t unormToLinear[256];
+  uint8_t linearToUnorm[MIP_ONE + 1];
+} MipTables;
+
+static MipTables tables = {.once = PTHREAD_ONCE_INIT};
+
+// Privates
+static void mip_init(void);
+static void mip_decode(const uint8_t* pixels, size_t texels, int32_t channels,
+                       int32_t srgbChannels, uint16_t* out);
+static void mip_encode(const uint16_t* texels, size_t count, int32_t channels,
+                       int32_t srgbChannels, uint8_t* out);
+static void mip_renormalize(uint16_t* texels, size_t count, int32_t channels);
+static float mip_coverage(const uint8_t* pixels, size_t texels,
+                          int32_t channels, int32_t alpha, float scale);
+static void mip_keep_coverage(uint8_t* pixels, size_t texels,
+                              int32_t channels, int32_t alpha, float target);
+static void mip_row_scalar(const uint16_t* row0, const uint16_t* row1,
+                           int32_t width, int32_t begin, uint16_t* out);
+#ifdef MIP_X86
+static void mip_row_sse2(const uint16_t* row0, const uint16_t* row1,
+                         int32_t width, int32_t begin, uint16_t* out);
+static void mip_row_avx2(const uint16_t* row0, const uint16_t* row1,
+                         int32_t width, int32_t begin, uint16_t* out);
+#endif
+
+uint32_t mip_count(int32_t width, int32_t height) {
+  uint32_t levels = 1;
+  while (width > 1 || height > 1) {
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    levels++;
+  }
+
+  return levels;
+}
+
+size_t mip_chain_size(int32_t width, int32_t height, int32_t channels) {
+  size_t size = 0;
+  for (;;) {
+    size += (size_t)width * height * channels;
+    if (width == 1 && height == 1) return size;
+
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+}
+
+uint8_t* mip_build_chain(const uint8_t* pixels, int32_t width, int32_t height,
+                         int32_t channels, uint32_t flags) {
+  pthread_once(&tables.once, mip_init);
+
+  // The last channel of grey-alpha and RGBA images is alpha, never sRGB
+  bool hasAlpha = channels == 2 || channels == 4;
+  int32_t alpha = hasAlpha ? channels - 1 : -1;
+  int32_t srgbChannels = 0;
+  if (flags & MIP_SRGB) srgbChannels = hasAlpha ? channels - 1 : channels;
+
+  size_t texels = (size_t)width * height;
+  uint8_t* chain = malloc(mip_chain_size(width, height, channels));
+  // Every level is filtered from the one above, kept at full precision
+  uint16_t* level = malloc(texels * 4 * sizeof(uint16_t));
+  uint16_t* next = malloc(
+      (texels / 2 + width + height) * 4 * sizeof(uint16_t));
+  if (chain == NULL || level == NULL || next == NULL) {
+    free(chain);
+    free(level);
+    free(next);
+    return NULL;
+  }
+
+  memcpy(chain, pixels, texels * channels);
+  mip_decode(pixels, texels, channels, srgbChannels, level);
+
+  float coverage = 0.0f;
+  bool keepCoverage = flags & MIP_ALPHA_COVERAGE && alpha >= 0;
+  if (keepCoverage) coverage = mip_coverage(pixels, texels, channels, alpha, 1);
+
+  uint8_t* out = chain + texels * channels;
+  while (width > 1 || height > 1) {
+    int32_t mipWidth = width > 1 ? width / 2 : 1;
+    int32_t mipHeight = height > 1 ? height / 2 : 1;
+    MipRowFunc row = width > 1 ? tables.row : mip_row_scalar;
+
+    for (int32_t y = 0; y < mipHeight; y++) {
+      int32_t y1 = 2 * y + 1 < height ? 2 * y + 1 : 2 * y;
+      row(level + (size_t)2 * y * width * 4, level + (size_t)y1 * width * 4,
+          width, 0, next + (size_t)y * mipWidth * 4);
+    }
+
+    size_t mipTexels = (size_t)mipWidth * mipHeight;
+    if (flags & MIP_NORMAL_MAP) mip_renormalize(next, mipTexels, channels);
+    mip_encode(next, mipTexels, channels, srgbChannels, out);
+    if (keepCoverage) {
+      mip_keep_coverage(out, mipTexels, channels, alpha, coverage);
+    }
+
+    uint16_t* swap = level;
+    level = next;
+    next = swap;
+    out += mipTexels * channels;
+    width = mipWidth;
+    height = mipHeight;
+  }
+
+  free(level);
+  free(next);
+  return chain;
+}
+
+const char* mip_kernel_name(void) {
+  pthread_once(&tables.once, mip_init);
+
+  return tables.kernel;
+}
+
+bool mip_use_kernel(const char* name) {
+  pthread_once(&tables.once, mip_init);
+
+  if (strcmp(name, "scalar") == 0) {
+    tables.row = mip_row_scalar;
+    tables.kernel = "scalar";
+    return true;
+  }
+#ifdef MIP_X86
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+    tables.row = mip_row_sse2;
+    tables.kernel = "sse2";
+    return true;
+  }
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+    tables.row = mip_row_avx2;
+    tables.kernel = "avx2";
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+// ------------------------------------------------------------------------
+
+static void mip_init(void) {
+  for (int i = 0; i < 256; i++) {
+    double c = i / 255.0;
+    double linear = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+    tables.srgbToLinear[i] = (uint16_t)lround(linear * MIP_ONE);
+    tables.unormToLinear[i] = (uint16_t)lround(c * MIP_ONE);
+  }
+
+  for (int i = 0; i <= MIP_ONE; i++) {
+    double linear = (double)i / MIP_ONE;
+    double c = linear <= 0.0031308 ? linear * 12.92
+                                   : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+    tables.linearToSrgb[i] = (uint8_t)lround(c * 255.0);
+    tables.linearToUnorm[i] = (uint8_t)lround(linear * 255.0);
+  }
+
+  tables.row = mip_row_scalar;
+  tables.kernel = "scalar";
+#ifdef MIP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    tables.row = mip_row_avx2;
+    tables.kernel = "avx2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    tables.row = mip_row_sse2;
+    tables.kernel = "sse2";
+  }
+#endif
+}
+
+// 8-bit texels to four linear 14-bit channels, missing channels read as zero
+static void mip_decode(const uint8_t* pixels, size_t texels, int32_t channels,
+                       int32_t srgbChannels, uint16_t* out) {
+  const uint16_t* lut[4];
+  for (int32_t c = 0; c < 4; c++) {
+    lut[c] = c < srgbChannels ? tables.srgbToLinear : tables.unormToLinear;
+  }
+
+  for (size_t i = 0; i < texels; i++, pixels += channels, out += 4) {
+    out[0] = out[1] = out[2] = out[3] = 0;
+    for (int32_t c = 0; c < channels; c++) out[c] = lut[c][pixels[c]];
+  }
+}
+
+static void mip_encode(const uint16_t* texels, size_t count, int32_t channels,
+                       int32_t srgbChannels, uint8_t* out) {
+  const uint8_t* lut[4];
+  for (int32_t c = 0; c < 4; c++) {
+    lut[c] = c < srgbChannels ? tables.linearToSrgb : tables.linearToUnorm;
+  }
+
+  for (size_t i = 0; i < count; i++, texels += 4, out += channels) {
+    for (int32_t c = 0; c < channels; c++) out[c] = lut[c][texels[c]];
+  }
+}
+
+// Averaged normals come out shorter than one. Two channel maps only store
+// x and y, those are kept inside the unit circle so z stays real.
+static void mip_renormalize(uint16_t* texels, size_t count, int32_t channels) {
+  if (channels < 2) return;
+
+  for (size_t i = 0; i < count; i++, texels += 4) {
+    float n[3] = {0.0f, 0.0f, 0.0f};
+    int32_t axes = channels >= 3 ? 3 : 2;
+    float length = 0.0f;
+    for (int32_t c = 0; c < axes; c++) {
+      n[c] = texels[c] * (2.0f / MIP_ONE) - 1.0f;
+      length += n[c] * n[c];
+    }
+    if (length == 0.0f || (axes == 2 && length <= 1.0f)) continue;
+
+    float scale = 1.0f / sqrtf(length);
+    for (int32_t c = 0; c < axes; c++) {
+      float value = (n[c] * scale + 1.0f) * 0.5f * MIP_ONE;
+      texels[c] = (uint16_t)(value < 0.0f        ? 0
+                             : value > MIP_ONE ? MIP_ONE
+                                               : value + 0.5f);
+    }
+  }
+}
+
+// Share of texels passing the alpha test once alpha is scaled by `scale`
+static float mip_coverage(const uint8_t* pixels, size_t texels,
+                          int32_t channels, int32_t alpha, float scale) {
+  size_t passed = 0;
+  for (size_t i = 0; i < texels; i++) {
+    if (pixels[i * channels + alpha] * scale >= MIP_ALPHA_CUTOFF) passed++;
+  }
+
+  return (float)passed / texels;
+}
+
+// Box filtering blurs alpha towards the middle, which makes alpha-tested
+// cutouts thin out or bloat with distance. Searches the alpha scale that
+// brings this level's coverage back to `target` and applies it.
+static void mip_keep_coverage(uint8_t* pixels, size_t texels,
+                              int32_t channels, int32_t alpha, float target) {
+  float low = 0.0f;
+  float high = 4.0f;
+  for (int step = 0; step < 10; step++) {
+    float scale = (low + high) * 0.5f;
+    if (mip_coverage(pixels, texels, channels, alpha, scale) < target) {
+      low = scale;
+    } else {
+      high = scale;
+    }
+  }
+
+  // Coverage moves in steps, take whichever side lands closer
+  float below = mip_coverage(pixels, texels, channels, alpha, low);
+  float above = mip_coverage(pixels, texels, channels, alpha, high);
+  float scale = target - below < above - target ? low : high;
+
+  for (size_t i = 0; i < texels; i++) {
+    float value = pixels[i * channels + alpha] * scale + 0.5f;
+    pixels[i * channels + alpha] = value > 255.0f ? 255 : (uint8_t)value;
+  }
+}
+
+static void mip_row_scalar(const uint16_t* row0, const uint16_t* row1,
+                           int32_t width, int32_t begin, uint16_t* out) {
+  int32_t mipWidth = width > 1 ? width / 2 : 1;
+  for (int32_t x = begin; x < mipWidth; x++) {
+    int32_t x0 = 2 * x * 4;
+    int32_t x1 = 2 * x + 1 < width ? x0 + 4 : x0;
+    for (int32_t c = 0; c < 4; c++) {
+      out[x * 4 + c] =
+          (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2;
+    }
+  }
+}
+
+#ifdef MIP_X86
+// Two output texels per step. Both rows are added first, then the halves
+// holding neighbouring texels are paired up and added.
+static void mip_row_sse2(const uint16_t* row0, const uint16_t* row1,
+                         int32_t width, int32_t begin, uint16_t* out) {
+  const __m128i round = _mm_set1_epi16(2);
+  int32_t mipWidth = width / 2;
+  int32_t x = begin;
+
+  for (; x + 2 <= mipWidth; x += 2) {
+    const __m128i* top = (const __m128i*)(row0 + x * 8);
+    const __m128i* bottom = (const __m128i*)(row1 + x * 8);
+    __m128i a =
+        _mm_add_epi16(_mm_loadu_si128(top), _mm_loadu_si128(bottom));
+    __m128i b =
+        _mm_add_epi16(_mm_loadu_si128(top + 1), _mm_loadu_si128(bottom + 1));
+
+    __m128i even = _mm_unpacklo_epi64(a, b);
+    __m128i odd = _mm_unpackhi_epi64(a, b);
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(even, odd), round);
+    _mm_storeu_si128((__m128i*)(out + x * 4), _mm_srli_epi16(sum, 2));
+  }
+
+  mip_row_scalar(row0, row1, width, x, out);
+}
+
+// Same as the SSE2 kernel four texels at a time. The unpacks work within
+// each 128-bit lane and leave the texels in 0 2 1 3 order.
+__attribute__((target("avx2"))) static void mip_row_avx2(
+    const uint16_t* row0, const uint16_t* row1, int32_t width, int32_t begin,
+    uint16_t* out) {
+  const __m256i round = _mm256_set1_epi16(2);
+  int32_t mipWidth = width / 2;
+  int32_t x = begin;
+
+  for (; x + 4 <= mipWidth; x += 4) {
+    const __m256i* top = (const __m256i*)(row0 + x * 8);
+    const __m256i* bottom = (const __m256i*)(row1 + x * 8);
+    __m256i a = _mm256_add_epi16(_mm256_loadu_si256(top),
+                                 _mm256_loadu_si256(bottom));
+    __m256i b = _mm256_add_epi16(_mm256_loadu_si256(top + 1),
+                                 _mm256_loadu_si256(bottom + 1));
+
+    __m256i even = _mm256_unpacklo_epi64(a, b);
+    __m256i odd = _mm256_unpackhi_epi64(a, b);
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(even, odd), round);
+    sum = _mm256_permute4x64_epi64(sum, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256((__m256i*)(out + x * 4), _mm256_srli_epi16(sum, 2));
+  }
+
+  mip_row_sse2(row0, row1, width, x, out);
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef MIP_H
+#define MIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  MIP_SRGB = 1 << 0,            // colour channels gamma-encoded, alpha linear
+  MIP_NORMAL_MAP = 1 << 1,      // renormalized after filtering
+  MIP_ALPHA_COVERAGE = 1 << 2,  // alpha scaled to keep level 0's coverage
+} MipFlags;
+
+// Levels of a full chain down to 1x1
+uint32_t mip_count(int32_t width, int32_t height);
+size_t mip_chain_size(int32_t width, int32_t height, int32_t channels);
+
+// Box filters 8-bit `pixels` into a full mip chain, level 0 included, largest
+// first and back to back. Filtering happens on linear values with 14 bits
+// of precision, sRGB channels are decoded first. Returns NULL when out of
+// memory, free() the result. Safe to call from any thread.
+uint8_t* mip_build_chain(const uint8_t* pixels, int32_t width, int32_t height,
+                         int32_t channels, uint32_t flags);
+
+// Kernels picked for this CPU: "avx2", "sse2" or "scalar"
+const char* mip_kernel_name(void);
+// Switches kernels by name, for benchmarks. False if the CPU lacks them.
+bool mip_use_kernel(const char* name);
+
+#endif  // MIP_H
@@ -0,0 +1,926 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assimp/GltfMaterial.h"
+#include "assimp/cimport.h"
+#include "assimp/postprocess.h"
+#include "cglm/struct/box.h"
+#include "cglm/struct/mat3.h"
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/vec3.h"
+#include "model.h"
+
+typedef struct {
+  size_t numNodes;
+  size_t numMeshRefs;
+  size_t numVertices;
+  size_t numIndices;
+  size_t numTextureRefs;
+  size_t numBones;
+  size_t numClips;
+  size_t numChannels;
+  size_t numVectorKeys;
+  size_t numQuatKeys;
+  size_t numNameBytes;  // node, bone, clip names and texture paths
+} ModelCounts;
+
+// Meshes per model_enqueue job
+#define MODEL_ENQUEUE_MESHES 32
+
+// What model_enqueue's jobs share. Each slice of MODEL_ENQUEUE_MESHES
+// meshes writes its own buffer and cull counts.
+typedef struct {
+  const Model* model;
+  RenderQueue* queue;
+  RenderBuffer* buffers;
+  CullStats* counts;
+  Shader* shader;
+  mat4s transform;
+  const CullFrustum* frustum;
+} ModelEnqueueBatch;
+
+// Privates
+static void model_count_node(const struct aiNode* node,
+                             const struct aiScene* scene, ModelCounts* counts);
+static void model_count_animations(const struct aiScene* scene,
+                                   ModelCounts* counts);
+static GLuint model_load_bones(Model* model, const struct aiMesh* mesh,
+                               Vertex* vertices);
+static void model_load_animations(Model* model, const struct aiScene* scene);
+static void model_batch_static(Model* model);
+static void model_pool_textures(Model* model);
+static void model_use_textures(const Mesh* mesh, mat4s world);
+static bool model_alpha_tested(const struct aiMaterial* material);
+static bool model_next_range(const Mesh* mesh, const CullFrustum* frustum,
+                             mat4s world, GLuint* cursor, Submesh* range,
+                             CullStats* counts);
+static void model_draw_ranges(const Mesh* mesh, Shader* shader, mat4s world,
+                              const CullFrustum* frustum);
+static void model_enqueue_range(void* data, uint32_t begin, uint32_t end);
+static void model_bind_mesh(const void* mesh, Shader* shader);
+static int model_compare_keys(const void* a, const void* b);
+static mat4s model_ai_to_mat4(const struct aiMatrix4x4* m);
+
+// Texture slots imported for every material, in binding order
+static const struct {
+  enum aiTextureType type;
+  char* name;
+} MATERIAL_TEXTURES[] = {
+    {aiTextureType_DIFFUSE, "texture_diffuse"},
+    {aiTextureType_SPECULAR, "texture_specular"},
+    {aiTextureType_HEIGHT, "texture_normal"},
+    {aiTextureType_AMBIENT, "texture_height"},
+};
+#define NUM_MATERIAL_TEXTURES \
+  (sizeof(MATERIAL_TEXTURES) / sizeof(MATERIAL_TEXTURES[0]))
+
+Model model_create(const char* path) {
+  return model_create_with_flags(path, 0);
+}
+
+Model model_create_with_flags(const char* path, ModelLoadFlags flags) {
+  // Diffuse maps are authored in sRGB
+  Model model = {.gammaCorrection = true};
+  model_load(&model, path, flags);
+
+  return model;
+}
+
+// Releases the GPU objects and every CPU-side allocation in one go
+void model_destroy(Model* model) {
+  for (GLuint i = 0; i < model->numMeshes; i++) {
+    mesh_unload(&model->meshes[i]);
+  }
+  for (GLuint i = 0; i < model->numLoadedTextures; i++) {
+    texture_release(model->loadedTextures[i].handle);
+  }
+
+  scene_destroy(&model->scene);
+  arena_destroy(&model->arena);
+
+  *model = (Model){0};
+}
+
+void model_load(Model* model, const char* path, ModelLoadFlags flags) {
+  const struct aiScene* scene =
+      aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+
+  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+      !scene->mRootNode) {
+    fprintf(stderr, "ERROR::ASSIMP::%s\n", aiGetErrorString());
+    return;
+  }
+
+  // Size the arena up front so the whole import fits in one block
+  ModelCounts counts = {0};
+  model_count_node(scene->mRootNode, scene, &counts);
+  model_count_animations(scene, &counts);
+
+  // Batching keeps a merged copy of the geometry next to the source meshes,
+  // along with its sort keys and a dynamic flag per node
+  bool batch = flags & MODEL_LOAD_BATCH_STATIC;
+  size_t geometryCopies = batch ? 2 : 1;
+  size_t batchBytes =
+      batch ? counts.numMeshRefs * sizeof(uint64_t) + counts.numNodes : 0;
+  // Each allocation may be padded up to the largest alignment
+  size_t numAllocs = 3 * geometryCopies * counts.numMeshRefs +
+                     counts.numTextureRefs + counts.numNodes +
+                     counts.numBones + 2 * counts.numClips +
+                     3 * counts.numChannels + 32;
+  model->arena = arena_create(
+      counts.numMeshRefs * geometryCopies *
+          (sizeof(Mesh) + sizeof(Submesh) + sizeof(int32_t) + sizeof(GLuint)) +
+      geometryCopies * (counts.numVertices * sizeof(Vertex) +
+                        counts.numIndices * sizeof(GLuint)) +
+      counts.numTextureRefs * 2 * sizeof(Texture) +
+      counts.numNodes * (2 * sizeof(mat4s) + sizeof(versors) +
+                         2 * sizeof(vec3s) + 2 * sizeof(uint32_t) + 1 +
+                         sizeof(char*)) +
+      counts.numBones * (sizeof(mat4s) + sizeof(int32_t) + sizeof(char*)) +
+      counts.numClips * sizeof(AnimationClip) +
+      counts.numChannels * sizeof(AnimationChannel) +
+      counts.numVectorKeys * sizeof(VectorKey) +
+      counts.numQuatKeys * sizeof(QuatKey) + counts.numNameBytes +
+      batchBytes + numAllocs * 16);
+
+  model->meshes = arena_new(&model->arena, Mesh, counts.numMeshRefs);
+  model->meshNodes = arena_new(&model->arena, int32_t, counts.numMeshRefs);
+  model->meshMaterials = arena_new(&model->arena, GLuint, counts.numMeshRefs);
+  model->loadedTextures =
+      arena_new(&model->arena, Texture, counts.numTextureRefs);
+  model->nodeNames = arena_new(&model->arena, char*, counts.numNodes);
+  model->scene = scene_create_in_arena(&model->arena, counts.numNodes);
+  model->skeleton = (Skeleton){
+      .names = arena_new(&model->arena, char*, counts.numBones),
+      .nodes = arena_new(&model->arena, int32_t, counts.numBones),
+      .offsets = arena_new(&model->arena, mat4s, counts.numBones),
+  };
+
+  extract_directory(path, model->directory, sizeof(model->directory));
+  model_process_node(model, scene->mRootNode, scene, SCENE_NO_PARENT);
+
+  // Bones can reference nodes visited after their mesh, bind them now
+  for (uint32_t b = 0; b < model->skeleton.numBones; b++) {
+    model->skeleton.nodes[b] = model_find_node(model, model->skeleton.names[b]);
+    if (model->skeleton.nodes[b] == SCENE_NO_PARENT) {
+      fprintf(stderr, "ERROR: Bone %s has no node\n", model->skeleton.names[b]);
+      model->skeleton.nodes[b] = 0;
+    }
+  }
+  if (model->skeleton.numBones > MAX_BONES) {
+    fprintf(stderr,
+            "ERROR: %s has %u bones, only the first %d deform vertices\n",
+            path, model->skeleton.numBones, MAX_BONES);
+  }
+  model_load_animations(model, scene);
+
+  GLuint numSourceMeshes = model->numMeshes;
+  if (flags & MODEL_LOAD_BATCH_STATIC) model_batch_static(model);
+  if (flags & MODEL_LOAD_TEXTURE_ARRAYS) model_pool_textures(model);
+
+  for (GLuint i = 0; i < model->numMeshes; i++) {
+    model->meshes[i].uvDensity = mesh_uv_density(&model->meshes[i]);
+    mesh_setup(&model->meshes[i]);
+  }
+
+  printf("%s: %u meshes drawn with %u draw calls\n", path, numSourceMeshes,
+         model->numMeshes);
+  arena_print_stats(&model->arena, path, stdout);
+  if (model->arena.numGrowths > 0) {
+    fprintf(stderr, "WARNING: %s outgrew its arena estimate %zu times\n",
+            path, model->arena.numGrowths);
+  }
+
+  aiReleaseImport(scene);
+}
+
+// Draws every mesh with the world matrix of the node that references it. Move
+// the whole model through the root node, scene node 0.
+void model_draw(Model* model, Shader* shader) {
+  model_draw_transformed(model, shader, glms_mat4_identity());
+}
+
+// Draws an instance of the model placed by `transform`. Skinned meshes get
+// the bare transform, their bone palette already holds the node hierarchy.
+void model_draw_transformed(Model* model, Shader* shader, mat4s transform) {
+  model_draw_culled(model, shader, transform, NULL);
+}
+
+void model_draw_culled(Model* model, Shader* shader, mat4s transform,
+                       const CullFrustum* frustum) {
+  model_draw_occluded(model, shader, transform, frustum, NULL);
+}
+
+void model_draw_occluded(Model* model, Shader* shader, mat4s transform,
+                         const CullFrustum* frustum, Occlusion* occlusion) {
+  scene_update(&model->scene);
+
+  for (GLuint i = 0; i < model->numMeshes; i++) {
+    Mesh* mesh = &model->meshes[i];
+    bool skinned = mesh->format & VERTEX_BONES;
+    mat4s world =
+        skinned ? transform
+                : glms_mat4_mul(transform,
+                                model->scene.world[model->meshNodes[i]]);
+    if (frustum != NULL && !skinned &&
+        !cull_test_aabb(frustum, mesh->aabb, world)) {
+      continue;
+    }
+    bool queried = occlusion != NULL && !skinned;
+    if (queried) {
+      vec3s box[2];
+      glms_aabb_transform(mesh->aabb, world, box);
+      if (!occlusion_begin_draw(occlusion, i, box)) continue;
+    }
+    shader_set_mat4(shader, "model", world);
+    if (!mesh->pooled) model_use_textures(mesh, world);
+    model_draw_ranges(mesh, shader, world, frustum);
+    if (queried) occlusion_end_draw(occlusion, i);
+  }
+
+  if (occlusion == NULL || occlusion_test_deferred(occlusion) == 0) return;
+
+  // Meshes hidden last frame, drawn unless their box query found no samples
+  shader_use(shader);
+  for (uint32_t d = 0; d < occlusion->numDeferred; d++) {
+    uint32_t i = occlusion->deferred[d];
+    Mesh* mesh = &model->meshes[i];
+    mat4s world =
+        glms_mat4_mul(transform, model->scene.world[model->meshNodes[i]]);
+    occlusion_begin_conditional(occlusion, i);
+    shader_set_mat4(shader, "model", world);
+    if (!mesh->pooled) model_use_textures(mesh, world);
+    model_draw_ranges(mesh, shader, world, frustum);
+    occlusion_end_conditional(occlusion);
+  }
+}
+
+void model_enqueue(Model* model, RenderQueue* queue, Shader* shader,
+                   mat4s transform, const CullFrustum* frustum,
+                   JobPool* pool) {
+  scene_update(&model->scene);
+  if (model->numMeshes == 0) return;
+
+  uint32_t numSlices =
+      (model->numMeshes + MODEL_ENQUEUE_MESHES - 1) / MODEL_ENQUEUE_MESHES;
+  ModelEnqueueBatch batch = {
+      .model = model,
+      .queue = queue,
+      .buffers = render_queue_buffers(queue, numSlices),
+      .counts = calloc(numSlices, sizeof(CullStats)),
+      .shader = shader,
+      .transform = transform,
+      .frustum = frustum,
+  };
+  job_pool_parallel_for(pool, model->numMeshes, MODEL_ENQUEUE_MESHES,
+                        model_enqueue_range, &batch);
+  for (uint32_t s = 0; s < numSlices; s++) cull_add_stats(batch.counts[s]);
+  free(batch.counts);
+
+  uint32_t first = queue->numPackets;
+  render_queue_merge(queue);
+
+  // Streaming isn't thread safe: the meshes that made it into the queue
+  // report their textures from here. Ranges of a mesh are consecutive.
+  const Mesh* last = NULL;
+  for (uint32_t p = first; p < queue->numPackets; p++) {
+    const Mesh* mesh = queue->packets[p].material;
+    if (mesh != last && !mesh->pooled) {
+      model_use_textures(mesh, queue->packets[p].model);
+    }
+    last = mesh;
+  }
+}
+
+int32_t model_find_node(const Model* model, const char* name) {
+  for (uint32_t i = 0; i < model->scene.count; i++) {
+    if (strcmp(model->nodeNames[i], name) == 0) return (int32_t)i;
+  }
+
+  return SCENE_NO_PARENT;
+}
+
+void model_process_node(Model* model, struct aiNode* node,
+                        const struct aiScene* scene, int32_t parent) {
+  int32_t index = scene_add_node_matrix(
+      &model->scene, parent, model_ai_to_mat4(&node->mTransformation));
+  model->nodeNames[index] = arena_strdup(&model->arena, node->mName.data);
+
+  // process all the node's meshes (if any)
+  for (GLuint i = 0; i < node->mNumMeshes; i++) {
+    struct aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+    model->meshes[model->numMeshes] = model_process_mesh(model, mesh, scene);
+    model->meshNodes[model->numMeshes] = index;
+    model->meshMaterials[model->numMeshes] = mesh->mMaterialIndex;
+    model->numMeshes++;
+  }
+  // then do the same for each of its children
+  for (GLuint i = 0; i < node->mNumChildren; i++) {
+    model_process_node(model, node->mChildren[i], scene, index);
+  }
+}
+
+Mesh model_process_mesh(Model* model, struct aiMesh* mesh,
+                        const struct aiScene* scene) {
+  GLuint numVertices = mesh->mNumVertices;
+  GLuint numIndices = 0;
+  for (GLuint i = 0; i < mesh->mNumFaces; i++) {
+    numIndices += mesh->mFaces[i].mNumIndices;
+  }
+
+  Vertex* vertices = arena_new(&model->arena, Vertex, numVertices);
+  GLuint* indices = arena_new(&model->arena, GLuint, numIndices);
+
+  GLuint format = 0;
+  if (mesh->mNormals != NULL) format |= VERTEX_NORMALS;
+  if (mesh->mTextureCoords[0] != NULL) format |= VERTEX_TEXCOORDS;
+  if (mesh->mTangents != NULL) format |= VERTEX_TANGENTS;
+  if (mesh->mNumBones > 0) format |= VERTEX_BONES;
+
+  vec3s aabb[2];
+  glms_aabb_invalidate(aabb);
+
+  for (GLuint i = 0; i < numVertices; i++) {
+    Vertex vertex = {0};
+    vertex.Position = (vec3s){
+        .x = mesh->mVertices[i].x,
+        .y = mesh->mVertices[i].y,
+        .z = mesh->mVertices[i].z,
+    };
+
+    if (mesh->mNormals != NULL) {
+      vertex.Normal = (vec3s){
+          .x = mesh->mNormals[i].x,
+          .y = mesh->mNormals[i].y,
+          .z = mesh->mNormals[i].z,
+      };
+    }
+
+    if (mesh->mTextureCoords[0]) {
+      vertex.TexCoords = (vec2s){
+          .x = mesh->mTextureCoords[0][i].x,
+          .y = mesh->mTextureCoords[0][i].y,
+      };
+    }
+
+    if (mesh->mTangents != NULL) {
+      vertex.Tangent = (vec3s){
+          .x = mesh->mTangents[i].x,
+          .y = mesh->mTangents[i].y,
+          .z = mesh->mTangents[i].z,
+      };
+
+      vertex.Bitangent = (vec3s){
+          .x = mesh->mBitangents[i].x,
+          .y = mesh->mBitangents[i].y,
+          .z = mesh->mBitangents[i].z,
+      };
+    }
+
+    vertices[i] = vertex;
+    aabb[0] = glms_vec3_minv(aabb[0], vertex.Position);
+    aabb[1] = glms_vec3_maxv(aabb[1], vertex.Position);
+  }
+
+  GLuint dropped = model_load_bones(model, mesh, vertices);
+  if (dropped > 0) {
+    fprintf(stderr, "ERROR: Mesh %s dropped %u influences of bones past %d\n",
+            mesh->mName.data, dropped, MAX_BONES);
+  }
+
+  // Indices
+  GLuint index = 0;
+  for (GLuint i = 0; i < mesh->mNumFaces; i++) {
+    struct aiFace face = mesh->mFaces[i];
+    for (GLuint j = 0; j < face.mNumIndices; j++) {
+      indices[index++] = face.mIndices[j];
+    }
+  }
+
+  // Diffuse, specular, normal and height maps in a single array
+  struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+  GLuint numTextures = 0;
+  for (size_t t = 0; t < NUM_MATERIAL_TEXTURES; t++) {
+    numTextures +=
+        aiGetMaterialTextureCount(material, MATERIAL_TEXTURES[t].type);
+  }
+
+  Texture* textures = arena_new(&model->arena, Texture, numTextures);
+  GLuint loaded = 0;
+  for (size_t t = 0; t < NUM_MATERIAL_TEXTURES; t++) {
+    loaded += model_load_material_textures(
+        model, material, MATERIAL_TEXTURES[t].type, MATERIAL_TEXTURES[t].name,
+        textures + loaded);
+  }
+
+  Mesh result = {
+      .vertices = vertices,
+      .indices = indices,
+      .textures = textures,
+
+      .numVertices = numVertices,
+      .numIndices = numIndices,
+      .numTextures = loaded,
+      .format = format,
+      .aabb = {aabb[0], aabb[1]},
+  };
+
+  return result;
+}
+
+// Paths longer than `size` are truncated, `directory` is always terminated
+void extract_directory(const char* path, char* directory, size_t size) {
+  // Find the last occurrence of '/' in 'path'
+  const char* lastSlash = strrchr(path, '/');
+
+  // If '/' is found, extract the directory part
+  if (lastSlash != NULL) {
+    size_t length = lastSlash - path;
+    if (length > size - 1) length = size - 1;
+    memcpy(directory, path, length);
+    directory[length] = '\0';  // Null-terminate the directory string
+  } else {
+    // Handle the case when '/' is not found in 'path'
+    snprintf(directory, size, ".");
+  }
+}
+
+// Writes the material's textures of `type` to `textures` and returns how many
+// were written. Every slot holds its own reference in the texture manager,
+// which shares the GL texture between meshes and models.
+GLuint model_load_material_textures(Model* model, struct aiMaterial* mat,
+                                    enum aiTextureType type, char* typeName,
+                                    Texture* textures) {
+  GLuint count = 0;
+
+  for (GLuint i = 0; i < aiGetMaterialTextureCount(mat, type); i++) {
+    struct aiString str;
+    if (aiGetMaterialTexture(mat, type, i, &str, NULL, NULL, NULL, NULL, NULL,
+                             NULL) != AI_SUCCESS) {
+      continue;
+    }
+
+    char filename[MAXLEN + 256];
+    snprintf(filename, sizeof(filename), "%s/%s", model->directory, str.data);
+
+    TextureFlags flags = 0;
+    if (model->gammaCorrection && type == aiTextureType_DIFFUSE) {
+      flags |= TEXTURE_SRGB;
+    }
+    if (type == aiTextureType_DIFFUSE && model_alpha_tested(mat)) {
+      flags |= TEXTURE_ALPHA_TEST;
+    }
+    // Assimp files tangent-space normal maps of .obj models as height maps
+    if (type == aiTextureType_HEIGHT) flags |= TEXTURE_NORMAL_MAP;
+
+    Texture texture = {
+        .handle = texture_load(filename, flags),
+        .type = typeName,
+        .path = arena_strdup(&model->arena, str.data),
+    };
+    textures[count++] = texture;
+    model->loadedTextures[model->numLoadedTextures++] = texture;
+  }
+
+  return count;
+}
+
+// ------------------------------------------------------------------------
+
+// Registers the mesh's bones in the model skeleton and stores the strongest
+// MAX_BONE_INFLUENCE weights of every vertex, normalized to sum to one.
+// Influences of bones past MAX_BONES are dropped, returns how many were.
+static GLuint model_load_bones(Model* model, const struct aiMesh* mesh,
+                               Vertex* vertices) {
+  Skeleton* skeleton = &model->skeleton;
+  GLuint dropped = 0;
+
+  for (GLuint b = 0; b < mesh->mNumBones; b++) {
+    const struct aiBone* bone = mesh->mBones[b];
+
+    uint32_t id = 0;
+    while (id < skeleton->numBones &&
+           strcmp(skeleton->names[id], bone->mName.data) != 0) {
+      id++;
+    }
+    if (id == skeleton->numBones) {
+      skeleton->names[id] = arena_strdup(&model->arena, bone->mName.data);
+      skeleton->offsets[id] = model_ai_to_mat4(&bone->mOffsetMatrix);
+      skeleton->numBones++;
+    }
+
+    for (GLuint w = 0; w < bone->mNumWeights; w++) {
+      Vertex* vertex = &vertices[bone->mWeights[w].mVertexId];
+      if (!animation_add_influence(vertex->m_BoneIDs, vertex->m_Weights, id,
+                                   bone->mWeights[w].mWeight)) {
+        dropped++;
+      }
+    }
+  }
+
+  for (GLuint v = 0; mesh->mNumBones > 0 && v < mesh->mNumVertices; v++) {
+    animation_normalize_influences(vertices[v].m_Weights);
+  }
+
+  return dropped;
+}
+
+// Converts every aiAnimation into a clip with times in seconds. Channels are
+// bound to scene nodes by name, unknown nodes are dropped.
+static void model_load_animations(Model* model, const struct aiScene* scene) {
+  model->numClips = scene->mNumAnimations;
+  model->clips = arena_new(&model->arena, AnimationClip, model->numClips);
+
+  for (GLuint a = 0; a < scene->mNumAnimations; a++) {
+    const struct aiAnimation* animation = scene->mAnimations[a];
+    float ticks = animation->mTicksPerSecond > 0.0
+                      ? (float)animation->mTicksPerSecond
+                      : 25.0f;
+
+    AnimationClip* clip = &model->clips[a];
+    clip->name = arena_strdup(&model->arena, animation->mName.data);
+    clip->duration = (float)animation->mDuration / ticks;
+    clip->channels =
+        arena_new(&model->arena, AnimationChannel, animation->mNumChannels);
+    clip->numChannels = 0;
+
+    for (GLuint c = 0; c < animation->mNumChannels; c++) {
+      const struct aiNodeAnim* src = animation->mChannels[c];
+      int32_t node = model_find_node(model, src->mNodeName.data);
+      if (node == SCENE_NO_PARENT) continue;
+
+      AnimationChannel* channel = &clip->channels[clip->numChannels++];
+      *channel = (AnimationChannel){
+          .node = node,
+          .positions = arena_new(&model->arena, VectorKey, src->mNumPositionKeys),
+          .rotations = arena_new(&model->arena, QuatKey, src->mNumRotationKeys),
+          .scales = arena_new(&model->arena, VectorKey, src->mNumScalingKeys),
+          .numPositions = src->mNumPositionKeys,
+          .numRotations = src->mNumRotationKeys,
+          .numScales = src->mNumScalingKeys,
+      };
+
+      for (GLuint k = 0; k < src->mNumPositionKeys; k++) {
+        const struct aiVectorKey* key = &src->mPositionKeys[k];
+        channel->positions[k] = (VectorKey){
+            .time = (float)key->mTime / ticks,
+            .value = {{key->mValue.x, key->mValue.y, key->mValue.z}},
+        };
+      }
+      for (GLuint k = 0; k < src->mNumRotationKeys; k++) {
+        const struct aiQuatKey* key = &src->mRotationKeys[k];
+        channel->rotations[k] = (QuatKey){
+            .time = (float)key->mTime / ticks,
+            .value = {{key->mValue.x, key->mValue.y, key->mValue.z,
+                       key->mValue.w}},
+        };
+      }
+      for (GLuint k = 0; k < src->mNumScalingKeys; k++) {
+        const struct aiVectorKey* key = &src->mScalingKeys[k];
+        channel->scales[k] = (VectorKey){
+            .time = (float)key->mTime / ticks,
+            .value = {{key->mValue.x, key->mValue.y, key->mValue.z}},
+        };
+      }
+    }
+  }
+}
+
+// Merges static meshes that share material and vertex format into a single
+// vertex/index range each. Vertices are pre-transformed into the space of the
+// root node, which the merged mesh is attached to, so moving the model still
+// works. Every source mesh stays addressable as a Submesh with its own bounds.
+static void model_batch_static(Model* model) {
+  GLuint numMeshes = model->numMeshes;
+  if (numMeshes < 2) return;
+
+  scene_update(&model->scene);
+  mat4s rootInv = glms_mat4_inv(model->scene.world[0]);
+
+  // Nodes driven by a clip, directly or through an ancestor, are dynamic
+  bool* dynamic = arena_calloc(&model->arena, model->scene.count, sizeof(bool),
+                               _Alignof(bool));
+  for (GLuint a = 0; a < model->numClips; a++) {
+    for (uint32_t c = 0; c < model->clips[a].numChannels; c++) {
+      dynamic[model->clips[a].channels[c].node] = true;
+    }
+  }
+  for (uint32_t i = 1; i < model->scene.count; i++) {
+    dynamic[i] = dynamic[i] || dynamic[model->scene.parent[i]];
+  }
+
+  // Group key in the high bits, mesh index in the low ones. Skinned and
+  // animated meshes get a unique group so they are never merged.
+  uint64_t* keys = arena_new(&model->arena, uint64_t, numMeshes);
+  for (GLuint i = 0; i < numMeshes; i++) {
+    uint64_t group =
+        (uint64_t)model->meshMaterials[i] << 8 | model->meshes[i].format;
+    if ((model->meshes[i].format & VERTEX_BONES) ||
+        dynamic[model->meshNodes[i]]) {
+      group = 1ull << 31 | i;
+    }
+    keys[i] = group << 32 | i;
+  }
+  qsort(keys, numMeshes, sizeof(uint64_t), model_compare_keys);
+
+  Mesh* meshes = arena_new(&model->arena, Mesh, numMeshes);
+  int32_t* meshNodes = arena_new(&model->arena, int32_t, numMeshes);
+  GLuint* meshMaterials = arena_new(&model->arena, GLuint, numMeshes);
+  GLuint count = 0;
+
+  GLuint end;
+  for (GLuint first = 0; first < numMeshes; first = end) {
+    end = first + 1;
+    while (end < numMeshes && keys[end] >> 32 == keys[first] >> 32) end++;
+
+    GLuint head = (GLuint)keys[first];
+    meshNodes[count] = model->meshNodes[head];
+    meshMaterials[count] = model->meshMaterials[head];
+
+    if (end - first == 1) {
+      meshes[count++] = model->meshes[head];
+      continue;
+    }
+
+    Mesh merged = model->meshes[head];
+    merged.numVertices = 0;
+    merged.numIndices = 0;
+    merged.numSubmeshes = end - first;
+    for (GLuint k = first; k < end; k++) {
+      merged.numVertices += model->meshes[(GLuint)keys[k]].numVertices;
+      merged.numIndices += model->meshes[(GLuint)keys[k]].numIndices;
+    }
+
+    merged.vertices = arena_new(&model->arena, Vertex, merged.numVertices);
+    merged.indices = arena_new(&model->arena, GLuint, merged.numIndices);
+    merged.submeshes = arena_new(&model->arena, Submesh, merged.numSubmeshes);
+    glms_aabb_invalidate(merged.aabb);
+
+    GLuint baseVertex = 0;
+    GLuint baseIndex = 0;
+    for (GLuint k = first; k < end; k++) {
+      GLuint i = (GLuint)keys[k];
+      const Mesh* src = &model->meshes[i];
+
+      mat4s m = glms_mat4_mul(rootInv, model->scene.world[model->meshNodes[i]]);
+      mat3s basis = glms_mat4_pick3(m);
+      mat3s normalMatrix = glms_mat3_transpose(glms_mat3_inv(basis));
+
+      Submesh* sub = &merged.submeshes[k - first];
+      sub->firstIndex = baseIndex;
+      sub->numIndices = src->numIndices;
+      glms_aabb_invalidate(sub->aabb);
+
+      for (GLuint v = 0; v < src->numVertices; v++) {
+        Vertex vertex = src->vertices[v];
+        vertex.Position = glms_mat4_mulv3(m, vertex.Position, 1.0f);
+        if (src->format & VERTEX_NORMALS) {
+          vertex.Normal =
+              glms_vec3_normalize(glms_mat3_mulv(normalMatrix, vertex.Normal));
+        }
+        if (src->format & VERTEX_TANGENTS) {
+          vertex.Tangent =
+              glms_vec3_normalize(glms_mat3_mulv(basis, vertex.Tangent));
+          vertex.Bitangent =
+              glms_vec3_normalize(glms_mat3_mulv(basis, vertex.Bitangent));
+        }
+
+        merged.vertices[baseVertex + v] = vertex;
+        sub->aabb[0] = glms_vec3_minv(sub->aabb[0], vertex.Position);
+        sub->aabb[1] = glms_vec3_maxv(sub->aabb[1], vertex.Position);
+      }
+
+      for (GLuint j = 0; j < src->numIndices; j++) {
+        merged.indices[baseIndex + j] = src->indices[j] + baseVertex;
+      }
+
+      glms_aabb_merge(merged.aabb, sub->aabb, merged.aabb);
+      baseVertex += src->numVertices;
+      baseIndex += src->numIndices;
+    }
+
+    meshes[count] = merged;
+    meshNodes[count] = 0;
+    count++;
+  }
+
+  model->meshes = meshes;
+  model->meshNodes = meshNodes;
+  model->meshMaterials = meshMaterials;
+  model->numMeshes = count;
+}
+
+// Copies the material textures into their pools, waiting for the loads, and
+// drops the model's references: the pools hold the only copy it draws with
+static void model_pool_textures(Model* model) {
+  texture_finish();
+  for (GLuint i = 0; i < model->numMeshes; i++) {
+    mesh_pool_textures(&model->meshes[i]);
+  }
+
+  for (GLuint i = 0; i < model->numLoadedTextures; i++) {
+    texture_release(model->loadedTextures[i].handle);
+  }
+  model->numLoadedTextures = 0;
+}
+
+// Tells texture streaming how large the mesh's textures show on screen,
+// measured at the centre of its bounds
+static void model_use_textures(const Mesh* mesh, mat4s world) {
+  vec3s center = glms_mat4_mulv3(
+      world, glms_vec3_scale(glms_vec3_add(mesh->aabb[0], mesh->aabb[1]), 0.5f),
+      1.0f);
+  float scale = cbrtf(fabsf(glms_mat3_det(glms_mat4_pick3(world))));
+  float uvDensity = scale > 0.0f ? mesh->uvDensity / scale : 0.0f;
+
+  for (GLuint t = 0; t < mesh->numTextures; t++) {
+    texture_use(mesh->textures[t].handle, center.raw, uvDensity);
+  }
+}
+
+// Meshes of one source material bind the same textures, or pool slots
+static void model_bind_mesh(const void* mesh, Shader* shader) {
+  mesh_bind_textures(mesh, shader);
+}
+
+// Visits the index ranges of the mesh to draw, one per call. Batched meshes
+// skip the submeshes outside `frustum`, consecutive visible ones are joined
+// into one range whose bounds cover them all. Other meshes, or a NULL
+// frustum, give the whole mesh once. `cursor` starts at 0. Tests are
+// counted into `counts`.
+static bool model_next_range(const Mesh* mesh, const CullFrustum* frustum,
+                             mat4s world, GLuint* cursor, Submesh* range,
+                             CullStats* counts) {
+  if (frustum == NULL || mesh->numSubmeshes < 2) {
+    if (*cursor > 0) return false;
+    *cursor = 1;
+    *range = (Submesh){
+        .numIndices = mesh->numIndices,
+        .aabb = {mesh->aabb[0], mesh->aabb[1]},
+    };
+    return true;
+  }
+
+  GLuint s = *cursor;
+  while (s < mesh->numSubmeshes &&
+         !cull_test_aabb_into(frustum, mesh->submeshes[s].aabb, world,
+                              counts)) {
+    s++;
+  }
+  if (s == mesh->numSubmeshes) {
+    *cursor = s;
+    return false;
+  }
+
+  *range = mesh->submeshes[s++];
+  while (s < mesh->numSubmeshes &&
+         cull_test_aabb_into(frustum, mesh->submeshes[s].aabb, world,
+                             counts)) {
+    range->numIndices += mesh->submeshes[s].numIndices;
+    glms_aabb_merge(range->aabb, mesh->submeshes[s].aabb, range->aabb);
+    s++;
+  }
+  *cursor = s;
+
+  return true;
+}
+
+// Binds the mesh's textures once for all of its visible ranges
+static void model_draw_ranges(const Mesh* mesh, Shader* shader, mat4s world,
+                              const CullFrustum* frustum) {
+  mesh_bind_textures(mesh, shader);
+
+  GLuint cursor = 0;
+  Submesh range;
+  CullStats counts = {0};
+  while (model_next_range(mesh, frustum, world, &cursor, &range, &counts)) {
+    mesh_draw_range(mesh, range.firstIndex, range.numIndices);
+  }
+  cull_add_stats(counts);
+}
+
+// Places, culls and keys meshes [begin, end) into the slice's own buffer
+static void model_enqueue_range(void* data, uint32_t begin, uint32_t end) {
+  ModelEnqueueBatch* batch = data;
+  const Model* model = batch->model;
+  uint32_t slice = begin / MODEL_ENQUEUE_MESHES;
+  RenderBuffer* buffer = &batch->buffers[slice];
+  CullStats* counts = &batch->counts[slice];
+
+  for (uint32_t i = begin; i < end; i++) {
+    const Mesh* mesh = &model->meshes[i];
+    bool skinned = mesh->format & VERTEX_BONES;
+    mat4s world =
+        skinned ? batch->transform
+                : glms_mat4_mul(batch->transform,
+                                model->scene.world[model->meshNodes[i]]);
+    if (batch->frustum != NULL && !skinned &&
+        !cull_test_aabb_into(batch->frustum, mesh->aabb, world, counts)) {
+      continue;
+    }
+
+    GLuint cursor = 0;
+    Submesh range;
+    while (model_next_range(mesh, batch->frustum, world, &cursor, &range,
+                            counts)) {
+      RenderPacket packet = {
+          .shader = batch->shader,
+          .VAO = mesh->VAO,
+          .bind = model_bind_mesh,
+          .material = mesh,
+          .materialId = (uint16_t)model->meshMaterials[i],
+          .model = world,
+          .mode = GL_TRIANGLES,
+          .first = range.firstIndex,
+          .count = range.numIndices,
+          .indexed = true,
+      };
+      vec3s center = glms_mat4_mulv3(
+          world,
+          glms_vec3_scale(glms_vec3_add(range.aabb[0], range.aabb[1]), 0.5f),
+          1.0f);
+      render_buffer_submit(batch->queue, buffer, RENDER_PASS_OPAQUE, &packet,
+                           center);
+    }
+  }
+}
+
+// Cut-out materials: glTF's MASK alpha mode, or an opacity map the way .obj
+// foliage is usually authored
+static bool model_alpha_tested(const struct aiMaterial* material) {
+  struct aiString mode;
+  if (aiGetMaterialString(material, AI_MATKEY_GLTF_ALPHAMODE, &mode) ==
+      AI_SUCCESS) {
+    return strcmp(mode.data, "MASK") == 0;
+  }
+
+  return aiGetMaterialTextureCount(material, aiTextureType_OPACITY) > 0;
+}
+
+static int model_compare_keys(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+// Upper bounds for everything model_process_node will allocate
+static void model_count_node(const struct aiNode* node,
+                             const struct aiScene* scene, ModelCounts* counts) {
+  counts->numNodes++;
+  counts->numNameBytes += node->mName.length + 1;
+  counts->numMeshRefs += node->mNumMeshes;
+
+  for (GLuint i = 0; i < node->mNumMeshes; i++) {
+    const struct aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+    const struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+    counts->numBones += mesh->mNumBones;
+    for (GLuint b = 0; b < mesh->mNumBones; b++) {
+      counts->numNameBytes += mesh->mBones[b]->mName.length + 1;
+    }
+    counts->numVertices += mesh->mNumVertices;
+    counts->numIndices += (size_t)mesh->mNumFaces * 3;
+    for (size_t t = 0; t < NUM_MATERIAL_TEXTURES; t++) {
+      enum aiTextureType type = MATERIAL_TEXTURES[t].type;
+      GLuint numTextures = aiGetMaterialTextureCount(material, type);
+      counts->numTextureRefs += numTextures;
+      for (GLuint k = 0; k < numTextures; k++) {
+        struct aiString str;
+        if (aiGetMaterialTexture(material, type, k, &str, NULL, NULL, NULL,
+                                 NULL, NULL, NULL) == AI_SUCCESS) {
+          counts->numNameBytes += str.length + 1;
+        }
+      }
+    }
+  }
+
+  for (GLuint i = 0; i < node->mNumChildren; i++) {
+    model_count_node(node->mChildren[i], scene, counts);
+  }
+}
+
+// Upper bounds for everything model_load_animations will allocate
+static void model_count_animations(const struct aiScene* scene,
+                                   ModelCounts* counts) {
+  counts->numClips = scene->mNumAnimations;
+  for (GLuint a = 0; a < scene->mNumAnimations; a++) {
+    const struct aiAnimation* animation = scene->mAnimations[a];
+    counts->numNameBytes += animation->mName.length + 1;
+    counts->numChannels += animation->mNumChannels;
+    for (GLuint c = 0; c < animation->mNumChannels; c++) {
+      const struct aiNodeAnim* channel = animation->mChannels[c];
+      counts->numVectorKeys +=
+          channel->mNumPositionKeys + channel->mNumScalingKeys;
+      counts->numQuatKeys += channel->mNumRotationKeys;
+    }
+  }
+}
+
+// Assimp matrices are row-major, cglm expects column-major
+static mat4s model_ai_to_mat4(const struct aiMatrix4x4* m) {
+  return glms_mat4_transpose(glms_mat4_make((float*)&m->a1));
+}
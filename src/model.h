@@ -0,0 +1,89 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "animation.h"
+#include "arena.h"
+#include "assimp/material.h"
+#include "assimp/scene.h"
+#include "cull.h"
+#include "mesh.h"
+#include "occlusion.h"
+#include "render.h"
+#include "scene.h"
+
+typedef enum {
+  // Merge static meshes sharing material and vertex format into one draw
+  MODEL_LOAD_BATCH_STATIC = 1 << 0,
+  // Sample diffuse and specular maps from texture array pools, one bind per
+  // pool instead of per mesh. Draw with the TEXTURE_ARRAYS shader variant.
+  MODEL_LOAD_TEXTURE_ARRAYS = 1 << 1,
+} ModelLoadFlags;
+
+typedef struct {
+  Mesh* meshes;
+  // One entry per texture reference held by the meshes, released on destroy
+  Texture* loadedTextures;
+
+  GLuint numMeshes;
+  GLuint numLoadedTextures;
+
+  // Node hierarchy of the imported file, meshNodes[i] places meshes[i]
+  Scene scene;
+  int32_t* meshNodes;
+  // Source material index of meshes[i]
+  GLuint* meshMaterials;
+  // Node names, used to bind bones and animation channels
+  char** nodeNames;
+
+  Skeleton skeleton;
+  AnimationClip* clips;
+  GLuint numClips;
+
+  // Backs every CPU-side allocation above, released by model_destroy
+  Arena arena;
+
+  char directory[256];
+  bool gammaCorrection;
+} Model;
+
+Model model_create(const char* path);
+Model model_create_with_flags(const char* path, ModelLoadFlags flags);
+void model_destroy(Model* model);
+void model_draw(Model* model, Shader* shader);
+void model_draw_transformed(Model* model, Shader* shader, mat4s transform);
+// Skips meshes whose bounds lie outside `frustum`, NULL draws them all.
+// Batched meshes draw only the index ranges of their visible submeshes.
+// Skinned meshes are always drawn, their bounds hold the bind pose only.
+void model_draw_culled(Model* model, Shader* shader, mat4s transform,
+                       const CullFrustum* frustum);
+// Also skips meshes that were occluded last frame unless their bounding box
+// now passes, see occlusion.h. `occlusion` holds one object per mesh, NULL
+// turns the test off. Rebinds `shader` after the box pass.
+void model_draw_occluded(Model* model, Shader* shader, mat4s transform,
+                         const CullFrustum* frustum, Occlusion* occlusion);
+// Submits what model_draw_culled would draw to `queue` instead, each index
+// range an opaque packet keyed by its source material. Meshes are placed,
+// culled and keyed on the pool's workers, NULL does it all on the calling
+// thread. Texture streaming hears of the visible ones on the calling thread.
+void model_enqueue(Model* model, RenderQueue* queue, Shader* shader,
+                   mat4s transform, const CullFrustum* frustum,
+                   JobPool* pool);
+int32_t model_find_node(const Model* model, const char* name);
+
+// privates
+void model_load(Model* model, const char* path, ModelLoadFlags flags);
+void model_process_node(Model* model, struct aiNode* node,
+                        const struct aiScene* scene, int32_t parent);
+Mesh model_process_mesh(Model* model, struct aiMesh* mesh,
+                        const struct aiScene* scene);
+
+GLuint model_load_material_textures(Model* model, struct aiMaterial* mat,
+                                    enum aiTextureType type, char* typeName,
+                                    Texture* textures);
+void extract_directory(const char* path, char* directory, size_t size);
+
+#endif  // MODEL_H
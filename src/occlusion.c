@@ -0,0 +1,228 @@
+#include <stdlib.h>
+
+#include "occlusion.h"
+
+#include "cglm/struct/vec3.h"
+#include "glstate.h"
+
+// Boxes the camera is this close to may lose the faces in front of it to
+// the near plane, their objects are drawn without asking
+#define OCCLUSION_NEAR_MARGIN 0.2f
+
+static OcclusionStats stats;
+static OcclusionStats reported;  // stats at the last frame report
+
+// Privates
+static void occlusion_read_results(Occlusion* occlusion);
+static bool occlusion_contains(const vec3s aabb[2], vec3s point);
+
+// Unit cube, corner at the origin
+static const float OCCLUSION_VERTICES[] = {
+    0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+};
+static const GLubyte OCCLUSION_INDICES[] = {
+    0, 2, 1, 0, 3, 2,  // -z
+    4, 5, 6, 4, 6, 7,  // +z
+    0, 1, 5, 0, 5, 4,  // -y
+    3, 7, 6, 3, 6, 2,  // +y
+    0, 4, 7, 0, 7, 3,  // -x
+    1, 2, 6, 1, 6, 5,  // +x
+};
+
+Occlusion occlusion_create(uint32_t count) {
+  Occlusion occlusion = {
+      .queries = malloc(count * sizeof(GLuint)),
+      .lastQueried = calloc(count, sizeof(uint32_t)),
+      .flags = malloc(count),
+      .boxes = malloc(count * sizeof(*occlusion.boxes)),
+      .deferred = malloc(count * sizeof(uint32_t)),
+      .count = count,
+      // Conservative queries may count samples a precise test would not,
+      // which only ever errs towards drawing
+      .target = GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+                                           : GL_ANY_SAMPLES_PASSED,
+  };
+  glGenQueries(count, occlusion.queries);
+  for (uint32_t i = 0; i < count; i++) {
+    occlusion.flags[i] = OCCLUSION_VISIBLE;
+  }
+
+  glGenVertexArrays(1, &occlusion.VAO);
+  glGenBuffers(1, &occlusion.VBO);
+  glGenBuffers(1, &occlusion.EBO);
+  glstate_bind_vertex_array(occlusion.VAO);
+  glstate_bind_buffer(GL_ARRAY_BUFFER, occlusion.VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(OCCLUSION_VERTICES),
+               OCCLUSION_VERTICES, GL_STATIC_DRAW);
+  glstate_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, occlusion.EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(OCCLUSION_INDICES),
+               OCCLUSION_INDICES, GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), NULL);
+  glEnableVertexAttribArray(0);
+  glstate_bind_vertex_array(0);
+
+  occlusion.shader =
+      shader_create("./glsl/occlusion_vs.glsl", "./glsl/occlusion_fs.glsl");
+
+  return occlusion;
+}
+
+void occlusion_destroy(Occlusion* occlusion) {
+  glDeleteQueries(occlusion->count, occlusion->queries);
+  glstate_delete_vertex_arrays(1, &occlusion->VAO);
+  glstate_delete_buffers(1, &occlusion->VBO);
+  glstate_delete_buffers(1, &occlusion->EBO);
+  glstate_delete_program(occlusion->shader.ID);
+
+  free(occlusion->queries);
+  free(occlusion->lastQueried);
+  free(occlusion->flags);
+  free(occlusion->boxes);
+  free(occlusion->deferred);
+  *occlusion = (Occlusion){0};
+}
+
+void occlusion_begin_frame(Occlusion* occlusion, mat4s viewProjection,
+                           vec3s eye) {
+  occlusion->frame++;
+  occlusion->viewProjection = viewProjection;
+  occlusion->eye = eye;
+  occlusion->numDeferred = 0;
+
+  occlusion_read_results(occlusion);
+}
+
+bool occlusion_begin_draw(Occlusion* occlusion, uint32_t index,
+                          const vec3s aabb[2]) {
+  uint8_t* flags = &occlusion->flags[index];
+  stats.objects++;
+
+  if (!(*flags & OCCLUSION_VISIBLE)) {
+    if (!occlusion_contains(aabb, occlusion->eye)) {
+      uint32_t d = occlusion->numDeferred++;
+      occlusion->deferred[d] = index;
+      occlusion->boxes[d][0] = aabb[0];
+      occlusion->boxes[d][1] = aabb[1];
+      stats.occluded++;
+      return false;
+    }
+    *flags |= OCCLUSION_VISIBLE;
+  }
+
+  bool due = (occlusion->frame + index) % OCCLUSION_REQUERY_FRAMES == 0;
+  if (due && !(*flags & OCCLUSION_PENDING)) {
+    glBeginQuery(occlusion->target, occlusion->queries[index]);
+    *flags |= OCCLUSION_PENDING;
+    occlusion->lastQueried[index] = occlusion->frame;
+    stats.drawQueries++;
+  }
+
+  return true;
+}
+
+void occlusion_end_draw(Occlusion* occlusion, uint32_t index) {
+  if (occlusion->lastQueried[index] == occlusion->frame &&
+      occlusion->flags[index] & OCCLUSION_PENDING) {
+    glEndQuery(occlusion->target);
+  }
+}
+
+// Objects whose previous box query is still out keep it, conditional
+// render then goes by that one
+uint32_t occlusion_test_deferred(Occlusion* occlusion) {
+  if (occlusion->numDeferred == 0) return 0;
+
+  shader_use(&occlusion->shader);
+  shader_set_mat4(&occlusion->shader, "viewProjection",
+                  occlusion->viewProjection);
+  glstate_color_mask(false);
+  glstate_depth_mask(false);
+  glstate_bind_vertex_array(occlusion->VAO);
+
+  for (uint32_t d = 0; d < occlusion->numDeferred; d++) {
+    uint32_t index = occlusion->deferred[d];
+    if (occlusion->flags[index] & OCCLUSION_PENDING) continue;
+
+    shader_set_vec3(&occlusion->shader, "boxMin", occlusion->boxes[d][0]);
+    shader_set_vec3(
+        &occlusion->shader, "boxSize",
+        glms_vec3_sub(occlusion->boxes[d][1], occlusion->boxes[d][0]));
+    glBeginQuery(occlusion->target, occlusion->queries[index]);
+    glDrawElements(GL_TRIANGLES, sizeof(OCCLUSION_INDICES), GL_UNSIGNED_BYTE,
+                   NULL);
+    glEndQuery(occlusion->target);
+
+    occlusion->flags[index] |= OCCLUSION_PENDING;
+    occlusion->lastQueried[index] = occlusion->frame;
+    stats.boxQueries++;
+  }
+
+  glstate_depth_mask(true);
+  glstate_color_mask(true);
+
+  return occlusion->numDeferred;
+}
+
+void occlusion_begin_conditional(Occlusion* occlusion, uint32_t index) {
+  glBeginConditionalRender(occlusion->queries[index], GL_QUERY_NO_WAIT);
+}
+
+void occlusion_end_conditional(Occlusion* occlusion) {
+  (void)occlusion;
+  glEndConditionalRender();
+}
+
+OcclusionStats occlusion_get_stats(void) {
+  return stats;
+}
+
+void occlusion_print_frame_stats(FILE* stream) {
+  fprintf(stream,
+          "occlusion: %u objects, %u occluded, %u revealed, %u draw + %u box "
+          "queries, %u late\n",
+          stats.objects - reported.objects,
+          stats.occluded - reported.occluded,
+          stats.revealed - reported.revealed,
+          stats.drawQueries - reported.drawQueries,
+          stats.boxQueries - reported.boxQueries, stats.late - reported.late);
+  reported = stats;
+}
+
+// ------------------------------------------------------------------------
+
+// Polls every query in flight, never waits for one
+static void occlusion_read_results(Occlusion* occlusion) {
+  for (uint32_t i = 0; i < occlusion->count; i++) {
+    uint8_t* flags = &occlusion->flags[i];
+    if (!(*flags & OCCLUSION_PENDING)) continue;
+
+    GLuint available = 0;
+    glGetQueryObjectuiv(occlusion->queries[i], GL_QUERY_RESULT_AVAILABLE,
+                        &available);
+    if (!available) {
+      if (occlusion->frame - occlusion->lastQueried[i] > 1 &&
+          !(*flags & OCCLUSION_LATE)) {
+        *flags |= OCCLUSION_LATE;
+        stats.late++;
+      }
+      continue;
+    }
+
+    GLuint passed = 0;
+    glGetQueryObjectuiv(occlusion->queries[i], GL_QUERY_RESULT, &passed);
+    if (passed && !(*flags & OCCLUSION_VISIBLE)) stats.revealed++;
+    *flags = passed ? OCCLUSION_VISIBLE : 0;
+  }
+}
+
+static bool occlusion_contains(const vec3s aabb[2], vec3s point) {
+  for (int a = 0; a < 3; a++) {
+    if (point.raw[a] < aabb[0].raw[a] - OCCLUSION_NEAR_MARGIN ||
+        point.raw[a] > aabb[1].raw[a] + OCCLUSION_NEAR_MARGIN) {
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,84 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+#include "shader.h"
+
+// Objects seen last frame are queried again every this many frames,
+// staggered by index so the queries spread over frames
+#define OCCLUSION_REQUERY_FRAMES 8
+
+// Hardware occlusion culling that never waits for a result. Every object
+// draws by what its last finished query said:
+//  1. Objects visible last frame draw first and fill the depth buffer. Some
+//     of them draw inside a query, which notices when they get hidden.
+//  2. The bounding boxes of the others are queried against that depth.
+//  3. Those draw under conditional render on their box query, which the
+//     GPU skips when no sample passed and draws while the result is out.
+// Results are read back a frame or more later, as they become available.
+// GL thread only.
+
+typedef enum {
+  OCCLUSION_VISIBLE = 1 << 0,  // last result had samples pass
+  OCCLUSION_PENDING = 1 << 1,  // query issued, result not read yet
+  OCCLUSION_LATE = 1 << 2,     // pending query already counted late
+} OcclusionFlags;
+
+typedef struct {
+  uint32_t objects;      // passed to occlusion_begin_draw
+  uint32_t occluded;     // deferred on last frame's result
+  uint32_t revealed;     // results flipping an object back to visible
+  uint32_t drawQueries;  // queries wrapped around real draws
+  uint32_t boxQueries;   // bounding boxes queried
+  uint32_t late;         // queries still out a frame after issue, once each
+} OcclusionStats;
+
+typedef struct {
+  GLuint* queries;
+  uint32_t* lastQueried;  // frame of each object's last query
+  uint8_t* flags;         // OcclusionFlags
+  vec3s (*boxes)[2];      // world bounds of the deferred objects
+  uint32_t* deferred;     // objects deferred this frame, in order
+  uint32_t numDeferred;
+  uint32_t count;
+
+  uint32_t frame;
+  mat4s viewProjection;
+  vec3s eye;
+  GLenum target;  // conservative any-samples queries when supported
+
+  Shader shader;
+  GLuint VAO, VBO, EBO;
+} Occlusion;
+
+// `count` objects, all assumed visible until queried. Needs a current GL
+// context.
+Occlusion occlusion_create(uint32_t count);
+void occlusion_destroy(Occlusion* occlusion);
+
+// Reads the results that are ready and takes the camera for the box pass
+void occlusion_begin_frame(Occlusion* occlusion, mat4s viewProjection,
+                           vec3s eye);
+// False when the object was hidden last frame: it is deferred to the box
+// pass and the caller skips it for now. Otherwise the caller draws it and
+// calls occlusion_end_draw.
+bool occlusion_begin_draw(Occlusion* occlusion, uint32_t index,
+                          const vec3s aabb[2]);
+void occlusion_end_draw(Occlusion* occlusion, uint32_t index);
+// Queries the deferred objects' boxes against the depth drawn so far and
+// returns how many were deferred. Leaves the box shader bound.
+uint32_t occlusion_test_deferred(Occlusion* occlusion);
+// Wrap the draw of each deferred object, occlusion->deferred[i]
+void occlusion_begin_conditional(Occlusion* occlusion, uint32_t index);
+void occlusion_end_conditional(Occlusion* occlusion);
+
+OcclusionStats occlusion_get_stats(void);
+// Objects drawn, deferred and queried since the last report, a stats report
+void occlusion_print_frame_stats(FILE* stream);
+
+#endif  // OCCLUSION_H
@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "pacing.h"
+
+// Sleeps wake up late by up to a scheduler tick, the rest is spun
+#define PACING_SPIN_MS 2.0
+
+static PacingStats stats;
+static PacingStats reported;  // stats at the last frame report
+
+// Privates
+static double pacing_now(void);
+static void pacing_limit(Pacing* pacing);
+
+Pacing pacing_create(uint32_t maxFramesInFlight, double targetFps) {
+  return (Pacing){
+      .maxFramesInFlight = maxFramesInFlight < PACING_MAX_FRAMES
+                               ? maxFramesInFlight
+                               : PACING_MAX_FRAMES,
+      .period = targetFps > 0.0 ? 1.0 / targetFps : 0.0,
+      .deadline = pacing_now(),
+      .inputTime = pacing_now(),
+  };
+}
+
+void pacing_destroy(Pacing* pacing) {
+  for (uint32_t i = 0; i < pacing->numFences; i++) {
+    glDeleteSync(
+        pacing->fences[(pacing->firstFence + i) % PACING_MAX_FRAMES]);
+  }
+  *pacing = (Pacing){0};
+}
+
+void pacing_begin_frame(Pacing* pacing) {
+  if (pacing->period > 0.0) pacing_limit(pacing);
+
+  if (pacing->maxFramesInFlight == 0) return;
+  double start = pacing_now();
+  while (pacing->numFences >= pacing->maxFramesInFlight) {
+    GLsync fence = pacing->fences[pacing->firstFence];
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    glDeleteSync(fence);
+    pacing->firstFence = (pacing->firstFence + 1) % PACING_MAX_FRAMES;
+    pacing->numFences--;
+  }
+  stats.fenceWaitMs += (pacing_now() - start) * 1000.0;
+}
+
+void pacing_mark_input(Pacing* pacing) {
+  pacing->inputTime = pacing_now();
+}
+
+void pacing_end_frame(Pacing* pacing) {
+  double latencyMs = (pacing_now() - pacing->inputTime) * 1000.0;
+  stats.frames++;
+  stats.latencyMs += latencyMs;
+  if (latencyMs > stats.latencyMsMax) stats.latencyMsMax = latencyMs;
+
+  if (pacing->maxFramesInFlight == 0) return;
+  uint32_t last =
+      (pacing->firstFence + pacing->numFences) % PACING_MAX_FRAMES;
+  pacing->fences[last] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  pacing->numFences++;
+}
+
+PacingStats pacing_get_stats(void) {
+  return stats;
+}
+
+void pacing_print_frame_stats(FILE* stream) {
+  uint32_t frames = stats.frames - reported.frames;
+  double perFrame = frames > 0 ? 1.0 / frames : 0.0;
+  fprintf(stream,
+          "pacing: %.2f ms input to swap (max %.2f), %.2f ms fence wait, "
+          "%.2f ms limiter wait\n",
+          (stats.latencyMs - reported.latencyMs) * perFrame,
+          stats.latencyMsMax,
+          (stats.fenceWaitMs - reported.fenceWaitMs) * perFrame,
+          (stats.limiterWaitMs - reported.limiterWaitMs) * perFrame);
+  reported = stats;
+  stats.latencyMsMax = 0.0;
+}
+
+// ------------------------------------------------------------------------
+
+static double pacing_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sleeps until shortly before the deadline and spins the rest. A frame that
+// ran over by more than a whole period starts the schedule again instead of
+// rushing to catch up.
+static void pacing_limit(Pacing* pacing) {
+  double start = pacing_now();
+  double remaining = pacing->deadline - start;
+  if (remaining > PACING_SPIN_MS / 1000.0) {
+    double sleep = remaining - PACING_SPIN_MS / 1000.0;
+    struct timespec ts = {
+        .tv_sec = (time_t)sleep,
+        .tv_nsec = (long)((sleep - (time_t)sleep) * 1e9),
+    };
+    nanosleep(&ts, NULL);
+  }
+  double now = pacing_now();
+  while (now < pacing->deadline) {
+    now = pacing_now();
+  }
+  stats.limiterWaitMs += (now - start) * 1000.0;
+
+  pacing->deadline += pacing->period;
+  if (pacing->deadline < now) pacing->deadline = now + pacing->period;
+}
@@ -0,0 +1,54 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Most frames pacing_begin_frame lets the GPU fall behind by
+#define PACING_MAX_FRAMES 4
+
+// Frame pacing for low latency. Fences placed after each swap cap how many
+// frames the driver may queue, so input sampled after pacing_begin_frame is
+// shown a bounded number of frames later. An optional limiter holds frames
+// to a target rate, sleeping most of the wait and spinning the last
+// PACING_SPIN_MS for accuracy. GL thread only.
+
+typedef struct {
+  uint32_t frames;
+  double latencyMs;  // input sampled to swap returned, summed
+  double latencyMsMax;
+  double fenceWaitMs;    // blocked on the GPU, summed
+  double limiterWaitMs;  // held back by the limiter, summed
+} PacingStats;
+
+typedef struct {
+  uint32_t maxFramesInFlight;  // 0 leaves queuing to the driver
+  double period;               // seconds per frame, 0 runs uncapped
+
+  GLsync fences[PACING_MAX_FRAMES];
+  uint32_t firstFence;
+  uint32_t numFences;
+  double deadline;   // when the limiter lets the next frame start
+  double inputTime;  // when pacing_mark_input was last called
+} Pacing;
+
+// At most `maxFramesInFlight` frames queued, clamped to PACING_MAX_FRAMES,
+// and `targetFps` frames per second. Zero turns either off.
+Pacing pacing_create(uint32_t maxFramesInFlight, double targetFps);
+void pacing_destroy(Pacing* pacing);
+
+// Waits for the limiter and for the GPU to catch up, before the frame
+// samples input
+void pacing_begin_frame(Pacing* pacing);
+// Call right after input was sampled, latency is measured from here
+void pacing_mark_input(Pacing* pacing);
+// Call right after the swap, fences the frame
+void pacing_end_frame(Pacing* pacing);
+
+PacingStats pacing_get_stats(void);
+// Input to swap latency and time spent waiting since the last report, a
+// stats report
+void pacing_print_frame_stats(FILE* stream);
+
+#endif  // PACING_H
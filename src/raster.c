@@ -0,0 +1,649 @@
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RASTER_X86
+#endif
+
+#include "raster.h"
+
+#include "cglm/struct/box.h"
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/vec3.h"
+#include "cglm/struct/vec4.h"
+#include "cglm/util.h"
+
+// Screen triangles one binning job can write
+#define RASTER_CHUNK_TRIANGLES (2 * RASTER_BIN_TRIANGLES)
+// Clip space vertices one binning job can keep
+#define RASTER_CHUNK_VERTICES (3 * RASTER_BIN_TRIANGLES)
+
+// Edge functions and depth as planes over the screen, e = a x + b y + c
+typedef struct {
+  float a[3], b[3], c[3];
+  float zx, zy, zc;
+} RasterSetup;
+
+// Draws the pixels of a triangle within [x0, x1) x [y0, y1), one tile at most
+typedef void (*RasterFunc)(const RasterTriangle* triangle, int x0, int y0,
+                           int x1, int y1, float* depth);
+
+typedef struct {
+  pthread_once_t once;
+  RasterFunc func;
+  const char* kernel;
+} RasterKernels;
+
+static RasterKernels kernels = {.once = PTHREAD_ONCE_INIT};
+static RasterStats stats;
+static RasterStats reported;  // stats at the last frame report
+
+// Privates
+static void raster_init(void);
+static void raster_grow_chunks(Raster* raster, uint32_t capacity);
+static void raster_bin_range(void* data, uint32_t begin, uint32_t end);
+static void raster_bin_chunk(Raster* raster, uint32_t chunk);
+static vec4s raster_transform(mat4s transform, const RasterOccluder* occluder,
+                              uint32_t index);
+static uint32_t raster_clip_near(const vec4s in[3], vec4s out[4]);
+static bool raster_project(const vec4s clip[3], RasterTriangle* triangle);
+static bool raster_pixels(const RasterTriangle* triangle, int rect[4]);
+static void raster_tile_range(void* data, uint32_t begin, uint32_t end);
+static void raster_draw_tile(Raster* raster, uint32_t tile);
+static bool raster_test_box(const Raster* raster, vec3s min, vec3s max);
+static RasterSetup raster_setup(const RasterTriangle* triangle);
+static void raster_scalar(const RasterTriangle* triangle, int x0, int y0,
+                          int x1, int y1, float* depth);
+#ifdef RASTER_X86
+static void raster_sse(const RasterTriangle* triangle, int x0, int y0,
+                       int x1, int y1, float* depth);
+static void raster_avx(const RasterTriangle* triangle, int x0, int y0,
+                       int x1, int y1, float* depth);
+#endif
+
+Raster raster_create(void) {
+  Raster raster = {
+      .depth = aligned_alloc(32, RASTER_WIDTH * RASTER_HEIGHT * sizeof(float)),
+      .blockMax = malloc(RASTER_BLOCKS_X * RASTER_BLOCKS_Y * sizeof(float)),
+      .viewProjection = glms_mat4_identity(),
+  };
+  for (int i = 0; i < RASTER_WIDTH * RASTER_HEIGHT; i++) {
+    raster.depth[i] = 1.0f;
+  }
+  for (int i = 0; i < RASTER_BLOCKS_X * RASTER_BLOCKS_Y; i++) {
+    raster.blockMax[i] = 1.0f;
+  }
+
+  return raster;
+}
+
+void raster_destroy(Raster* raster) {
+  free(raster->depth);
+  free(raster->blockMax);
+  free(raster->occluders);
+  free(raster->triangles);
+  free(raster->vertices);
+  free(raster->bins);
+  free(raster->binCounts);
+  free(raster->rasterized);
+  *raster = (Raster){0};
+}
+
+void raster_begin(Raster* raster, mat4s viewProjection) {
+  raster->viewProjection = viewProjection;
+  raster->numOccluders = 0;
+  raster->numTriangles = 0;
+}
+
+void raster_add_occluder(Raster* raster, const RasterOccluder* occluder) {
+  if (raster->numOccluders == raster->occluderCapacity) {
+    raster->occluderCapacity =
+        raster->occluderCapacity > 0 ? raster->occluderCapacity * 2 : 16;
+    raster->occluders =
+        realloc(raster->occluders,
+                raster->occluderCapacity * sizeof(RasterOccluder));
+  }
+  raster->occluders[raster->numOccluders++] = *occluder;
+  raster->numTriangles += occluder->numTriangles;
+}
+
+void raster_render(Raster* raster, JobPool* pool) {
+  pthread_once(&kernels.once, raster_init);
+
+  uint32_t numChunks =
+      (raster->numTriangles + RASTER_BIN_TRIANGLES - 1) / RASTER_BIN_TRIANGLES;
+  if (numChunks > raster->chunkCapacity) {
+    raster_grow_chunks(raster, numChunks);
+  }
+  raster->numChunks = numChunks;
+
+  if (pool != NULL && numChunks > 1) {
+    job_pool_parallel_for(pool, numChunks, 1, raster_bin_range, raster);
+  } else {
+    raster_bin_range(raster, 0, numChunks);
+  }
+  if (pool != NULL) {
+    job_pool_parallel_for(pool, RASTER_TILES, 1, raster_tile_range, raster);
+  } else {
+    raster_tile_range(raster, 0, RASTER_TILES);
+  }
+
+  stats.triangles += raster->numTriangles;
+  for (uint32_t c = 0; c < numChunks; c++) {
+    stats.rasterized += raster->rasterized[c];
+    for (uint32_t t = 0; t < RASTER_TILES; t++) {
+      stats.binned += raster->binCounts[c * RASTER_TILES + t];
+    }
+  }
+}
+
+bool raster_test_aabb(const Raster* raster, const vec3s aabb[2],
+                      mat4s world) {
+  vec3s box[2];
+  glms_aabb_transform((vec3s*)aabb, world, box);
+
+  bool visible = raster_test_box(raster, box[0], box[1]);
+  stats.tested++;
+  stats.occluded += !visible;
+
+  return visible;
+}
+
+uint32_t raster_test_bounds(const Raster* raster, const CullBounds* bounds,
+                            uint32_t* indices, uint32_t count) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t index = indices[i];
+    vec3s center = {{bounds->centerX[index], bounds->centerY[index],
+                     bounds->centerZ[index]}};
+    vec3s extent = {{bounds->extentX[index], bounds->extentY[index],
+                     bounds->extentZ[index]}};
+    if (raster_test_box(raster, glms_vec3_sub(center, extent),
+                        glms_vec3_add(center, extent))) {
+      indices[kept++] = index;
+    }
+  }
+  stats.tested += count;
+  stats.occluded += count - kept;
+
+  return kept;
+}
+
+const char* raster_kernel_name(void) {
+  pthread_once(&kernels.once, raster_init);
+
+  return kernels.kernel;
+}
+
+bool raster_use_kernel(const char* name) {
+  pthread_once(&kernels.once, raster_init);
+
+  if (strcmp(name, "scalar") == 0) {
+    kernels.func = raster_scalar;
+    kernels.kernel = "scalar";
+    return true;
+  }
+#ifdef RASTER_X86
+  if (strcmp(name, "sse") == 0 && __builtin_cpu_supports("sse")) {
+    kernels.func = raster_sse;
+    kernels.kernel = "sse";
+    return true;
+  }
+  if (strcmp(name, "avx") == 0 && __builtin_cpu_supports("avx")) {
+    kernels.func = raster_avx;
+    kernels.kernel = "avx";
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+RasterStats raster_get_stats(void) {
+  return stats;
+}
+
+void raster_print_frame_stats(FILE* stream) {
+  uint64_t tested = stats.tested - reported.tested;
+  uint64_t occluded = stats.occluded - reported.occluded;
+  fprintf(stream,
+          "raster: %lu occluder triangles, %lu drawn in %lu tiles, %lu of "
+          "%lu bounds occluded (%.1f%%), %s\n",
+          (unsigned long)(stats.triangles - reported.triangles),
+          (unsigned long)(stats.rasterized - reported.rasterized),
+          (unsigned long)(stats.binned - reported.binned),
+          (unsigned long)occluded, (unsigned long)tested,
+          tested > 0 ? 100.0 * occluded / tested : 0.0,
+          raster_kernel_name());
+  reported = stats;
+}
+
+// ------------------------------------------------------------------------
+
+static void raster_init(void) {
+  kernels.func = raster_scalar;
+  kernels.kernel = "scalar";
+#ifdef RASTER_X86
+  // Rows of 32 pixel tiles leave most of eight lanes idle on small
+  // triangles, the AVX kernel measured no faster than SSE
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse")) {
+    kernels.func = raster_sse;
+    kernels.kernel = "sse";
+  }
+#endif
+}
+
+static void raster_grow_chunks(Raster* raster, uint32_t capacity) {
+  free(raster->triangles);
+  free(raster->vertices);
+  free(raster->bins);
+  free(raster->binCounts);
+  free(raster->rasterized);
+  raster->triangles = malloc((size_t)capacity * RASTER_CHUNK_TRIANGLES *
+                             sizeof(RasterTriangle));
+  raster->vertices = malloc((size_t)capacity * RASTER_CHUNK_VERTICES *
+                            sizeof(vec4s));
+  raster->bins = malloc((size_t)capacity * RASTER_TILES *
+                        RASTER_CHUNK_TRIANGLES * sizeof(uint16_t));
+  raster->binCounts =
+      malloc((size_t)capacity * RASTER_TILES * sizeof(uint16_t));
+  raster->rasterized = malloc(capacity * sizeof(uint32_t));
+  raster->chunkCapacity = capacity;
+}
+
+static void raster_bin_range(void* data, uint32_t begin, uint32_t end) {
+  for (uint32_t c = begin; c < end; c++) {
+    raster_bin_chunk(data, c);
+  }
+}
+
+// Transforms triangles [chunk * RASTER_BIN_TRIANGLES, +RASTER_BIN_TRIANGLES)
+// of all the occluders in a row, and lists the ones facing the camera on
+// screen in the bins of the tiles they touch
+static void raster_bin_chunk(Raster* raster, uint32_t chunk) {
+  uint32_t first = chunk * RASTER_BIN_TRIANGLES;
+  uint32_t last = first + RASTER_BIN_TRIANGLES;
+  if (last > raster->numTriangles) last = raster->numTriangles;
+
+  RasterTriangle* triangles =
+      raster->triangles + (size_t)chunk * RASTER_CHUNK_TRIANGLES;
+  uint16_t* bins =
+      raster->bins + (size_t)chunk * RASTER_TILES * RASTER_CHUNK_TRIANGLES;
+  uint16_t* binCounts = raster->binCounts + chunk * RASTER_TILES;
+  vec4s* vertices = raster->vertices + (size_t)chunk * RASTER_CHUNK_VERTICES;
+  memset(binCounts, 0, RASTER_TILES * sizeof(uint16_t));
+  uint32_t count = 0;
+
+  // Occluder holding the first triangle, and where its triangles start
+  uint32_t o = 0;
+  uint32_t start = 0;
+  while (start + raster->occluders[o].numTriangles <= first) {
+    start += raster->occluders[o++].numTriangles;
+  }
+
+  for (uint32_t t = first; t < last; o++) {
+    const RasterOccluder* occluder = &raster->occluders[o];
+    mat4s transform = glms_mat4_mul(raster->viewProjection, occluder->world);
+    uint32_t end = start + occluder->numTriangles;
+    if (end > last) end = last;
+
+    // Shared vertices are transformed once unless this chunk only holds a
+    // few of the occluder's triangles
+    bool shared = occluder->numVertices <= 3 * (end - t);
+    if (shared) {
+      for (uint32_t v = 0; v < occluder->numVertices; v++) {
+        vertices[v] = raster_transform(transform, occluder, v);
+      }
+    }
+
+    for (; t < end; t++) {
+      const uint32_t* index = occluder->indices + 3 * (t - start);
+      vec4s clip[3];
+      for (int v = 0; v < 3; v++) {
+        clip[v] = shared ? vertices[index[v]]
+                         : raster_transform(transform, occluder, index[v]);
+      }
+
+      // Entirely outside one side, or beyond the far plane
+      bool outside = false;
+      for (int a = 0; a < 3 && !outside; a++) {
+        outside = (clip[0].raw[a] > clip[0].w && clip[1].raw[a] > clip[1].w &&
+                   clip[2].raw[a] > clip[2].w) ||
+                  (a < 2 && clip[0].raw[a] < -clip[0].w &&
+                   clip[1].raw[a] < -clip[1].w && clip[2].raw[a] < -clip[2].w);
+      }
+      if (outside) continue;
+
+      vec4s polygon[4];
+      uint32_t numVertices = raster_clip_near(clip, polygon);
+      for (uint32_t v = 1; v + 1 < numVertices; v++) {
+        vec4s fan[3] = {polygon[0], polygon[v], polygon[v + 1]};
+        int rect[4];
+        if (!raster_project(fan, &triangles[count]) ||
+            !raster_pixels(&triangles[count], rect)) {
+          continue;
+        }
+
+        int tx1 = (rect[2] - 1) / RASTER_TILE_SIZE;
+        int ty1 = (rect[3] - 1) / RASTER_TILE_SIZE;
+        for (int ty = rect[1] / RASTER_TILE_SIZE; ty <= ty1; ty++) {
+          for (int tx = rect[0] / RASTER_TILE_SIZE; tx <= tx1; tx++) {
+            int tile = ty * RASTER_TILES_X + tx;
+            bins[tile * RASTER_CHUNK_TRIANGLES + binCounts[tile]++] =
+                (uint16_t)count;
+          }
+        }
+        count++;
+      }
+    }
+    start += occluder->numTriangles;
+  }
+
+  raster->rasterized[chunk] = count;
+}
+
+static vec4s raster_transform(mat4s transform, const RasterOccluder* occluder,
+                              uint32_t index) {
+  const float* p = (const float*)((const char*)occluder->positions +
+                                  (size_t)index * occluder->stride);
+
+  return glms_mat4_mulv(transform, (vec4s){{p[0], p[1], p[2], 1.0f}});
+}
+
+// Keeps the part in front of the near plane, z >= -w, as a triangle or a
+// quad
+static uint32_t raster_clip_near(const vec4s in[3], vec4s out[4]) {
+  uint32_t count = 0;
+  for (int i = 0; i < 3; i++) {
+    vec4s a = in[i];
+    vec4s b = in[(i + 1) % 3];
+    float da = a.z + a.w;
+    float db = b.z + b.w;
+    if (da >= 0.0f) out[count++] = a;
+    if ((da >= 0.0f) != (db >= 0.0f)) {
+      out[count++] = glms_vec4_lerp(a, b, da / (da - db));
+    }
+  }
+
+  return count;
+}
+
+// False for back facing and degenerate triangles
+static bool raster_project(const vec4s clip[3], RasterTriangle* triangle) {
+  for (int v = 0; v < 3; v++) {
+    float inverse = 1.0f / clip[v].w;
+    triangle->x[v] = (clip[v].x * inverse * 0.5f + 0.5f) * RASTER_WIDTH;
+    triangle->y[v] = (clip[v].y * inverse * 0.5f + 0.5f) * RASTER_HEIGHT;
+    triangle->z[v] = clip[v].z * inverse * 0.5f + 0.5f;
+  }
+  float area = (triangle->x[1] - triangle->x[0]) *
+                   (triangle->y[2] - triangle->y[0]) -
+               (triangle->x[2] - triangle->x[0]) *
+                   (triangle->y[1] - triangle->y[0]);
+
+  return area > 0.0f;
+}
+
+// Pixels whose centres the triangle's bounds hold, clamped to the screen,
+// as x0, y0, x1, y1 with the ends excluded. False when there are none.
+static bool raster_pixels(const RasterTriangle* triangle, int rect[4]) {
+  float minX = glm_min(glm_min(triangle->x[0], triangle->x[1]), triangle->x[2]);
+  float maxX = glm_max(glm_max(triangle->x[0], triangle->x[1]), triangle->x[2]);
+  float minY = glm_min(glm_min(triangle->y[0], triangle->y[1]), triangle->y[2]);
+  float maxY = glm_max(glm_max(triangle->y[0], triangle->y[1]), triangle->y[2]);
+  minX = glm_max(minX, 0.0f);
+  minY = glm_max(minY, 0.0f);
+  maxX = glm_min(maxX, (float)RASTER_WIDTH);
+  maxY = glm_min(maxY, (float)RASTER_HEIGHT);
+
+  rect[0] = (int)ceilf(minX - 0.5f);
+  rect[1] = (int)ceilf(minY - 0.5f);
+  rect[2] = (int)floorf(maxX - 0.5f) + 1;
+  rect[3] = (int)floorf(maxY - 0.5f) + 1;
+
+  return rect[0] < rect[2] && rect[1] < rect[3];
+}
+
+static void raster_tile_range(void* data, uint32_t begin, uint32_t end) {
+  for (uint32_t t = begin; t < end; t++) {
+    raster_draw_tile(data, t);
+  }
+}
+
+// Clears the tile, draws its bins in submission order and updates its
+// blocks
+static void raster_draw_tile(Raster* raster, uint32_t tile) {
+  int left = (int)(tile % RASTER_TILES_X) * RASTER_TILE_SIZE;
+  int bottom = (int)(tile / RASTER_TILES_X) * RASTER_TILE_SIZE;
+  int right = left + RASTER_TILE_SIZE;
+  int top = bottom + RASTER_TILE_SIZE;
+
+  for (int y = bottom; y < top; y++) {
+    float* row = raster->depth + y * RASTER_WIDTH;
+    for (int x = left; x < right; x++) {
+      row[x] = 1.0f;
+    }
+  }
+
+  for (uint32_t c = 0; c < raster->numChunks; c++) {
+    const RasterTriangle* triangles =
+        raster->triangles + (size_t)c * RASTER_CHUNK_TRIANGLES;
+    const uint16_t* bin =
+        raster->bins +
+        ((size_t)c * RASTER_TILES + tile) * RASTER_CHUNK_TRIANGLES;
+    uint32_t count = raster->binCounts[c * RASTER_TILES + tile];
+    for (uint32_t i = 0; i < count; i++) {
+      const RasterTriangle* triangle = &triangles[bin[i]];
+      int rect[4];
+      raster_pixels(triangle, rect);
+      kernels.func(triangle, rect[0] > left ? rect[0] : left,
+                   rect[1] > bottom ? rect[1] : bottom,
+                   rect[2] < right ? rect[2] : right,
+                   rect[3] < top ? rect[3] : top, raster->depth);
+    }
+  }
+
+  for (int by = bottom; by < top; by += RASTER_BLOCK_SIZE) {
+    for (int bx = left; bx < right; bx += RASTER_BLOCK_SIZE) {
+      float farthest = 0.0f;
+      for (int y = by; y < by + RASTER_BLOCK_SIZE; y++) {
+        const float* row = raster->depth + y * RASTER_WIDTH;
+        for (int x = bx; x < bx + RASTER_BLOCK_SIZE; x++) {
+          farthest = glm_max(farthest, row[x]);
+        }
+      }
+      raster->blockMax[(by / RASTER_BLOCK_SIZE) * RASTER_BLOCKS_X +
+                       bx / RASTER_BLOCK_SIZE] = farthest;
+    }
+  }
+}
+
+// Visible when the box's nearest depth is not behind the occluders at some
+// pixel its screen rectangle touches. Blocks whose farthest occluder is
+// nearer than the box are skipped whole.
+static bool raster_test_box(const Raster* raster, vec3s min, vec3s max) {
+  float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+  float maxX = -FLT_MAX, maxY = -FLT_MAX;
+  // Corners from the min corner plus the box's edges along each axis
+  vec4s origin = glms_mat4_mulv(raster->viewProjection,
+                                (vec4s){{min.x, min.y, min.z, 1.0f}});
+  vec3s size = glms_vec3_sub(max, min);
+  vec4s edges[3];
+  for (int a = 0; a < 3; a++) {
+    edges[a] = glms_vec4_scale(raster->viewProjection.col[a], size.raw[a]);
+  }
+  for (int i = 0; i < 8; i++) {
+    vec4s clip = origin;
+    if (i & 1) clip = glms_vec4_add(clip, edges[0]);
+    if (i & 2) clip = glms_vec4_add(clip, edges[1]);
+    if (i & 4) clip = glms_vec4_add(clip, edges[2]);
+    if (clip.w <= 0.0f || clip.z < -clip.w) return true;
+
+    float inverse = 1.0f / clip.w;
+    float x = (clip.x * inverse * 0.5f + 0.5f) * RASTER_WIDTH;
+    float y = (clip.y * inverse * 0.5f + 0.5f) * RASTER_HEIGHT;
+    minX = glm_min(minX, x);
+    maxX = glm_max(maxX, x);
+    minY = glm_min(minY, y);
+    maxY = glm_max(maxY, y);
+    minZ = glm_min(minZ, clip.z * inverse * 0.5f + 0.5f);
+  }
+
+  int x0 = (int)floorf(glm_max(minX, 0.0f));
+  int y0 = (int)floorf(glm_max(minY, 0.0f));
+  int x1 = (int)ceilf(glm_min(maxX, (float)RASTER_WIDTH));
+  int y1 = (int)ceilf(glm_min(maxY, (float)RASTER_HEIGHT));
+  if (x0 >= x1 || y0 >= y1) return false;
+
+  for (int by = y0 / RASTER_BLOCK_SIZE; by * RASTER_BLOCK_SIZE < y1; by++) {
+    for (int bx = x0 / RASTER_BLOCK_SIZE; bx * RASTER_BLOCK_SIZE < x1; bx++) {
+      if (minZ > raster->blockMax[by * RASTER_BLOCKS_X + bx]) continue;
+
+      int px0 = bx * RASTER_BLOCK_SIZE > x0 ? bx * RASTER_BLOCK_SIZE : x0;
+      int py0 = by * RASTER_BLOCK_SIZE > y0 ? by * RASTER_BLOCK_SIZE : y0;
+      int px1 = (bx + 1) * RASTER_BLOCK_SIZE < x1 ? (bx + 1) * RASTER_BLOCK_SIZE
+                                                  : x1;
+      int py1 = (by + 1) * RASTER_BLOCK_SIZE < y1 ? (by + 1) * RASTER_BLOCK_SIZE
+                                                  : y1;
+      for (int y = py0; y < py1; y++) {
+        const float* row = raster->depth + y * RASTER_WIDTH;
+        for (int x = px0; x < px1; x++) {
+          if (minZ <= row[x]) return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+// Edges run from each vertex to the next, and are positive inside a counter
+// clockwise triangle. Depth weighs each vertex by the edge facing it.
+static RasterSetup raster_setup(const RasterTriangle* triangle) {
+  RasterSetup setup;
+  for (int e = 0; e < 3; e++) {
+    int n = (e + 1) % 3;
+    setup.a[e] = triangle->y[e] - triangle->y[n];
+    setup.b[e] = triangle->x[n] - triangle->x[e];
+    setup.c[e] = -(setup.a[e] * triangle->x[e] + setup.b[e] * triangle->y[e]);
+  }
+
+  float area = setup.a[0] * triangle->x[2] + setup.b[0] * triangle->y[2] +
+               setup.c[0];
+  float inverse = 1.0f / area;
+  const float* z = triangle->z;
+  setup.zx = (z[0] * setup.a[1] + z[1] * setup.a[2] + z[2] * setup.a[0]) *
+             inverse;
+  setup.zy = (z[0] * setup.b[1] + z[1] * setup.b[2] + z[2] * setup.b[0]) *
+             inverse;
+  setup.zc = (z[0] * setup.c[1] + z[1] * setup.c[2] + z[2] * setup.c[0]) *
+             inverse;
+
+  return setup;
+}
+
+// Every kernel evaluates the planes at pixel centres the same way, so they
+// write the same depth
+static void raster_scalar(const RasterTriangle* triangle, int x0, int y0,
+                          int x1, int y1, float* depth) {
+  RasterSetup s = raster_setup(triangle);
+
+  for (int y = y0; y < y1; y++) {
+    float py = (float)y + 0.5f;
+    float r0 = s.b[0] * py + s.c[0];
+    float r1 = s.b[1] * py + s.c[1];
+    float r2 = s.b[2] * py + s.c[2];
+    float rz = s.zy * py + s.zc;
+    float* row = depth + y * RASTER_WIDTH;
+    for (int x = x0; x < x1; x++) {
+      float px = (float)x + 0.5f;
+      float e0 = s.a[0] * px + r0;
+      float e1 = s.a[1] * px + r1;
+      float e2 = s.a[2] * px + r2;
+      if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+        float z = s.zx * px + rz;
+        if (z < row[x]) row[x] = z;
+      }
+    }
+  }
+}
+
+#ifdef RASTER_X86
+// Four pixels of a row at a time from a multiple of four, which stays
+// inside the tile as tiles are too
+static void raster_sse(const RasterTriangle* triangle, int x0, int y0,
+                       int x1, int y1, float* depth) {
+  RasterSetup s = raster_setup(triangle);
+  const __m128 a0 = _mm_set1_ps(s.a[0]);
+  const __m128 a1 = _mm_set1_ps(s.a[1]);
+  const __m128 a2 = _mm_set1_ps(s.a[2]);
+  const __m128 zx = _mm_set1_ps(s.zx);
+  const __m128 centres = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 far = _mm_set1_ps(FLT_MAX);
+
+  for (int y = y0; y < y1; y++) {
+    float py = (float)y + 0.5f;
+    __m128 r0 = _mm_set1_ps(s.b[0] * py + s.c[0]);
+    __m128 r1 = _mm_set1_ps(s.b[1] * py + s.c[1]);
+    __m128 r2 = _mm_set1_ps(s.b[2] * py + s.c[2]);
+    __m128 rz = _mm_set1_ps(s.zy * py + s.zc);
+    float* row = depth + y * RASTER_WIDTH;
+    for (int x = x0 & ~3; x < x1; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps((float)x), centres);
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+      __m128 inside =
+          _mm_cmpge_ps(_mm_min_ps(_mm_min_ps(e0, e1), e2), zero);
+      if (_mm_movemask_ps(inside) == 0) continue;
+
+      __m128 z = _mm_add_ps(_mm_mul_ps(zx, px), rz);
+      z = _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, far));
+      _mm_store_ps(row + x, _mm_min_ps(_mm_load_ps(row + x), z));
+    }
+  }
+}
+
+// Same as the SSE kernel eight pixels at a time
+__attribute__((target("avx"))) static void raster_avx(
+    const RasterTriangle* triangle, int x0, int y0, int x1, int y1,
+    float* depth) {
+  RasterSetup s = raster_setup(triangle);
+  const __m256 a0 = _mm256_set1_ps(s.a[0]);
+  const __m256 a1 = _mm256_set1_ps(s.a[1]);
+  const __m256 a2 = _mm256_set1_ps(s.a[2]);
+  const __m256 zx = _mm256_set1_ps(s.zx);
+  const __m256 centres =
+      _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 far = _mm256_set1_ps(FLT_MAX);
+
+  for (int y = y0; y < y1; y++) {
+    float py = (float)y + 0.5f;
+    __m256 r0 = _mm256_set1_ps(s.b[0] * py + s.c[0]);
+    __m256 r1 = _mm256_set1_ps(s.b[1] * py + s.c[1]);
+    __m256 r2 = _mm256_set1_ps(s.b[2] * py + s.c[2]);
+    __m256 rz = _mm256_set1_ps(s.zy * py + s.zc);
+    float* row = depth + y * RASTER_WIDTH;
+    for (int x = x0 & ~7; x < x1; x += 8) {
+      __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), centres);
+      __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), r0);
+      __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), r1);
+      __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), r2);
+      __m256 inside = _mm256_cmp_ps(
+          _mm256_min_ps(_mm256_min_ps(e0, e1), e2), zero, _CMP_GE_OQ);
+      if (_mm256_movemask_ps(inside) == 0) continue;
+
+      __m256 z = _mm256_add_ps(_mm256_mul_ps(zx, px), rz);
+      z = _mm256_blendv_ps(far, z, inside);
+      _mm256_store_ps(row + x, _mm256_min_ps(_mm256_load_ps(row + x), z));
+    }
+  }
+}
+#endif
@@ -0,0 +1,113 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+#include "cull.h"
+#include "job.h"
+
+// Low resolution depth buffer drawn on the CPU from occluder meshes, so
+// object bounds can be tested against it in the frame they are drawn,
+// without waiting on the GPU. Occluder triangles are transformed, clipped
+// and binned to tiles in parallel, then each tile is rasterized by one job.
+// Depth is z/w mapped to [0, 1] and every pixel keeps its nearest occluder.
+// Every block also keeps the farthest depth of its pixels, which rejects
+// most hidden objects without reading pixels. Coverage is sampled at pixel
+// centres, so an object showing less than a pixel past an occluder edge can
+// be culled. Any thread, one at a time per Raster.
+
+#define RASTER_WIDTH 256
+#define RASTER_HEIGHT 128
+// Square tiles, each rasterized by one job
+#define RASTER_TILE_SIZE 32
+#define RASTER_TILES_X (RASTER_WIDTH / RASTER_TILE_SIZE)
+#define RASTER_TILES_Y (RASTER_HEIGHT / RASTER_TILE_SIZE)
+#define RASTER_TILES (RASTER_TILES_X * RASTER_TILES_Y)
+// Square blocks keeping their farthest depth
+#define RASTER_BLOCK_SIZE 8
+#define RASTER_BLOCKS_X (RASTER_WIDTH / RASTER_BLOCK_SIZE)
+#define RASTER_BLOCKS_Y (RASTER_HEIGHT / RASTER_BLOCK_SIZE)
+// Occluder triangles per binning job
+#define RASTER_BIN_TRIANGLES 1024
+
+// Closed mesh with counter-clockwise front faces, back faces are skipped
+typedef struct {
+  const float* positions;  // x, y, z at the start of each vertex
+  uint32_t stride;         // bytes from one vertex to the next
+  uint32_t numVertices;    // indexed vertices, shared ones transform once
+  const uint32_t* indices;
+  uint32_t numTriangles;
+  mat4s world;
+} RasterOccluder;
+
+// Screen space, in pixels from the bottom left, and depth in [0, 1]
+typedef struct {
+  float x[3];
+  float y[3];
+  float z[3];
+} RasterTriangle;
+
+typedef struct {
+  uint64_t triangles;   // occluder triangles submitted
+  uint64_t rasterized;  // left after clipping and back face culling
+  uint64_t binned;      // triangle and tile pairs
+  uint64_t tested;      // bounds tested against the depth
+  uint64_t occluded;    // ... and found hidden
+} RasterStats;
+
+typedef struct {
+  float* depth;     // RASTER_WIDTH x RASTER_HEIGHT, bottom row first
+  float* blockMax;  // RASTER_BLOCKS_X x RASTER_BLOCKS_Y
+  mat4s viewProjection;
+
+  RasterOccluder* occluders;
+  uint32_t numOccluders;
+  uint32_t occluderCapacity;
+  uint32_t numTriangles;
+
+  // Per binning job: room for two screen triangles per occluder triangle,
+  // as the near plane can split one, and per tile the ones touching it
+  RasterTriangle* triangles;
+  vec4s* vertices;       // [chunk][vertex] in clip space
+  uint16_t* bins;        // [chunk][tile][triangle]
+  uint16_t* binCounts;   // [chunk][tile]
+  uint32_t* rasterized;  // [chunk]
+  uint32_t numChunks;
+  uint32_t chunkCapacity;
+} Raster;
+
+Raster raster_create(void);
+void raster_destroy(Raster* raster);
+
+// Drops last frame's occluders and takes this frame's camera
+void raster_begin(Raster* raster, mat4s viewProjection);
+// The arrays are read by raster_render and must live until then
+void raster_add_occluder(Raster* raster, const RasterOccluder* occluder);
+// Clears the depth and draws every occluder. A NULL pool does it all on the
+// calling thread.
+void raster_render(Raster* raster, JobPool* pool);
+
+// False when the box placed by `world` is hidden behind the occluders or
+// off screen. Boxes crossing the near plane are always visible.
+bool raster_test_aabb(const Raster* raster, const vec3s aabb[2],
+                      mat4s world);
+// Keeps the visible bounds of `indices` in order, returns how many remain
+uint32_t raster_test_bounds(const Raster* raster, const CullBounds* bounds,
+                            uint32_t* indices, uint32_t count);
+
+// Kernel picked for this CPU: "sse" or "scalar". "avx" is only picked by
+// raster_use_kernel.
+const char* raster_kernel_name(void);
+// Switches kernels by name, for benchmarks. False if the CPU lacks them.
+bool raster_use_kernel(const char* name);
+
+// Counted on the calling thread
+RasterStats raster_get_stats(void);
+// Occluder triangles and culled bounds since the last report, a stats
+// report
+void raster_print_frame_stats(FILE* stream);
+
+#endif  // RASTER_H
@@ -0,0 +1,389 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cglm/struct/vec3.h"
+#include "cglm/util.h"
+#include "render.h"
+
+// Key fields, most significant first. Opaque keys hold the program, the
+// material, the VAO and the depth below the pass, blended keys move the
+// inverted depth right below the pass.
+#define RENDER_PASS_SHIFT 60
+#define RENDER_PROGRAM_BITS 8
+#define RENDER_MATERIAL_BITS 16
+#define RENDER_VAO_BITS 12
+#define RENDER_DEPTH_BITS 24
+#define RENDER_FIELD_MASK(bits) ((UINT64_C(1) << (bits)) - 1)
+#define RENDER_DEPTH_MAX ((float)RENDER_FIELD_MASK(RENDER_DEPTH_BITS))
+
+// Sorted by bytes, passes where every key shares the byte are skipped
+#define RENDER_RADIX_BITS 8
+#define RENDER_RADIX_PASSES (64 / RENDER_RADIX_BITS)
+#define RENDER_RADIX_BUCKETS (1 << RENDER_RADIX_BITS)
+
+// State a draw changes from the one before it
+#define RENDER_CHANGE_PROGRAM (1u << 0)
+#define RENDER_CHANGE_MATERIAL (1u << 1)
+#define RENDER_CHANGE_VAO (1u << 2)
+
+static RenderQueueStats stats;
+static RenderQueueStats reported;  // stats at the last frame report
+
+// Privates
+static void render_queue_reserve(RenderQueue* queue, uint32_t count);
+static uint64_t render_queue_depth_key(const RenderQueue* queue,
+                                       RenderPass pass,
+                                       const RenderPacket* packet,
+                                       vec3s center);
+static uint64_t render_queue_key(RenderPass pass, const RenderPacket* packet,
+                                 uint64_t depth);
+static uint32_t render_changes(const RenderPacket* packet,
+                               const RenderPacket* last);
+static void render_queue_count_changes(const RenderQueue* queue, int order);
+static void render_queue_record_range(void* data, uint32_t begin,
+                                      uint32_t end);
+static double render_now(void);
+
+RenderQueue render_queue_create(void) {
+  return (RenderQueue){
+      .forward = {{0.0f, 0.0f, -1.0f}},
+      .depthScale = RENDER_DEPTH_MAX,
+  };
+}
+
+void render_queue_destroy(RenderQueue* queue) {
+  for (uint32_t i = 0; i < queue->listCapacity; i++) {
+    cmdlist_destroy(&queue->lists[i]);
+  }
+  free(queue->lists);
+  for (uint32_t i = 0; i < queue->bufferCapacity; i++) {
+    free(queue->buffers[i].packets);
+    free(queue->buffers[i].items);
+  }
+  free(queue->buffers);
+  free(queue->packets);
+  free(queue->items);
+  free(queue->scratch);
+  *queue = (RenderQueue){0};
+}
+
+void render_queue_begin(RenderQueue* queue, vec3s eye, vec3s forward,
+                        float far) {
+  queue->numPackets = 0;
+  queue->eye = eye;
+  queue->forward = forward;
+  queue->depthScale = far > 0.0f ? RENDER_DEPTH_MAX / far : 0.0f;
+}
+
+void render_queue_submit(RenderQueue* queue, RenderPass pass,
+                         const RenderPacket* packet, vec3s center) {
+  render_queue_reserve(queue, queue->numPackets + 1);
+
+  uint32_t index = queue->numPackets++;
+  queue->packets[index] = *packet;
+  queue->items[index] = (RenderItem){
+      .key = render_queue_depth_key(queue, pass, packet, center),
+      .packet = index,
+  };
+}
+
+RenderBuffer* render_queue_buffers(RenderQueue* queue, uint32_t count) {
+  if (count > queue->bufferCapacity) {
+    queue->buffers = realloc(queue->buffers, count * sizeof(RenderBuffer));
+    for (uint32_t i = queue->bufferCapacity; i < count; i++) {
+      queue->buffers[i] = (RenderBuffer){0};
+    }
+    queue->bufferCapacity = count;
+  }
+  queue->numBuffers = count;
+
+  return queue->buffers;
+}
+
+void render_buffer_submit(const RenderQueue* queue, RenderBuffer* buffer,
+                          RenderPass pass, const RenderPacket* packet,
+                          vec3s center) {
+  if (buffer->numPackets == buffer->capacity) {
+    buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 64;
+    buffer->packets =
+        realloc(buffer->packets, buffer->capacity * sizeof(RenderPacket));
+    buffer->items =
+        realloc(buffer->items, buffer->capacity * sizeof(RenderItem));
+  }
+
+  uint32_t index = buffer->numPackets++;
+  buffer->packets[index] = *packet;
+  buffer->items[index] = (RenderItem){
+      .key = render_queue_depth_key(queue, pass, packet, center),
+      .packet = index,
+  };
+}
+
+void render_queue_merge(RenderQueue* queue) {
+  uint32_t total = queue->numPackets;
+  for (uint32_t b = 0; b < queue->numBuffers; b++) {
+    total += queue->buffers[b].numPackets;
+  }
+  render_queue_reserve(queue, total);
+
+  for (uint32_t b = 0; b < queue->numBuffers; b++) {
+    RenderBuffer* buffer = &queue->buffers[b];
+    uint32_t first = queue->numPackets;
+    memcpy(queue->packets + first, buffer->packets,
+           buffer->numPackets * sizeof(RenderPacket));
+    for (uint32_t i = 0; i < buffer->numPackets; i++) {
+      queue->items[first + i] = (RenderItem){
+          .key = buffer->items[i].key,
+          .packet = first + i,
+      };
+    }
+    queue->numPackets += buffer->numPackets;
+    buffer->numPackets = 0;
+  }
+  queue->numBuffers = 0;
+}
+
+// Least significant byte first, each pass a stable counting sort
+void render_queue_sort(RenderQueue* queue) {
+  uint32_t count = queue->numPackets;
+  if (count < 2) return;
+
+  uint32_t histograms[RENDER_RADIX_PASSES][RENDER_RADIX_BUCKETS];
+  memset(histograms, 0, sizeof(histograms));
+  for (uint32_t i = 0; i < count; i++) {
+    uint64_t key = queue->items[i].key;
+    for (int p = 0; p < RENDER_RADIX_PASSES; p++) {
+      histograms[p][(key >> (p * RENDER_RADIX_BITS)) &
+                    (RENDER_RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  RenderItem* src = queue->items;
+  RenderItem* dst = queue->scratch;
+  for (int p = 0; p < RENDER_RADIX_PASSES; p++) {
+    int shift = p * RENDER_RADIX_BITS;
+    uint32_t* histogram = histograms[p];
+    if (histogram[(src[0].key >> shift) & (RENDER_RADIX_BUCKETS - 1)] ==
+        count) {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (int b = 0; b < RENDER_RADIX_BUCKETS; b++) {
+      uint32_t n = histogram[b];
+      histogram[b] = offset;
+      offset += n;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      dst[histogram[(src[i].key >> shift) & (RENDER_RADIX_BUCKETS - 1)]++] =
+          src[i];
+    }
+
+    RenderItem* swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  queue->items = src;
+  queue->scratch = dst;
+}
+
+void render_queue_record(RenderQueue* queue, JobPool* pool) {
+  double start = render_now();
+  uint32_t numLists =
+      (queue->numPackets + RENDER_LIST_PACKETS - 1) / RENDER_LIST_PACKETS;
+  if (numLists > queue->listCapacity) {
+    queue->lists = realloc(queue->lists, numLists * sizeof(CommandList));
+    for (uint32_t i = queue->listCapacity; i < numLists; i++) {
+      queue->lists[i] = cmdlist_create(0);
+    }
+    queue->listCapacity = numLists;
+  }
+  queue->numLists = numLists;
+
+  job_pool_parallel_for(pool, numLists, 1, render_queue_record_range, queue);
+  stats.recordMs += render_now() - start;
+}
+
+void render_queue_execute(RenderQueue* queue) {
+  double start = render_now();
+  for (uint32_t i = 0; i < queue->numLists; i++) {
+    cmdlist_execute(&queue->lists[i]);
+    stats.commands += queue->lists[i].numCommands;
+  }
+  stats.replayMs += render_now() - start;
+}
+
+void render_queue_flush(RenderQueue* queue, JobPool* pool) {
+  stats.flushes++;
+  stats.packets += queue->numPackets;
+  render_queue_count_changes(queue, 0);
+  render_queue_sort(queue);
+  render_queue_count_changes(queue, 1);
+
+  render_queue_record(queue, pool);
+  render_queue_execute(queue);
+  queue->numPackets = 0;
+  queue->numLists = 0;
+}
+
+RenderQueueStats render_queue_get_stats(void) { return stats; }
+
+void render_queue_print_frame_stats(FILE* stream) {
+  uint64_t flushes = stats.flushes - reported.flushes;
+  double perFlush = flushes > 0 ? 1.0 / flushes : 0.0;
+  fprintf(stream,
+          "render queue: %lu draws, state changes submitted -> sorted: "
+          "%lu -> %lu programs, %lu -> %lu materials, %lu -> %lu VAOs\n",
+          (unsigned long)(stats.packets - reported.packets),
+          (unsigned long)(stats.programChanges[0] - reported.programChanges[0]),
+          (unsigned long)(stats.programChanges[1] - reported.programChanges[1]),
+          (unsigned long)(stats.materialChanges[0] -
+                          reported.materialChanges[0]),
+          (unsigned long)(stats.materialChanges[1] -
+                          reported.materialChanges[1]),
+          (unsigned long)(stats.vaoChanges[0] - reported.vaoChanges[0]),
+          (unsigned long)(stats.vaoChanges[1] - reported.vaoChanges[1]));
+  fprintf(stream,
+          "  %lu commands, %.3f ms recording and %.3f ms replaying per "
+          "flush\n",
+          (unsigned long)(stats.commands - reported.commands),
+          (stats.recordMs - reported.recordMs) * perFlush,
+          (stats.replayMs - reported.replayMs) * perFlush);
+  reported = stats;
+}
+
+// ------------------------------------------------------------------------
+
+// Room for `count` packets, growing by doubling
+static void render_queue_reserve(RenderQueue* queue, uint32_t count) {
+  if (count <= queue->capacity) return;
+
+  uint32_t capacity = queue->capacity > 0 ? queue->capacity : 64;
+  while (capacity < count) capacity *= 2;
+  queue->capacity = capacity;
+  queue->packets =
+      realloc(queue->packets, queue->capacity * sizeof(RenderPacket));
+  queue->items = realloc(queue->items, queue->capacity * sizeof(RenderItem));
+  queue->scratch =
+      realloc(queue->scratch, queue->capacity * sizeof(RenderItem));
+}
+
+// Key of the packet with the view depth of `center` from the queue's camera
+static uint64_t render_queue_depth_key(const RenderQueue* queue,
+                                       RenderPass pass,
+                                       const RenderPacket* packet,
+                                       vec3s center) {
+  float depth = glms_vec3_dot(glms_vec3_sub(center, queue->eye),
+                              queue->forward) *
+                queue->depthScale;
+  depth = glm_clamp(depth, 0.0f, RENDER_DEPTH_MAX);
+
+  return render_queue_key(pass, packet, (uint64_t)depth);
+}
+
+static uint64_t render_queue_key(RenderPass pass, const RenderPacket* packet,
+                                 uint64_t depth) {
+  uint64_t program =
+      packet->shader->ID & RENDER_FIELD_MASK(RENDER_PROGRAM_BITS);
+  uint64_t material = packet->materialId;
+  uint64_t vao = packet->VAO & RENDER_FIELD_MASK(RENDER_VAO_BITS);
+  uint64_t key = (uint64_t)pass << RENDER_PASS_SHIFT;
+
+  if (pass == RENDER_PASS_BLENDED) {
+    uint64_t far = RENDER_FIELD_MASK(RENDER_DEPTH_BITS) - depth;
+    return key |
+           far << (RENDER_PASS_SHIFT - RENDER_DEPTH_BITS) |
+           program << (RENDER_MATERIAL_BITS + RENDER_VAO_BITS) |
+           material << RENDER_VAO_BITS | vao;
+  }
+  return key |
+         program << (RENDER_PASS_SHIFT - RENDER_PROGRAM_BITS) |
+         material << (RENDER_VAO_BITS + RENDER_DEPTH_BITS) |
+         vao << RENDER_DEPTH_BITS | depth;
+}
+
+// A new program rebinds the material too, sampler uniforms are per program
+static uint32_t render_changes(const RenderPacket* packet,
+                               const RenderPacket* last) {
+  if (last == NULL) {
+    return RENDER_CHANGE_PROGRAM | RENDER_CHANGE_VAO |
+           (packet->bind != NULL ? RENDER_CHANGE_MATERIAL : 0);
+  }
+
+  uint32_t changes = 0;
+  if (packet->shader->ID != last->shader->ID) {
+    changes |= RENDER_CHANGE_PROGRAM;
+  }
+  if (packet->bind != NULL &&
+      (changes || packet->bind != last->bind ||
+       packet->materialId != last->materialId)) {
+    changes |= RENDER_CHANGE_MATERIAL;
+  }
+  if (packet->VAO != last->VAO) changes |= RENDER_CHANGE_VAO;
+
+  return changes;
+}
+
+// `order` 0 counts the items as submitted, 1 as sorted
+static void render_queue_count_changes(const RenderQueue* queue, int order) {
+  const RenderPacket* last = NULL;
+  for (uint32_t i = 0; i < queue->numPackets; i++) {
+    const RenderPacket* packet = &queue->packets[queue->items[i].packet];
+    uint32_t changes = render_changes(packet, last);
+    stats.programChanges[order] += (changes & RENDER_CHANGE_PROGRAM) != 0;
+    stats.materialChanges[order] += (changes & RENDER_CHANGE_MATERIAL) != 0;
+    stats.vaoChanges[order] += (changes & RENDER_CHANGE_VAO) != 0;
+    last = packet;
+  }
+}
+
+// Each list starts from the packet the list before it ended on, so lists
+// record independently and replay as if recorded in one go
+static void render_queue_record_range(void* data, uint32_t begin,
+                                      uint32_t end) {
+  const RenderQueue* queue = data;
+  for (uint32_t l = begin; l < end; l++) {
+    CommandList* list = &queue->lists[l];
+    cmdlist_reset(list);
+
+    uint32_t first = l * RENDER_LIST_PACKETS;
+    uint32_t last = first + RENDER_LIST_PACKETS < queue->numPackets
+                        ? first + RENDER_LIST_PACKETS
+                        : queue->numPackets;
+    const RenderPacket* previous =
+        first > 0 ? &queue->packets[queue->items[first - 1].packet] : NULL;
+    for (uint32_t i = first; i < last; i++) {
+      const RenderPacket* packet = &queue->packets[queue->items[i].packet];
+      uint32_t changes = render_changes(packet, previous);
+      if (changes & RENDER_CHANGE_PROGRAM) {
+        cmdlist_use_program(list, packet->shader->ID);
+      }
+      if (changes & RENDER_CHANGE_MATERIAL) {
+        cmdlist_call(list, packet->bind, packet->material, packet->shader);
+      }
+      if (changes & RENDER_CHANGE_VAO) {
+        cmdlist_bind_vertex_array(list, packet->VAO);
+      }
+
+      cmdlist_set_mat4(list, packet->shader->modelLocation, packet->model);
+      if (packet->indexed) {
+        cmdlist_draw_elements(list, packet->mode, packet->first,
+                              packet->count);
+      } else {
+        cmdlist_draw_arrays(list, packet->mode, packet->first, packet->count);
+      }
+      previous = packet;
+    }
+  }
+}
+
+static double render_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,140 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+#include "cmdlist.h"
+#include "job.h"
+#include "shader.h"
+
+// Draws collected through a frame and issued in the order of a 64-bit key,
+// radix sorted when the queue is flushed. Opaque keys put the program first,
+// then the material and the VAO, then the view depth, so draws sharing state
+// go out together and nearest first among themselves. Blended keys put the
+// depth first, farthest first as blending needs, state only breaks ties.
+// Ids wider than their field are truncated: draws that collide sort
+// together and still bind their own state. The sorted draws are recorded
+// into command lists, RENDER_LIST_PACKETS per list, by the job pool's
+// workers, then replayed in order. GL thread only, except for
+// render_buffer_submit into the buffers jobs fill in parallel.
+
+#define RENDER_LIST_PACKETS 512
+
+typedef enum {
+  RENDER_PASS_OPAQUE = 0,
+  RENDER_PASS_BLENDED = 1,
+} RenderPass;
+
+// Binds the textures and constant attributes of a material for `shader`,
+// called on the GL thread
+typedef CommandFunc RenderBindFunc;
+
+typedef struct {
+  Shader* shader;
+  GLuint VAO;
+  // Called whenever the material differs from the draw before. Packets with
+  // the same bind and materialId must bind the same state. NULL binds none.
+  RenderBindFunc bind;
+  const void* material;
+  uint16_t materialId;
+
+  mat4s model;  // set as the shader's "model" uniform
+  GLenum mode;
+  GLint first;  // first vertex, or first index when indexed
+  GLsizei count;
+  bool indexed;  // GL_UNSIGNED_INT indices of the VAO's element buffer
+} RenderPacket;
+
+typedef struct {
+  uint64_t key;
+  uint32_t packet;
+} RenderItem;
+
+// Packets one job built off the GL thread, keyed already. The queue takes
+// them over in render_queue_merge.
+typedef struct {
+  RenderPacket* packets;
+  RenderItem* items;
+  uint32_t numPackets;
+  uint32_t capacity;
+} RenderBuffer;
+
+typedef struct {
+  uint64_t packets;
+  // Counted over the packets in the order they were submitted and in the
+  // order they were drawn
+  uint64_t programChanges[2];
+  uint64_t materialChanges[2];
+  uint64_t vaoChanges[2];
+
+  uint64_t flushes;
+  uint64_t commands;
+  double recordMs;  // building the command lists, summed
+  double replayMs;  // executing them on the GL thread, summed
+} RenderQueueStats;
+
+typedef struct {
+  RenderPacket* packets;
+  RenderItem* items;    // in submission order until sorted
+  RenderItem* scratch;  // radix sort ping-pong
+  uint32_t numPackets;
+  uint32_t capacity;
+
+  // One per RENDER_LIST_PACKETS sorted packets
+  CommandList* lists;
+  uint32_t numLists;
+  uint32_t listCapacity;
+
+  RenderBuffer* buffers;  // handed out by render_queue_buffers
+  uint32_t numBuffers;
+  uint32_t bufferCapacity;
+
+  // View depth along `forward`, scaled to the key's depth range
+  vec3s eye;
+  vec3s forward;
+  float depthScale;
+} RenderQueue;
+
+RenderQueue render_queue_create(void);
+void render_queue_destroy(RenderQueue* queue);
+
+// Drops the last frame's packets and takes this frame's camera. Depth
+// saturates at `far`.
+void render_queue_begin(RenderQueue* queue, vec3s eye, vec3s forward,
+                        float far);
+// Copies the packet, keyed by its state and by the view depth of `center`
+void render_queue_submit(RenderQueue* queue, RenderPass pass,
+                         const RenderPacket* packet, vec3s center);
+// `count` empty buffers, one per job building packets in parallel
+RenderBuffer* render_queue_buffers(RenderQueue* queue, uint32_t count);
+// render_queue_submit into a buffer. Only reads the queue's camera, so jobs
+// may call it between render_queue_begin and render_queue_merge.
+void render_buffer_submit(const RenderQueue* queue, RenderBuffer* buffer,
+                          RenderPass pass, const RenderPacket* packet,
+                          vec3s center);
+// Appends the packets of the buffers in buffer order, as if they had been
+// submitted one after the other, and empties them
+void render_queue_merge(RenderQueue* queue);
+// Orders the items by key, stable for equal keys
+void render_queue_sort(RenderQueue* queue);
+// Records the sorted packets into command lists, binding only the state
+// that changed from the packet before. A NULL pool records them all on the
+// calling thread.
+void render_queue_record(RenderQueue* queue, JobPool* pool);
+// Replays the command lists in order
+void render_queue_execute(RenderQueue* queue);
+// Sorts, records and draws every packet. Per pass uniforms are set on each
+// program beforehand. Leaves the last program and VAO bound.
+void render_queue_flush(RenderQueue* queue, JobPool* pool);
+
+// Counted on the calling thread
+RenderQueueStats render_queue_get_stats(void);
+// State changes before and after sorting and the time spent recording and
+// replaying since the last report, a stats report
+void render_queue_print_frame_stats(FILE* stream);
+
+#endif  // RENDER_H
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+
+#include "replay.h"
+
+#define REPLAY_MAGIC 0x48544150u  // "PATH"
+#define REPLAY_VERSION 1u
+
+bool replay_record(Replay* replay, const char* path) {
+  *replay = (Replay){0};
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) return false;
+
+  uint32_t header[2] = {REPLAY_MAGIC, REPLAY_VERSION};
+  if (fwrite(header, sizeof(header), 1, file) != 1) {
+    fclose(file);
+    return false;
+  }
+  replay->file = file;
+
+  return true;
+}
+
+void replay_write(Replay* replay, const Camera* camera) {
+  ReplayFrame frame = {
+      .position = {camera->Position.x, camera->Position.y,
+                   camera->Position.z},
+      .yaw = camera->Yaw,
+      .pitch = camera->Pitch,
+      .zoom = camera->Zoom,
+  };
+  fwrite(&frame, sizeof(frame), 1, replay->file);
+  replay->numFrames++;
+}
+
+// Frames run to the end of the file, a recording cut short keeps the frames
+// written before
+bool replay_load(Replay* replay, const char* path) {
+  *replay = (Replay){0};
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return false;
+
+  uint32_t header[2];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      header[0] != REPLAY_MAGIC || header[1] != REPLAY_VERSION ||
+      fseek(file, 0, SEEK_END) != 0) {
+    fclose(file);
+    return false;
+  }
+  long size = ftell(file) - (long)sizeof(header);
+  fseek(file, sizeof(header), SEEK_SET);
+
+  uint32_t count = size > 0 ? (uint32_t)(size / sizeof(ReplayFrame)) : 0;
+  ReplayFrame* frames = malloc((count > 0 ? count : 1) * sizeof(ReplayFrame));
+  bool read = fread(frames, sizeof(ReplayFrame), count, file) == count;
+  fclose(file);
+  if (!read || count == 0) {
+    free(frames);
+    return false;
+  }
+
+  replay->frames = frames;
+  replay->numFrames = count;
+
+  return true;
+}
+
+bool replay_play(Replay* replay, Camera* camera) {
+  if (replay->frame == replay->numFrames) return false;
+
+  const ReplayFrame* frame = &replay->frames[replay->frame++];
+  camera_set_pose(camera,
+                  (vec3s){{frame->position[0], frame->position[1],
+                           frame->position[2]}},
+                  frame->yaw, frame->pitch, frame->zoom);
+
+  return true;
+}
+
+void replay_close(Replay* replay) {
+  if (replay->file != NULL) fclose(replay->file);
+  free(replay->frames);
+  *replay = (Replay){0};
+}
@@ -0,0 +1,44 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "camera.h"
+
+// Camera paths saved one frame at a time and played back for repeatable
+// benchmark runs. Frames keep the camera's pose rather than the input that
+// moved it, so a path stays valid when input handling changes. Playback
+// takes one frame per rendered frame and REPLAY_STEP as every frame's delta
+// time, so builds replaying the same file draw the same frames.
+
+#define REPLAY_STEP (1.0f / 60.0f)
+
+// 24 bytes per frame on disk, after an 8 byte header
+typedef struct {
+  float position[3];
+  float yaw;
+  float pitch;
+  float zoom;
+} ReplayFrame;
+
+typedef struct {
+  FILE* file;           // open while recording
+  ReplayFrame* frames;  // loaded for playback
+  uint32_t numFrames;
+  uint32_t frame;  // next one to play
+} Replay;
+
+// Starts a new file at `path`, false if it can't be created
+bool replay_record(Replay* replay, const char* path);
+// Appends the camera's pose, call once per frame after input
+void replay_write(Replay* replay, const Camera* camera);
+// Loads a recorded path, false if missing or not a path file
+bool replay_load(Replay* replay, const char* path);
+// Moves the camera to the next frame, false once every frame was played
+bool replay_play(Replay* replay, Camera* camera);
+// Finishes a recording or frees a loaded path
+void replay_close(Replay* replay);
+
+#endif  // REPLAY_H
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scene.h"
+
+#include "cglm/struct/affine.h"
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/quat.h"
+
+// Privates
+static bool scene_reserve(Scene* scene, uint32_t capacity);
+static void* scene_realloc_aligned(void* ptr, size_t oldSize, size_t newSize);
+static void scene_mark_dirty(Scene* scene, int32_t node);
+static void scene_update_range(Scene* scene, uint32_t first, uint32_t end);
+
+Scene scene_create(uint32_t capacity) {
+  Scene scene = {0};
+  scene_reserve(&scene, capacity > 0 ? capacity : 16);
+
+  return scene;
+}
+
+// Creates a scene whose arrays live in `arena` and are released with it.
+// Such a scene cannot grow, so `capacity` has to cover every node.
+Scene scene_create_in_arena(Arena* arena, uint32_t capacity) {
+  Scene scene = {
+      .parent = arena_new(arena, int32_t, capacity),
+      .subtreeSize = arena_new(arena, uint32_t, capacity),
+      .flags = arena_new(arena, uint8_t, capacity),
+      .position = arena_new(arena, vec3s, capacity),
+      .rotation = arena_new(arena, versors, capacity),
+      .scale = arena_new(arena, vec3s, capacity),
+      .local = arena_new(arena, mat4s, capacity),
+      .world = arena_new(arena, mat4s, capacity),
+      .capacity = capacity,
+      .fixed = true,
+  };
+
+  return scene;
+}
+
+void scene_destroy(Scene* scene) {
+  if (scene->fixed) {
+    *scene = (Scene){0};
+    return;
+  }
+
+  free(scene->parent);
+  free(scene->subtreeSize);
+  free(scene->flags);
+  free(scene->position);
+  free(scene->rotation);
+  free(scene->scale);
+  free(scene->local);
+  free(scene->world);
+
+  *scene = (Scene){0};
+}
+
+// Appends a node under `parent` (or as a new root with SCENE_NO_PARENT).
+// Nodes must be added in depth-first order: the parent's subtree has to be the
+// tail of the arrays, which is what a recursive importer produces naturally.
+int32_t scene_add_node(Scene* scene, int32_t parent, vec3s position,
+                       versors rotation, vec3s scale) {
+  if (parent != SCENE_NO_PARENT &&
+      ((uint32_t)parent >= scene->count ||
+       parent + scene->subtreeSize[parent] != scene->count)) {
+    fprintf(stderr, "ERROR: Scene node %d added out of depth-first order\n",
+            parent);
+    return SCENE_NO_PARENT;
+  }
+
+  if (scene->count == scene->capacity &&
+      (scene->fixed || !scene_reserve(scene, scene->capacity * 2))) {
+    fprintf(stderr, "ERROR: Failed to grow scene to %u nodes\n",
+            scene->capacity * 2);
+    return SCENE_NO_PARENT;
+  }
+
+  int32_t node = (int32_t)scene->count++;
+  scene->parent[node] = parent;
+  scene->subtreeSize[node] = 1;
+  scene->flags[node] = 0;
+  scene->position[node] = position;
+  scene->rotation[node] = rotation;
+  scene->scale[node] = scale;
+
+  for (int32_t p = parent; p != SCENE_NO_PARENT; p = scene->parent[p]) {
+    scene->subtreeSize[p]++;
+  }
+
+  scene_mark_dirty(scene, node);
+
+  return node;
+}
+
+// Appends a node whose local transform is given as an affine matrix, which is
+// decomposed into TRS so it can be animated like any other node.
+int32_t scene_add_node_matrix(Scene* scene, int32_t parent, mat4s local) {
+  vec4s t;
+  mat4s r;
+  vec3s s;
+  glms_decompose(local, &t, &r, &s);
+
+  return scene_add_node(scene, parent, glms_vec3(t), glms_mat4_quat(r), s);
+}
+
+void scene_set_position(Scene* scene, int32_t node, vec3s position) {
+  scene->position[node] = position;
+  scene_mark_dirty(scene, node);
+}
+
+void scene_set_rotation(Scene* scene, int32_t node, versors rotation) {
+  scene->rotation[node] = rotation;
+  scene_mark_dirty(scene, node);
+}
+
+void scene_set_scale(Scene* scene, int32_t node, vec3s scale) {
+  scene->scale[node] = scale;
+  scene_mark_dirty(scene, node);
+}
+
+void scene_set_trs(Scene* scene, int32_t node, vec3s position,
+                   versors rotation, vec3s scale) {
+  scene->position[node] = position;
+  scene->rotation[node] = rotation;
+  scene->scale[node] = scale;
+  scene_mark_dirty(scene, node);
+}
+
+// Brings every world matrix up to date in a single forward pass. Clean
+// subtrees are stepped over as a whole, so static nodes cost nothing and a
+// frame without changes returns immediately.
+void scene_update(Scene* scene) {
+  scene->numUpdated = 0;
+  if (!scene->dirty) return;
+
+  uint32_t i = 0;
+  while (i < scene->count) {
+    uint8_t flags = scene->flags[i];
+    uint32_t end = i + scene->subtreeSize[i];
+
+    if (!(flags & SCENE_NODE_SUBTREE_DIRTY)) {
+      i = end;
+    } else if (flags & SCENE_NODE_LOCAL_DIRTY) {
+      scene_update_range(scene, i, end);
+      i = end;
+    } else {
+      // Only some descendants changed, walk into the subtree
+      scene->flags[i] = 0;
+      i++;
+    }
+  }
+
+  scene->dirty = false;
+}
+
+// Builds translate * rotate * scale without going through three multiplies
+mat4s scene_trs_matrix(vec3s position, versors rotation, vec3s scale) {
+  mat4s m = glms_quat_mat4(rotation);
+  m.col[0] = glms_vec4_scale(m.col[0], scale.x);
+  m.col[1] = glms_vec4_scale(m.col[1], scale.y);
+  m.col[2] = glms_vec4_scale(m.col[2], scale.z);
+  m.col[3] = glms_vec4(position, 1.0f);
+
+  return m;
+}
+
+// ------------------------------------------------------------------------
+
+// Recomputes [first, end), a whole subtree whose root changed. Parents come
+// before children, so each world matrix is a single SIMD mat4 multiply.
+static void scene_update_range(Scene* scene, uint32_t first, uint32_t end) {
+  for (uint32_t i = first; i < end; i++) {
+    if (scene->flags[i] & SCENE_NODE_LOCAL_DIRTY) {
+      scene->local[i] = scene_trs_matrix(scene->position[i],
+                                         scene->rotation[i], scene->scale[i]);
+    }
+
+    int32_t parent = scene->parent[i];
+    if (parent == SCENE_NO_PARENT) {
+      scene->world[i] = scene->local[i];
+    } else {
+      glm_mat4_mul(scene->world[parent].raw, scene->local[i].raw,
+                   scene->world[i].raw);
+    }
+
+    scene->flags[i] = 0;
+  }
+
+  scene->numUpdated += end - first;
+}
+
+// Flags the node and propagates the subtree bit upwards. An ancestor that
+// already carries the bit implies all of its ancestors do too.
+static void scene_mark_dirty(Scene* scene, int32_t node) {
+  scene->flags[node] |= SCENE_NODE_LOCAL_DIRTY | SCENE_NODE_SUBTREE_DIRTY;
+  scene->dirty = true;
+
+  for (int32_t p = scene->parent[node]; p != SCENE_NO_PARENT;
+       p = scene->parent[p]) {
+    if (scene->flags[p] & SCENE_NODE_SUBTREE_DIRTY) break;
+    scene->flags[p] |= SCENE_NODE_SUBTREE_DIRTY;
+  }
+}
+
+static bool scene_reserve(Scene* scene, uint32_t capacity) {
+  uint32_t old = scene->capacity;
+
+  int32_t* parent = realloc(scene->parent, capacity * sizeof(int32_t));
+  if (parent) scene->parent = parent;
+  uint32_t* subtreeSize =
+      realloc(scene->subtreeSize, capacity * sizeof(uint32_t));
+  if (subtreeSize) scene->subtreeSize = subtreeSize;
+  uint8_t* flags = realloc(scene->flags, capacity * sizeof(uint8_t));
+  if (flags) scene->flags = flags;
+  vec3s* position = realloc(scene->position, capacity * sizeof(vec3s));
+  if (position) scene->position = position;
+  vec3s* scale = realloc(scene->scale, capacity * sizeof(vec3s));
+  if (scale) scene->scale = scale;
+
+  // Quaternions and matrices keep their SIMD alignment
+  versors* rotation = scene_realloc_aligned(
+      scene->rotation, old * sizeof(versors), capacity * sizeof(versors));
+  if (rotation) scene->rotation = rotation;
+  mat4s* local = scene_realloc_aligned(scene->local, old * sizeof(mat4s),
+                                       capacity * sizeof(mat4s));
+  if (local) scene->local = local;
+  mat4s* world = scene_realloc_aligned(scene->world, old * sizeof(mat4s),
+                                       capacity * sizeof(mat4s));
+  if (world) scene->world = world;
+
+  if (!parent || !subtreeSize || !flags || !position || !scale || !rotation ||
+      !local || !world) {
+    return false;
+  }
+
+  scene->capacity = capacity;
+  return true;
+}
+
+static void* scene_realloc_aligned(void* ptr, size_t oldSize, size_t newSize) {
+  // aligned_alloc wants a size that is a multiple of the alignment
+  void* data = aligned_alloc(32, (newSize + 31) & ~(size_t)31);
+  if (data == NULL) return NULL;
+
+  if (ptr != NULL) {
+    memcpy(data, ptr, oldSize);
+    free(ptr);
+  }
+
+  return data;
+}
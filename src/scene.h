@@ -0,0 +1,63 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "cglm/types-struct.h"
+
+#define SCENE_NO_PARENT (-1)
+
+typedef enum {
+  // Local TRS changed, the node and its whole subtree need new world matrices
+  SCENE_NODE_LOCAL_DIRTY = 1 << 0,
+  // Some node in the subtree (this one included) is dirty
+  SCENE_NODE_SUBTREE_DIRTY = 1 << 1,
+} SceneNodeFlags;
+
+// Transform hierarchy stored as parallel arrays in depth-first pre-order: a
+// parent always has a lower index than its children and the subtree of node i
+// is the contiguous range [i, i + subtreeSize[i]).
+typedef struct {
+  int32_t* parent;
+  uint32_t* subtreeSize;
+  uint8_t* flags;
+
+  // Local TRS
+  vec3s* position;
+  versors* rotation;
+  vec3s* scale;
+
+  // Cached matrices
+  mat4s* local;
+  mat4s* world;
+
+  uint32_t count;
+  uint32_t capacity;
+  // Arrays carved from an arena: not freed by scene_destroy and cannot grow
+  bool fixed;
+
+  // Nodes whose world matrix was recomputed by the last scene_update
+  uint32_t numUpdated;
+  bool dirty;
+} Scene;
+
+Scene scene_create(uint32_t capacity);
+Scene scene_create_in_arena(Arena* arena, uint32_t capacity);
+void scene_destroy(Scene* scene);
+
+int32_t scene_add_node(Scene* scene, int32_t parent, vec3s position,
+                       versors rotation, vec3s scale);
+int32_t scene_add_node_matrix(Scene* scene, int32_t parent, mat4s local);
+
+void scene_set_position(Scene* scene, int32_t node, vec3s position);
+void scene_set_rotation(Scene* scene, int32_t node, versors rotation);
+void scene_set_scale(Scene* scene, int32_t node, vec3s scale);
+void scene_set_trs(Scene* scene, int32_t node, vec3s position,
+                   versors rotation, vec3s scale);
+
+void scene_update(Scene* scene);
+mat4s scene_trs_matrix(vec3s position, versors rotation, vec3s scale);
+
+#endif  // SCENE_H
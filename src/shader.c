@@ -1,17 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "glstate.h"
 #include "shader.h"
 
 // Privates
 static char* read_file(const char* path, const char* modes);
+static char* insert_defines(char* code, const char* defines);
 
 Shader shader_create(const char* vertexPath, const char* fragmentPath) {
+  return shader_create_with_defines(vertexPath, fragmentPath, NULL);
+}
+
+// `defines` go right after the #version line of both stages, one or more
+// "#define NAME" lines selecting a variant of the same files
+Shader shader_create_with_defines(const char* vertexPath,
+                                  const char* fragmentPath,
+                                  const char* defines) {
   Shader shader = {0};
 
   // 1. Retrieve the vertex/fragment source code from filePath
-  shader.vertex_code = read_file(vertexPath, "r");
-  shader.fragment_code = read_file(fragmentPath, "r");
+  shader.vertex_code = insert_defines(read_file(vertexPath, "r"), defines);
+  shader.fragment_code = insert_defines(read_file(fragmentPath, "r"), defines);
 
   GLuint vertex, fragment;
   int success;
@@ -51,6 +62,7 @@ Shader shader_create(const char* vertexPath, const char* fragmentPath) {
     glGetProgramInfoLog(shader.ID, 512, NULL, infoLog);
     fprintf(stderr, "ERROR: Shader program linking failed %s\n", infoLog);
   }
+  shader.modelLocation = glGetUniformLocation(shader.ID, "model");
 
   glDeleteShader(vertex);
   glDeleteShader(fragment);
@@ -59,7 +71,7 @@ Shader shader_create(const char* vertexPath, const char* fragmentPath) {
 }
 
 void shader_use(Shader* shader) {
-  glUseProgram(shader->ID);
+  glstate_use_program(shader->ID);
 }
 
 void shader_set_bool(Shader* shader, const char* name, bool value) {
@@ -110,6 +122,14 @@ void shader_set_mat4(Shader* shader, const char* name, const mat4s mat) {
   glUniformMatrix4fv(glGetUniformLocation(shader->ID, name), 1, GL_FALSE, *mat.raw);
 }
 
+void shader_set_block_binding(Shader* shader, const char* name,
+                              GLuint binding) {
+  GLuint index = glGetUniformBlockIndex(shader->ID, name);
+  if (index != GL_INVALID_INDEX) {
+    glUniformBlockBinding(shader->ID, index, binding);
+  }
+}
+
 static char* read_file(const char* path, const char* modes) {
   FILE* file = fopen(path, modes);
   if (file == NULL) {
@@ -130,3 +150,19 @@ static char* read_file(const char* path, const char* modes) {
 
   return text;
 }
+
+static char* insert_defines(char* code, const char* defines) {
+  if (defines == NULL) return code;
+
+  // #version has to stay the first line
+  char* body = strchr(code, '\n');
+  size_t head = body != NULL ? (size_t)(body + 1 - code) : strlen(code);
+  size_t length = strlen(code) + strlen(defines) + 2;
+
+  char* text = (char*)malloc(length + 1);
+  snprintf(text, length + 1, "%.*s%s\n%s", (int)head, code, defines,
+           code + head);
+  free(code);
+
+  return text;
+}
@@ -8,11 +8,16 @@
 
 typedef struct {
   GLuint ID;
+  // Looked up once linked, -1 when the program has no "model" uniform
+  GLint modelLocation;
   const char* vertex_code;
   const char* fragment_code;
 } Shader;
 
 Shader shader_create(const char* vertexPath, const char* fragmentPath);
+Shader shader_create_with_defines(const char* vertexPath,
+                                  const char* fragmentPath,
+                                  const char* defines);
 void shader_use(Shader* shader);
 
 // Primitives
@@ -33,4 +38,7 @@ void shader_set_mat2(Shader* shader, const char* name, const mat2s mat);
 void shader_set_mat3(Shader* shader, const char* name, const mat3s mat);
 void shader_set_mat4(Shader* shader, const char* name, const mat4s mat);
 
+// Uniform blocks
+void shader_set_block_binding(Shader* shader, const char* name, GLuint binding);
+
 #endif // SHADER_H
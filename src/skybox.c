@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cglm/struct/mat3.h"
+#include "cglm/struct/mat4.h"
+#include "glstate.h"
+#include "skybox.h"
+#include "texture.h"
+
+typedef struct {
+  const char** paths;
+  TextureImage images[SKYBOX_FACES];
+  bool decoded[SKYBOX_FACES];
+} SkyboxLoad;
+
+static SkyboxStats stats;
+static SkyboxStats reported;  // stats at the last frame report
+
+// Privates
+static void skybox_decode_faces(void* data, uint32_t begin, uint32_t end);
+static void skybox_flip_rows(TextureImage* image);
+static void skybox_read_queries(Skybox* skybox, uint32_t slot);
+
+// Unit cube seen from the inside
+static const float SKYBOX_VERTICES[] = {
+    -1.0f, 1.0f,  -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f,
+    1.0f,  -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, -1.0f, 1.0f,  -1.0f,
+
+    -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  -1.0f,
+    -1.0f, 1.0f,  -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, -1.0f, 1.0f,
+
+    1.0f,  -1.0f, -1.0f, 1.0f,  -1.0f, 1.0f,  1.0f,  1.0f,  1.0f,
+    1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  -1.0f, 1.0f,  -1.0f, -1.0f,
+
+    -1.0f, -1.0f, 1.0f,  -1.0f, 1.0f,  1.0f,  1.0f,  1.0f,  1.0f,
+    1.0f,  1.0f,  1.0f,  1.0f,  -1.0f, 1.0f,  -1.0f, -1.0f, 1.0f,
+
+    -1.0f, 1.0f,  -1.0f, 1.0f,  1.0f,  -1.0f, 1.0f,  1.0f,  1.0f,
+    1.0f,  1.0f,  1.0f,  -1.0f, 1.0f,  1.0f,  -1.0f, 1.0f,  -1.0f,
+
+    -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, -1.0f,
+    1.0f,  -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, 1.0f,
+};
+
+bool skybox_create(Skybox* skybox, const char* faces[SKYBOX_FACES],
+                   JobPool* pool) {
+  *skybox = (Skybox){0};
+
+  SkyboxLoad load = {.paths = faces};
+  if (pool != NULL) {
+    job_pool_parallel_for(pool, SKYBOX_FACES, 1, skybox_decode_faces, &load);
+  } else {
+    skybox_decode_faces(&load, 0, SKYBOX_FACES);
+  }
+
+  bool complete = true;
+  for (uint32_t i = 0; i < SKYBOX_FACES; i++) {
+    const TextureImage* image = &load.images[i];
+    if (!load.decoded[i]) {
+      fprintf(stderr, "ERROR: Failed to load skybox face %s\n", faces[i]);
+      complete = false;
+    } else if (image->width != image->height ||
+               image->width != load.images[0].width ||
+               image->channels != load.images[0].channels) {
+      fprintf(stderr, "ERROR: Skybox face %s doesn't match the others\n",
+              faces[i]);
+      complete = false;
+    }
+  }
+
+  if (complete) {
+    const TextureImage* first = &load.images[0];
+    GLenum format = first->channels == 4 ? GL_RGBA : GL_RGB;
+    GLenum internalFormat =
+        first->channels == 4 ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+    skybox->size = first->width;
+    skybox->levels = first->levels;
+
+    glGenTextures(1, &skybox->texture);
+    glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_CUBE_MAP,
+                         skybox->texture);
+    if (GLEW_ARB_texture_storage) {
+      glTexStorage2D(GL_TEXTURE_CUBE_MAP, skybox->levels, internalFormat,
+                     skybox->size, skybox->size);
+    } else {
+      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL,
+                      skybox->levels - 1);
+    }
+
+    // Rows of RGB levels aren't 4-byte aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (uint32_t i = 0; i < SKYBOX_FACES; i++) {
+      const TextureImage* image = &load.images[i];
+      const GLubyte* level = image->pixels;
+      for (uint32_t l = 0; l < image->levels; l++) {
+        int32_t size = skybox->size >> l > 0 ? skybox->size >> l : 1;
+        GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+        if (GLEW_ARB_texture_storage) {
+          glTexSubImage2D(target, l, 0, 0, size, size, format,
+                          GL_UNSIGNED_BYTE, level);
+        } else {
+          glTexImage2D(target, l, internalFormat, size, size, 0, format,
+                       GL_UNSIGNED_BYTE, level);
+        }
+        level += texture_level_size(image, l);
+      }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // Filters across face edges instead of clamping at each face
+    glstate_set_enabled(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
+  }
+
+  for (uint32_t i = 0; i < SKYBOX_FACES; i++) {
+    if (load.decoded[i]) texture_image_free(&load.images[i]);
+  }
+  if (!complete) return false;
+
+  glGenVertexArrays(1, &skybox->VAO);
+  glGenBuffers(1, &skybox->VBO);
+  glstate_bind_vertex_array(skybox->VAO);
+  glstate_bind_buffer(GL_ARRAY_BUFFER, skybox->VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(SKYBOX_VERTICES), SKYBOX_VERTICES,
+               GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, false, 3 * sizeof(float), NULL);
+  glEnableVertexAttribArray(0);
+  glstate_bind_vertex_array(0);
+
+  skybox->shader =
+      shader_create("./glsl/skybox_vs.glsl", "./glsl/skybox_fs.glsl");
+  shader_use(&skybox->shader);
+  shader_set_int(&skybox->shader, "skybox", SKYBOX_TEXTURE_UNIT);
+
+  glGenQueries(SKYBOX_QUERY_FRAMES, skybox->samplesQueries);
+  glGenQueries(SKYBOX_QUERY_FRAMES, skybox->timeQueries);
+
+  return true;
+}
+
+void skybox_destroy(Skybox* skybox) {
+  glDeleteQueries(SKYBOX_QUERY_FRAMES, skybox->samplesQueries);
+  glDeleteQueries(SKYBOX_QUERY_FRAMES, skybox->timeQueries);
+  glstate_delete_vertex_arrays(1, &skybox->VAO);
+  glstate_delete_buffers(1, &skybox->VBO);
+  glstate_delete_textures(1, &skybox->texture);
+  glstate_delete_program(skybox->shader.ID);
+
+  *skybox = (Skybox){0};
+}
+
+void skybox_draw(Skybox* skybox, mat4s view, mat4s projection) {
+  // The queries issued SKYBOX_QUERY_FRAMES draws ago are done by now
+  uint32_t slot = skybox->queryFrame % SKYBOX_QUERY_FRAMES;
+  if (skybox->queryFrame >= SKYBOX_QUERY_FRAMES) {
+    skybox_read_queries(skybox, slot);
+  }
+  skybox->queryFrame++;
+
+  shader_use(&skybox->shader);
+  // Only the rotation: the sky stays infinitely far away
+  shader_set_mat4(&skybox->shader, "view",
+                  glms_mat4_ins3(glms_mat4_pick3(view), glms_mat4_identity()));
+  shader_set_mat4(&skybox->shader, "projection", projection);
+
+  glstate_bind_texture(SKYBOX_TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP,
+                       skybox->texture);
+
+  glstate_depth_func(GL_LEQUAL);
+  glstate_depth_mask(false);
+
+  glBeginQuery(GL_SAMPLES_PASSED, skybox->samplesQueries[slot]);
+  glBeginQuery(GL_TIME_ELAPSED, skybox->timeQueries[slot]);
+  glstate_bind_vertex_array(skybox->VAO);
+  glDrawArrays(GL_TRIANGLES, 0, 36);
+  glEndQuery(GL_TIME_ELAPSED);
+  glEndQuery(GL_SAMPLES_PASSED);
+
+  glstate_depth_mask(true);
+  glstate_depth_func(GL_LESS);
+}
+
+SkyboxStats skybox_get_stats(void) {
+  return stats;
+}
+
+void skybox_print_frame_stats(FILE* stream) {
+  uint32_t frames = stats.frames - reported.frames;
+  if (frames > 0) {
+    fprintf(stream, "skybox: %.0f samples shaded, %.3f ms GPU per frame\n",
+            (double)(stats.samples - reported.samples) / frames,
+            (stats.gpuMs - reported.gpuMs) / frames);
+  }
+  reported = stats;
+}
+
+// ------------------------------------------------------------------------
+
+static void skybox_decode_faces(void* data, uint32_t begin, uint32_t end) {
+  SkyboxLoad* load = data;
+  for (uint32_t i = begin; i < end; i++) {
+    TextureImage* image = &load->images[i];
+    load->decoded[i] = texture_decode_file(load->paths[i], image);
+    if (!load->decoded[i]) continue;
+
+    skybox_flip_rows(image);
+    texture_build_mips(image, TEXTURE_SRGB);
+  }
+}
+
+// Cube map faces are laid out top row first, unlike 2D textures. The
+// decoder flips every image for those, flip the face back.
+static void skybox_flip_rows(TextureImage* image) {
+  size_t pitch = (size_t)image->width * image->channels;
+  GLubyte* row = malloc(pitch);
+  for (int32_t y = 0; y < image->height / 2; y++) {
+    GLubyte* top = image->pixels + y * pitch;
+    GLubyte* bottom = image->pixels + (image->height - 1 - y) * pitch;
+    memcpy(row, top, pitch);
+    memcpy(top, bottom, pitch);
+    memcpy(bottom, row, pitch);
+  }
+  free(row);
+}
+
+static void skybox_read_queries(Skybox* skybox, uint32_t slot) {
+  GLuint available = 0;
+  glGetQueryObjectuiv(skybox->timeQueries[slot], GL_QUERY_RESULT_AVAILABLE,
+                      &available);
+  if (!available) return;
+
+  GLuint64 samples = 0;
+  GLuint64 nanoseconds = 0;
+  glGetQueryObjectui64v(skybox->samplesQueries[slot], GL_QUERY_RESULT,
+                        &samples);
+  glGetQueryObjectui64v(skybox->timeQueries[slot], GL_QUERY_RESULT,
+                        &nanoseconds);
+
+  stats.frames++;
+  stats.samples += samples;
+  stats.gpuMs += nanoseconds / 1e6;
+}
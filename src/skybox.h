@@ -0,0 +1,56 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+#include "job.h"
+#include "shader.h"
+
+// Faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order: +x, -x, +y, -y, +z, -z
+#define SKYBOX_FACES 6
+
+// Unit of its own, so the bindings material draws leave in place survive
+#define SKYBOX_TEXTURE_UNIT 15
+
+// Occlusion and timer queries kept in flight, read back frames later so
+// the results never stall the draw
+#define SKYBOX_QUERY_FRAMES 3
+
+typedef struct {
+  uint32_t frames;   // frames with results
+  uint64_t samples;  // fragments that passed the depth test
+  double gpuMs;      // time the sky pass took on the GPU
+} SkyboxStats;
+
+typedef struct {
+  GLuint texture;  // GL_TEXTURE_CUBE_MAP
+  GLuint VAO, VBO;
+  Shader shader;
+  int32_t size;
+  uint32_t levels;
+
+  GLuint samplesQueries[SKYBOX_QUERY_FRAMES];
+  GLuint timeQueries[SKYBOX_QUERY_FRAMES];
+  uint32_t queryFrame;
+} Skybox;
+
+// Decodes the faces on the pool's workers, NULL decodes in place. Faces must
+// be square and of the same size. Needs a current GL context.
+bool skybox_create(Skybox* skybox, const char* faces[SKYBOX_FACES],
+                   JobPool* pool);
+void skybox_destroy(Skybox* skybox);
+
+// Draws at depth 1.0 with GL_LEQUAL and no depth writes. Drawn after the
+// opaque geometry, early-z rejects the covered pixels before shading; drawn
+// right after the clear every pixel is shaded, which the stats measure.
+void skybox_draw(Skybox* skybox, mat4s view, mat4s projection);
+
+SkyboxStats skybox_get_stats(void);
+// Shaded samples and GPU time per frame, a stats report
+void skybox_print_frame_stats(FILE* stream);
+
+#endif  // SKYBOX_H
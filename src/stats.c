@@ -0,0 +1,41 @@
+#include "stats.h"
+
+static Stats stats;
+
+void stats_init(double interval) {
+  stats = (Stats){.interval = interval};
+}
+
+void stats_add_report(StatsReportFunc report) {
+  if (stats.numReports == STATS_MAX_REPORTS) {
+    fprintf(stderr, "ERROR: Too many stats reports\n");
+    return;
+  }
+
+  stats.reports[stats.numReports++] = report;
+}
+
+void stats_frame(double deltaTime) {
+  if (stats.interval <= 0.0) return;
+
+  double frameMs = deltaTime * 1000.0;
+  stats.elapsed += deltaTime;
+  stats.frames++;
+  stats.frameMsSum += frameMs;
+  if (frameMs > stats.frameMsMax) stats.frameMsMax = frameMs;
+
+  if (stats.elapsed < stats.interval) return;
+
+  printf("-- %.1f fps, %.2f ms avg, %.2f ms max\n",
+         stats.frames / stats.elapsed, stats.frameMsSum / stats.frames,
+         stats.frameMsMax);
+  for (uint32_t i = 0; i < stats.numReports; i++) {
+    stats.reports[i](stdout);
+  }
+  fflush(stdout);
+
+  stats.elapsed = 0.0;
+  stats.frames = 0;
+  stats.frameMsSum = 0.0;
+  stats.frameMsMax = 0.0;
+}
@@ -0,0 +1,30 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATS_MAX_REPORTS 16
+
+// Prints one line of a subsystem's counters
+typedef void (*StatsReportFunc)(FILE* stream);
+
+// Periodic profiling output: frame timings followed by every registered
+// report, written to stdout once per interval
+typedef struct {
+  double interval;  // seconds, 0 disables the output
+  double elapsed;
+  uint32_t frames;
+  double frameMsSum;
+  double frameMsMax;
+
+  StatsReportFunc reports[STATS_MAX_REPORTS];
+  uint32_t numReports;
+} Stats;
+
+void stats_init(double interval);
+void stats_add_report(StatsReportFunc report);
+// Accounts one frame, prints when the interval is over
+void stats_frame(double deltaTime);
+
+#endif  // STATS_H
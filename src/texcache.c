@@ -0,0 +1,173 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "texcache.h"
+
+// Header words, the magic included. Written as is, little-endian hosts only.
+#define DDS_WORDS 37
+#define DDS_MAGIC 0x20534444  // "DDS "
+#define DDS_FOURCC_DX10 0x30315844
+#define DDS_HEADER_SIZE 124
+#define DDS_PIXELFORMAT_SIZE 32
+#define DDS_FLAGS 0x21007  // caps, size, pixel format, mip count
+#define DDS_FLAG_PITCH 0x8
+#define DDS_FLAG_LINEAR_SIZE 0x80000
+#define DDS_PF_FOURCC 0x4
+#define DDS_CAPS 0x401008  // texture, mipmap, complex
+#define DXGI_DIMENSION_TEXTURE2D 3
+
+enum {
+  DDS_MAGIC_WORD = 0,
+  DDS_SIZE = 1,
+  DDS_HEADER_FLAGS = 2,
+  DDS_HEIGHT = 3,
+  DDS_WIDTH = 4,
+  DDS_PITCH_OR_LINEAR_SIZE = 5,
+  DDS_MIP_COUNT = 7,
+  DDS_CHANNELS = 8,  // first reserved word, channels of the source image
+  DDS_PF_SIZE = 19,
+  DDS_PF_FLAGS = 20,
+  DDS_PF_FOURCC_WORD = 21,
+  DDS_CAPS_WORD = 27,
+  DX10_FORMAT = 32,
+  DX10_DIMENSION = 33,
+  DX10_ARRAY_SIZE = 35,
+};
+
+typedef struct {
+  BCFormat format;
+  int32_t channels;  // raw formats only
+  uint32_t dxgi[2];  // DXGI_FORMAT, linear and sRGB
+} TexcacheFormat;
+
+static const TexcacheFormat FORMATS[] = {
+    {BC1, 0, {71, 72}},     {BC3, 0, {77, 78}},     {BC4, 0, {80, 80}},
+    {BC5, 0, {83, 83}},     {BC7, 0, {98, 99}},     {BC_NONE, 1, {61, 61}},
+    {BC_NONE, 2, {49, 49}}, {BC_NONE, 4, {28, 29}},
+};
+#define NUM_FORMATS (sizeof(FORMATS) / sizeof(FORMATS[0]))
+
+// Privates
+static const TexcacheFormat* texcache_find_format(BCFormat format,
+                                                  int32_t channels);
+
+bool texcache_write(const char* path, const TextureImage* image, bool srgb) {
+  // Three channel images have no DXGI format
+  const TexcacheFormat* format =
+      texcache_find_format(image->format, image->channels);
+  if (format == NULL) return false;
+
+  bool raw = image->format == BC_NONE;
+
+  uint32_t header[DDS_WORDS] = {0};
+  header[DDS_MAGIC_WORD] = DDS_MAGIC;
+  header[DDS_SIZE] = DDS_HEADER_SIZE;
+  header[DDS_HEADER_FLAGS] =
+      DDS_FLAGS | (raw ? DDS_FLAG_PITCH : DDS_FLAG_LINEAR_SIZE);
+  header[DDS_HEIGHT] = image->height;
+  header[DDS_WIDTH] = image->width;
+  header[DDS_PITCH_OR_LINEAR_SIZE] =
+      raw ? (size_t)image->width * image->channels
+          : texture_level_size(image, 0);
+  header[DDS_MIP_COUNT] = image->levels;
+  header[DDS_CHANNELS] = image->channels;
+  header[DDS_PF_SIZE] = DDS_PIXELFORMAT_SIZE;
+  header[DDS_PF_FLAGS] = DDS_PF_FOURCC;
+  header[DDS_PF_FOURCC_WORD] = DDS_FOURCC_DX10;
+  header[DDS_CAPS_WORD] = DDS_CAPS;
+  header[DX10_FORMAT] = format->dxgi[srgb];
+  header[DX10_DIMENSION] = DXGI_DIMENSION_TEXTURE2D;
+  header[DX10_ARRAY_SIZE] = 1;
+
+  // Written aside and renamed, readers never see half a file
+  char temp[1024];
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+  FILE* file = fopen(temp, "wb");
+  if (file == NULL) return false;
+
+  bool written = fwrite(header, sizeof(header), 1, file) == 1 &&
+                 fwrite(image->pixels, 1, image->size, file) == image->size;
+  written = fclose(file) == 0 && written;
+
+  if (!written || rename(temp, path) != 0) {
+    remove(temp);
+    return false;
+  }
+
+  return true;
+}
+
+bool texcache_read(const char* path, TextureImage* image) {
+  *image = (TextureImage){0};
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return false;
+
+  uint32_t header[DDS_WORDS];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      header[DDS_MAGIC_WORD] != DDS_MAGIC ||
+      header[DDS_PF_FOURCC_WORD] != DDS_FOURCC_DX10 ||
+      header[DX10_DIMENSION] != DXGI_DIMENSION_TEXTURE2D ||
+      header[DDS_MIP_COUNT] == 0 || header[DDS_MIP_COUNT] > 32 ||
+      header[DDS_CHANNELS] == 0 || header[DDS_CHANNELS] > 4) {
+    fclose(file);
+    return false;
+  }
+
+  const TexcacheFormat* format = NULL;
+  for (size_t i = 0; i < NUM_FORMATS; i++) {
+    if (FORMATS[i].dxgi[0] == header[DX10_FORMAT] ||
+        FORMATS[i].dxgi[1] == header[DX10_FORMAT]) {
+      format = &FORMATS[i];
+    }
+  }
+
+  TextureImage found = {
+      .width = header[DDS_WIDTH],
+      .height = header[DDS_HEIGHT],
+      .channels = header[DDS_CHANNELS],
+      .levels = header[DDS_MIP_COUNT],
+      .cached = true,
+  };
+  bool valid = format != NULL && found.width > 0 && found.height > 0 &&
+               (format->format != BC_NONE ||
+                format->channels == found.channels);
+  if (valid) {
+    found.format = format->format;
+    for (uint32_t level = 0; level < found.levels; level++) {
+      found.size += texture_level_size(&found, level);
+    }
+  }
+
+  GLubyte* pixels = found.size > 0 ? malloc(found.size) : NULL;
+  bool read =
+      pixels != NULL && fread(pixels, 1, found.size, file) == found.size;
+  fclose(file);
+
+  if (!read) {
+    free(pixels);
+    return false;
+  }
+
+  *image = found;
+  image->pixels = pixels;
+  image->fileBytes = sizeof(header) + found.size;
+
+  return true;
+}
+
+// ------------------------------------------------------------------------
+
+static const TexcacheFormat* texcache_find_format(BCFormat format,
+                                                  int32_t channels) {
+  for (size_t i = 0; i < NUM_FORMATS; i++) {
+    if (FORMATS[i].format == format &&
+        (format != BC_NONE || FORMATS[i].channels == channels)) {
+      return &FORMATS[i];
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <stdbool.h>
+
+#include "texture.h"
+
+// Images with their mip chains saved as DDS files with a DX10 header, block
+// compressed or 8-bit with one, two or four channels. Rows stay bottom to
+// top as GL takes them, so the files are only meant to be read back by
+// texcache_read. Safe to call from any thread.
+
+// Writes `image` with all its levels, false on I/O errors or when no DXGI
+// format fits
+bool texcache_write(const char* path, const TextureImage* image, bool srgb);
+// Reads a file written by texcache_write, false if missing or unusable
+bool texcache_read(const char* path, TextureImage* image);
+
+#endif  // TEXCACHE_H
@@ -0,0 +1,407 @@
+#include <stdlib.h>
+
+#include "texpool.h"
+
+#include "glstate.h"
+
+// Layers of a new pool, doubled whenever it fills up
+#define TEXPOOL_MIN_LAYERS 4
+
+typedef struct {
+  uint64_t hash;  // of the texture copied in
+  // Streamed textures come in without their top levels: the layer holds
+  // baseLevel and down, and a reference to the source until it has them all
+  uint32_t baseLevel;
+  TextureHandle source;
+} TexturePoolLayer;
+
+typedef struct {
+  GLuint id;
+  int32_t width;
+  int32_t height;
+  GLenum internalFormat;
+  BCFormat format;
+  int32_t channels;
+  uint32_t levels;
+  TextureSampler sampler;
+  uint32_t baseLevel;  // largest level every layer has, where sampling starts
+
+  TexturePoolLayer* layers;
+  uint32_t numLayers;
+  uint32_t capacity;
+} TexturePool;
+
+typedef struct {
+  TexturePool* pools;
+  uint32_t numPools;
+  uint32_t capacity;
+  uint32_t maxLayers;
+
+  // Copies go through glCopyImageSubData where the driver has
+  // ARB_copy_image, otherwise through the staging buffer
+  bool copyImage;
+  bool storage;
+  GLuint staging;
+  size_t stagingSize;
+
+  TexturePoolStats stats;
+} TexturePoolManager;
+
+static TexturePoolManager manager;
+
+// Privates
+static TexturePool* texpool_find(const TextureEntry* entry);
+static GLuint texpool_create_array(const TexturePool* pool, uint32_t layers);
+static void texpool_grow(TexturePool* pool);
+static void texpool_copy(const TexturePool* pool, GLenum srcTarget, GLuint src,
+                         uint32_t srcLayers, GLuint dst, uint32_t dstLayer,
+                         uint32_t firstLevel, uint32_t endLevel);
+static void texpool_set_base_level(TexturePool* pool);
+static size_t texpool_level_size(const TexturePool* pool, uint32_t level);
+static GLenum texpool_pixel_format(const TexturePool* pool);
+static const char* texpool_format_name(const TexturePool* pool);
+static int32_t texpool_level_extent(int32_t size, uint32_t level);
+
+void texpool_init(void) {
+  manager = (TexturePoolManager){
+      .copyImage = GLEW_ARB_copy_image,
+      .storage = GLEW_ARB_texture_storage,
+  };
+
+  GLint maxLayers = 256;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+  manager.maxLayers = maxLayers < UINT16_MAX ? (uint32_t)maxLayers : UINT16_MAX;
+}
+
+void texpool_destroy(void) {
+  for (uint32_t i = 0; i < manager.numPools; i++) {
+    TexturePool* pool = &manager.pools[i];
+    for (uint32_t l = 0; l < pool->numLayers; l++) {
+      texture_release(pool->layers[l].source);
+    }
+    glstate_delete_textures(1, &pool->id);
+    free(pool->layers);
+  }
+  glstate_delete_buffers(1, &manager.staging);
+  free(manager.pools);
+
+  manager = (TexturePoolManager){0};
+}
+
+TexturePoolSlot texpool_add(TextureHandle handle) {
+  if (texture_get(handle)->state == TEXTURE_PENDING) texture_finish();
+
+  const TextureEntry* source = texture_get(handle);
+  if (source->state != TEXTURE_READY) source = texture_get(TEXTURE_FALLBACK);
+
+  TexturePool* pool = texpool_find(source);
+  TexturePoolSlot slot = {.pool = (uint16_t)(pool - manager.pools)};
+  for (uint32_t i = 0; i < pool->numLayers; i++) {
+    if (pool->layers[i].hash == source->hash) {
+      slot.layer = (uint16_t)i;
+      return slot;
+    }
+  }
+
+  if (pool->numLayers == pool->capacity) texpool_grow(pool);
+  texpool_copy(pool, source->target, source->id, 1, pool->id, pool->numLayers,
+               source->baseLevel, pool->levels);
+
+  // Pools are sized for the full chain, texpool_update copies the levels a
+  // streamed texture still lacks as they arrive
+  TexturePoolLayer* layer = &pool->layers[pool->numLayers];
+  *layer = (TexturePoolLayer){
+      .hash = source->hash,
+      .baseLevel = source->baseLevel,
+  };
+  if (layer->baseLevel > 0) {
+    layer->source = texture_acquire(handle);
+    manager.stats.streaming++;
+  }
+
+  slot.layer = (uint16_t)pool->numLayers++;
+  manager.stats.layers++;
+  texpool_set_base_level(pool);
+
+  return slot;
+}
+
+void texpool_update(void) {
+  for (uint32_t i = 0; i < manager.numPools; i++) {
+    TexturePool* pool = &manager.pools[i];
+    bool copied = false;
+
+    for (uint32_t l = 0; l < pool->numLayers; l++) {
+      TexturePoolLayer* layer = &pool->layers[l];
+      if (layer->source == TEXTURE_FALLBACK) continue;
+
+      const TextureEntry* source = texture_get(layer->source);
+      if (source->baseLevel < layer->baseLevel) {
+        texpool_copy(pool, source->target, source->id, 1, pool->id, l,
+                     source->baseLevel, layer->baseLevel);
+        layer->baseLevel = source->baseLevel;
+        copied = true;
+      }
+
+      if (layer->baseLevel == 0) {
+        texture_release(layer->source);
+        layer->source = TEXTURE_FALLBACK;
+        manager.stats.streaming--;
+      } else {
+        texture_use_all_levels(layer->source);
+      }
+    }
+
+    if (copied) texpool_set_base_level(pool);
+  }
+}
+
+void texpool_bind(TexturePoolSlot slot, GLuint unit) {
+  const TexturePool* pool = &manager.pools[slot.pool];
+  glstate_bind_texture(unit, GL_TEXTURE_2D_ARRAY, pool->id);
+  glstate_bind_sampler(unit, texture_get_sampler(pool->sampler));
+}
+
+TexturePoolStats texpool_get_stats(void) {
+  return manager.stats;
+}
+
+void texpool_print_stats(FILE* stream) {
+  fprintf(stream,
+          "texture pools: %u pools, %u layers (%u streaming), %u grows, "
+          "%.2f MiB, %s copies\n",
+          manager.stats.pools, manager.stats.layers, manager.stats.streaming,
+          manager.stats.grows, manager.stats.bytes / (1024.0 * 1024.0),
+          manager.copyImage ? "image" : "buffer");
+  fprintf(stream, "  %11s %6s %6s %4s %7s\n", "size", "format", "levels",
+          "base", "layers");
+
+  for (uint32_t i = 0; i < manager.numPools; i++) {
+    const TexturePool* pool = &manager.pools[i];
+    char size[16];
+    snprintf(size, sizeof(size), "%dx%d", pool->width, pool->height);
+    fprintf(stream, "  %11s %6s %6u %4u %3u/%-3u\n", size,
+            texpool_format_name(pool), pool->levels, pool->baseLevel,
+            pool->numLayers, pool->capacity);
+  }
+}
+
+// ------------------------------------------------------------------------
+
+// The pool with room for `entry`, a new one when none matches or the
+// matching ones are at the driver's layer limit
+static TexturePool* texpool_find(const TextureEntry* entry) {
+  for (uint32_t i = 0; i < manager.numPools; i++) {
+    TexturePool* pool = &manager.pools[i];
+    if (pool->width != entry->width || pool->height != entry->height ||
+        pool->internalFormat != entry->internalFormat ||
+        pool->levels != entry->levels || pool->sampler != entry->sampler) {
+      continue;
+    }
+
+    for (uint32_t l = 0; l < pool->numLayers; l++) {
+      if (pool->layers[l].hash == entry->hash) return pool;
+    }
+    if (pool->numLayers < manager.maxLayers) return pool;
+  }
+
+  if (manager.numPools == manager.capacity) {
+    manager.capacity = manager.capacity > 0 ? manager.capacity * 2 : 8;
+    manager.pools =
+        realloc(manager.pools, manager.capacity * sizeof(TexturePool));
+  }
+
+  TexturePool* pool = &manager.pools[manager.numPools++];
+  *pool = (TexturePool){
+      .width = entry->width,
+      .height = entry->height,
+      .internalFormat = entry->internalFormat,
+      .format = entry->format,
+      .channels = entry->channels,
+      .levels = entry->levels,
+      .sampler = entry->sampler,
+      .capacity = TEXPOOL_MIN_LAYERS < manager.maxLayers ? TEXPOOL_MIN_LAYERS
+                                                         : manager.maxLayers,
+  };
+  pool->layers = malloc(pool->capacity * sizeof(TexturePoolLayer));
+  pool->id = texpool_create_array(pool, pool->capacity);
+  manager.stats.pools++;
+
+  return pool;
+}
+
+// Array storage for `layers` layers of the pool's size and format
+static GLuint texpool_create_array(const TexturePool* pool, uint32_t layers) {
+  GLuint id;
+  glGenTextures(1, &id);
+  glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_2D_ARRAY, id);
+
+  if (manager.storage) {
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, pool->levels, pool->internalFormat,
+                   pool->width, pool->height, layers);
+  } else {
+    for (uint32_t i = 0; i < pool->levels; i++) {
+      int32_t width = texpool_level_extent(pool->width, i);
+      int32_t height = texpool_level_extent(pool->height, i);
+      if (pool->format != BC_NONE) {
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, pool->internalFormat,
+                               width, height, layers, 0,
+                               texpool_level_size(pool, i) * layers, NULL);
+      } else {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, i, pool->internalFormat, width,
+                     height, layers, 0, texpool_pixel_format(pool),
+                     GL_UNSIGNED_BYTE, NULL);
+      }
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                    pool->levels - 1);
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, pool->baseLevel);
+  // Same swizzle as the BC4 textures the layers come from
+  if (pool->format == BC4) {
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_G, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_B, GL_RED);
+  }
+
+  for (uint32_t i = 0; i < pool->levels; i++) {
+    manager.stats.bytes += texpool_level_size(pool, i) * layers;
+  }
+
+  return id;
+}
+
+// Immutable arrays can't take more layers: moves the pool to one twice the
+// size, as far as the driver allows, and copies the layers over
+static void texpool_grow(TexturePool* pool) {
+  uint32_t capacity = pool->capacity * 2 < manager.maxLayers
+                          ? pool->capacity * 2
+                          : manager.maxLayers;
+  GLuint id = texpool_create_array(pool, capacity);
+  texpool_copy(pool, GL_TEXTURE_2D_ARRAY, pool->id, pool->numLayers, id, 0, 0,
+               pool->levels);
+
+  glstate_delete_textures(1, &pool->id);
+  for (uint32_t i = 0; i < pool->levels; i++) {
+    manager.stats.bytes -= texpool_level_size(pool, i) * pool->capacity;
+  }
+
+  pool->id = id;
+  pool->capacity = capacity;
+  pool->layers = realloc(pool->layers, capacity * sizeof(TexturePoolLayer));
+  manager.stats.grows++;
+}
+
+// Copies levels `firstLevel` up to `endLevel` of the `srcLayers` layers of
+// `src` into `dst` from `dstLayer` on. `src` starts at `firstLevel`, like a
+// streamed texture missing its top levels. Both paths stay on the GPU:
+// without ARB_copy_image each level is packed into the staging buffer and
+// unpacked from it.
+static void texpool_copy(const TexturePool* pool, GLenum srcTarget, GLuint src,
+                         uint32_t srcLayers, GLuint dst, uint32_t dstLayer,
+                         uint32_t firstLevel, uint32_t endLevel) {
+  bool compressed = pool->format != BC_NONE;
+
+  for (uint32_t i = firstLevel; i < endLevel; i++) {
+    GLint srcLevel = i - firstLevel;
+    int32_t width = texpool_level_extent(pool->width, i);
+    int32_t height = texpool_level_extent(pool->height, i);
+
+    if (manager.copyImage) {
+      glCopyImageSubData(src, srcTarget, srcLevel, 0, 0, 0, dst,
+                         GL_TEXTURE_2D_ARRAY, i, 0, 0, dstLayer, width, height,
+                         srcLayers);
+      continue;
+    }
+
+    size_t size = texpool_level_size(pool, i) * srcLayers;
+    if (manager.staging == 0) glGenBuffers(1, &manager.staging);
+    glstate_bind_buffer(GL_PIXEL_PACK_BUFFER, manager.staging);
+    if (size > manager.stagingSize) {
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_COPY);
+      manager.stagingSize = size;
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glstate_bind_texture(GLSTATE_UPLOAD_UNIT, srcTarget, src);
+    if (compressed) {
+      glGetCompressedTexImage(srcTarget, srcLevel, NULL);
+    } else {
+      glGetTexImage(srcTarget, srcLevel, texpool_pixel_format(pool),
+                    GL_UNSIGNED_BYTE, NULL);
+    }
+    glstate_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, manager.staging);
+    glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_2D_ARRAY, dst);
+    if (compressed) {
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, dstLayer, width,
+                                height, srcLayers, pool->internalFormat, size,
+                                NULL);
+    } else {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, dstLayer, width, height,
+                      srcLayers, texpool_pixel_format(pool), GL_UNSIGNED_BYTE,
+                      NULL);
+    }
+    glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+}
+
+// Sampling starts at the largest level all layers have, so a layer still
+// streaming shows its best copied level rather than the unwritten ones
+static void texpool_set_base_level(TexturePool* pool) {
+  uint32_t base = 0;
+  for (uint32_t l = 0; l < pool->numLayers; l++) {
+    if (pool->layers[l].baseLevel > base) base = pool->layers[l].baseLevel;
+  }
+  if (base == pool->baseLevel) return;
+
+  pool->baseLevel = base;
+  glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_2D_ARRAY, pool->id);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base);
+}
+
+// Bytes of one layer of a level, texels or blocks
+static size_t texpool_level_size(const TexturePool* pool, uint32_t level) {
+  int32_t width = texpool_level_extent(pool->width, level);
+  int32_t height = texpool_level_extent(pool->height, level);
+  if (pool->format != BC_NONE) {
+    return bc_level_size(pool->format, width, height);
+  }
+
+  return (size_t)width * height * pool->channels;
+}
+
+static GLenum texpool_pixel_format(const TexturePool* pool) {
+  switch (pool->channels) {
+    case 1:
+      return GL_RED;
+    case 2:
+      return GL_RG;
+    case 3:
+      return GL_RGB;
+    default:
+      return GL_RGBA;
+  }
+}
+
+static const char* texpool_format_name(const TexturePool* pool) {
+  if (pool->format != BC_NONE) return bc_name(pool->format);
+
+  switch (pool->channels) {
+    case 1:
+      return "R8";
+    case 2:
+      return "RG8";
+    case 3:
+      return "RGB8";
+    default:
+      return "RGBA8";
+  }
+}
+
+static int32_t texpool_level_extent(int32_t size, uint32_t level) {
+  return size >> level > 0 ? size >> level : 1;
+}
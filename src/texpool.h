@@ -0,0 +1,52 @@
+#ifndef TEXPOOL_H
+#define TEXPOOL_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "texture.h"
+
+// Material textures packed into GL_TEXTURE_2D_ARRAY pools, one pool per
+// size, sized format, level count and sampler. Draws bind the pool once and
+// select their texture with a layer index, so meshes sharing a pool draw
+// back to back without rebinding. Layers are copied on the GPU from resident
+// textures and stay until texpool_destroy. GL thread only.
+//
+// Pools hold the full mip chain. A streamed texture pooled before its top
+// levels are in keeps streaming them, and texpool_update copies them into
+// its layer as they arrive; until then its pool samples from the largest
+// level all of its layers have.
+
+typedef struct {
+  uint16_t pool;
+  uint16_t layer;
+} TexturePoolSlot;
+
+typedef struct {
+  uint32_t pools;
+  uint32_t layers;
+  uint32_t streaming;  // layers still missing their top levels
+  uint32_t grows;  // arrays reallocated to make room for more layers
+  size_t bytes;    // estimated GPU memory of every pool
+} TexturePoolStats;
+
+void texpool_init(void);
+void texpool_destroy(void);
+
+// Copies the texture into the pool matching it and returns its slot. Pending
+// textures are finished first and failed ones pool the fallback. A texture
+// already pooled returns its slot without copying again.
+TexturePoolSlot texpool_add(TextureHandle handle);
+// Copies the levels streamed in since the last call into their layers, call
+// once per frame after texture_pump
+void texpool_update(void);
+// Binds the slot's pool with its sampler, through glstate so a pool already
+// bound to `unit` isn't bound again
+void texpool_bind(TexturePoolSlot slot, GLuint unit);
+
+TexturePoolStats texpool_get_stats(void);
+// Pools with their size and layers
+void texpool_print_stats(FILE* stream);
+
+#endif  // TEXPOOL_H
@@ -0,0 +1,1083 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <math.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#include "glstate.h"
+#include "mip.h"
+#include "texcache.h"
+#include "texture.h"
+
+// Staging memory shared by every upload
+#define TEXTURE_UPLOAD_RING_SIZE (64u << 20)
+
+// Transcoded textures, one DDS file per source file and flags. Bump the
+// version when the encoder output changes to drop the stale files.
+#define TEXTURE_CACHE_DIR ".texcache"
+#define TEXTURE_CACHE_VERSION 2
+
+// Streamed textures keep the levels of this size and smaller resident
+#define TEXTURE_STREAM_TAIL_SIZE 64
+// Frames without a texture_use before a texture drops back to its tail
+#define TEXTURE_STREAM_EVICT_FRAMES 300
+// Files read at once for new levels, bounds disk and upload traffic
+#define TEXTURE_STREAM_MAX_REQUESTS 4
+
+typedef struct {
+  TextureEntry* entries;  // entries[TEXTURE_FALLBACK] is the fallback
+  uint32_t count;
+  uint32_t capacity;
+
+  GLuint samplers[NUM_TEXTURE_SAMPLERS];
+  TextureStats stats;
+
+  JobPool* pool;
+  JobQueue completed;  // TextureDecode, pushed by the workers
+  UploadRing* ring;
+
+  // Block formats the driver takes besides RGTC, which is core
+  bool s3tc;
+  bool bptc;
+  // Immutable storage through glTexStorage2D
+  bool storage;
+  // Dropped levels are copied out on the GPU with glCopyImageSubData
+  bool copyImage;
+
+  // Streaming, off while the budget is 0
+  size_t budget;
+  uint32_t frame;
+  float eye[3];
+  float focalPixels;      // pixels covered by one world unit at distance 1
+  TextureHandle* order;   // scratch for texture_stream_update
+  uint32_t orderCapacity;
+} TextureManager;
+
+// One file decoding on a worker. Owns a copy of the path so the entry can be
+// released while the decode is in flight.
+typedef struct {
+  JobNode node;
+  TextureHandle handle;
+  char* path;
+  uint32_t flags;
+  // Stream requests replace the levels of a resident texture by the chain
+  // from baseLevel down
+  bool stream;
+  uint32_t baseLevel;
+  TextureImage image;
+  bool decoded;
+  // Pixels already copied into the upload ring by the worker
+  UploadSlice slice;
+  bool staged;
+} TextureDecode;
+
+static TextureManager manager;
+
+// Privates
+static uint64_t texture_hash(const char* path, uint32_t flags);
+static TextureEntry* texture_new_entry(TextureHandle* handle);
+static void texture_decode_job(void* data);
+static bool texture_prepare(const char* path, uint32_t flags,
+                            TextureImage* image);
+static uint64_t texture_cache_key(const char* path, uint32_t flags,
+                                  const struct stat* info);
+static BCFormat texture_choose_format(const TextureImage* image,
+                                      uint32_t flags);
+static void texture_add_alpha(TextureImage* image);
+static void texture_image_trim(TextureImage* image, uint32_t level);
+static uint32_t texture_tail_level(int32_t width, int32_t height,
+                                   uint32_t levels);
+static uint32_t texture_stream_level(const TextureEntry* entry);
+static void texture_stream_request(TextureHandle handle);
+static void texture_drop_levels(TextureEntry* entry, uint32_t level);
+static int texture_compare_use(const void* a, const void* b);
+static uint32_t texture_finish_decode(TextureDecode* decode);
+static void texture_complete(TextureEntry* entry, const TextureImage* image,
+                             bool decoded, const UploadSlice* staged);
+static void texture_upload(TextureEntry* entry, GLuint buffer,
+                           const void* pixels);
+static GLuint texture_allocate(const TextureEntry* entry, uint32_t level);
+static size_t texture_chain_bytes(const TextureEntry* entry, uint32_t level);
+static GLenum texture_pixel_format(int32_t channels);
+static GLenum texture_internal_format(const TextureEntry* entry);
+static const char* texture_format_name(const TextureEntry* entry);
+static int32_t texture_level_extent(int32_t size, uint32_t level);
+static size_t texture_rgba8_bytes(const TextureEntry* entry);
+static GLuint texture_create_sampler(GLint wrap, GLint minFilter,
+                                     GLint magFilter);
+
+void texture_manager_init(JobPool* pool) {
+  manager = (TextureManager){.pool = pool};
+  atomic_init(&manager.completed.head, NULL);
+
+  // Set once, workers only ever read it
+  stbi_set_flip_vertically_on_load(true);
+
+  manager.s3tc = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+  manager.bptc = GLEW_ARB_texture_compression_bptc;
+  manager.storage = GLEW_ARB_texture_storage;
+  manager.copyImage = GLEW_ARB_copy_image;
+  mkdir(TEXTURE_CACHE_DIR, 0755);
+
+  manager.samplers[TEXTURE_SAMPLER_REPEAT] =
+      texture_create_sampler(GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+  manager.samplers[TEXTURE_SAMPLER_CLAMP] = texture_create_sampler(
+      GL_CLAMP_TO_EDGE, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+  manager.samplers[TEXTURE_SAMPLER_NEAREST] =
+      texture_create_sampler(GL_REPEAT, GL_NEAREST, GL_NEAREST);
+
+  // Magenta checkerboard, hard to miss on screen
+  static const GLubyte checker[] = {
+      255, 0, 255, 255, 0,   0, 0,   255,
+      0,   0, 0,   255, 255, 0, 255, 255,
+  };
+  TextureHandle handle;
+  TextureEntry* fallback = texture_new_entry(&handle);
+  *fallback = (TextureEntry){
+      .path = strdup("<fallback>"),
+      .refs = 1,
+      .state = TEXTURE_READY,
+      .target = GL_TEXTURE_2D,
+      .sampler = TEXTURE_SAMPLER_NEAREST,
+      .width = 2,
+      .height = 2,
+      .channels = 4,
+      .levels = 1,
+  };
+  texture_upload(fallback, 0, checker);
+
+  manager.ring = upload_ring_create(TEXTURE_UPLOAD_RING_SIZE);
+}
+
+void texture_manager_destroy(void) {
+  // Workers may still reference the queue
+  texture_finish();
+
+  for (uint32_t i = 0; i < manager.count; i++) {
+    TextureEntry* entry = &manager.entries[i];
+    if (entry->path == NULL) continue;
+
+    if (i != TEXTURE_FALLBACK) {
+      fprintf(stderr, "WARNING: Texture %s destroyed with %u references\n",
+              entry->path, entry->refs);
+    }
+    glstate_delete_textures(1, &entry->id);
+    free(entry->path);
+  }
+
+  glstate_delete_samplers(NUM_TEXTURE_SAMPLERS, manager.samplers);
+  upload_ring_destroy(manager.ring);
+  free(manager.entries);
+  free(manager.order);
+
+  manager = (TextureManager){0};
+}
+
+TextureHandle texture_load(const char* path, TextureFlags flags) {
+  manager.stats.requests++;
+
+  uint64_t hash = texture_hash(path, flags);
+  for (uint32_t i = 0; i < manager.count; i++) {
+    TextureEntry* entry = &manager.entries[i];
+    if (entry->path != NULL && entry->hash == hash && entry->flags == flags &&
+        strcmp(entry->path, path) == 0) {
+      manager.stats.hits++;
+      entry->refs++;
+      return i;
+    }
+  }
+
+  TextureHandle handle;
+  TextureEntry* entry = texture_new_entry(&handle);
+  *entry = (TextureEntry){
+      .path = strdup(path),
+      .hash = hash,
+      .flags = flags,
+      .refs = 1,
+      .state = TEXTURE_PENDING,
+      .target = GL_TEXTURE_2D,
+      .sampler = flags & TEXTURE_CLAMP ? TEXTURE_SAMPLER_CLAMP
+                                       : TEXTURE_SAMPLER_REPEAT,
+      .lastUsed = manager.frame,
+  };
+
+  if (manager.pool != NULL) {
+    TextureDecode* decode = calloc(1, sizeof(TextureDecode));
+    decode->handle = handle;
+    decode->path = strdup(path);
+    decode->flags = flags;
+    manager.stats.pending++;
+    job_pool_submit(manager.pool, texture_decode_job, decode);
+  } else {
+    TextureImage image;
+    bool decoded = texture_prepare(path, flags, &image);
+    if (decoded && manager.budget > 0) {
+      texture_image_trim(&image, texture_tail_level(image.width, image.height,
+                                                    image.levels));
+    }
+    texture_complete(entry, &image, decoded, NULL);
+    if (decoded) texture_image_free(&image);
+  }
+
+  return handle;
+}
+
+TextureHandle texture_acquire(TextureHandle handle) {
+  if (handle != TEXTURE_FALLBACK && handle < manager.count &&
+      manager.entries[handle].path != NULL) {
+    manager.entries[handle].refs++;
+  }
+
+  return handle;
+}
+
+// Deletes the texture once the last reference is gone. The fallback is
+// never released, textures still reading levels are deleted by texture_pump.
+void texture_release(TextureHandle handle) {
+  if (handle == TEXTURE_FALLBACK || handle >= manager.count) return;
+
+  TextureEntry* entry = &manager.entries[handle];
+  if (entry->path == NULL || entry->refs == 0 || --entry->refs > 0) return;
+  // texture_pump frees the slot when the decode comes back
+  if (entry->state == TEXTURE_PENDING || entry->streaming) return;
+
+  glstate_delete_textures(1, &entry->id);
+  free(entry->path);
+  manager.stats.bytes -= entry->bytes;
+
+  *entry = (TextureEntry){0};
+}
+
+uint32_t texture_pump(void) {
+  uint32_t uploaded = 0;
+  if (manager.ring != NULL) upload_ring_retire(manager.ring);
+
+  // Staged decodes go first: their ring space can only be freed once their
+  // copy is issued, and the others may have to wait for that space
+  JobNode* node = job_queue_take_all(&manager.completed);
+  JobNode* rest = NULL;
+  JobNode** restEnd = &rest;
+  while (node != NULL) {
+    JobNode* next = node->next;
+    if (((TextureDecode*)node)->staged) {
+      uploaded += texture_finish_decode((TextureDecode*)node);
+    } else {
+      node->next = NULL;
+      *restEnd = node;
+      restEnd = &node->next;
+    }
+    node = next;
+  }
+
+  while (rest != NULL) {
+    JobNode* next = rest->next;
+    uploaded += texture_finish_decode((TextureDecode*)rest);
+    rest = next;
+  }
+
+  return uploaded;
+}
+
+void texture_finish(void) {
+  while (manager.stats.pending > 0 || manager.stats.streaming > 0) {
+    if (texture_pump() == 0) sched_yield();
+  }
+}
+
+void texture_set_budget(size_t bytes) {
+  manager.budget = bytes;
+  manager.stats.budget = bytes;
+}
+
+void texture_stream_view(const float eye[3], float fovY, float height) {
+  memcpy(manager.eye, eye, sizeof(manager.eye));
+  manager.focalPixels = height / (2.0f * tanf(fovY * 0.5f));
+}
+
+// Keeps the largest density of the frame: the closest and most magnified
+// surface decides the level
+void texture_use(TextureHandle handle, const float center[3],
+                 float uvDensity) {
+  if (handle == TEXTURE_FALLBACK || handle >= manager.count) return;
+
+  TextureEntry* entry = &manager.entries[handle];
+  if (entry->path == NULL) return;
+
+  float dx = center[0] - manager.eye[0];
+  float dy = center[1] - manager.eye[1];
+  float dz = center[2] - manager.eye[2];
+  float distance = fmaxf(sqrtf(dx * dx + dy * dy + dz * dz), 0.01f);
+  float pixelsPerUv =
+      uvDensity > 0.0f ? manager.focalPixels / (distance * uvDensity) : 0.0f;
+
+  if (entry->lastUsed != manager.frame) {
+    entry->lastUsed = manager.frame;
+    entry->pixelsPerUv = 0.0f;
+  }
+  entry->pixelsPerUv = fmaxf(entry->pixelsPerUv, pixelsPerUv);
+}
+
+void texture_use_all_levels(TextureHandle handle) {
+  if (handle == TEXTURE_FALLBACK || handle >= manager.count) return;
+
+  TextureEntry* entry = &manager.entries[handle];
+  if (entry->path == NULL) return;
+
+  entry->lastUsed = manager.frame;
+  entry->pixelsPerUv = INFINITY;
+}
+
+// Textures used this frame want the level their density asks for, the ones
+// used lately keep theirs and the rest fall back to the tail. Over budget,
+// the least recently used give up levels first, then the textures drawn
+// this frame one level at a time, least magnified first.
+void texture_stream_update(void) {
+  if (manager.budget > 0) {
+    if (manager.orderCapacity < manager.count) {
+      manager.orderCapacity = manager.capacity;
+      manager.order = realloc(manager.order,
+                              manager.orderCapacity * sizeof(TextureHandle));
+    }
+
+    uint32_t count = 0;
+    size_t total = 0;
+    for (uint32_t i = 1; i < manager.count; i++) {
+      TextureEntry* entry = &manager.entries[i];
+      if (entry->path == NULL || entry->state != TEXTURE_READY) continue;
+
+      if (entry->lastUsed == manager.frame) {
+        entry->wantedLevel = texture_stream_level(entry);
+      } else if (manager.frame - entry->lastUsed >
+                 TEXTURE_STREAM_EVICT_FRAMES) {
+        entry->wantedLevel =
+            texture_tail_level(entry->width, entry->height, entry->levels);
+      }
+
+      total += texture_chain_bytes(entry, entry->wantedLevel);
+      manager.order[count++] = i;
+    }
+
+    qsort(manager.order, count, sizeof(TextureHandle), texture_compare_use);
+
+    bool dropped = true;
+    while (total > manager.budget && dropped) {
+      dropped = false;
+      for (uint32_t i = 0; i < count && total > manager.budget; i++) {
+        TextureEntry* entry = &manager.entries[manager.order[i]];
+        uint32_t tail =
+            texture_tail_level(entry->width, entry->height, entry->levels);
+        while (entry->wantedLevel < tail && total > manager.budget) {
+          total -= texture_chain_bytes(entry, entry->wantedLevel) -
+                   texture_chain_bytes(entry, entry->wantedLevel + 1);
+          entry->wantedLevel++;
+          dropped = true;
+          if (entry->lastUsed == manager.frame) break;
+        }
+      }
+    }
+
+    // Dropping levels first frees the memory the new ones will take
+    for (uint32_t i = 0; i < count; i++) {
+      TextureEntry* entry = &manager.entries[manager.order[i]];
+      if (entry->streaming || entry->wantedLevel <= entry->baseLevel) continue;
+
+      if (manager.copyImage) {
+        texture_drop_levels(entry, entry->wantedLevel);
+      } else if (manager.stats.streaming < TEXTURE_STREAM_MAX_REQUESTS) {
+        texture_stream_request(manager.order[i]);
+      }
+    }
+    for (uint32_t i = count; i-- > 0;) {
+      TextureEntry* entry = &manager.entries[manager.order[i]];
+      if (!entry->streaming && entry->wantedLevel < entry->baseLevel &&
+          manager.stats.streaming < TEXTURE_STREAM_MAX_REQUESTS) {
+        texture_stream_request(manager.order[i]);
+      }
+    }
+  }
+
+  manager.frame++;
+}
+
+bool texture_decode_file(const char* path, TextureImage* image) {
+  *image = (TextureImage){0};
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  GLubyte* bytes = size > 0 ? malloc(size) : NULL;
+  bool read = bytes != NULL && fread(bytes, 1, size, file) == (size_t)size;
+  fclose(file);
+
+  if (read) {
+    int width, height, channels;
+    image->pixels = stbi_load_from_memory(bytes, (int)size, &width, &height,
+                                          &channels, 0);
+    image->width = width;
+    image->height = height;
+    image->channels = channels;
+    image->levels = 1;
+    image->size = (size_t)width * height * channels;
+    image->fileBytes = size;
+  }
+  free(bytes);
+
+  return image->pixels != NULL;
+}
+
+void texture_build_mips(TextureImage* image, uint32_t flags) {
+  uint32_t mipFlags = 0;
+  if (flags & TEXTURE_SRGB) mipFlags |= MIP_SRGB;
+  if (flags & TEXTURE_NORMAL_MAP) mipFlags |= MIP_NORMAL_MAP;
+  if (flags & TEXTURE_ALPHA_TEST) mipFlags |= MIP_ALPHA_COVERAGE;
+
+  GLubyte* chain = mip_build_chain(image->pixels, image->width,
+                                   image->height, image->channels, mipFlags);
+  if (chain == NULL) return;  // keeps the single level
+
+  stbi_image_free(image->pixels);
+  image->pixels = chain;
+  image->levels = mip_count(image->width, image->height);
+  image->size = mip_chain_size(image->width, image->height, image->channels);
+}
+
+void texture_compress(TextureImage* image, BCFormat format) {
+  TextureImage compressed = *image;
+  compressed.format = format;
+  compressed.size = 0;
+  for (uint32_t level = 0; level < image->levels; level++) {
+    compressed.size += texture_level_size(&compressed, level);
+  }
+  compressed.pixels = malloc(compressed.size);
+
+  const GLubyte* source = image->pixels;
+  GLubyte* out = compressed.pixels;
+  for (uint32_t level = 0; level < image->levels; level++) {
+    int32_t width = texture_level_extent(image->width, level);
+    int32_t height = texture_level_extent(image->height, level);
+    bc_encode(format, source, width, height, image->channels, out,
+              manager.pool);
+    source += texture_level_size(image, level);
+    out += texture_level_size(&compressed, level);
+  }
+
+  stbi_image_free(image->pixels);
+  *image = compressed;
+}
+
+size_t texture_level_size(const TextureImage* image, uint32_t level) {
+  int32_t width = texture_level_extent(image->width, level);
+  int32_t height = texture_level_extent(image->height, level);
+  if (image->format != BC_NONE) {
+    return bc_level_size(image->format, width, height);
+  }
+
+  return (size_t)width * height * image->channels;
+}
+
+// stb allocates with malloc as well, one free fits raw and compressed pixels
+void texture_image_free(TextureImage* image) {
+  stbi_image_free(image->pixels);
+
+  *image = (TextureImage){0};
+}
+
+void texture_print_frame_stats(FILE* stream) {
+  fprintf(stream, "textures: %u pending, %.2f MiB resident\n",
+          manager.stats.pending, manager.stats.bytes / (1024.0 * 1024.0));
+  if (manager.budget > 0) {
+    fprintf(stream,
+            "  streaming: %.2f MiB budget, %u requests in flight, "
+            "%u streamed in, %u evicted\n",
+            manager.budget / (1024.0 * 1024.0), manager.stats.streaming,
+            manager.stats.streamedIn, manager.stats.evicted);
+  }
+  if (manager.ring != NULL) upload_ring_print_stats(manager.ring, stream);
+}
+
+void texture_bind(TextureHandle handle, GLuint unit) {
+  const TextureEntry* entry = texture_get(handle);
+  if (entry->state != TEXTURE_READY) entry = texture_get(TEXTURE_FALLBACK);
+
+  glstate_bind_texture(unit, entry->target, entry->id);
+  glstate_bind_sampler(unit, manager.samplers[entry->sampler]);
+}
+
+// Stale or invalid handles resolve to the fallback
+const TextureEntry* texture_get(TextureHandle handle) {
+  if (handle >= manager.count || manager.entries[handle].path == NULL) {
+    handle = TEXTURE_FALLBACK;
+  }
+
+  return &manager.entries[handle];
+}
+
+GLuint texture_get_sampler(TextureSampler sampler) {
+  return manager.samplers[sampler];
+}
+
+TextureStats texture_get_stats(void) {
+  return manager.stats;
+}
+
+// Next to its real size every texture shows what it would take as RGBA8,
+// the format drivers pick for unsized RGB and RGBA uploads
+void texture_print_stats(FILE* stream) {
+  uint32_t live = 0;
+  size_t rgba8Bytes = 0;
+  for (uint32_t i = 0; i < manager.count; i++) {
+    if (manager.entries[i].path == NULL) continue;
+
+    live++;
+    rgba8Bytes += texture_rgba8_bytes(&manager.entries[i]);
+  }
+
+  fprintf(stream,
+          "textures: %u live, %u requests, %u cache hits, %u failures, "
+          "%u compressed, %u from %s/, %s mips, %s storage\n",
+          live, manager.stats.requests, manager.stats.hits,
+          manager.stats.failures, manager.stats.compressed,
+          manager.stats.cacheReads, TEXTURE_CACHE_DIR, mip_kernel_name(),
+          manager.storage ? "immutable" : "mutable");
+  fprintf(stream, "  VRAM %.2f MiB, %.2f MiB as RGBA8 (%.1fx smaller)\n",
+          manager.stats.bytes / (1024.0 * 1024.0),
+          rgba8Bytes / (1024.0 * 1024.0),
+          manager.stats.bytes > 0 ? (double)rgba8Bytes / manager.stats.bytes
+                                  : 1.0);
+  fprintf(stream, "  %4s %11s %2s %6s %6s %10s %10s  %s\n", "refs", "size",
+          "ch", "format", "levels", "bytes", "as RGBA8", "path");
+
+  for (uint32_t i = 0; i < manager.count; i++) {
+    const TextureEntry* entry = &manager.entries[i];
+    if (entry->path == NULL) continue;
+
+    char size[16];
+    snprintf(size, sizeof(size), "%dx%d", entry->width, entry->height);
+    // Resident levels out of the full chain
+    char levels[16];
+    snprintf(levels, sizeof(levels), "%u/%u",
+             entry->levels - entry->baseLevel, entry->levels);
+    const char* state = entry->state == TEXTURE_PENDING  ? " (pending)"
+                        : entry->state == TEXTURE_FAILED ? " (failed)"
+                                                         : "";
+    fprintf(stream, "  %4u %11s %2d %6s %6s %10zu %10zu  %s%s%s\n",
+            entry->refs, size, entry->channels, texture_format_name(entry),
+            levels, entry->bytes, texture_rgba8_bytes(entry),
+            entry->path, entry->flags & TEXTURE_SRGB ? " (sRGB)" : "", state);
+  }
+}
+
+// ------------------------------------------------------------------------
+
+// FNV-1a over the path, with the flags folded in
+static uint64_t texture_hash(const char* path, uint32_t flags) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char* c = path; *c != '\0'; c++) {
+    hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+  }
+
+  return (hash ^ flags) * 1099511628211ull;
+}
+
+// Reuses a released slot when there is one, never the fallback's
+static TextureEntry* texture_new_entry(TextureHandle* handle) {
+  for (uint32_t i = 1; i < manager.count; i++) {
+    if (manager.entries[i].path == NULL) {
+      *handle = i;
+      return &manager.entries[i];
+    }
+  }
+
+  if (manager.count == manager.capacity) {
+    manager.capacity = manager.capacity ? manager.capacity * 2 : 32;
+    manager.entries =
+        realloc(manager.entries, manager.capacity * sizeof(TextureEntry));
+  }
+
+  *handle = manager.count;
+  manager.entries[manager.count] = (TextureEntry){0};
+  return &manager.entries[manager.count++];
+}
+
+static void texture_decode_job(void* data) {
+  TextureDecode* decode = data;
+  decode->decoded =
+      texture_prepare(decode->path, decode->flags, &decode->image);
+
+  // Streamed loads start from the tail
+  const TextureImage* image = &decode->image;
+  if (decode->decoded && !decode->stream && manager.budget > 0) {
+    decode->baseLevel =
+        texture_tail_level(image->width, image->height, image->levels);
+  }
+  if (decode->decoded) texture_image_trim(&decode->image, decode->baseLevel);
+
+  // With a persistent map the copy into GL memory happens here as well,
+  // leaving only the upload command to the GL thread
+  if (decode->decoded && manager.ring != NULL &&
+      upload_ring_try_reserve(manager.ring, image->size, &decode->slice)) {
+    memcpy(decode->slice.memory, image->pixels, image->size);
+    stbi_image_free(decode->image.pixels);
+    decode->image.pixels = NULL;
+    decode->staged = true;
+  }
+
+  job_queue_push(&manager.completed, &decode->node);
+}
+
+// What the GL thread will upload for `path`: the cached copy when it is
+// current, else the decoded file with its mips built here, block compressed
+// when a format suits it, and written to the cache for the next run
+static bool texture_prepare(const char* path, uint32_t flags,
+                            TextureImage* image) {
+  struct stat info;
+  bool cacheable = stat(path, &info) == 0;
+
+  char cachePath[64];
+  if (cacheable) {
+    snprintf(cachePath, sizeof(cachePath), "%s/%016" PRIx64 ".dds",
+             TEXTURE_CACHE_DIR, texture_cache_key(path, flags, &info));
+    if (texcache_read(cachePath, image)) return true;
+  }
+
+  if (!texture_decode_file(path, image)) return false;
+
+  BCFormat format = flags & TEXTURE_UNCOMPRESSED
+                        ? BC_NONE
+                        : texture_choose_format(image, flags);
+  if (format == BC_NONE && image->channels == 3) texture_add_alpha(image);
+
+  texture_build_mips(image, flags);
+  if (format != BC_NONE) texture_compress(image, format);
+
+  if (cacheable && !texcache_write(cachePath, image, flags & TEXTURE_SRGB)) {
+    fprintf(stderr, "WARNING: Failed to write texture cache %s\n",
+            cachePath);
+  }
+
+  return true;
+}
+
+// The source file's size and modification time invalidate the cached copy,
+// the formats the driver takes choose which one it holds
+static uint64_t texture_cache_key(const char* path, uint32_t flags,
+                                  const struct stat* info) {
+  uint64_t parts[] = {
+      info->st_size, info->st_mtime, manager.s3tc,
+      manager.bptc,  TEXTURE_CACHE_VERSION,
+  };
+
+  uint64_t hash = texture_hash(path, flags);
+  for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+    hash = (hash ^ parts[i]) * 1099511628211ull;
+  }
+
+  return hash;
+}
+
+// BC4 for grey, BC5 for two channels and normal maps, BC7 for colour or BC1
+// and BC3 without BPTC. BC_NONE when nothing fits: sRGB data needs a colour
+// format.
+static BCFormat texture_choose_format(const TextureImage* image,
+                                      uint32_t flags) {
+  bool srgb = flags & TEXTURE_SRGB;
+  if (flags & TEXTURE_NORMAL_MAP || image->channels == 2) {
+    return srgb ? BC_NONE : BC5;
+  }
+
+  bool grey = image->channels == 1;
+  bool opaque = image->channels != 4;
+  if (image->channels >= 3) {
+    size_t texels = (size_t)image->width * image->height;
+    grey = true;
+    opaque = true;
+    for (size_t i = 0; i < texels && (grey || opaque); i++) {
+      const GLubyte* texel = image->pixels + i * image->channels;
+      if (texel[0] != texel[1] || texel[0] != texel[2]) grey = false;
+      if (image->channels == 4 && texel[3] != 255) opaque = false;
+    }
+  }
+
+  if (grey && opaque && !srgb) return BC4;
+  if (manager.bptc) return BC7;
+  if (manager.s3tc) return opaque ? BC1 : BC3;
+
+  return BC_NONE;
+}
+
+// RGB images left uncompressed are stored as RGBA, which is how drivers keep
+// them anyway, so every raw level has 4-byte aligned rows
+static void texture_add_alpha(TextureImage* image) {
+  size_t texels = (size_t)image->width * image->height;
+  GLubyte* pixels = malloc(texels * 4);
+  for (size_t i = 0; i < texels; i++) {
+    memcpy(&pixels[i * 4], &image->pixels[i * 3], 3);
+    pixels[i * 4 + 3] = 255;
+  }
+
+  stbi_image_free(image->pixels);
+  image->pixels = pixels;
+  image->channels = 4;
+  image->size = texels * 4;
+}
+
+// Drops the levels above `level` from a decoded chain
+static void texture_image_trim(TextureImage* image, uint32_t level) {
+  size_t skipped = 0;
+  for (uint32_t i = image->baseLevel; i < level && i < image->levels; i++) {
+    skipped += texture_level_size(image, i);
+  }
+  if (skipped == 0) return;
+
+  memmove(image->pixels, image->pixels + skipped, image->size - skipped);
+  image->size -= skipped;
+  image->baseLevel = level;
+}
+
+// First level no larger than TEXTURE_STREAM_TAIL_SIZE on either side, always
+// resident once a texture is streamed
+static uint32_t texture_tail_level(int32_t width, int32_t height,
+                                   uint32_t levels) {
+  uint32_t level = 0;
+  while (level + 1 < levels &&
+         (texture_level_extent(width, level) > TEXTURE_STREAM_TAIL_SIZE ||
+          texture_level_extent(height, level) > TEXTURE_STREAM_TAIL_SIZE)) {
+    level++;
+  }
+
+  return level;
+}
+
+// Level with about one texel per pixel where the texture was drawn the
+// closest this frame. Densities are measured along the larger side.
+static uint32_t texture_stream_level(const TextureEntry* entry) {
+  uint32_t tail =
+      texture_tail_level(entry->width, entry->height, entry->levels);
+  if (entry->pixelsPerUv <= 0.0f) return tail;
+
+  int32_t size = entry->width > entry->height ? entry->width : entry->height;
+  float texelsPerPixel = size / entry->pixelsPerUv;
+  if (texelsPerPixel <= 1.0f) return 0;
+
+  uint32_t level = (uint32_t)floorf(log2f(texelsPerPixel));
+  return level < tail ? level : tail;
+}
+
+// Reads the levels the entry wants from the cached file, on the pool when
+// there is one. texture_pump swaps them in.
+static void texture_stream_request(TextureHandle handle) {
+  TextureEntry* entry = &manager.entries[handle];
+  entry->streaming = true;
+  manager.stats.streaming++;
+
+  TextureDecode* decode = calloc(1, sizeof(TextureDecode));
+  decode->handle = handle;
+  decode->path = strdup(entry->path);
+  decode->flags = entry->flags;
+  decode->stream = true;
+  decode->baseLevel = entry->wantedLevel;
+
+  if (manager.pool != NULL) {
+    job_pool_submit(manager.pool, texture_decode_job, decode);
+  } else {
+    texture_decode_job(decode);
+  }
+}
+
+// Moves the levels from `level` down to a smaller texture without going
+// back to the file
+static void texture_drop_levels(TextureEntry* entry, uint32_t level) {
+  GLuint id = texture_allocate(entry, level);
+
+  for (uint32_t i = level; i < entry->levels; i++) {
+    glCopyImageSubData(entry->id, GL_TEXTURE_2D, i - entry->baseLevel, 0, 0,
+                       0, id, GL_TEXTURE_2D, i - level, 0, 0, 0,
+                       texture_level_extent(entry->width, i),
+                       texture_level_extent(entry->height, i), 1);
+  }
+
+  glstate_delete_textures(1, &entry->id);
+  manager.stats.bytes -= entry->bytes;
+  entry->id = id;
+  entry->baseLevel = level;
+  entry->bytes = texture_chain_bytes(entry, level);
+  manager.stats.bytes += entry->bytes;
+  manager.stats.evicted++;
+}
+
+// Least recently used first, the least magnified first among equals
+static int texture_compare_use(const void* a, const void* b) {
+  const TextureEntry* x = &manager.entries[*(const TextureHandle*)a];
+  const TextureEntry* y = &manager.entries[*(const TextureHandle*)b];
+  if (x->lastUsed != y->lastUsed) return x->lastUsed < y->lastUsed ? -1 : 1;
+
+  return (x->pixelsPerUv > y->pixelsPerUv) - (x->pixelsPerUv < y->pixelsPerUv);
+}
+
+// Hands a decode back to its entry and frees it, returns 1 if it uploaded
+static uint32_t texture_finish_decode(TextureDecode* decode) {
+  uint32_t uploaded = 0;
+
+  TextureEntry* entry = &manager.entries[decode->handle];
+  if (decode->stream) {
+    entry->streaming = false;
+    manager.stats.streaming--;
+  } else {
+    manager.stats.pending--;
+  }
+
+  if (entry->refs == 0) {
+    // Released while decoding. Staged space still needs its fence.
+    if (decode->staged) upload_ring_submit(manager.ring, &decode->slice);
+    glstate_delete_textures(1, &entry->id);
+    manager.stats.bytes -= entry->bytes;
+    free(entry->path);
+    *entry = (TextureEntry){0};
+  } else if (decode->stream && !decode->decoded) {
+    // The file went away, the levels already resident stay
+  } else {
+    texture_complete(entry, &decode->image, decode->decoded,
+                     decode->staged ? &decode->slice : NULL);
+    uploaded = decode->decoded;
+  }
+
+  if (decode->staged) manager.ring->stats.workerCopies++;
+  if (decode->decoded) texture_image_free(&decode->image);
+  free(decode->path);
+  free(decode);
+
+  return uploaded;
+}
+
+// Uploads a finished decode through the ring, or marks the entry failed.
+// `staged` is the slice a worker already filled, if any.
+static void texture_complete(TextureEntry* entry, const TextureImage* image,
+                             bool decoded, const UploadSlice* staged) {
+  if (!decoded) {
+    fprintf(stderr, "ERROR: Failed to load texture at path: %s\n",
+            entry->path);
+    manager.stats.failures++;
+    entry->state = TEXTURE_FAILED;
+    return;
+  }
+
+  // Streamed levels replace the texture holding the previous ones
+  if (entry->state == TEXTURE_READY) {
+    if (image->baseLevel < entry->baseLevel) manager.stats.streamedIn++;
+    if (image->baseLevel > entry->baseLevel) manager.stats.evicted++;
+    glstate_delete_textures(1, &entry->id);
+    manager.stats.bytes -= entry->bytes;
+  } else if (image->cached) {
+    manager.stats.cacheReads++;
+  } else if (image->format != BC_NONE) {
+    manager.stats.compressed++;
+  }
+
+  entry->width = image->width;
+  entry->height = image->height;
+  entry->channels = image->channels;
+  entry->format = image->format;
+  entry->levels = image->levels;
+  entry->baseLevel = image->baseLevel;
+  if (entry->state == TEXTURE_PENDING) entry->wantedLevel = image->baseLevel;
+  entry->state = TEXTURE_READY;
+
+  UploadRing* ring = manager.ring;
+  UploadSlice slice;
+  bool viaRing = staged != NULL;
+  if (viaRing) {
+    slice = *staged;
+  } else if (ring != NULL && upload_ring_reserve(ring, image->size, &slice)) {
+    upload_ring_write(ring, &slice, image->pixels, image->size);
+    viaRing = true;
+  } else if (ring != NULL) {
+    ring->stats.direct++;
+  }
+
+  GLuint buffer = viaRing ? ring->buffer : 0;
+  const void* pixels =
+      viaRing ? (const void*)(uintptr_t)slice.offset : image->pixels;
+  texture_upload(entry, buffer, pixels);
+
+  if (viaRing) upload_ring_submit(ring, &slice);
+}
+
+// Creates the GL texture from the resident levels of the image and accounts
+// its memory. With a pixel unpack `buffer`, `pixels` is an offset into it.
+static void texture_upload(TextureEntry* entry, GLuint buffer,
+                           const void* pixels) {
+  bool compressed = entry->format != BC_NONE;
+  GLenum format = texture_pixel_format(entry->channels);
+  entry->internalFormat = texture_internal_format(entry);
+  entry->id = texture_allocate(entry, entry->baseLevel);
+
+  // Rows of RG levels aren't 4-byte aligned in general
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+  const GLubyte* level = pixels;
+  for (uint32_t i = entry->baseLevel; i < entry->levels; i++) {
+    int32_t width = texture_level_extent(entry->width, i);
+    int32_t height = texture_level_extent(entry->height, i);
+    GLint target = i - entry->baseLevel;
+    size_t size = compressed ? bc_level_size(entry->format, width, height)
+                             : (size_t)width * height * entry->channels;
+
+    if (compressed) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, target, 0, 0, width, height,
+                                entry->internalFormat, size, level);
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, target, 0, 0, width, height, format,
+                      GL_UNSIGNED_BYTE, level);
+    }
+    level += size;
+  }
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  entry->bytes = texture_chain_bytes(entry, entry->baseLevel);
+  manager.stats.bytes += entry->bytes;
+}
+
+// Generates a texture with storage for the levels from `level` down and
+// leaves it bound to GLSTATE_UPLOAD_UNIT. Storage is immutable where the
+// driver has ARB_texture_storage, which also spares it from checking the
+// chain for mip completeness.
+static GLuint texture_allocate(const TextureEntry* entry, uint32_t level) {
+  uint32_t levels = entry->levels - level;
+  GLuint id;
+  glGenTextures(1, &id);
+  glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_2D, id);
+
+  if (manager.storage) {
+    glTexStorage2D(GL_TEXTURE_2D, levels, entry->internalFormat,
+                   texture_level_extent(entry->width, level),
+                   texture_level_extent(entry->height, level));
+  } else {
+    for (uint32_t i = 0; i < levels; i++) {
+      int32_t width = texture_level_extent(entry->width, level + i);
+      int32_t height = texture_level_extent(entry->height, level + i);
+      if (entry->format != BC_NONE) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, entry->internalFormat, width,
+                               height, 0,
+                               bc_level_size(entry->format, width, height),
+                               NULL);
+      } else {
+        glTexImage2D(GL_TEXTURE_2D, i, entry->internalFormat, width, height,
+                     0, texture_pixel_format(entry->channels),
+                     GL_UNSIGNED_BYTE, NULL);
+      }
+    }
+    // Immutable textures are limited to their levels already
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  }
+  // BC4 textures read as grey, the one channel repeated over rgb
+  if (entry->format == BC4) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+  }
+
+  return id;
+}
+
+// Estimated GPU memory of the levels from `level` down
+static size_t texture_chain_bytes(const TextureEntry* entry, uint32_t level) {
+  size_t bytes = 0;
+  for (uint32_t i = level; i < entry->levels; i++) {
+    int32_t width = texture_level_extent(entry->width, i);
+    int32_t height = texture_level_extent(entry->height, i);
+    if (entry->format != BC_NONE) {
+      bytes += bc_level_size(entry->format, width, height);
+    } else {
+      // Drivers pad three channel texels to four
+      bytes += (size_t)width * height *
+               (entry->channels == 3 ? 4 : entry->channels);
+    }
+  }
+
+  return bytes;
+}
+
+static GLenum texture_pixel_format(int32_t channels) {
+  switch (channels) {
+    case 1:
+      return GL_RED;
+    case 2:
+      return GL_RG;
+    case 3:
+      return GL_RGB;
+    default:
+      return GL_RGBA;
+  }
+}
+
+// Sized format for the entry's data: blocks as encoded, 8 bits per raw
+// channel. Only colour textures are ever sRGB.
+static GLenum texture_internal_format(const TextureEntry* entry) {
+  bool srgb = entry->flags & TEXTURE_SRGB;
+  if (entry->format != BC_NONE) return bc_gl_format(entry->format, srgb);
+
+  switch (entry->channels) {
+    case 1:
+      return GL_R8;
+    case 2:
+      return GL_RG8;
+    case 3:
+      return srgb ? GL_SRGB8 : GL_RGB8;
+    default:
+      return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+  }
+}
+
+static const char* texture_format_name(const TextureEntry* entry) {
+  switch (entry->internalFormat) {
+    case GL_R8:
+      return "R8";
+    case GL_RG8:
+      return "RG8";
+    case GL_RGB8:
+    case GL_SRGB8:
+      return "RGB8";
+    case GL_RGBA8:
+    case GL_SRGB8_ALPHA8:
+      return "RGBA8";
+    default:
+      return bc_name(entry->format);
+  }
+}
+
+static int32_t texture_level_extent(int32_t size, uint32_t level) {
+  return size >> level > 0 ? size >> level : 1;
+}
+
+static size_t texture_rgba8_bytes(const TextureEntry* entry) {
+  size_t bytes = 0;
+  for (uint32_t i = entry->baseLevel; i < entry->levels; i++) {
+    bytes += (size_t)texture_level_extent(entry->width, i) *
+             texture_level_extent(entry->height, i) * 4;
+  }
+
+  return bytes;
+}
+
+static GLuint texture_create_sampler(GLint wrap, GLint minFilter,
+                                     GLint magFilter) {
+  GLuint sampler;
+  glGenSamplers(1, &sampler);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrap);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrap);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, wrap);
+  glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+  glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+
+  return sampler;
+}
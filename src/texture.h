@@ -0,0 +1,160 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bc.h"
+#include "job.h"
+#include "upload.h"
+
+// Part of the cache key: the same file loaded with different flags is a
+// different texture
+typedef enum {
+  TEXTURE_SRGB = 1 << 0,          // gamma-encoded colour data
+  TEXTURE_CLAMP = 1 << 1,         // clamp to edge instead of repeating
+  TEXTURE_NORMAL_MAP = 1 << 2,    // only x and y are kept, rebuild z
+  TEXTURE_UNCOMPRESSED = 1 << 3,  // never block compressed
+  TEXTURE_ALPHA_TEST = 1 << 4,    // mips keep the share of opaque texels
+} TextureFlags;
+
+// Index into the texture table. Handle 0 is the fallback texture, bound in
+// place of textures still loading or that failed to, so any handle is safe
+// to bind.
+typedef uint32_t TextureHandle;
+#define TEXTURE_FALLBACK 0
+
+typedef enum {
+  TEXTURE_SAMPLER_REPEAT,
+  TEXTURE_SAMPLER_CLAMP,
+  TEXTURE_SAMPLER_NEAREST,
+  NUM_TEXTURE_SAMPLERS,
+} TextureSampler;
+
+typedef enum {
+  TEXTURE_PENDING,  // decoding on a worker, binds the fallback meanwhile
+  TEXTURE_READY,
+  TEXTURE_FAILED,  // binds the fallback for good
+} TextureState;
+
+// Decoded pixels, rows bottom to top as GL expects them. Once the mips are
+// built every level is stored, largest first, from baseLevel on.
+typedef struct {
+  GLubyte* pixels;
+  int32_t width;  // of level 0, stored or not
+  int32_t height;
+  int32_t channels;
+  BCFormat format;     // BC_NONE for 8-bit channels
+  uint32_t levels;     // of the full chain
+  uint32_t baseLevel;  // first level in pixels, streaming drops the others
+  size_t size;         // bytes of every level in pixels
+  size_t fileBytes;  // size of the encoded file
+  bool cached;       // read from the transcoded cache
+} TextureImage;
+
+typedef struct {
+  char* path;  // NULL for free slots
+  uint64_t hash;
+  uint32_t flags;
+  uint32_t refs;
+  TextureState state;
+
+  GLuint id;
+  GLenum target;
+  GLenum internalFormat;  // sized, chosen by texture_upload
+  TextureSampler sampler;
+
+  int32_t width;  // of level 0, resident or not
+  int32_t height;
+  int32_t channels;
+  BCFormat format;
+  uint32_t levels;  // of the full chain
+  size_t bytes;     // estimated GPU memory, resident levels
+
+  // Streaming: the GL texture holds levels baseLevel and down only
+  uint32_t baseLevel;
+  uint32_t wantedLevel;  // chosen by the last texture_stream_update
+  uint32_t lastUsed;     // frame of the last texture_use
+  float pixelsPerUv;     // largest screen density asked for that frame
+  bool streaming;        // a new set of levels is being read
+} TextureEntry;
+
+typedef struct {
+  uint32_t requests;    // texture_load calls
+  uint32_t hits;        // served from the cache
+  uint32_t failures;    // answered with the fallback
+  uint32_t pending;     // decodes not uploaded yet
+  uint32_t compressed;  // block compressed from the source file
+  uint32_t cacheReads;  // read back from the transcoded cache
+  size_t bytes;         // sum of all live entries
+
+  uint32_t streaming;   // level changes being read
+  uint32_t streamedIn;  // level changes that added mips
+  uint32_t evicted;     // level changes that dropped mips
+  size_t budget;        // 0 when every level stays resident
+} TextureStats;
+
+// Needs a current GL context. With a pool, files are decoded on its workers
+// and uploaded by texture_pump, otherwise texture_load decodes in place.
+void texture_manager_init(JobPool* pool);
+// Deletes every texture still alive and reports the ones never released
+void texture_manager_destroy(void);
+
+// Loads `path` or takes another reference to the cached copy. The handle is
+// usable right away, it binds the fallback until the pixels are uploaded.
+TextureHandle texture_load(const char* path, TextureFlags flags);
+// Takes another reference to a live texture
+TextureHandle texture_acquire(TextureHandle handle);
+void texture_release(TextureHandle handle);
+
+// Uploads the decodes finished so far, call once per frame on the GL thread.
+// Returns how many textures became resident.
+uint32_t texture_pump(void);
+// Pumps until every pending load and stream request is resident
+void texture_finish(void);
+
+// Streaming. With a budget, loads upload the smallest levels only and
+// texture_stream_update brings in the levels the draws asked for through
+// texture_use, dropping them again from the least recently used textures
+// whenever the budget runs out. Set it before loading anything.
+void texture_set_budget(size_t bytes);
+// Eye position, vertical field of view in radians and viewport height in
+// pixels of the frame being drawn
+void texture_stream_view(const float eye[3], float fovY, float height);
+// Marks the texture as drawn this frame on a surface around `center` with
+// `uvDensity` UV units per world unit
+void texture_use(TextureHandle handle, const float center[3],
+                 float uvDensity);
+// Marks the texture as drawn this frame at full resolution, for copies that
+// need every level like the texture pools
+void texture_use_all_levels(TextureHandle handle);
+// Picks the levels every texture needs and requests the changes, call once
+// per frame after the draws
+void texture_stream_update(void);
+
+// Reads and decodes an image file, safe to call from any thread
+bool texture_decode_file(const char* path, TextureImage* image);
+// Replaces the single level of a decoded image by the full mip chain,
+// filtered as `flags` describe the data. Safe to call from any thread.
+void texture_build_mips(TextureImage* image, uint32_t flags);
+// Replaces every raw level by `format` blocks. Safe to call from any thread,
+// blocks are encoded on the manager's pool.
+void texture_compress(TextureImage* image, BCFormat format);
+// Bytes of one level, texels or blocks
+size_t texture_level_size(const TextureImage* image, uint32_t level);
+void texture_image_free(TextureImage* image);
+
+void texture_bind(TextureHandle handle, GLuint unit);
+const TextureEntry* texture_get(TextureHandle handle);
+// Sampler object shared by every texture using `sampler`
+GLuint texture_get_sampler(TextureSampler sampler);
+TextureStats texture_get_stats(void);
+// One row per live texture with its size and references, plus totals
+void texture_print_stats(FILE* stream);
+// Pending decodes and upload ring counters, a stats report
+void texture_print_frame_stats(FILE* stream);
+
+#endif  // TEXTURE_H
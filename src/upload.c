@@ -0,0 +1,234 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "upload.h"
+
+#include "glstate.h"
+
+#define UPLOAD_ALIGNMENT 64
+
+// Privates
+static bool upload_ring_alloc(UploadRing* ring, size_t size,
+                              UploadSlice* slice);
+static void upload_ring_retire_locked(UploadRing* ring);
+static double upload_now(void);
+
+UploadRing* upload_ring_create(size_t size) {
+  UploadRing* ring = calloc(1, sizeof(UploadRing));
+  if (ring == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate upload ring\n");
+    return NULL;
+  }
+
+  ring->size = size;
+  pthread_mutex_init(&ring->mutex, NULL);
+
+  glGenBuffers(1, &ring->buffer);
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer);
+  if (GLEW_ARB_buffer_storage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+    ring->mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+  } else {
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  return ring;
+}
+
+void upload_ring_destroy(UploadRing* ring) {
+  if (ring == NULL) return;
+
+  for (uint32_t i = 0; i < ring->numRegions; i++) {
+    UploadRegion* region =
+        &ring->regions[(ring->firstRegion + i) % UPLOAD_MAX_REGIONS];
+    if (region->fence == NULL) continue;
+
+    glClientWaitSync(region->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    glDeleteSync(region->fence);
+  }
+
+  if (ring->mapped != NULL) {
+    glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  glstate_delete_buffers(1, &ring->buffer);
+  pthread_mutex_destroy(&ring->mutex);
+  free(ring);
+}
+
+bool upload_ring_try_reserve(UploadRing* ring, size_t size,
+                             UploadSlice* slice) {
+  if (ring->mapped == NULL) return false;
+
+  pthread_mutex_lock(&ring->mutex);
+  bool reserved = upload_ring_alloc(ring, size, slice);
+  pthread_mutex_unlock(&ring->mutex);
+
+  return reserved;
+}
+
+bool upload_ring_reserve(UploadRing* ring, size_t size, UploadSlice* slice) {
+  for (;;) {
+    pthread_mutex_lock(&ring->mutex);
+    upload_ring_retire_locked(ring);
+    if (upload_ring_alloc(ring, size, slice)) {
+      pthread_mutex_unlock(&ring->mutex);
+      return true;
+    }
+
+    // Space is freed in reservation order, so the oldest region is the one
+    // to wait for. Without a fence nothing has been issued for it yet.
+    GLsync fence = NULL;
+    if (size <= ring->size && ring->numRegions > 0) {
+      fence = ring->regions[ring->firstRegion % UPLOAD_MAX_REGIONS].fence;
+    }
+    pthread_mutex_unlock(&ring->mutex);
+    if (fence == NULL) return false;
+
+    double start = upload_now();
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    ring->stats.stalls++;
+    ring->stats.stallMs += upload_now() - start;
+  }
+}
+
+void upload_ring_write(UploadRing* ring, const UploadSlice* slice,
+                       const void* data, size_t size) {
+  if (slice->memory != NULL) {
+    memcpy(slice->memory, data, size);
+    return;
+  }
+
+  // The fences already keep the GPU off this range, skip the driver's sync
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer);
+  void* memory = glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, slice->offset, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT);
+  if (memory != NULL) {
+    memcpy(memory, data, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  }
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void upload_ring_submit(UploadRing* ring, const UploadSlice* slice) {
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  pthread_mutex_lock(&ring->mutex);
+  ring->regions[slice->region % UPLOAD_MAX_REGIONS].fence = fence;
+  pthread_mutex_unlock(&ring->mutex);
+}
+
+void upload_ring_retire(UploadRing* ring) {
+  pthread_mutex_lock(&ring->mutex);
+  upload_ring_retire_locked(ring);
+  pthread_mutex_unlock(&ring->mutex);
+}
+
+UploadStats upload_ring_get_stats(UploadRing* ring) {
+  pthread_mutex_lock(&ring->mutex);
+  UploadStats stats = ring->stats;
+  stats.bytesInFlight = ring->used;
+  pthread_mutex_unlock(&ring->mutex);
+
+  return stats;
+}
+
+void upload_ring_print_stats(UploadRing* ring, FILE* stream) {
+  UploadStats stats = upload_ring_get_stats(ring);
+
+  fprintf(stream,
+          "upload: %u uploads (%u copied by workers, %u direct), %.1f MiB, "
+          "%.2f of %.0f MiB in flight, %u stalls (%.1f ms), %s\n",
+          stats.uploads, stats.workerCopies, stats.direct,
+          stats.bytesUploaded / (1024.0 * 1024.0),
+          stats.bytesInFlight / (1024.0 * 1024.0),
+          ring->size / (1024.0 * 1024.0), stats.stalls, stats.stallMs,
+          ring->mapped != NULL ? "persistent" : "mapped per upload");
+}
+
+// ------------------------------------------------------------------------
+
+// Carves `size` bytes out of the free part of the ring, wrapping to the
+// start when the end is too short. Caller holds the mutex.
+static bool upload_ring_alloc(UploadRing* ring, size_t size,
+                              UploadSlice* slice) {
+  size_t need = (size + UPLOAD_ALIGNMENT - 1) & ~(size_t)(UPLOAD_ALIGNMENT - 1);
+  if (need > ring->size || ring->numRegions == UPLOAD_MAX_REGIONS ||
+      ring->used == ring->size) {
+    return false;
+  }
+
+  if (ring->used == 0) ring->head = 0;
+  size_t tail = (ring->head + ring->size - ring->used) % ring->size;
+
+  size_t offset;
+  size_t skipped = 0;
+  if (ring->used == 0) {
+    offset = 0;
+  } else if (ring->head > tail) {
+    if (ring->size - ring->head >= need) {
+      offset = ring->head;
+    } else if (tail >= need) {
+      offset = 0;
+      skipped = ring->size - ring->head;
+    } else {
+      return false;
+    }
+  } else if (tail - ring->head >= need) {
+    offset = ring->head;
+  } else {
+    return false;
+  }
+
+  uint64_t region = ring->firstRegion + ring->numRegions++;
+  ring->regions[region % UPLOAD_MAX_REGIONS] = (UploadRegion){
+      .bytes = skipped + need,
+  };
+  ring->used += skipped + need;
+  ring->head = (offset + need) % ring->size;
+
+  ring->stats.uploads++;
+  ring->stats.bytesUploaded += size;
+
+  *slice = (UploadSlice){
+      .offset = offset,
+      .memory = ring->mapped != NULL ? ring->mapped + offset : NULL,
+      .region = region,
+  };
+
+  return true;
+}
+
+static void upload_ring_retire_locked(UploadRing* ring) {
+  while (ring->numRegions > 0) {
+    UploadRegion* region =
+        &ring->regions[ring->firstRegion % UPLOAD_MAX_REGIONS];
+    if (region->fence == NULL) break;
+
+    GLenum status = glClientWaitSync(region->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+
+    glDeleteSync(region->fence);
+    ring->used -= region->bytes;
+    ring->firstRegion++;
+    ring->numRegions--;
+  }
+}
+
+static double upload_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,77 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <GL/glew.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Reservations that may be alive at once
+#define UPLOAD_MAX_REGIONS 256
+
+// Part of the ring reserved for one upload. Only freed once the fence placed
+// after the GL commands reading it has signaled.
+typedef struct {
+  size_t bytes;  // including the tail skipped when the ring wrapped
+  GLsync fence;  // NULL until upload_ring_submit
+} UploadRegion;
+
+typedef struct {
+  size_t offset;    // into the buffer, what glTex*Image takes as pointer
+  GLubyte* memory;  // where to write, NULL unless the ring is mapped
+  uint64_t region;  // sequence number of the reservation
+} UploadSlice;
+
+typedef struct {
+  uint32_t uploads;
+  uint32_t workerCopies;  // written by a worker into the persistent map
+  uint32_t direct;        // didn't fit, uploaded from client memory
+  uint32_t stalls;        // waits on a fence to free space
+  double stallMs;
+  size_t bytesUploaded;
+  size_t bytesInFlight;  // reserved and not yet retired
+} UploadStats;
+
+// Pixel unpack buffer used as a ring. With ARB_buffer_storage it stays
+// mapped (persistent, coherent) and any thread may reserve and write into
+// it; otherwise only the GL thread writes, through unsynchronized maps.
+typedef struct {
+  GLuint buffer;
+  GLubyte* mapped;
+  size_t size;
+
+  // Bookkeeping, shared with the workers
+  pthread_mutex_t mutex;
+  size_t head;  // next byte to hand out
+  size_t used;  // bytes between the oldest live region and head
+  UploadRegion regions[UPLOAD_MAX_REGIONS];
+  uint64_t firstRegion;  // sequence number of the oldest live region
+  uint32_t numRegions;
+
+  UploadStats stats;
+} UploadRing;
+
+// GL thread
+UploadRing* upload_ring_create(size_t size);
+void upload_ring_destroy(UploadRing* ring);
+
+// Any thread, persistent rings only. Fails instead of waiting.
+bool upload_ring_try_reserve(UploadRing* ring, size_t size,
+                             UploadSlice* slice);
+// GL thread. Waits for the GPU to free space if needed, fails when `size`
+// can't fit or the space is held by a slice not submitted yet.
+bool upload_ring_reserve(UploadRing* ring, size_t size, UploadSlice* slice);
+// GL thread. Copies into a slice of a ring that isn't persistently mapped.
+void upload_ring_write(UploadRing* ring, const UploadSlice* slice,
+                       const void* data, size_t size);
+// GL thread, after the commands reading the slice have been issued
+void upload_ring_submit(UploadRing* ring, const UploadSlice* slice);
+// GL thread. Frees the regions the GPU is done with, never blocks.
+void upload_ring_retire(UploadRing* ring);
+
+UploadStats upload_ring_get_stats(UploadRing* ring);
+void upload_ring_print_stats(UploadRing* ring, FILE* stream);
+
+#endif  // UPLOAD_H
@@ -0,0 +1,518 @@
+#include <stdlib.h>
+
+#include "video.h"
+
+static VideoStats stats;
+static VideoStats reported;  // stats at the last frame report
+
+#ifdef VIDEO_FFMPEG
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "cglm/struct/affine.h"
+#include "cglm/struct/mat4.h"
+#include "glstate.h"
+#include "shader.h"
+
+typedef struct {
+  uint8_t* pixels;  // Y, U then V planes, rows top first without padding
+  double pts;       // seconds, growing across loops
+} VideoFrame;
+
+typedef struct {
+  GLuint buffer;
+  GLsync fence;  // NULL until the first upload from it
+} VideoBuffer;
+
+struct Video {
+  AVFormatContext* format;
+  AVCodecContext* codec;
+  struct SwsContext* sws;  // sources not in 4:2:0 only
+  int stream;
+  double timeBase;
+  double frameTime;  // seconds between frames at the nominal rate
+
+  int32_t width;
+  int32_t height;
+  int32_t chromaWidth;
+  int32_t chromaHeight;
+  size_t frameSize;  // bytes of the three planes
+  bool fullRange;    // JPEG range instead of 16-235
+
+  // Shared with the decode thread. Slots [head, head + count) are decoded
+  // and belong to the GL thread, the rest to the decoder.
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t freed;  // a slot was given back or quit was set
+  VideoFrame frames[VIDEO_QUEUE_FRAMES];
+  uint32_t head;
+  uint32_t count;
+  uint32_t decoded;
+  uint32_t loops;
+  bool quit;
+
+  // GL thread
+  GLuint planes[3];
+  VideoBuffer buffers[VIDEO_UPLOAD_BUFFERS];
+  uint32_t nextBuffer;
+  double start;
+  bool started;
+  bool hasFrame;
+  Shader shader;
+  GLuint VAO, VBO;
+};
+
+// Privates
+static void video_free(Video* video);
+static void video_create_gl(Video* video);
+static void* video_decode_thread(void* data);
+static void video_receive_frames(Video* video, AVFrame* frame, double offset,
+                                 double* end);
+static void video_queue_frame(Video* video, const AVFrame* frame, double pts);
+static void video_copy_planes(const Video* video, const AVFrame* frame,
+                              uint8_t* pixels);
+static bool video_upload(Video* video, const uint8_t* pixels);
+
+// Unit quad facing +z, texture rows top first
+static const float VIDEO_VERTICES[] = {
+    // positions   // texture coords
+    -0.5f, -0.5f, 0.0f, 1.0f,  0.5f, -0.5f, 1.0f, 1.0f,
+    0.5f,  0.5f,  1.0f, 0.0f,  0.5f, 0.5f,  1.0f, 0.0f,
+    -0.5f, 0.5f,  0.0f, 0.0f,  -0.5f, -0.5f, 0.0f, 1.0f,
+};
+
+Video* video_open(const char* path) {
+  Video* video = calloc(1, sizeof(Video));
+  pthread_mutex_init(&video->mutex, NULL);
+  pthread_cond_init(&video->freed, NULL);
+
+  const AVCodec* decoder = NULL;
+  if (avformat_open_input(&video->format, path, NULL, NULL) < 0 ||
+      avformat_find_stream_info(video->format, NULL) < 0 ||
+      (video->stream = av_find_best_stream(video->format, AVMEDIA_TYPE_VIDEO,
+                                           -1, -1, &decoder, 0)) < 0) {
+    fprintf(stderr, "ERROR: No video stream in %s\n", path);
+    video_free(video);
+    return NULL;
+  }
+
+  AVStream* stream = video->format->streams[video->stream];
+  video->codec = avcodec_alloc_context3(decoder);
+  avcodec_parameters_to_context(video->codec, stream->codecpar);
+  // Let the decoder pick its own slice and frame threads
+  video->codec->thread_count = 0;
+  if (avcodec_open2(video->codec, decoder, NULL) < 0) {
+    fprintf(stderr, "ERROR: Failed to open the %s decoder for %s\n",
+            decoder->name, path);
+    video_free(video);
+    return NULL;
+  }
+
+  video->timeBase = av_q2d(stream->time_base);
+  AVRational rate = av_guess_frame_rate(video->format, stream, NULL);
+  video->frameTime = rate.num > 0 ? av_q2d(av_inv_q(rate)) : 1.0 / 30.0;
+  video->width = video->codec->width;
+  video->height = video->codec->height;
+  video->chromaWidth = (video->width + 1) / 2;
+  video->chromaHeight = (video->height + 1) / 2;
+  video->frameSize = (size_t)video->width * video->height +
+                     2 * (size_t)video->chromaWidth * video->chromaHeight;
+
+  // 4:2:0 planes go up as decoded, anything else is converted to them
+  enum AVPixelFormat format = video->codec->pix_fmt;
+  if (format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P) {
+    video->fullRange = format == AV_PIX_FMT_YUVJ420P ||
+                       video->codec->color_range == AVCOL_RANGE_JPEG;
+  } else {
+    video->sws = sws_getContext(video->width, video->height, format,
+                                video->width, video->height,
+                                AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL,
+                                NULL);
+  }
+
+  for (uint32_t i = 0; i < VIDEO_QUEUE_FRAMES; i++) {
+    video->frames[i].pixels = malloc(video->frameSize);
+  }
+
+  video_create_gl(video);
+  pthread_create(&video->thread, NULL, video_decode_thread, video);
+
+  printf("video %s: %dx%d %s, %.2f fps, %.1f MiB queued at most\n", path,
+         video->width, video->height, decoder->name, 1.0 / video->frameTime,
+         VIDEO_QUEUE_FRAMES * video->frameSize / (1024.0 * 1024.0));
+
+  return video;
+}
+
+void video_close(Video* video) {
+  if (video == NULL) return;
+
+  pthread_mutex_lock(&video->mutex);
+  video->quit = true;
+  pthread_cond_broadcast(&video->freed);
+  pthread_mutex_unlock(&video->mutex);
+  pthread_join(video->thread, NULL);
+
+  for (uint32_t i = 0; i < VIDEO_UPLOAD_BUFFERS; i++) {
+    if (video->buffers[i].fence != NULL) glDeleteSync(video->buffers[i].fence);
+    glstate_delete_buffers(1, &video->buffers[i].buffer);
+  }
+  glstate_delete_textures(3, video->planes);
+  glstate_delete_vertex_arrays(1, &video->VAO);
+  glstate_delete_buffers(1, &video->VBO);
+  glstate_delete_program(video->shader.ID);
+
+  video_free(video);
+}
+
+bool video_update(Video* video, double time) {
+  if (!video->started) {
+    video->start = time;
+    video->started = true;
+  }
+  double clock = time - video->start;
+
+  // Of the frames due by now only the newest is worth showing
+  pthread_mutex_lock(&video->mutex);
+  uint32_t due = 0;
+  while (due < video->count &&
+         video->frames[(video->head + due) % VIDEO_QUEUE_FRAMES].pts <=
+             clock) {
+    due++;
+  }
+  if (due > 1) {
+    stats.dropped += due - 1;
+    video->head = (video->head + due - 1) % VIDEO_QUEUE_FRAMES;
+    video->count -= due - 1;
+    pthread_cond_signal(&video->freed);
+  }
+  if (due == 0 && video->count == 0) stats.starved++;
+  stats.decoded = video->decoded;
+  stats.loops = video->loops;
+  pthread_mutex_unlock(&video->mutex);
+
+  if (due == 0) return false;
+
+  // The head slot stays ours until it is given back below. When the upload
+  // buffer is still busy the frame stays queued and is retried next update,
+  // dropped there only if a newer frame has become due by then.
+  if (!video_upload(video, video->frames[video->head].pixels)) {
+    stats.busy++;
+    return false;
+  }
+  stats.shown++;
+  video->hasFrame = true;
+
+  pthread_mutex_lock(&video->mutex);
+  video->head = (video->head + 1) % VIDEO_QUEUE_FRAMES;
+  video->count--;
+  pthread_cond_signal(&video->freed);
+  pthread_mutex_unlock(&video->mutex);
+
+  return true;
+}
+
+void video_draw(Video* video, mat4s model, mat4s view, mat4s projection) {
+  if (!video->hasFrame) return;
+
+  float aspect = (float)video->height / (float)video->width;
+  shader_use(&video->shader);
+  shader_set_mat4(&video->shader, "model",
+                  glms_scale(model, (vec3s){{1.0f, aspect, 1.0f}}));
+  shader_set_mat4(&video->shader, "view", view);
+  shader_set_mat4(&video->shader, "projection", projection);
+  shader_set_bool(&video->shader, "fullRange", video->fullRange);
+
+  for (GLuint i = 0; i < 3; i++) {
+    glstate_bind_texture(VIDEO_TEXTURE_UNIT + i, GL_TEXTURE_2D,
+                         video->planes[i]);
+  }
+
+  glstate_bind_vertex_array(video->VAO);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+int32_t video_width(const Video* video) {
+  return video->width;
+}
+
+int32_t video_height(const Video* video) {
+  return video->height;
+}
+
+// ------------------------------------------------------------------------
+
+static void video_free(Video* video) {
+  for (uint32_t i = 0; i < VIDEO_QUEUE_FRAMES; i++) {
+    free(video->frames[i].pixels);
+  }
+  sws_freeContext(video->sws);
+  avcodec_free_context(&video->codec);
+  avformat_close_input(&video->format);
+  pthread_cond_destroy(&video->freed);
+  pthread_mutex_destroy(&video->mutex);
+  free(video);
+}
+
+// One R8 texture per plane, the unpack buffers and the quad
+static void video_create_gl(Video* video) {
+  glGenTextures(3, video->planes);
+  for (uint32_t i = 0; i < 3; i++) {
+    int32_t width = i == 0 ? video->width : video->chromaWidth;
+    int32_t height = i == 0 ? video->height : video->chromaHeight;
+
+    glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_2D,
+                         video->planes[i]);
+    if (GLEW_ARB_texture_storage) {
+      glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, width, height);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED,
+                   GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  for (uint32_t i = 0; i < VIDEO_UPLOAD_BUFFERS; i++) {
+    glGenBuffers(1, &video->buffers[i].buffer);
+    glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, video->buffers[i].buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, video->frameSize, NULL,
+                 GL_STREAM_DRAW);
+  }
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  glGenVertexArrays(1, &video->VAO);
+  glGenBuffers(1, &video->VBO);
+  glstate_bind_vertex_array(video->VAO);
+  glstate_bind_buffer(GL_ARRAY_BUFFER, video->VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(VIDEO_VERTICES), VIDEO_VERTICES,
+               GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_FLOAT, false, 4 * sizeof(float), NULL);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, false, 4 * sizeof(float),
+                        (void*)(2 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+  glstate_bind_vertex_array(0);
+
+  video->shader = shader_create("./glsl/video_vs.glsl", "./glsl/video_fs.glsl");
+  shader_use(&video->shader);
+  shader_set_int(&video->shader, "planeY", VIDEO_TEXTURE_UNIT);
+  shader_set_int(&video->shader, "planeU", VIDEO_TEXTURE_UNIT + 1);
+  shader_set_int(&video->shader, "planeV", VIDEO_TEXTURE_UNIT + 2);
+}
+
+// Decodes ahead of the GL thread until the queue is full, looping at the end
+// of the file with timestamps that keep growing
+static void* video_decode_thread(void* data) {
+  Video* video = data;
+  AVPacket* packet = av_packet_alloc();
+  AVFrame* frame = av_frame_alloc();
+  double offset = 0.0;  // added to the timestamps of the current loop
+  double end = 0.0;     // end of the last frame queued
+
+  for (;;) {
+    pthread_mutex_lock(&video->mutex);
+    bool quit = video->quit;
+    pthread_mutex_unlock(&video->mutex);
+    if (quit) break;
+
+    if (av_read_frame(video->format, packet) < 0) {
+      // Drain the frames the decoder holds back, then start over
+      avcodec_send_packet(video->codec, NULL);
+      video_receive_frames(video, frame, offset, &end);
+      avcodec_flush_buffers(video->codec);
+
+      // Nothing decoded in a whole pass, looping would spin
+      if (end <= offset ||
+          av_seek_frame(video->format, video->stream, 0,
+                        AVSEEK_FLAG_BACKWARD) < 0) {
+        break;
+      }
+      offset = end;
+
+      pthread_mutex_lock(&video->mutex);
+      video->loops++;
+      pthread_mutex_unlock(&video->mutex);
+      continue;
+    }
+
+    if (packet->stream_index == video->stream &&
+        avcodec_send_packet(video->codec, packet) == 0) {
+      video_receive_frames(video, frame, offset, &end);
+    }
+    av_packet_unref(packet);
+  }
+
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+
+  return NULL;
+}
+
+static void video_receive_frames(Video* video, AVFrame* frame, double offset,
+                                 double* end) {
+  while (avcodec_receive_frame(video->codec, frame) == 0) {
+    // Frames without a timestamp follow the previous one
+    double pts = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                     ? offset + frame->best_effort_timestamp * video->timeBase
+                     : *end;
+    if (frame->width == video->width && frame->height == video->height) {
+      video_queue_frame(video, frame, pts);
+    }
+    if (pts + video->frameTime > *end) *end = pts + video->frameTime;
+    av_frame_unref(frame);
+  }
+}
+
+// Waits for a free slot, which keeps the decoder at most VIDEO_QUEUE_FRAMES
+// ahead and its memory bounded
+static void video_queue_frame(Video* video, const AVFrame* frame, double pts) {
+  pthread_mutex_lock(&video->mutex);
+  while (video->count == VIDEO_QUEUE_FRAMES && !video->quit) {
+    pthread_cond_wait(&video->freed, &video->mutex);
+  }
+  if (video->quit) {
+    pthread_mutex_unlock(&video->mutex);
+    return;
+  }
+  VideoFrame* slot =
+      &video->frames[(video->head + video->count) % VIDEO_QUEUE_FRAMES];
+  pthread_mutex_unlock(&video->mutex);
+
+  // The GL thread doesn't look past head + count, the copy needs no lock
+  video_copy_planes(video, frame, slot->pixels);
+  slot->pts = pts;
+
+  pthread_mutex_lock(&video->mutex);
+  video->count++;
+  video->decoded++;
+  pthread_mutex_unlock(&video->mutex);
+}
+
+static void video_copy_planes(const Video* video, const AVFrame* frame,
+                              uint8_t* pixels) {
+  size_t lumaSize = (size_t)video->width * video->height;
+  size_t chromaSize = (size_t)video->chromaWidth * video->chromaHeight;
+  uint8_t* planes[3] = {pixels, pixels + lumaSize,
+                        pixels + lumaSize + chromaSize};
+  int pitches[3] = {video->width, video->chromaWidth, video->chromaWidth};
+
+  if (video->sws != NULL) {
+    sws_scale(video->sws, (const uint8_t* const*)frame->data,
+              frame->linesize, 0, video->height, planes, pitches);
+    return;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    int rows = i == 0 ? video->height : video->chromaHeight;
+    av_image_copy_plane(planes[i], pitches[i], frame->data[i],
+                        frame->linesize[i], pitches[i], rows);
+  }
+}
+
+// Writes the planes into the next unpack buffer and updates the textures
+// from it. Gives up rather than wait when the GPU still reads that buffer.
+static bool video_upload(Video* video, const uint8_t* pixels) {
+  VideoBuffer* buffer = &video->buffers[video->nextBuffer];
+  if (buffer->fence != NULL) {
+    if (glClientWaitSync(buffer->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+    glDeleteSync(buffer->fence);
+    buffer->fence = NULL;
+  }
+  video->nextBuffer = (video->nextBuffer + 1) % VIDEO_UPLOAD_BUFFERS;
+
+  // The fence already keeps the GPU off this buffer, skip the driver's sync
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer->buffer);
+  void* memory = glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, video->frameSize,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT);
+  if (memory == NULL) {
+    glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return false;
+  }
+  memcpy(memory, pixels, video->frameSize);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  // Chroma rows of odd widths aren't 4-byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  size_t offset = 0;
+  for (uint32_t i = 0; i < 3; i++) {
+    int32_t width = i == 0 ? video->width : video->chromaWidth;
+    int32_t height = i == 0 ? video->height : video->chromaHeight;
+    glstate_bind_texture(GLSTATE_UPLOAD_UNIT, GL_TEXTURE_2D,
+                         video->planes[i]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED,
+                    GL_UNSIGNED_BYTE, (const void*)(uintptr_t)offset);
+    offset += (size_t)width * height;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glstate_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  return true;
+}
+
+#else
+
+Video* video_open(const char* path) {
+  fprintf(stderr,
+          "WARNING: Built without video support, rebuild with `make "
+          "VIDEO=1` to play %s\n",
+          path);
+  return NULL;
+}
+
+void video_close(Video* video) {
+  (void)video;
+}
+
+bool video_update(Video* video, double time) {
+  (void)video;
+  (void)time;
+  return false;
+}
+
+void video_draw(Video* video, mat4s model, mat4s view, mat4s projection) {
+  (void)video;
+  (void)model;
+  (void)view;
+  (void)projection;
+}
+
+int32_t video_width(const Video* video) {
+  (void)video;
+  return 0;
+}
+
+int32_t video_height(const Video* video) {
+  (void)video;
+  return 0;
+}
+
+#endif  // VIDEO_FFMPEG
+
+VideoStats video_get_stats(void) {
+  return stats;
+}
+
+void video_print_frame_stats(FILE* stream) {
+  fprintf(stream,
+          "video: %u decoded, %u shown, %u dropped, %u starved, %u busy, "
+          "%u loops\n",
+          stats.decoded - reported.decoded, stats.shown - reported.shown,
+          stats.dropped - reported.dropped, stats.starved - reported.starved,
+          stats.busy - reported.busy, stats.loops);
+  reported = stats;
+}
@@ -0,0 +1,52 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cglm/types-struct.h"
+
+// Video textures, decoded with FFmpeg when built with `make VIDEO=1`.
+// Without it video_open reports the missing support and returns NULL.
+
+// Decoded frames waiting for their presentation time, bounds the memory the
+// decode thread may hold
+#define VIDEO_QUEUE_FRAMES 4
+// Pixel unpack buffers cycled by the uploads
+#define VIDEO_UPLOAD_BUFFERS 3
+// Units of the Y, U and V planes, clear of the material and sky units
+#define VIDEO_TEXTURE_UNIT 12
+
+typedef struct {
+  uint32_t decoded;  // frames out of the decoder
+  uint32_t shown;    // uploaded at their presentation time
+  uint32_t dropped;  // late by the time a newer frame was due, skipped
+  uint32_t starved;  // updates with nothing decoded yet, kept the last frame
+  uint32_t busy;     // updates whose buffer the GPU still read, frame retried
+  uint32_t loops;    // times the video restarted from the beginning
+} VideoStats;
+
+typedef struct Video Video;
+
+// Starts decoding `path` on a thread of its own. Needs a current GL context.
+Video* video_open(const char* path);
+void video_close(Video* video);
+
+// Uploads the newest frame due at `time`, in seconds from the first call.
+// Never waits: frames not decoded yet or buffers still in use keep the
+// frame on screen. Returns true when a new frame was uploaded.
+bool video_update(Video* video, double time);
+// Draws the current frame on a quad as wide as the model matrix's x axis,
+// with the video's aspect ratio
+void video_draw(Video* video, mat4s model, mat4s view, mat4s projection);
+
+int32_t video_width(const Video* video);
+int32_t video_height(const Video* video);
+
+VideoStats video_get_stats(void);
+// Frames shown, dropped and starved since the last report, a stats report
+void video_print_frame_stats(FILE* stream);
+
+#endif  // VIDEO_H